@@ -30,7 +30,7 @@
 //         -march=armv6 -mtune=arm1176jzf-s -mfloat-abi=hard -mfpu=vfp
 //         -ffast-math -pipe -O3
 
-#define alsaPiVersion "Version 0.1"
+#define alsaPiVersion "Version 0.2"
 
 //  Authors:        D.Faulke    10/12/2015
 //
@@ -39,6 +39,7 @@
 //  Changelog:
 //
 //  v0.1 Original version.
+//  v0.2 Added stepVol for accelerated controls.
 //
 
 //  To Do:
@@ -230,6 +231,24 @@ void decVol( void )
     return;
 };
 
+// ----------------------------------------------------------------------------
+//  Changes volume by a number of increments, +ve or -ve.
+// ----------------------------------------------------------------------------
+void stepVol( int steps )
+{
+    int index = sound.index + steps;
+
+    // Ensure within limits.
+    if ( index > sound.incs ) index = sound.incs;
+    else if ( index < 0 ) index = 0;
+    sound.index = index;
+
+    // Set volume.
+    setVol();
+
+    return;
+};
+
 // ----------------------------------------------------------------------------
 //  Detaches and closes ALSA.
 // ----------------------------------------------------------------------------
@@ -80,6 +80,10 @@
 // Display buffer.
 uint8_t *ssd1322_fb[SSD1322_DISPLAYS_MAX];
 
+// Packed frame written instead of the display buffer, if set.
+const uint8_t *ssd1322_fb_packed[SSD1322_DISPLAYS_MAX];
+uint16_t ssd1322_fb_packed_stride[SSD1322_DISPLAYS_MAX];
+
 // Mutex for locking updates to FB while buffer is being written to display.
 pthread_mutex_t ssd1322_display_busy;
 
@@ -103,6 +107,41 @@ int8_t ssd1322_fb_init( uint8_t id )
     else return 0;
 }
 
+// ----------------------------------------------------------------------------
+/*
+    Sets a packed frame to write instead of the framebuffer.
+
+    The frame is already in the display's RAM format, two pixels per byte
+    with the left pixel in the high nibble, so it is streamed a row at a
+    time without re-packing, e.g. the ring of a meterPi waterfall. Rows
+    start stride bytes apart. NULL goes back to the framebuffer. Anything
+    that changes the frame should hold ssd1322_display_busy.
+*/
+// ----------------------------------------------------------------------------
+void ssd1322_fb_set_packed( uint8_t id, const uint8_t *packed,
+                            uint16_t stride )
+{
+    pthread_mutex_lock( &ssd1322_display_busy );
+    ssd1322_fb_packed[id] = packed;
+    ssd1322_fb_packed_stride[id] = stride;
+    pthread_mutex_unlock( &ssd1322_display_busy );
+}
+
+// ----------------------------------------------------------------------------
+/*
+    Writes a packed frame to display via SPI interface.
+*/
+// ----------------------------------------------------------------------------
+void ssd1322_fb_write_packed( uint8_t id, const uint8_t *packed,
+                              uint16_t stride )
+{
+    uint8_t row;
+
+    for ( row = 0; row < SSD1322_ROWS; row++ )
+        ssd1322_write_stream( id, (uint8_t *) packed + row * stride,
+                              SSD1322_COLS / 2 );
+}
+
 // ----------------------------------------------------------------------------
 /*
     Writes framebuffer to display via SPI interface.
@@ -125,6 +164,13 @@ void *ssd1322_fb_write( void *params )
     while ( !ssd1322_fb_kill )
     {
         pthread_mutex_lock( &ssd1322_display_busy );
+        if ( ssd1322_fb_packed[id] )
+        {
+            ssd1322_fb_write_packed( id, ssd1322_fb_packed[id],
+                                     ssd1322_fb_packed_stride[id] );
+            pthread_mutex_unlock( &ssd1322_display_busy );
+            continue;
+        }
         for ( i = 0; i < SSD1322_COLS * SSD1322_ROWS / 2; i++ )
         {
             data = ssd1322_fb[id][i*2] << 4 | ssd1322_fb[id][i*2+1];
@@ -0,0 +1,1115 @@
+//  ===========================================================================
+/*
+    benchmeterPi:
+
+    Benchmarks for meterPi. Runs without Squeezelite by creating a local
+    visualisation buffer with the same layout and locking as the shared
+    memory object.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Compile with:
+
+        gcc -Wall meterPi.c meterPi-kernel.c meterPi-truepeak.c
+            meterPi-loudness.c meterPi-spectrum.c meterPi-phase.c
+            meterPi-pace.c meterPi-source.c meterPi-publish.c
+            meterPi-waveform.c meterPi-waterfall.c meterPi-dynamics.c
+            benchmeterPi.c
+            -o benchmeterPi -lm -lpthread -lrt
+
+    For Raspberry Pi v1 optimisation use the following flags:
+
+        -march=armv6zk -mtune=arm1176jzf-s -mfloat-abi=hard -mfpu=vfp
+        -ffast-math -pipe -O3
+
+    For Raspberry Pi v2 optimisation use the following flags:
+
+        -march=armv7-a -mtune=cortex-a7 -mfloat-abi=hard -mfpu=neon-vfpv4
+        -ffast-math -pipe -O3
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+*/
+//  ===========================================================================
+
+//  Installed libraries -------------------------------------------------------
+
+#include <stdbool.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+//  Local libraries -----------------------------------------------------------
+
+#include "meterPi.h"
+#include "meterPi-kernel.h"
+#include "meterPi-truepeak.h"
+#include "meterPi-loudness.h"
+#include "meterPi-spectrum.h"
+#include "meterPi-phase.h"
+#include "meterPi-source.h"
+#include "meterPi-publish.h"
+#include "meterPi-waveform.h"
+#include "meterPi-waterfall.h"
+#include "meterPi-dynamics.h"
+
+//  Macros. -------------------------------------------------------------------
+
+#define BENCH_LOOPS   20000 // Number of reader iterations per test.
+#define BENCH_INT_MS  5     // IEC 60268-18 integration time (ms).
+#define BENCH_BLOCK   1024  // Frames per simulated Squeezelite write.
+#define BENCH_PUBLISH 500   // Publish period in latency test (us).
+
+//  Types. --------------------------------------------------------------------
+
+struct lock_stats_t
+{
+    uint64_t total; // Total lock hold time (ns).
+    uint64_t max;   // Longest lock hold time (ns).
+    uint32_t count; // Number of locks taken.
+};
+
+struct bench_publisher_t
+{
+    struct vis_t             *vis;       // Buffer written and metered.
+    struct meter_publisher_t *publisher; // Results object.
+    struct lock_stats_t      latency;    // Write to publish (ns).
+};
+
+struct bench_writer_t
+{
+    struct vis_t        *vis;   // Buffer to write to.
+    struct lock_stats_t stats;  // Time spent waiting for the write lock.
+};
+
+//  Local variables. ----------------------------------------------------------
+
+static const uint32_t bench_rates[] = { 44100, 96000, 384000 };
+
+static struct vis_snapshot_t snapshot;
+static volatile bool writer_stop;
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Returns monotonic time in nanoseconds.
+//  ---------------------------------------------------------------------------
+static uint64_t time_ns( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//  ---------------------------------------------------------------------------
+//  Adds a lock hold time to statistics.
+//  ---------------------------------------------------------------------------
+static void stats_add( struct lock_stats_t *stats, uint64_t ns )
+{
+    stats->total += ns;
+    if ( ns > stats->max ) stats->max = ns;
+    stats->count++;
+}
+
+//  ---------------------------------------------------------------------------
+//  Creates a local visualisation buffer filled with a stereo sine.
+//  ---------------------------------------------------------------------------
+static struct vis_t *bench_vis_create( uint32_t rate )
+{
+    struct vis_t *vis;
+    pthread_rwlockattr_t attr;
+    uint32_t i;
+
+    if ( posix_memalign( (void **) &vis, VIS_ALIGN, sizeof( struct vis_t )))
+        return NULL;
+    memset( vis, 0, sizeof( struct vis_t ));
+
+    // Squeezelite shares the lock between processes.
+    pthread_rwlockattr_init( &attr );
+    pthread_rwlockattr_setpshared( &attr, PTHREAD_PROCESS_SHARED );
+    pthread_rwlock_init( &vis->rwlock, &attr );
+    pthread_rwlockattr_destroy( &attr );
+
+    vis->buf_size  = VIS_BUF_SIZE;
+    vis->buf_index = 0;
+    vis->running   = true;
+    vis->rate      = rate;
+    vis->updated   = time( NULL );
+
+    for ( i = 0; i < VIS_BUF_SIZE / VIS_CHANNELS; i++ )
+    {
+        vis->buffer[i * 2]     = 16384 * sin( 2 * M_PI * 997 * i / rate );
+        vis->buffer[i * 2 + 1] = 16384 * cos( 2 * M_PI * 997 * i / rate );
+    }
+
+    return vis;
+}
+
+//  ---------------------------------------------------------------------------
+//  Destroys a local visualisation buffer.
+//  ---------------------------------------------------------------------------
+static void bench_vis_destroy( struct vis_t *vis )
+{
+    pthread_rwlock_destroy( &vis->rwlock );
+    free( vis );
+}
+
+//  ---------------------------------------------------------------------------
+//  Simulates the Squeezelite writer and records how long it waits.
+//  ---------------------------------------------------------------------------
+static void *bench_writer( void *params )
+{
+    struct bench_writer_t *writer = params;
+    struct vis_t *vis = writer->vis;
+    struct timespec period;
+    uint64_t start;
+    uint32_t i, idx;
+
+    // Write a block at the rate Squeezelite would.
+    period.tv_sec  = 0;
+    period.tv_nsec = (uint64_t) BENCH_BLOCK * 1000000000ULL / vis->rate;
+
+    while ( !writer_stop )
+    {
+        start = time_ns();
+        pthread_rwlock_wrlock( &vis->rwlock );
+        stats_add( &writer->stats, time_ns() - start );
+
+        idx = vis->buf_index;
+        for ( i = 0; i < BENCH_BLOCK * VIS_CHANNELS; i++ )
+        {
+            vis->buffer[idx] = vis->buffer[( idx + 7 ) % VIS_BUF_SIZE];
+            if ( ++idx == VIS_BUF_SIZE ) idx = 0;
+        }
+        vis->buf_index = idx;
+        vis->updated = time( NULL );
+
+        pthread_rwlock_unlock( &vis->rwlock );
+        nanosleep( &period, NULL );
+    }
+
+    return NULL;
+}
+
+//  ---------------------------------------------------------------------------
+//  Original reader. Sums squares with the read lock held throughout.
+//  ---------------------------------------------------------------------------
+static uint64_t bench_locked_sum( struct vis_t *vis, uint32_t frames,
+                                  struct lock_stats_t *stats )
+{
+    int16_t  *ptr;
+    int16_t  sample;
+    uint64_t sum = 0;
+    uint64_t start;
+    size_t   i, wrap;
+    int      offs;
+
+    pthread_rwlock_rdlock( &vis->rwlock );
+    start = time_ns();
+
+    offs = vis->buf_index - ( frames * VIS_CHANNELS );
+    while ( offs < 0 ) offs += vis->buf_size;
+
+    ptr = vis->buffer + offs;
+    wrap = vis->buf_size - offs;
+
+    for ( i = 0; i < frames; i++ )
+    {
+        sample = *ptr++;
+        sum += sample * sample;
+        sample = *ptr++;
+        sum += sample * sample;
+        wrap -= 2;
+        if ( wrap <= 0 )
+        {
+            ptr = vis->buffer;
+            wrap = vis->buf_size;
+        }
+    }
+
+    stats_add( stats, time_ns() - start );
+    pthread_rwlock_unlock( &vis->rwlock );
+
+    return sum;
+}
+
+//  ---------------------------------------------------------------------------
+//  Snapshot reader. Sums squares on a private copy.
+//  ---------------------------------------------------------------------------
+static uint64_t bench_snapshot_sum( struct vis_t *vis, uint32_t frames,
+                                    struct lock_stats_t *stats )
+{
+    uint64_t sum = 0;
+    uint64_t start;
+    uint32_t i;
+
+    /*
+        The lock is taken and released inside vis_snapshot so this includes
+        an uncontended lock/unlock pair. It is an upper bound on hold time.
+    */
+    start = time_ns();
+    vis_snapshot( vis, &snapshot, frames );
+    stats_add( stats, time_ns() - start );
+
+    for ( i = 0; i < snapshot.frames * VIS_CHANNELS; i++ )
+        sum += snapshot.buffer[i] * snapshot.buffer[i];
+
+    return sum;
+}
+
+//  ---------------------------------------------------------------------------
+//  Runs one reader method against a simulated writer.
+//  ---------------------------------------------------------------------------
+static void bench_reader( struct vis_t *vis, uint32_t frames, bool locked,
+                          struct lock_stats_t *reader,
+                          struct lock_stats_t *writer )
+{
+    struct bench_writer_t params = { .vis = vis };
+    pthread_t thread;
+    volatile uint64_t sum;
+    uint32_t i;
+
+    memset( reader, 0, sizeof( *reader ));
+
+    writer_stop = false;
+    pthread_create( &thread, NULL, bench_writer, &params );
+
+    for ( i = 0; i < BENCH_LOOPS; i++ )
+    {
+        if ( locked ) sum = bench_locked_sum( vis, frames, reader );
+        else sum = bench_snapshot_sum( vis, frames, reader );
+    }
+    (void) sum;
+
+    writer_stop = true;
+    pthread_join( thread, NULL );
+
+    *writer = params.stats;
+}
+
+//  ---------------------------------------------------------------------------
+//  Benchmarks lock hold times for the original and snapshot readers.
+//  ---------------------------------------------------------------------------
+static void bench_lock_hold( void )
+{
+    struct vis_t *vis;
+    struct lock_stats_t reader[2], writer[2];
+    uint32_t frames;
+    uint8_t  r, m;
+
+    printf( "\nRead lock hold time, %dms integration, %d loops.\n\n",
+            BENCH_INT_MS, BENCH_LOOPS );
+    printf( "\t+--------+--------+----------+-------------------+"
+            "-------------------+\n" );
+    printf( "\t| Rate   | Frames | Reader   | Hold mean/max(ns) |"
+            " Write wait (ns)   |\n" );
+    printf( "\t+--------+--------+----------+-------------------+"
+            "-------------------+\n" );
+
+    for ( r = 0; r < sizeof( bench_rates ) / sizeof( bench_rates[0] ); r++ )
+    {
+        vis = bench_vis_create( bench_rates[r] );
+        if ( !vis ) return;
+
+        frames = bench_rates[r] * BENCH_INT_MS / 1000;
+        if ( frames > VIS_BUF_SIZE / VIS_CHANNELS )
+             frames = VIS_BUF_SIZE / VIS_CHANNELS;
+
+        bench_reader( vis, frames, true,  &reader[0], &writer[0] );
+        bench_reader( vis, frames, false, &reader[1], &writer[1] );
+
+        for ( m = 0; m < 2; m++ )
+        {
+            printf( "\t| %6u | %6u | %-8s | %8llu/%-8llu | %8llu/%-8llu |\n",
+                    bench_rates[r], frames, m ? "snapshot" : "locked",
+                    (unsigned long long)( reader[m].total /
+                                          ( reader[m].count ?
+                                            reader[m].count : 1 )),
+                    (unsigned long long) reader[m].max,
+                    (unsigned long long)( writer[m].total /
+                                          ( writer[m].count ?
+                                            writer[m].count : 1 )),
+                    (unsigned long long) writer[m].max );
+        }
+
+        bench_vis_destroy( vis );
+    }
+
+    printf( "\t+--------+--------+----------+-------------------+"
+            "-------------------+\n" );
+}
+
+//  ---------------------------------------------------------------------------
+//  Copies the frames of a visualisation buffer in a sample format.
+//  ---------------------------------------------------------------------------
+static void bench_format( struct vis_t *vis, uint8_t format, void *buffer )
+{
+    uint8_t  *bytes = buffer;
+    uint32_t i;
+
+    for ( i = 0; i < VIS_BUF_SIZE; i++ )
+    {
+        switch ( format )
+        {
+            case METER_S16 :
+                ((int16_t *) buffer)[i] = vis->buffer[i];
+                break;
+            case METER_S24 :
+                bytes[i * 3]     = 0;
+                bytes[i * 3 + 1] = vis->buffer[i];
+                bytes[i * 3 + 2] = vis->buffer[i] >> 8;
+                break;
+            case METER_S32 :
+                ((int32_t *) buffer)[i] = vis->buffer[i] * 65536;
+                break;
+            case METER_FLOAT :
+                ((float *) buffer)[i] = vis->buffer[i] / 32768.0f;
+                break;
+        }
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Benchmarks a kernel over a buffer full of frames.
+//  ---------------------------------------------------------------------------
+static void bench_kernel( const char *name, uint8_t format, uint8_t channels,
+                          meter_kernel_t kernel, const void *samples )
+{
+    struct meter_acc_t acc;
+    uint64_t start, elapsed;
+    uint32_t frames = VIS_BUF_SIZE / channels;
+    uint32_t i;
+
+    meter_acc_clear( &acc );
+
+    start = time_ns();
+    for ( i = 0; i < BENCH_LOOPS / 10; i++ )
+        kernel( samples, frames, channels, &acc );
+    elapsed = time_ns() - start;
+
+    printf( "\t| %-6s | %8u | %-8s | %12.1f | %8.3f |\n",
+            meter_format_name( format ), channels, name,
+            (double) frames * ( BENCH_LOOPS / 10 ) * 1e3 / elapsed,
+            (double) elapsed / frames / ( BENCH_LOOPS / 10 ));
+}
+
+//  ---------------------------------------------------------------------------
+//  Benchmarks the available accumulation kernels for each sample format.
+//  ---------------------------------------------------------------------------
+/*
+    Stereo, 5.1 and 7.1 frames, read from the same buffer of samples.
+*/
+static void bench_kernels( void )
+{
+    static const uint8_t channels[] = { 2, 6, 8 };
+    static const meter_kernel_t scalar[METER_FORMATS] =
+        { meter_kernel_scalar, meter_kernel_s24_scalar,
+          meter_kernel_s32_scalar, meter_kernel_float_scalar };
+#if defined( __i386__ ) || defined( __x86_64__ )
+    static const meter_kernel_t sse2[METER_FORMATS] =
+        { meter_kernel_sse2, NULL, meter_kernel_s32_sse2,
+          meter_kernel_float_sse2 };
+#endif
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+    static const meter_kernel_t neon[METER_FORMATS] =
+        { meter_kernel_neon, NULL, meter_kernel_s32_neon,
+          meter_kernel_float_neon };
+#endif
+    static int32_t buffer[VIS_BUF_SIZE] __attribute__(( aligned( VIS_ALIGN )));
+    struct vis_t *vis = bench_vis_create( 44100 );
+    uint8_t format, i;
+
+    if ( !vis ) return;
+
+    printf( "\nAccumulation kernels, selected: %s.\n\n",
+            meter_kernel_name( meter_kernel_select( METER_S16 )));
+    printf( "\t+--------+----------+----------+--------------+----------+\n" );
+    printf( "\t| Format | Channels | Kernel   | Mframes/s    | ns/frame |\n" );
+    printf( "\t+--------+----------+----------+--------------+----------+\n" );
+
+    for ( format = 0; format < METER_FORMATS; format++ )
+    {
+        bench_format( vis, format, buffer );
+
+        for ( i = 0; i < sizeof( channels ); i++ )
+        {
+            bench_kernel( "scalar", format, channels[i], scalar[format],
+                          buffer );
+#if defined( __i386__ ) || defined( __x86_64__ )
+            if ( sse2[format] )
+                bench_kernel( "sse2", format, channels[i], sse2[format],
+                              buffer );
+#endif
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+            if ( neon[format] )
+                bench_kernel( "neon", format, channels[i], neon[format],
+                              buffer );
+#endif
+        }
+    }
+
+    printf( "\t+--------+----------+----------+--------------+----------+\n" );
+
+    bench_vis_destroy( vis );
+}
+
+//  ---------------------------------------------------------------------------
+//  Benchmarks the true-peak stage with a filter kernel.
+//  ---------------------------------------------------------------------------
+/*
+    Includes de-interleaving, so this is the cost per stereo frame of the
+    whole stage. Load is the share of one core needed at 384kHz.
+*/
+static void bench_truepeak_kernel( const char *name, truepeak_kernel_t kernel,
+                                   struct vis_t *vis )
+{
+    struct truepeak_t *truepeak = truepeak_create();
+    uint64_t start, elapsed;
+    uint32_t frames = VIS_BUF_SIZE / VIS_CHANNELS;
+    uint32_t i;
+    double   rate;
+
+    if ( !truepeak ) return;
+    truepeak->kernel = kernel;
+    truepeak_reset( truepeak, vis->rate, VIS_CHANNELS );
+
+    start = time_ns();
+    for ( i = 0; i < BENCH_LOOPS / 100; i++ )
+        truepeak_process( truepeak, vis->buffer, frames );
+    elapsed = time_ns() - start;
+
+    rate = (double) frames * ( BENCH_LOOPS / 100 ) * 1e9 / elapsed;
+    printf( "\t| %-8s | %12.2f | %8.2f | %7.2f%% |\n", name, rate / 1e6,
+            1e9 / rate, 384000 * 100.0 / rate );
+
+    truepeak_destroy( truepeak );
+}
+
+//  ---------------------------------------------------------------------------
+//  Benchmarks the available true-peak filter kernels.
+//  ---------------------------------------------------------------------------
+static void bench_truepeak( void )
+{
+    struct vis_t *vis = bench_vis_create( 44100 );
+
+    if ( !vis ) return;
+
+    printf( "\nTrue-peak 4x oversampling, stereo, single core.\n\n" );
+    printf( "\t+----------+--------------+----------+----------+\n" );
+    printf( "\t| Kernel   | Mframes/s    | ns/frame | 384kHz   |\n" );
+    printf( "\t+----------+--------------+----------+----------+\n" );
+
+    bench_truepeak_kernel( "scalar", truepeak_kernel_scalar, vis );
+#if defined( __i386__ ) || defined( __x86_64__ )
+    bench_truepeak_kernel( "sse2", truepeak_kernel_sse2, vis );
+#endif
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+    bench_truepeak_kernel( "neon", truepeak_kernel_neon, vis );
+#endif
+
+    printf( "\t+----------+--------------+----------+----------+\n" );
+
+    bench_vis_destroy( vis );
+}
+
+//  ---------------------------------------------------------------------------
+//  Benchmarks the loudness stage.
+//  ---------------------------------------------------------------------------
+/*
+    Cost per stereo frame of K-weighting and block updates, and the share
+    of one core needed at common rates.
+*/
+static void bench_loudness( void )
+{
+    struct vis_t      *vis      = bench_vis_create( 48000 );
+    struct loudness_t *loudness = loudness_create();
+    struct loudness_meter_t loudness_meter;
+    uint64_t start, elapsed;
+    uint32_t frames = VIS_BUF_SIZE / VIS_CHANNELS;
+    uint32_t i;
+    double   rate;
+
+    if ( vis && loudness )
+    {
+        loudness_reset( loudness, vis->rate, VIS_CHANNELS );
+
+        start = time_ns();
+        for ( i = 0; i < BENCH_LOOPS / 100; i++ )
+            loudness_process( loudness, vis->buffer, frames );
+        elapsed = time_ns() - start;
+        rate = (double) frames * ( BENCH_LOOPS / 100 ) * 1e9 / elapsed;
+
+        start = time_ns();
+        for ( i = 0; i < BENCH_LOOPS; i++ )
+            loudness_read( loudness, &loudness_meter );
+        elapsed = time_ns() - start;
+
+        printf( "\nLoudness (K-weighting and gating), stereo, single core.\n\n" );
+        printf( "\tProcess: %.2f Mframes/s, %.2f ns/frame.\n",
+                rate / 1e6, 1e9 / rate );
+        printf( "\tLoad:    %.2f%% at 44.1kHz, %.2f%% at 384kHz.\n",
+                44100 * 100.0 / rate, 384000 * 100.0 / rate );
+        printf( "\tRead:    %.2f us.\n",
+                (double) elapsed / BENCH_LOOPS / 1e3 );
+    }
+
+    loudness_destroy( loudness );
+    if ( vis ) bench_vis_destroy( vis );
+}
+
+//  ---------------------------------------------------------------------------
+//  Benchmarks the spectrum analyser for a number of FFT sizes.
+//  ---------------------------------------------------------------------------
+/*
+    Hop is half the FFT size. Load is the share of one core needed at
+    384kHz, including mixing, windowing, banding and ballistics.
+*/
+static void bench_spectrum( void )
+{
+    struct spectrum_config_t config =
+        { .bands = 16, .low = 50, .high = 16000, .attack = 10, .decay = 300,
+          .floor = -80 };
+    static const uint16_t sizes[] = { 256, 1024, 4096 };
+    struct   vis_t *vis = bench_vis_create( 48000 );
+    struct   spectrum_t *spectrum;
+    uint64_t start, elapsed;
+    uint32_t frames = VIS_BUF_SIZE / VIS_CHANNELS;
+    uint32_t i, transforms;
+    uint8_t  s;
+    double   rate;
+
+    if ( !vis ) return;
+
+    printf( "\nSpectrum analyser, hop of half the FFT size, single core.\n\n" );
+    printf( "\t+------+--------------+----------+----------+\n" );
+    printf( "\t| Size | us/transform | ns/frame | 384kHz   |\n" );
+    printf( "\t+------+--------------+----------+----------+\n" );
+
+    for ( s = 0; s < sizeof( sizes ) / sizeof( sizes[0] ); s++ )
+    {
+        config.size = sizes[s];
+        config.hop  = sizes[s] / 2;
+        spectrum = spectrum_create( &config );
+        if ( !spectrum ) continue;
+        spectrum_reset( spectrum, vis->rate, VIS_CHANNELS );
+
+        start = time_ns();
+        for ( i = 0; i < BENCH_LOOPS / 100; i++ )
+            spectrum_process( spectrum, vis->buffer, frames );
+        elapsed = time_ns() - start;
+
+        transforms = frames * ( BENCH_LOOPS / 100 ) / config.hop;
+        rate = (double) frames * ( BENCH_LOOPS / 100 ) * 1e9 / elapsed;
+        printf( "\t| %4u | %12.2f | %8.2f | %7.2f%% |\n", config.size,
+                (double) elapsed / transforms / 1e3, 1e9 / rate,
+                384000 * 100.0 / rate );
+
+        spectrum_destroy( spectrum );
+    }
+
+    printf( "\t+------+--------------+----------+----------+\n" );
+
+    bench_vis_destroy( vis );
+}
+
+//  ---------------------------------------------------------------------------
+//  Benchmarks a waterfall column against packing a whole frame buffer.
+//  ---------------------------------------------------------------------------
+/*
+    Packing is the loop of ssd1322_fb_write, into memory rather than SPI,
+    which every frame of a one byte per pixel frame buffer needs. A
+    waterfall packs one column when it is added and a frame is then only
+    a pointer.
+*/
+static void bench_waterfall( void )
+{
+    struct spectrum_config_t spectrum_config =
+        { .size = 1024, .hop = 512, .bands = 64, .low = 50, .high = 16000,
+          .attack = 10, .decay = 300, .floor = -80 };
+    struct waterfall_config_t config =
+        { .cols = 256, .rows = 64, .floor = -80, .ceiling = 0 };
+    struct   spectrum_t  *spectrum = spectrum_create( &spectrum_config );
+    struct   waterfall_t *waterfall = NULL;
+    static   uint8_t fb[256 * 64], packed[256 * 64 / 2];
+    const    uint8_t *frame = NULL;
+    volatile uint8_t sink;
+    uint64_t start, elapsed;
+    uint32_t i, j;
+    uint16_t stride;
+
+    if ( spectrum ) waterfall = waterfall_create( &config, spectrum );
+    if ( !waterfall )
+    {
+        spectrum_destroy( spectrum );
+        return;
+    }
+    waterfall_reset( waterfall, 48000, VIS_CHANNELS );
+    for ( i = 0; i < sizeof( fb ); i++ ) fb[i] = i % 16;
+
+    printf( "\nSSD1322 256x64 frame, single core.\n\n" );
+
+    start = time_ns();
+    for ( i = 0; i < BENCH_LOOPS; i++ )
+    {
+        for ( j = 0; j < sizeof( packed ); j++ )
+            packed[j] = fb[j * 2] << 4 | fb[j * 2 + 1];
+        sink = packed[i % sizeof( packed )];
+    }
+    elapsed = time_ns() - start;
+    printf( "\tPack frame buffer:     %8.2f us/frame\n",
+            elapsed / 1e3 / BENCH_LOOPS );
+
+    start = time_ns();
+    for ( i = 0; i < BENCH_LOOPS; i++ )
+    {
+        waterfall_add_column( waterfall );
+        frame = waterfall_get_frame( waterfall, &stride );
+        sink  = frame[0];
+    }
+    elapsed = time_ns() - start;
+    printf( "\tAdd waterfall column:  %8.2f us/frame\n",
+            elapsed / 1e3 / BENCH_LOOPS );
+    (void) sink;
+
+    waterfall_destroy( waterfall );
+    spectrum_destroy( spectrum );
+}
+
+//  ---------------------------------------------------------------------------
+//  Benchmarks the phase meter for a number of goniometer decimations.
+//  ---------------------------------------------------------------------------
+/*
+    Includes the correlation sums and goniometer points. Load is the share
+    of one core needed at 384kHz.
+*/
+static void bench_phase( void )
+{
+    struct phase_config_t config = { .integration = 300, .points = 512 };
+    static const uint16_t decimations[] = { 1, 16, 256 };
+    struct   vis_t *vis = bench_vis_create( 48000 );
+    struct   phase_t *phase;
+    uint64_t start, elapsed;
+    uint32_t frames = VIS_BUF_SIZE / VIS_CHANNELS;
+    uint32_t i;
+    uint8_t  d;
+    double   rate;
+
+    if ( !vis ) return;
+
+    printf( "\nPhase correlation and goniometer, single core.\n\n" );
+    printf( "\t+----------+--------------+----------+----------+\n" );
+    printf( "\t| Decimate | Mframes/s    | ns/frame | 384kHz   |\n" );
+    printf( "\t+----------+--------------+----------+----------+\n" );
+
+    for ( d = 0; d < sizeof( decimations ) / sizeof( decimations[0] ); d++ )
+    {
+        config.decimate = decimations[d];
+        phase = phase_create( &config );
+        if ( !phase ) continue;
+        phase_reset( phase, vis->rate, VIS_CHANNELS );
+
+        start = time_ns();
+        for ( i = 0; i < BENCH_LOOPS / 10; i++ )
+            phase_process( phase, vis->buffer, frames );
+        elapsed = time_ns() - start;
+
+        rate = (double) frames * ( BENCH_LOOPS / 10 ) * 1e9 / elapsed;
+        printf( "\t| %8u | %12.1f | %8.3f | %7.2f%% |\n", config.decimate,
+                rate / 1e6, 1e9 / rate, 384000 * 100.0 / rate );
+
+        phase_destroy( phase );
+    }
+
+    printf( "\t+----------+--------------+----------+----------+\n" );
+
+    bench_vis_destroy( vis );
+}
+
+//  ---------------------------------------------------------------------------
+//  Benchmarks dynamics statistics.
+//  ---------------------------------------------------------------------------
+/*
+    Load is the share of one core needed for stereo at 96kHz, which should
+    be under 2%.
+*/
+static void bench_dynamics( void )
+{
+    struct   vis_t *vis = bench_vis_create( 96000 );
+    struct   dynamics_t *dynamics = dynamics_create();
+    uint64_t start, elapsed;
+    uint32_t frames = VIS_BUF_SIZE / VIS_CHANNELS;
+    uint32_t i;
+    double   rate;
+
+    if ( vis && dynamics )
+    {
+        dynamics_reset( dynamics, vis->rate, VIS_CHANNELS );
+
+        start = time_ns();
+        for ( i = 0; i < BENCH_LOOPS / 10; i++ )
+            dynamics_process( dynamics, vis->buffer, frames );
+        elapsed = time_ns() - start;
+
+        rate = (double) frames * ( BENCH_LOOPS / 10 ) * 1e9 / elapsed;
+        printf( "\nDynamics statistics, stereo, single core.\n\n" );
+        printf( "\t%.1f Mframes/s, %.3f ns/frame, %.2f%% at 96kHz.\n",
+                rate / 1e6, 1e9 / rate, 96000 * 100.0 / rate );
+    }
+
+    dynamics_destroy( dynamics );
+    if ( vis ) bench_vis_destroy( vis );
+}
+
+//  ---------------------------------------------------------------------------
+//  Benchmarks the waveform pyramid and drawing at a number of zooms.
+//  ---------------------------------------------------------------------------
+/*
+    Adding frames costs the same at any zoom, so is only measured once.
+    Drawing is a 256x64 SSD1322 frame buffer for the given frames per
+    column, which should cost about the same however many frames.
+*/
+static void bench_waveform( void )
+{
+    struct waveform_config_t config =
+        { .base = 64, .factor = 4, .levels = 3, .buckets = 1024 };
+    static const uint32_t zooms[] = { 64, 256, 700, 1024, 4096 };
+    static uint8_t fb[256 * 64];
+    struct   vis_t *vis = bench_vis_create( 48000 );
+    struct   waveform_t *waveform = waveform_create( &config );
+    uint64_t start, elapsed;
+    uint32_t frames = VIS_BUF_SIZE / VIS_CHANNELS;
+    uint32_t i;
+    uint8_t  z;
+    double   rate;
+
+    if ( !vis || !waveform )
+    {
+        if ( vis ) bench_vis_destroy( vis );
+        waveform_destroy( waveform );
+        return;
+    }
+
+    waveform_reset( waveform, vis->rate, VIS_CHANNELS );
+    start = time_ns();
+    for ( i = 0; i < BENCH_LOOPS / 10; i++ )
+        waveform_process( waveform, vis->buffer, frames );
+    elapsed = time_ns() - start;
+    rate = (double) frames * ( BENCH_LOOPS / 10 ) * 1e9 / elapsed;
+
+    printf( "\nWaveform pyramid, %u/%u/%u frames, single core.\n\n",
+            waveform_bucket_frames( waveform, 0 ),
+            waveform_bucket_frames( waveform, 1 ),
+            waveform_bucket_frames( waveform, 2 ));
+    printf( "\tAdd: %.1f Mframes/s, %.3f ns/frame, %.2f%% at 384kHz.\n\n",
+            rate / 1e6, 1e9 / rate, 384000 * 100.0 / rate );
+    printf( "\t+----------+--------------+\n" );
+    printf( "\t| Frames   | 256x64 draw  |\n" );
+    printf( "\t+----------+--------------+\n" );
+
+    for ( z = 0; z < sizeof( zooms ) / sizeof( zooms[0] ); z++ )
+    {
+        start = time_ns();
+        for ( i = 0; i < BENCH_LOOPS / 10; i++ )
+            waveform_draw( waveform, fb, 256, 64, zooms[z] );
+        elapsed = time_ns() - start;
+
+        printf( "\t| %8u | %9.1f us |\n", zooms[z],
+                elapsed / 1e3 / ( BENCH_LOOPS / 10 ));
+    }
+
+    printf( "\t+----------+--------------+\n" );
+
+    waveform_destroy( waveform );
+    bench_vis_destroy( vis );
+}
+
+//  ---------------------------------------------------------------------------
+//  Writes a block, meters it and publishes the results on every period.
+//  ---------------------------------------------------------------------------
+/*
+    update_ns is the time of the write, so publish_ns - update_ns is the
+    whole cost of metering and publishing new frames.
+*/
+static void *bench_publisher( void *params )
+{
+    struct bench_publisher_t *bench = params;
+    struct vis_t *vis = bench->vis;
+    struct timespec period = { 0, BENCH_PUBLISH * 1000 };
+    struct peak_meter_t peak_meter =
+    {
+        .samples = 240, .hold_incs = 7, .fall_incs = 2, .over_peaks = 3,
+        .over_incs = 10, .num_levels = 16, .floor = -80,
+        .reference = METER_FULL_SCALE,
+        .scale = { -48, -42, -36, -30, -24, -20, -18, -16,
+                   -14, -12, -10,  -8,  -6,  -4,  -2,   0 }
+    };
+    struct meter_results_t results;
+    struct meter_t *meter = meter_attach( vis );
+    uint32_t i, idx;
+
+    if ( !meter ) return NULL;
+    memset( &results, 0, sizeof( results ));
+
+    while ( !writer_stop )
+    {
+        pthread_rwlock_wrlock( &vis->rwlock );
+        idx = vis->buf_index;
+        for ( i = 0; i < 24 * VIS_CHANNELS; i++ )
+        {
+            vis->buffer[idx] = vis->buffer[( idx + 7 ) % VIS_BUF_SIZE];
+            if ( ++idx == VIS_BUF_SIZE ) idx = 0;
+        }
+        vis->buf_index = idx;
+        vis->updated = time( NULL );
+        results.update_ns = time_ns();
+        pthread_rwlock_unlock( &vis->rwlock );
+
+        meter_get_dBfs( meter, &peak_meter );
+        meter_get_dB_indices( meter, &peak_meter );
+        meter_results_set_peak( &results, &peak_meter );
+        results.running = true;
+        results.rate    = vis->rate;
+        meter_publish( bench->publisher, &results );
+        stats_add( &bench->latency, results.publish_ns - results.update_ns );
+
+        nanosleep( &period, NULL );
+    }
+
+    meter_close( meter );
+
+    return NULL;
+}
+
+//  ---------------------------------------------------------------------------
+//  Benchmarks publishing results and the latency to a subscriber.
+//  ---------------------------------------------------------------------------
+/*
+    The subscriber polls as fast as it can, so publish to read is the
+    latency of the shared memory alone. A display polling at its refresh
+    rate adds up to a period to this.
+*/
+static void bench_publish( void )
+{
+    struct bench_publisher_t bench;
+    struct meter_subscriber_t *subscriber;
+    struct meter_results_t results;
+    struct lock_stats_t read = { 0, 0, 0 };
+    struct vis_t *vis = bench_vis_create( 48000 );
+    pthread_t thread;
+    uint64_t  start, elapsed, end;
+    uint32_t  i, missed = 0, last = 0;
+    char      name[VIS_NAME_LEN];
+
+    if ( !vis ) return;
+    snprintf( name, sizeof( name ), "/meterPi-bench-%d", (int) getpid() );
+
+    memset( &bench, 0, sizeof( bench ));
+    bench.vis       = vis;
+    bench.publisher = meter_publisher_create( name );
+    subscriber      = meter_subscriber_open( name );
+    if ( !bench.publisher || !subscriber )
+    {
+        meter_publisher_destroy( bench.publisher );
+        meter_subscriber_close( subscriber );
+        bench_vis_destroy( vis );
+        return;
+    }
+
+    printf( "\nPublished results, %zu byte object.\n\n",
+            sizeof( struct meter_results_shm_t ));
+    printf( "\t+------------------------------+----------+----------+\n" );
+    printf( "\t| Operation                    | Mean ns  | Max ns   |\n" );
+    printf( "\t+------------------------------+----------+----------+\n" );
+
+    // Cost of the calls alone, with nothing else running.
+    memset( &results, 0, sizeof( results ));
+    start = time_ns();
+    for ( i = 0; i < BENCH_LOOPS; i++ )
+        meter_publish( bench.publisher, &results );
+    elapsed = time_ns() - start;
+    printf( "\t| %-28s | %8.1f | %8s |\n", "meter_publish",
+            (double) elapsed / BENCH_LOOPS, "-" );
+
+    start = time_ns();
+    for ( i = 0; i < BENCH_LOOPS; i++ )
+    {
+        meter_publish( bench.publisher, &results );
+        meter_subscriber_read( subscriber, &results );
+    }
+    elapsed = time_ns() - start;
+    printf( "\t| %-28s | %8.1f | %8s |\n", "meter_publish + read",
+            (double) elapsed / BENCH_LOOPS, "-" );
+
+    // Latency with a publisher metering a buffer being written.
+    writer_stop = false;
+    pthread_create( &thread, NULL, bench_publisher, &bench );
+
+    end = time_ns() + 1000000000ULL;
+    while ( time_ns() < end )
+    {
+        if ( !meter_subscriber_read( subscriber, &results )) continue;
+        stats_add( &read, time_ns() - results.publish_ns );
+        if ( last && results.count != last + 1 ) missed++;
+        last = results.count;
+    }
+
+    writer_stop = true;
+    pthread_join( thread, NULL );
+
+    printf( "\t| %-28s | %8.1f | %8lu |\n", "Write to publish",
+            (double) bench.latency.total / bench.latency.count,
+            (unsigned long) bench.latency.max );
+    printf( "\t| %-28s | %8.1f | %8lu |\n", "Publish to read",
+            (double) read.total / read.count, (unsigned long) read.max );
+    printf( "\t+------------------------------+----------+----------+\n" );
+    printf( "\n\t%u results read, %u missed, %u reads retried.\n",
+            read.count, missed, subscriber->retries );
+
+    meter_subscriber_close( subscriber );
+    meter_publisher_destroy( bench.publisher );
+    bench_vis_destroy( vis );
+}
+
+//  ---------------------------------------------------------------------------
+//  Creates a meter for a WAV file of a buffer of frames in a sample format.
+//  ---------------------------------------------------------------------------
+static struct meter_t *bench_wav_open( uint8_t format, const void *buffer )
+{
+    struct   meter_source_t source;
+    struct   meter_t *meter = NULL;
+    uint8_t  header[44] = "RIFF....WAVEfmt \x10\0\0\0\x01\0\x02\0"
+                          "\x80\xbb\0\0....\0\0\0\0data";
+    uint16_t width = meter_format_width( format );
+    uint16_t value16;
+    uint32_t size = VIS_BUF_SIZE * width;
+    uint32_t value32;
+    char     path[64];
+    FILE     *file;
+
+    value16 = format == METER_FLOAT ? 3 : 1;
+    memcpy( header + 20, &value16, 2 );
+    value32 = 48000 * VIS_CHANNELS * width;
+    memcpy( header + 28, &value32, 4 );
+    value16 = VIS_CHANNELS * width;
+    memcpy( header + 32, &value16, 2 );
+    value16 = width * 8;
+    memcpy( header + 34, &value16, 2 );
+    memcpy( header + 40, &size, 4 );
+    size += 36;
+    memcpy( header + 4, &size, 4 );
+
+    snprintf( path, sizeof( path ), "/tmp/benchmeterPi-%d.wav",
+              (int) getpid() );
+    file = fopen( path, "wb" );
+    if ( file )
+    {
+        fwrite( header, 1, sizeof( header ), file );
+        fwrite( buffer, 1, VIS_BUF_SIZE * width, file );
+        fclose( file );
+        if ( source_wav( &source, path, BENCH_BLOCK, true ))
+            meter = meter_open_source( &source );
+        unlink( path );
+    }
+
+    return meter;
+}
+
+//  ---------------------------------------------------------------------------
+//  Benchmarks a peak meter reading from a WAV file in place.
+//  ---------------------------------------------------------------------------
+/*
+    The file is read in blocks rather than in real time, so every run
+    meters exactly the same frames. The same audio is read in each format.
+*/
+static void bench_source_wav( void )
+{
+    struct vis_t *vis = bench_vis_create( 48000 );
+    struct peak_meter_t peak_meter =
+    {
+        .samples = 48000 * BENCH_INT_MS / 1000, .num_levels = 16,
+        .floor = -80, .reference = METER_FULL_SCALE,
+        .scale = { -48, -42, -36, -30, -24, -20, -18, -16,
+                   -14, -12, -10,  -8,  -6,  -4,  -2,   0 }
+    };
+    static int32_t buffer[VIS_BUF_SIZE];
+    struct meter_t *meter;
+    uint64_t start, elapsed;
+    uint32_t i;
+    uint8_t  format;
+
+    if ( !vis ) return;
+
+    printf( "\nWAV source, %u frame reads in place, %u frame window.\n\n",
+            BENCH_BLOCK, peak_meter.samples );
+
+    for ( format = 0; format < METER_FORMATS; format++ )
+    {
+        bench_format( vis, format, buffer );
+        meter = bench_wav_open( format, buffer );
+        if ( !meter ) continue;
+
+        meter_get_dBfs( meter, &peak_meter );
+
+        start = time_ns();
+        for ( i = 0; i < BENCH_LOOPS; i++ )
+        {
+            meter_get_dBfs( meter, &peak_meter );
+            meter_get_dB_indices( meter, &peak_meter );
+        }
+        elapsed = time_ns() - start;
+
+        printf( "\t%-6s Refresh: %.2f us, %.2f dBFS.\n",
+                meter_format_name( format ),
+                (double) elapsed / BENCH_LOOPS / 1e3, peak_meter.dBfs[0] );
+
+        meter_close( meter );
+    }
+
+    bench_vis_destroy( vis );
+}
+
+//  ---------------------------------------------------------------------------
+//  Main.
+//  ---------------------------------------------------------------------------
+int main( void )
+{
+    bench_lock_hold();
+    bench_kernels();
+    bench_truepeak();
+    bench_loudness();
+    bench_spectrum();
+    bench_waterfall();
+    bench_phase();
+    bench_waveform();
+    bench_dynamics();
+    bench_publish();
+    bench_source_wav();
+
+    return 0;
+}
@@ -0,0 +1,624 @@
+//  ===========================================================================
+/*
+    capturemeterPi:
+
+    Records what a meter reads from Squeezelite and replays it through the
+    meter engines, timing each one and checking the results against a
+    golden trace.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Compile with:
+
+        gcc -Wall meterPi.c meterPi-kernel.c meterPi-truepeak.c
+            meterPi-loudness.c meterPi-spectrum.c meterPi-phase.c
+            meterPi-pace.c meterPi-source.c meterPi-capture.c
+            meterPi-dynamics.c capturemeterPi.c -o capturemeterPi -lm -lpthread -lrt
+
+    For Raspberry Pi v1 optimisation use the following flags:
+
+        -march=armv6zk -mtune=arm1176jzf-s -mfloat-abi=hard -mfpu=vfp
+        -ffast-math -pipe -O3
+
+    For Raspberry Pi v2 optimisation use the following flags:
+
+        -march=armv7-a -mtune=cortex-a7 -mfloat-abi=hard -mfpu=neon-vfpv4
+        -ffast-math -pipe -O3
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+*/
+//  ===========================================================================
+
+//  Installed libraries -------------------------------------------------------
+
+#include <stdbool.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <argp.h>
+
+//  Local libraries -----------------------------------------------------------
+
+#include "meterPi.h"
+#include "meterPi-loudness.h"
+#include "meterPi-spectrum.h"
+#include "meterPi-phase.h"
+#include "meterPi-pace.h"
+#include "meterPi-capture.h"
+#include "meterPi-dynamics.h"
+
+//  Info. ---------------------------------------------------------------------
+/*
+    Record 60s of whatever is playing, at the refresh rate of a display:
+
+        capturemeterPi -r track.mpc -u 30 -d 60
+
+    Replay it at full speed with every engine, writing a golden trace:
+
+        capturemeterPi -p track.mpc -t -l -b 16 -c -w track.trace
+
+    After a change, replay it again and check nothing has moved by more
+    than 0.01dB. The exit status is 1 if anything has:
+
+        capturemeterPi -p track.mpc -t -l -b 16 -c -g track.trace
+
+    The trace has a line for every record of the capture, with the peak
+    meter of each channel and then the true peaks, loudness, spectrum and
+    phase correlation, if enabled. Every number in a line is checked
+    against the tolerance, including the display indices, so indices
+    only pass if they are identical unless the tolerance is 1 or more.
+
+    Write the peak, RMS, crest factor, DR and clips of each track in a
+    capture as CSV, for checking a stream chain:
+
+        capturemeterPi -p track.mpc -s track.csv
+*/
+
+//  Macros. -------------------------------------------------------------------
+
+#define Version "Version 0.1"
+
+#define CAPTURE_IDLE       2    // Poll rate while stopped (Hz).
+#define CAPTURE_LEVELS     41   // Peak meter levels, -40dB to 0dB.
+#define CAPTURE_LINE       2048 // Longest trace line.
+#define CAPTURE_REPORTED   10   // Mismatches reported in full.
+
+//  Types. --------------------------------------------------------------------
+
+struct capture_args_t
+{
+    char     *record;   // Capture file to record.
+    char     *replay;   // Capture file to replay.
+    char     *trace;    // Trace to write.
+    char     *golden;   // Trace to check against.
+    char     *stats;    // Dynamics CSV to write.
+    char     name[VIS_NAME_LEN]; // Squeezelite object name.
+    uint16_t refresh;   // Refresh rate (Hz).
+    uint16_t duration;  // Recording time (s), 0 until stopped.
+    uint16_t int_time;  // Integration time (ms).
+    uint8_t  bands;     // Spectrum bands, 0 for none.
+    float    tolerance; // Largest difference from golden trace.
+    bool     realtime;  // Replay at the recorded times.
+    bool     loudness;  // Meter loudness.
+    bool     true_peak; // Meter true peaks.
+    bool     phase;     // Meter phase correlation.
+    bool     error;     // Invalid argument.
+};
+
+//  Local variables. ----------------------------------------------------------
+
+static volatile sig_atomic_t stopped = 0;
+
+//  argp documentation. -------------------------------------------------------
+
+const char *argp_program_version = Version;
+const char *argp_program_bug_address = "darren@alidaf.co.uk";
+static char doc[] = "Records meter input and replays it for benchmarks and "
+                    "regression tests.";
+static char args_doc[] = "capturemeterPi <options>";
+
+static struct argp_option options[] =
+{
+    { 0, 0, 0, 0, "Recording:" },
+    { "record", 'r', "<file>", 0, "Record Squeezelite to a capture file." },
+    { "name", 'n', "<name>", 0, "Squeezelite object name." },
+    { "duration", 'd', "<s>", 0, "Seconds to record (default until ^C)." },
+    { 0, 0, 0, 0, "Replay:" },
+    { "replay", 'p', "<file>", 0, "Replay a capture file." },
+    { "realtime", 'R', 0, 0, "Replay in real time (default full speed)." },
+    { "trace", 'w', "<file>", 0, "Write a trace of the results." },
+    { "golden", 'g', "<file>", 0, "Check results against a trace." },
+    { "tolerance", 'e', "<dB>", 0, "Largest difference (default 0.01)." },
+    { 0, 0, 0, 0, "Metering:" },
+    { "refresh", 'u', "<Hz>", 0, "Refresh rate (default 30)." },
+    { "integration", 'i', "<ms>", 0, "Integration time (default 50)." },
+    { "true-peak", 't', 0, 0, "Meter true peaks." },
+    { "loudness", 'l', 0, 0, "Meter EBU R128 loudness." },
+    { "bands", 'b', "<n>", 0, "Spectrum bands (default 0, none)." },
+    { "correlation", 'c', 0, 0, "Meter phase correlation." },
+    { "stats", 's', "<file>", 0, "Write dynamics of each track as CSV." },
+    { 0 }
+};
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Command line argument parser.
+//  ---------------------------------------------------------------------------
+static int parse_opt( int param, char *arg, struct argp_state *state )
+{
+    struct capture_args_t *args = state->input;
+
+    switch( param )
+    {
+        case 'r' :
+            args->record = arg;
+            break;
+        case 'n' :
+            snprintf( args->name, sizeof( args->name ), "%s", arg );
+            break;
+        case 'd' :
+            args->duration = atoi( arg );
+            break;
+        case 'p' :
+            args->replay = arg;
+            break;
+        case 'R' :
+            args->realtime = true;
+            break;
+        case 'w' :
+            args->trace = arg;
+            break;
+        case 'g' :
+            args->golden = arg;
+            break;
+        case 'e' :
+            args->tolerance = atof( arg );
+            if ( args->tolerance < 0 ) args->error = true;
+            break;
+        case 'u' :
+            args->refresh = atoi( arg );
+            if ( args->refresh == 0 ) args->error = true;
+            break;
+        case 'i' :
+            args->int_time = atoi( arg );
+            if ( args->int_time == 0 ) args->error = true;
+            break;
+        case 't' :
+            args->true_peak = true;
+            break;
+        case 'l' :
+            args->loudness = true;
+            break;
+        case 'b' :
+            args->bands = atoi( arg );
+            if ( args->bands > SPECTRUM_BANDS_MAX ) args->error = true;
+            break;
+        case 'c' :
+            args->phase = true;
+            break;
+        case 's' :
+            args->stats = arg;
+            break;
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+//  ---------------------------------------------------------------------------
+//  Stops recording or replay on a signal.
+//  ---------------------------------------------------------------------------
+static void capture_stop( int signal )
+{
+    (void) signal;
+    stopped = 1;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the monotonic time in ns.
+//  ---------------------------------------------------------------------------
+static uint64_t time_ns( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+//  ---------------------------------------------------------------------------
+//  Records Squeezelite at the refresh rate until stopped.
+//  ---------------------------------------------------------------------------
+static int capture_run_record( struct capture_args_t *args )
+{
+    struct capture_t   *capture;
+    struct meter_t     *meter;
+    struct meter_pace_t pace;
+    uint64_t start, end;
+    uint32_t frames;
+    bool     passed = true;
+
+    meter = meter_open( args->name[0] ? args->name : NULL );
+    if ( !meter )
+    {
+        fprintf( stderr, "Couldn't create meter.\n" );
+        return 1;
+    }
+    capture = capture_create( args->record );
+    if ( !capture )
+    {
+        fprintf( stderr, "Couldn't create %s.\n", args->record );
+        meter_close( meter );
+        return 1;
+    }
+
+    meter_pace_init( &pace, args->refresh, CAPTURE_IDLE );
+    start = time_ns();
+    end   = start + args->duration * 1000000000ULL;
+
+    // A new run starts with the integration window, as for a meter.
+    while ( passed && !stopped && ( args->duration == 0 || time_ns() < end ))
+    {
+        if ( !meter_pace_wait( &pace, meter )) continue;
+        frames = (uint64_t) meter_get_rate( meter ) * args->int_time / 1000;
+        if ( frames > VIS_BUF_SIZE / VIS_CHANNELS )
+            frames = VIS_BUF_SIZE / VIS_CHANNELS;
+        passed = capture_record( capture, meter, frames );
+    }
+
+    printf( "Recorded %u records, %llu frames in %.1fs.\n",
+            capture->records, (unsigned long long) capture->frames,
+            ( time_ns() - start ) / 1e9 );
+
+    if ( !capture_close( capture )) passed = false;
+    meter_close( meter );
+
+    if ( !passed ) fprintf( stderr, "Couldn't write %s.\n", args->record );
+
+    return passed ? 0 : 1;
+}
+
+//  ---------------------------------------------------------------------------
+//  Writes the results of a refresh as a trace line.
+//  ---------------------------------------------------------------------------
+static void capture_trace_line( char *line, size_t size,
+                                struct capture_replay_t *replay,
+                                struct peak_meter_t *peak_meter,
+                                struct loudness_meter_t *loudness,
+                                struct spectrum_t *spectrum,
+                                struct phase_t *phase )
+{
+    const struct capture_record_t *record = replay->record;
+    size_t  used;
+    uint8_t i;
+
+    used = snprintf( line, size, "%u %.3f %u %u", replay->records,
+                     record->time / 1e6,
+                     ( record->flags & CAPTURE_RUNNING ) ? 1 : 0,
+                     record->rate );
+
+    for ( i = 0; i < peak_meter->channels && used < size; i++ )
+        used += snprintf( line + used, size - used, " %.3f %u %u %u",
+                          peak_meter->dBfs[i], peak_meter->bar_index[i],
+                          peak_meter->dot_index[i],
+                          peak_meter->overload[i] ? 1 : 0 );
+
+    for ( i = 0; peak_meter->true_peak && i < peak_meter->channels &&
+                 used < size; i++ )
+        used += snprintf( line + used, size - used, " %.3f",
+                          peak_meter->dBtp[i] );
+
+    if ( loudness && used < size )
+        used += snprintf( line + used, size - used, " %.3f %.3f %.3f",
+                          loudness->momentary, loudness->short_term,
+                          loudness->integrated );
+
+    for ( i = 0; spectrum && i < spectrum->config.bands && used < size; i++ )
+        used += snprintf( line + used, size - used, " %.3f",
+                          spectrum->level[i] );
+
+    if ( phase && used < size )
+        used += snprintf( line + used, size - used, " %.4f",
+                          phase_get_correlation( phase ));
+
+    if ( used < size ) snprintf( line + used, size - used, "\n" );
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns true if every number in two trace lines is within tolerance.
+//  ---------------------------------------------------------------------------
+static bool capture_trace_match( const char *line, const char *golden,
+                                 float tolerance )
+{
+    char   *end_line, *end_golden;
+    double value, expected;
+
+    while ( 1 )
+    {
+        value    = strtod( line, &end_line );
+        expected = strtod( golden, &end_golden );
+
+        // Both lines must end together.
+        if ( end_line == line || end_golden == golden )
+            return ( end_line == line ) == ( end_golden == golden );
+
+        if ( fabs( value - expected ) > tolerance + 1e-6 ) return false;
+        line   = end_line;
+        golden = end_golden;
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Reads the next line of a trace that isn't a comment.
+//  ---------------------------------------------------------------------------
+static bool capture_trace_read( FILE *file, char *line, size_t size )
+{
+    while ( fgets( line, size, file ))
+        if ( line[0] != '#' ) return true;
+
+    return false;
+}
+
+//  ---------------------------------------------------------------------------
+//  Prints the time spent in the kernel and each stage.
+//  ---------------------------------------------------------------------------
+static void capture_report( struct meter_t *meter, uint64_t elapsed,
+                            uint64_t duration )
+{
+    struct meter_profile_t profile;
+    uint8_t i;
+
+    meter_get_profile( meter, &profile );
+    if ( profile.frames == 0 ) return;
+
+    printf( "\n\t+--------------+----------+----------+\n" );
+    printf( "\t| Stage        | Total ms | ns/frame |\n" );
+    printf( "\t+--------------+----------+----------+\n" );
+    printf( "\t| %-12s | %8.2f | %8.3f |\n", "peak",
+            profile.kernel_ns / 1e6,
+            (double) profile.kernel_ns / profile.frames );
+    if ( profile.convert_ns > 0 )
+        printf( "\t| %-12s | %8.2f | %8.3f |\n", "convert",
+                profile.convert_ns / 1e6,
+                (double) profile.convert_ns / profile.frames );
+    for ( i = 0; i < meter->num_stages; i++ )
+        printf( "\t| %-12s | %8.2f | %8.3f |\n", meter->stages[i].name,
+                profile.stage_ns[i] / 1e6,
+                (double) profile.stage_ns[i] / profile.frames );
+    printf( "\t+--------------+----------+----------+\n" );
+    printf( "\t| %-12s | %8.2f | %8.3f |\n", "total",
+            elapsed / 1e6, (double) elapsed / profile.frames );
+    printf( "\t+--------------+----------+----------+\n" );
+
+    if ( elapsed > 0 )
+        printf( "\n\t%llu frames, %.1fs of audio at %.1fx real time.\n",
+                (unsigned long long) profile.frames, duration / 1e9,
+                (double) duration / elapsed );
+}
+
+//  ---------------------------------------------------------------------------
+//  Replays a capture through the meter engines.
+//  ---------------------------------------------------------------------------
+/*
+    Total time includes reading the capture and working out the display
+    indices, so is a little more than the sum of the stages.
+*/
+static int capture_run_replay( struct capture_args_t *args )
+{
+    struct peak_meter_t peak_meter =
+    {
+        .hold_time  = 1000,
+        .fall_time  = 50,
+        .over_peaks = 10,
+        .over_time  = 3000,
+        .num_levels = CAPTURE_LEVELS,
+        .floor      = -96,
+        .reference  = METER_FULL_SCALE,
+        .scale      =
+            { -40, -39, -38, -37, -36, -35, -34, -33, -32, -31,
+              -30, -29, -28, -27, -26, -25, -24, -23, -22, -21,
+              -20, -19, -18, -17, -16, -15, -14, -13, -12, -11,
+              -10,  -9,  -8,  -7,  -6,  -5,  -4,  -3,  -2,  -1,   0 }
+    };
+    struct spectrum_config_t spectrum_config =
+        { .size = 2048, .hop = 512, .low = 50, .high = 16000,
+          .attack = 10, .decay = 300, .floor = -80 };
+    struct phase_config_t phase_config =
+        { .integration = 300, .points = 256, .decimate = 16 };
+    struct meter_source_t    source;
+    struct capture_replay_t *replay;
+    struct meter_t          *meter;
+    struct spectrum_t       *spectrum = NULL;
+    struct phase_t          *phase = NULL;
+    struct dynamics_t       *dynamics = NULL;
+    struct meter_stage_t     stage;
+    struct loudness_meter_t  loudness;
+    FILE     *trace = NULL, *golden = NULL, *stats = NULL;
+    char     line[CAPTURE_LINE], expected[CAPTURE_LINE];
+    uint64_t start, elapsed, duration = 0;
+    uint32_t rate = 0, samples, mismatches = 0;
+    int      status = 0;
+
+    if ( !source_capture( &source, args->replay, args->realtime ))
+    {
+        fprintf( stderr, "Couldn't read capture %s.\n", args->replay );
+        return 1;
+    }
+    replay = source.state;
+    meter  = meter_open_source( &source );
+    if ( !meter ) return 1;
+
+    peak_meter.true_peak = args->true_peak;
+    peak_meter.int_time  = args->int_time;
+    peak_meter.hold_incs = peak_meter.hold_time * args->refresh / 1000;
+    peak_meter.fall_incs = peak_meter.fall_time * args->refresh / 1000;
+    peak_meter.over_incs = peak_meter.over_time * args->refresh / 1000;
+    if ( peak_meter.fall_incs == 0 ) peak_meter.fall_incs = 1;
+
+    if ( args->bands > 0 )
+    {
+        spectrum_config.bands = args->bands;
+        spectrum = spectrum_create( &spectrum_config );
+        stage = spectrum_stage( spectrum );
+        if ( !spectrum || !meter_add_stage( meter, &stage ))
+            status = 1;
+    }
+    if ( args->phase )
+    {
+        phase = phase_create( &phase_config );
+        stage = phase_stage( phase );
+        if ( !phase || !meter_add_stage( meter, &stage ))
+            status = 1;
+    }
+    if ( args->stats )
+    {
+        dynamics = dynamics_create();
+        stage = dynamics_stage( dynamics );
+        if ( !dynamics || !( stats = fopen( args->stats, "w" )) ||
+             !meter_add_stage( meter, &stage ))
+            status = 1;
+        else
+            dynamics_set_csv( dynamics, stats );
+    }
+    if ( args->trace && !( trace = fopen( args->trace, "w" ))) status = 1;
+    if ( args->golden && !( golden = fopen( args->golden, "r" ))) status = 1;
+    if ( status )
+    {
+        fprintf( stderr, "Couldn't set up replay.\n" );
+        goto done;
+    }
+
+    if ( trace )
+        fprintf( trace, "# record time_ms running rate "
+                        "[dBfs bar dot overload] x channels%s%s%s%s\n",
+                 args->true_peak ? " [dBTP] x channels" : "",
+                 args->loudness ? " momentary short_term integrated" : "",
+                 spectrum ? " [band dBFS] x bands" : "",
+                 phase ? " correlation" : "" );
+
+    meter_profile( meter, true );
+    start = time_ns();
+
+    while ( !stopped && capture_replay_next( replay ))
+    {
+        // Integration window follows the stream rate.
+        if ( replay->record->rate != rate )
+        {
+            rate = replay->record->rate;
+            samples = (uint64_t) rate * args->int_time / 1000;
+            if ( samples < 1 ) samples = 1;
+            if ( samples > VIS_BUF_SIZE / VIS_CHANNELS )
+                samples = VIS_BUF_SIZE / VIS_CHANNELS;
+            peak_meter.samples = samples;
+        }
+
+        duration = replay->record->time;
+        meter_get_dBfs( meter, &peak_meter );
+        meter_get_dB_indices( meter, &peak_meter );
+        if ( args->loudness ) meter_get_loudness( meter, &loudness );
+
+        if ( !trace && !golden ) continue;
+        capture_trace_line( line, sizeof( line ), replay, &peak_meter,
+                            args->loudness ? &loudness : NULL,
+                            spectrum, phase );
+        if ( trace ) fputs( line, trace );
+        if ( !golden ) continue;
+
+        if ( !capture_trace_read( golden, expected, sizeof( expected )))
+            expected[0] = '\0';
+        if ( !capture_trace_match( line, expected, args->tolerance ))
+        {
+            if ( mismatches++ < CAPTURE_REPORTED )
+                printf( "Record %u differs:\n\tgot      %s\texpected %s%s",
+                        replay->records, line,
+                        expected[0] ? expected : "end of trace",
+                        expected[0] ? "" : "\n" );
+        }
+    }
+    elapsed = time_ns() - start;
+
+    // A track still playing at the end of the capture.
+    if ( dynamics ) dynamics_stop( dynamics );
+
+    // The golden trace must end here too.
+    if ( golden && !stopped &&
+         capture_trace_read( golden, expected, sizeof( expected )))
+    {
+        printf( "Golden trace has more records than the capture.\n" );
+        mismatches++;
+    }
+
+    printf( "Replayed %u records of %s.\n", replay->records, args->replay );
+    capture_report( meter, elapsed, duration );
+
+    if ( golden )
+    {
+        printf( "\n%u record(s) differ from %s.\n", mismatches,
+                args->golden );
+        if ( mismatches > 0 ) status = 1;
+    }
+
+done:
+    if ( trace && fclose( trace ) != 0 ) status = 1;
+    if ( golden ) fclose( golden );
+    if ( stats && fclose( stats ) != 0 ) status = 1;
+    meter_close( meter );
+    spectrum_destroy( spectrum );
+    phase_destroy( phase );
+    dynamics_destroy( dynamics );
+
+    return status;
+}
+
+//  ---------------------------------------------------------------------------
+//  Main.
+//  ---------------------------------------------------------------------------
+int main( int argc, char *argv[] )
+{
+    struct capture_args_t args =
+    {
+        .refresh   = 30,
+        .int_time  = 50,
+        .tolerance = 0.01
+    };
+
+    argp_parse( &argp, argc, argv, 0, 0, &args );
+    if ( args.error || !args.record == !args.replay )
+    {
+        fprintf( stderr, "Invalid settings, see capturemeterPi --help.\n" );
+        return 1;
+    }
+
+    signal( SIGINT, capture_stop );
+    signal( SIGTERM, capture_stop );
+
+    if ( args.record ) return capture_run_record( &args );
+
+    return capture_run_replay( &args );
+}
@@ -0,0 +1,350 @@
+//  ===========================================================================
+/*
+    meterPi-capture:
+
+    Records the frames and status changes of an audio source to a file and
+    replays them as a source, so metering can be repeated exactly.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Compile with meterPi.c.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+*/
+//  ===========================================================================
+
+//  Installed libraries -------------------------------------------------------
+
+#include <stdbool.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//  Local libraries -----------------------------------------------------------
+
+#include "meterPi.h"
+#include "meterPi-capture.h"
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Returns the size of the frames of a record, padded to CAPTURE_ALIGN.
+//  ---------------------------------------------------------------------------
+static uint64_t capture_data_size( const struct capture_record_t *record )
+{
+    uint64_t size = (uint64_t) record->frames * record->channels *
+                    meter_format_width( record->format );
+
+    return ( size + CAPTURE_ALIGN - 1 ) & ~(uint64_t)( CAPTURE_ALIGN - 1 );
+}
+
+//  ---------------------------------------------------------------------------
+//  Creates a capture file. Returns NULL on failure.
+//  ---------------------------------------------------------------------------
+struct capture_t *capture_create( const char *path )
+{
+    struct capture_header_t header = { CAPTURE_MAGIC, CAPTURE_VERSION };
+    struct capture_t *capture;
+
+    capture = calloc( 1, sizeof( struct capture_t ));
+    if ( !capture ) return NULL;
+
+    capture->file = fopen( path, "wb" );
+    if ( !capture->file ||
+         fwrite( &header, sizeof( header ), 1, capture->file ) != 1 )
+    {
+        if ( capture->file ) fclose( capture->file );
+        free( capture );
+        return NULL;
+    }
+
+    return capture;
+}
+
+//  ---------------------------------------------------------------------------
+//  Reads new frames from a meter's source and records them.
+//  ---------------------------------------------------------------------------
+/*
+    Frames are written from the source's spans, so nothing is copied
+    beyond the file's own buffer.
+*/
+bool capture_record( struct capture_t *capture, struct meter_t *meter,
+                     uint32_t frames )
+{
+    static const uint8_t zeros[CAPTURE_ALIGN] = { 0 };
+    struct meter_source_t  *source = &meter->source;
+    struct capture_record_t record;
+    struct meter_read_t     read;
+    struct timespec now;
+    size_t   size;
+    bool     passed = true, reading;
+    uint8_t  width, j;
+
+    meter_check( meter );
+
+    memset( &read, 0, sizeof( read ));
+    reading = meter->status.running &&
+              source->begin( source->state, &read, frames ? frames : 1 );
+
+    memset( &record, 0, sizeof( record ));
+    for ( j = 0; reading && j < read.spans; j++ )
+        record.frames += read.span[j].frames;
+
+    // Only new frames or a change of status are worth a record.
+    if ( record.frames > 0 || !capture->started ||
+         meter->status.running != capture->running ||
+         meter->status.rate != capture->rate )
+    {
+        clock_gettime( CLOCK_MONOTONIC, &now );
+        if ( !capture->started ) capture->start = now;
+        capture->started = true;
+        capture->running = meter->status.running;
+        capture->rate    = meter->status.rate;
+
+        record.time = ( now.tv_sec - capture->start.tv_sec ) * 1000000000ULL +
+                      now.tv_nsec - capture->start.tv_nsec;
+        record.rate = meter->status.rate;
+        if ( record.frames > 0 )
+        {
+            record.format   = read.format;
+            record.channels = read.channels;
+            if ( read.continuous ) record.flags |= CAPTURE_CONTINUOUS;
+        }
+        if ( meter->status.running ) record.flags |= CAPTURE_RUNNING;
+
+        passed = fwrite( &record, sizeof( record ), 1, capture->file ) == 1;
+        width  = meter_format_width( record.format ) * record.channels;
+        for ( j = 0; passed && record.frames > 0 && j < read.spans; j++ )
+            passed = fwrite( read.span[j].samples, width,
+                             read.span[j].frames, capture->file ) ==
+                     read.span[j].frames;
+
+        size = capture_data_size( &record ) -
+               (size_t) record.frames * width;
+        if ( passed && size > 0 )
+            passed = fwrite( zeros, 1, size, capture->file ) == size;
+
+        capture->records++;
+        capture->frames += record.frames;
+    }
+
+    if ( reading && source->end ) source->end( source->state, &read );
+
+    return passed;
+}
+
+//  ---------------------------------------------------------------------------
+//  Closes a capture file. Returns false if it couldn't all be written.
+//  ---------------------------------------------------------------------------
+bool capture_close( struct capture_t *capture )
+{
+    bool passed;
+
+    if ( !capture ) return false;
+
+    passed = !ferror( capture->file );
+    if ( fclose( capture->file ) != 0 ) passed = false;
+    free( capture );
+
+    return passed;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the status of a replay at its current record.
+//  ---------------------------------------------------------------------------
+static void replay_check( void *state, struct meter_status_t *status )
+{
+    struct capture_replay_t *replay = state;
+
+    status->running  = replay->record &&
+                       ( replay->record->flags & CAPTURE_RUNNING );
+    status->rate     = replay->record ? replay->record->rate : 0;
+    status->position = replay->position;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the frames of the current record in place.
+//  ---------------------------------------------------------------------------
+/*
+    Records hold every frame that was read live, so the number of frames
+    asked for is ignored as it is for other sources after the first read.
+*/
+static bool replay_begin( void *state, struct meter_read_t *read,
+                          uint32_t frames )
+{
+    struct capture_replay_t *replay = state;
+    const struct capture_record_t *record = replay->record;
+
+    (void) frames;
+
+    if ( !record || !( record->flags & CAPTURE_RUNNING )) return false;
+
+    read->rate       = record->rate;
+    read->format     = record->format;
+    read->channels   = record->channels;
+    read->continuous = ( record->flags & CAPTURE_CONTINUOUS ) &&
+                       !replay->skipped;
+    read->spans      = 0;
+
+    if ( replay->unread )
+    {
+        read->span[0].samples = replay->data;
+        read->span[0].frames  = record->frames;
+        read->spans    = 1;
+        replay->unread  = false;
+        replay->skipped = false;
+    }
+
+    return true;
+}
+
+//  ---------------------------------------------------------------------------
+//  Unmaps a capture file and frees its source.
+//  ---------------------------------------------------------------------------
+static void replay_close( void *state )
+{
+    struct capture_replay_t *replay = state;
+
+    munmap( replay->map, replay->map_size );
+    free( replay );
+}
+
+//  ---------------------------------------------------------------------------
+//  Creates a source that replays a capture file.
+//  ---------------------------------------------------------------------------
+bool source_capture( struct meter_source_t *source, const char *path,
+                     bool realtime )
+{
+    const struct capture_header_t *header;
+    struct capture_replay_t *replay;
+    struct stat info;
+    int    fd;
+
+    replay = calloc( 1, sizeof( struct capture_replay_t ));
+    if ( !replay ) return false;
+
+    fd = open( path, O_RDONLY );
+    if ( fd < 0 || fstat( fd, &info ) != 0 ||
+         info.st_size < (off_t) sizeof( struct capture_header_t ))
+    {
+        if ( fd >= 0 ) close( fd );
+        free( replay );
+        return false;
+    }
+
+    replay->map_size = info.st_size;
+    replay->map = mmap( NULL, replay->map_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if ( replay->map == MAP_FAILED )
+    {
+        free( replay );
+        return false;
+    }
+
+    header = replay->map;
+    if ( memcmp( header->magic, CAPTURE_MAGIC, 4 ) != 0 ||
+         header->version != CAPTURE_VERSION )
+    {
+        replay_close( replay );
+        return false;
+    }
+    madvise( replay->map, replay->map_size, MADV_SEQUENTIAL );
+
+    replay->next     = sizeof( struct capture_header_t );
+    replay->realtime = realtime;
+
+    source->name  = "capture";
+    source->state = replay;
+    source->check = replay_check;
+    source->begin = replay_begin;
+    source->end   = NULL;
+    source->close = replay_close;
+
+    return true;
+}
+
+//  ---------------------------------------------------------------------------
+//  Moves a replay to the next record. Returns false at the end.
+//  ---------------------------------------------------------------------------
+/*
+    A record that runs past the end of the file, e.g. because the recorder
+    was killed mid-write, ends the replay.
+*/
+bool capture_replay_next( struct capture_replay_t *replay )
+{
+    const struct capture_record_t *record;
+    struct timespec deadline;
+    uint64_t size;
+
+    if ( replay->unread ) replay->skipped = true;
+    replay->record = NULL;
+    replay->unread = false;
+
+    if ( replay->next + sizeof( struct capture_record_t ) >
+         replay->map_size ) return false;
+    record = (const struct capture_record_t *)
+             ( (const uint8_t *) replay->map + replay->next );
+
+    if ( record->frames > 0 &&
+         ( record->format >= METER_FORMATS || record->channels == 0 ||
+           record->channels > METER_CHANNELS_MAX )) return false;
+    size = capture_data_size( record );
+    if ( size > replay->map_size - replay->next -
+                sizeof( struct capture_record_t )) return false;
+
+    if ( replay->realtime )
+    {
+        if ( replay->records == 0 )
+            clock_gettime( CLOCK_MONOTONIC, &replay->start );
+
+        deadline.tv_sec  = replay->start.tv_sec + record->time / 1000000000;
+        deadline.tv_nsec = replay->start.tv_nsec + record->time % 1000000000;
+        if ( deadline.tv_nsec >= 1000000000 )
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+                                 NULL ) == EINTR );
+    }
+
+    replay->record = record;
+    replay->data   = record + 1;
+    replay->next  += sizeof( struct capture_record_t ) + size;
+    replay->records++;
+    if ( record->frames > 0 )
+    {
+        replay->unread = true;
+        replay->position++;
+    }
+
+    return true;
+}
@@ -0,0 +1,187 @@
+//  ===========================================================================
+/*
+    meterPi-capture:
+
+    Records the frames and status changes of an audio source to a file and
+    replays them as a source, so metering can be repeated exactly.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+
+    Changelog:
+
+        v01.00      Original version.
+*/
+//  ===========================================================================
+
+#ifndef METERPI_CAPTURE_H
+#define METERPI_CAPTURE_H
+
+//  Info. ---------------------------------------------------------------------
+/*
+    Live audio from LMS can't be played twice, so a meter fault seen on a
+    display is hard to reproduce. A capture holds what a meter read from
+    its source at each refresh, so it can be metered again any number of
+    times with exactly the same input.
+
+    The recorder reads a meter's source at the refresh rate, usually with
+    meter_pace, and writes a record only when there are new frames or the
+    rate or running status changes. Each record holds the time since the
+    start of the capture, the status and the new frames as read, so the
+    file grows with the audio and not with the refresh rate.
+
+        File:   capture_header_t
+                capture_record_t, frames, padding to CAPTURE_ALIGN
+                capture_record_t, frames, padding
+                ...
+
+    All values are little endian, as on the Pi and x86.
+
+    The replay source maps the file and plays it one record at a time.
+    capture_replay_next moves to the next record, sleeping until its time
+    if replaying in real time, and the meter then reads that record's
+    frames in place. At full speed each record is one refresh, however
+    long the meter takes, so every replay of a capture meters the same
+    frames at the same refreshes.
+
+    e.g.
+
+        capture = capture_create( "/tmp/capture.mpc" );
+        meter_pace_init( &pace, 30, 2 );
+        while ( ... )
+            if ( meter_pace_wait( &pace, meter ))
+                capture_record( capture, meter, window );
+        capture_close( capture );
+
+        source_capture( &source, "/tmp/capture.mpc", false );
+        replay = source.state;
+        meter  = meter_open_source( &source );
+        while ( capture_replay_next( replay ))
+            meter_get_dBfs( meter, &peak_meter );
+*/
+
+//  Macros. -------------------------------------------------------------------
+
+#define CAPTURE_MAGIC      "mPiC" // File identifier.
+#define CAPTURE_VERSION    1      // File layout.
+#define CAPTURE_ALIGN      8      // Alignment of records (bytes).
+#define CAPTURE_RUNNING    0x01   // Record flag, stream is playing.
+#define CAPTURE_CONTINUOUS 0x02   // Record flag, frames follow last record.
+
+//  Types. --------------------------------------------------------------------
+
+struct capture_header_t
+{
+    char     magic[4]; // CAPTURE_MAGIC.
+    uint32_t version;  // CAPTURE_VERSION.
+};
+
+struct capture_record_t
+{
+    uint64_t time;     // Time since start of capture (ns).
+    uint32_t rate;     // Sample rate (Hz).
+    uint32_t frames;   // Frames following.
+    uint8_t  format;   // Sample format, see meterPi-kernel.h.
+    uint8_t  channels; // Interleaved channels.
+    uint8_t  flags;    // CAPTURE_RUNNING and CAPTURE_CONTINUOUS.
+    uint8_t  reserved; // Zero.
+    uint32_t padding;  // Zero, so frames are aligned.
+};
+
+/*
+    Recorder.
+*/
+struct capture_t
+{
+    FILE     *file;            // Capture file.
+    struct   timespec start;   // Time of first record.
+    bool     started;          // A record has been written.
+    bool     running;          // Status of last record.
+    uint32_t rate;             // Rate of last record.
+    uint32_t records;          // Records written.
+    uint64_t frames;           // Frames written.
+};
+
+/*
+    Replay source.
+*/
+struct capture_replay_t
+{
+    void       *map;          // Mapped file.
+    size_t      map_size;     // Size of mapping.
+    size_t      next;         // Offset of next record.
+    const struct capture_record_t *record; // Current record, if any.
+    const void *data;         // Frames of current record.
+    bool        unread;       // Current record's frames are still to read.
+    bool        skipped;      // A record was passed without being read.
+    bool        realtime;     // Replay at the recorded times.
+    struct      timespec start; // Time replay started.
+    uint32_t    records;      // Records replayed.
+    uint32_t    position;     // Changes with each record of frames.
+};
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Creates a capture file. Returns NULL on failure.
+//  ---------------------------------------------------------------------------
+struct capture_t *capture_create( const char *path );
+
+//  ---------------------------------------------------------------------------
+//  Reads new frames from a meter's source and records them.
+//  ---------------------------------------------------------------------------
+/*
+    frames is the most to read at the start of a run, i.e. on the first
+    read or after a change of rate, as for the integration window of a
+    meter. After that every new frame is read. The frames are taken from
+    the source, so the meter mustn't be used for metering as well. Returns
+    false if the file can't be written.
+*/
+bool capture_record( struct capture_t *capture, struct meter_t *meter,
+                     uint32_t frames );
+
+//  ---------------------------------------------------------------------------
+//  Closes a capture file. Returns false if it couldn't all be written.
+//  ---------------------------------------------------------------------------
+bool capture_close( struct capture_t *capture );
+
+//  ---------------------------------------------------------------------------
+//  Creates a source that replays a capture file.
+//  ---------------------------------------------------------------------------
+/*
+    source->state is the struct capture_replay_t to pass to
+    capture_replay_next. Nothing is played until the first call. Returns
+    false if the file can't be read or isn't a capture.
+*/
+bool source_capture( struct meter_source_t *source, const char *path,
+                     bool realtime );
+
+//  ---------------------------------------------------------------------------
+//  Moves a replay to the next record. Returns false at the end.
+//  ---------------------------------------------------------------------------
+/*
+    In real time, sleeps until the record's time since the first call.
+    Frames of a record that wasn't read before the next call are lost, so
+    the meter sees a break in the frames, as it would live.
+*/
+bool capture_replay_next( struct capture_replay_t *replay );
+
+#endif // #ifndef METERPI_CAPTURE_H
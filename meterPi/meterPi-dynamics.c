@@ -0,0 +1,370 @@
+//  ===========================================================================
+/*
+    meterPi-dynamics:
+
+    Per track dynamics statistics: peak, RMS, crest factor, DR score and
+    clipped samples.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Compile with meterPi.c.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+*/
+//  ===========================================================================
+
+//  Installed libraries -------------------------------------------------------
+
+#include <stdbool.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+//  Local libraries -----------------------------------------------------------
+
+#include "meterPi.h"
+#include "meterPi-dynamics.h"
+
+//  Macros. -------------------------------------------------------------------
+
+#define DYNAMICS_FULL_SCALE 32768.0 // 0dBFS for 16-bit samples.
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Creates a dynamics stage. Returns NULL on failure.
+//  ---------------------------------------------------------------------------
+struct dynamics_t *dynamics_create( void )
+{
+    struct dynamics_t *dynamics;
+    uint16_t bin;
+
+    dynamics = calloc( 1, sizeof( struct dynamics_t ));
+    if ( !dynamics ) return NULL;
+
+    for ( bin = 0; bin < DYNAMICS_BINS; bin++ )
+        dynamics->power[bin] = pow( 10, ( DYNAMICS_BIN_TOP -
+                                    (double) bin / DYNAMICS_BIN_STEPS ) / 10 );
+
+    return dynamics;
+}
+
+//  ---------------------------------------------------------------------------
+//  Frees a dynamics stage.
+//  ---------------------------------------------------------------------------
+void dynamics_destroy( struct dynamics_t *dynamics )
+{
+    free( dynamics );
+}
+
+//  ---------------------------------------------------------------------------
+//  Ends the track, writing it as CSV if set.
+//  ---------------------------------------------------------------------------
+void dynamics_stop( void *state )
+{
+    struct dynamics_t *dynamics = state;
+
+    if ( dynamics->csv && dynamics->frames > 0 && !dynamics->written )
+        dynamics_write_csv( dynamics, dynamics->csv );
+    dynamics->written = true;
+    dynamics->stopped = true;
+}
+
+//  ---------------------------------------------------------------------------
+//  Starts a new track if the stream stopped or the rate or channels changed.
+//  ---------------------------------------------------------------------------
+/*
+    Otherwise the meter fell behind and the track carries on, including
+    the block that was being filled.
+*/
+void dynamics_reset( void *state, uint32_t rate, uint8_t channels )
+{
+    struct dynamics_t *dynamics = state;
+
+    if ( !dynamics->stopped && rate == dynamics->rate &&
+         channels == dynamics->channels ) return;
+
+    dynamics_stop( dynamics );
+
+    memset( dynamics->channel, 0, sizeof( dynamics->channel ));
+    dynamics->rate         = rate;
+    dynamics->channels     = channels;
+    dynamics->stopped      = false;
+    dynamics->written      = false;
+    dynamics->frames       = 0;
+    dynamics->block_frames = (uint64_t) rate * DYNAMICS_BLOCK_MS / 1000;
+    dynamics->block_fill   = 0;
+    dynamics->blocks       = 0;
+    if ( rate > 0 ) dynamics->track++;
+}
+
+//  ---------------------------------------------------------------------------
+//  Adds a whole block of each channel to the histograms.
+//  ---------------------------------------------------------------------------
+static void dynamics_block( struct dynamics_t *dynamics )
+{
+    struct   dynamics_channel_t *channel;
+    double   level;
+    int32_t  bin;
+    uint8_t  c;
+
+    for ( c = 0; c < dynamics->channels; c++ )
+    {
+        channel = &dynamics->channel[c];
+
+        // RMS lifted by 3dB, as the DR meter.
+        level = (double) channel->block_squares * 2 / dynamics->block_frames;
+        bin   = DYNAMICS_BINS - 1;
+        if ( level > 0 )
+            bin = lrint(( DYNAMICS_BIN_TOP - 10 * log10( level /
+                          ( DYNAMICS_FULL_SCALE * DYNAMICS_FULL_SCALE ))) *
+                        DYNAMICS_BIN_STEPS );
+        if ( bin < 0 ) bin = 0;
+        if ( bin > DYNAMICS_BINS - 1 ) bin = DYNAMICS_BINS - 1;
+        channel->bins[bin]++;
+
+        if ( channel->block_peak > channel->peaks[0] )
+        {
+            channel->peaks[1] = channel->peaks[0];
+            channel->peaks[0] = channel->block_peak;
+        }
+        else if ( channel->block_peak > channel->peaks[1] )
+            channel->peaks[1] = channel->block_peak;
+
+        if ( channel->block_peak > channel->peak )
+            channel->peak = channel->block_peak;
+        channel->sum_squares  += channel->block_squares;
+        channel->block_squares = 0;
+        channel->block_peak    = 0;
+    }
+
+    dynamics->block_fill = 0;
+    dynamics->blocks++;
+}
+
+//  ---------------------------------------------------------------------------
+//  Adds interleaved frames to the track.
+//  ---------------------------------------------------------------------------
+/*
+    Frames are taken a run at a time up to the end of the block, one
+    channel at a time, so that the sums stay in registers.
+*/
+void dynamics_process( void *state, const int16_t *samples, uint32_t frames )
+{
+    struct   dynamics_t *dynamics = state;
+    struct   dynamics_channel_t *channel;
+    const    int16_t *p;
+    uint8_t  channels = dynamics->channels;
+    uint64_t sum;
+    uint32_t run, clips, i;
+    int32_t  sample, magnitude;
+    uint16_t peak;
+    uint8_t  c;
+
+    if ( dynamics->block_frames == 0 || channels == 0 ) return;
+
+    while ( frames > 0 )
+    {
+        run = dynamics->block_frames - dynamics->block_fill;
+        if ( run > frames ) run = frames;
+
+        for ( c = 0; c < channels; c++ )
+        {
+            channel = &dynamics->channel[c];
+            peak  = channel->block_peak;
+            sum   = 0;
+            clips = 0;
+            p     = samples + c;
+            for ( i = 0; i < run; i++ )
+            {
+                sample = p[0];
+                p += channels;
+                magnitude = sample < 0 ? -sample : sample;
+                if ( magnitude > peak ) peak = magnitude;
+                sum   += (uint32_t)( sample * sample );
+                clips += magnitude >= INT16_MAX;
+            }
+            channel->block_peak     = peak;
+            channel->block_squares += sum;
+            channel->clips         += clips;
+        }
+
+        samples              += run * channels;
+        frames               -= run;
+        dynamics->frames     += run;
+        dynamics->block_fill += run;
+
+        if ( dynamics->block_fill == dynamics->block_frames )
+            dynamics_block( dynamics );
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns a meter stage for a dynamics stage.
+//  ---------------------------------------------------------------------------
+struct meter_stage_t dynamics_stage( struct dynamics_t *dynamics )
+{
+    struct meter_stage_t stage =
+    {
+        .name    = "dynamics",
+        .state   = dynamics,
+        .reset   = dynamics_reset,
+        .process = dynamics_process,
+        .stop    = dynamics_stop
+    };
+
+    return stage;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the DR of a channel.
+//  ---------------------------------------------------------------------------
+/*
+    The loudest 20% of blocks, at least one, are summed from the top bin
+    down.
+*/
+static float dynamics_dr( struct dynamics_t *dynamics,
+                          const struct dynamics_channel_t *channel )
+{
+    uint32_t loudest = ( dynamics->blocks + 4 ) / 5;
+    uint32_t left = loudest, take;
+    uint16_t bin, peak;
+    double   power = 0;
+
+    if ( dynamics->blocks == 0 ) return NAN;
+
+    for ( bin = 0; left > 0 && bin < DYNAMICS_BINS; bin++ )
+    {
+        take   = channel->bins[bin] < left ? channel->bins[bin] : left;
+        power += (double) take * dynamics->power[bin];
+        left  -= take;
+    }
+
+    peak = dynamics->blocks > 1 ? channel->peaks[1] : channel->peaks[0];
+
+    return 20 * log10( peak / DYNAMICS_FULL_SCALE ) -
+           10 * log10( power / loudest );
+}
+
+//  ---------------------------------------------------------------------------
+//  Gets the results of a channel. Returns false if there is no channel.
+//  ---------------------------------------------------------------------------
+bool dynamics_get_channel( struct dynamics_t *dynamics, uint8_t channel,
+                           struct dynamics_result_t *result )
+{
+    const struct dynamics_channel_t *stats;
+    uint64_t squares;
+    uint16_t peak;
+
+    if ( channel >= dynamics->channels ) return false;
+    stats = &dynamics->channel[channel];
+
+    peak    = stats->peak > stats->block_peak ? stats->peak
+                                              : stats->block_peak;
+    squares = stats->sum_squares + stats->block_squares;
+
+    result->peak  = 20 * log10( peak / DYNAMICS_FULL_SCALE );
+    result->rms   = dynamics->frames == 0 ? -INFINITY :
+                    10 * log10( (double) squares / dynamics->frames /
+                                ( DYNAMICS_FULL_SCALE * DYNAMICS_FULL_SCALE ));
+    result->crest = result->peak - result->rms;
+    result->dr    = dynamics_dr( dynamics, stats );
+    result->clips = stats->clips;
+
+    return true;
+}
+
+//  ---------------------------------------------------------------------------
+//  Gets the results of all channels together.
+//  ---------------------------------------------------------------------------
+void dynamics_get_all( struct dynamics_t *dynamics,
+                       struct dynamics_result_t *result )
+{
+    struct   dynamics_result_t channel;
+    double   power = 0;
+    float    dr = 0;
+    uint8_t  c;
+
+    result->peak  = -INFINITY;
+    result->clips = 0;
+
+    for ( c = 0; dynamics_get_channel( dynamics, c, &channel ); c++ )
+    {
+        if ( channel.peak > result->peak ) result->peak = channel.peak;
+        power += pow( 10, channel.rms / 10 );
+        dr    += channel.dr;
+        result->clips += channel.clips;
+    }
+
+    result->rms   = c == 0 ? -INFINITY : 10 * log10( power / c );
+    result->crest = result->peak - result->rms;
+    result->dr    = c == 0 ? NAN : dr / c;
+}
+
+//  ---------------------------------------------------------------------------
+//  Writes a line of results as CSV.
+//  ---------------------------------------------------------------------------
+static void dynamics_write_line( struct dynamics_t *dynamics, FILE *csv,
+                                 const char *channel,
+                                 const struct dynamics_result_t *result )
+{
+    fprintf( csv, "%u,%s,%u,%.3f,%u,%.2f,%.2f,%.2f,%.2f,%llu\n",
+             dynamics->track, channel, dynamics->rate,
+             dynamics->rate ? (double) dynamics->frames / dynamics->rate : 0,
+             dynamics->blocks, result->peak, result->rms, result->crest,
+             result->dr, (unsigned long long) result->clips );
+}
+
+//  ---------------------------------------------------------------------------
+//  Writes the results of the track so far as CSV lines.
+//  ---------------------------------------------------------------------------
+void dynamics_write_csv( struct dynamics_t *dynamics, FILE *csv )
+{
+    struct   dynamics_result_t result;
+    char     name[4];
+    uint8_t  c;
+
+    for ( c = 0; dynamics_get_channel( dynamics, c, &result ); c++ )
+    {
+        snprintf( name, sizeof( name ), "%u", c );
+        dynamics_write_line( dynamics, csv, name, &result );
+    }
+
+    dynamics_get_all( dynamics, &result );
+    dynamics_write_line( dynamics, csv, "all", &result );
+    fflush( csv );
+}
+
+//  ---------------------------------------------------------------------------
+//  Writes each track as CSV as it ends, starting with a header line.
+//  ---------------------------------------------------------------------------
+void dynamics_set_csv( struct dynamics_t *dynamics, FILE *csv )
+{
+    dynamics->csv = csv;
+    if ( csv )
+        fprintf( csv, "track,channel,rate,seconds,blocks,peak_dBFS,"
+                      "rms_dBFS,crest_dB,dr_dB,clips\n" );
+}
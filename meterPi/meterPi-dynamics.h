@@ -0,0 +1,188 @@
+//  ===========================================================================
+/*
+    meterPi-dynamics:
+
+    Per track dynamics statistics: peak, RMS, crest factor, DR score and
+    clipped samples.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+
+    Changelog:
+
+        v01.00      Original version.
+*/
+//  ===========================================================================
+
+#ifndef METERPI_DYNAMICS_H
+#define METERPI_DYNAMICS_H
+
+//  Info. ---------------------------------------------------------------------
+/*
+    A track runs from the stream starting to play until it stops or
+    changes rate or channels. Gaps where the meter fell behind don't start
+    a new track, so stats of a whole track survive a slow display.
+
+    For each channel of a track:
+
+        Peak    Highest absolute sample (dBFS).
+        RMS     Root mean square of every sample (dBFS), so a full scale
+                sine is -3dBFS.
+        Crest   Peak less RMS (dB), 3dB for a sine.
+        DR      As the DR meter. The track is cut into 3s blocks and each
+                block's RMS is taken with a 3dB lift, so a sine's RMS is
+                its peak. DR is the second highest block peak less the
+                RMS of the loudest 20% of blocks (dB). Only whole blocks
+                count, so DR is NAN for the first 3s.
+        Clips   Samples at 16-bit full scale, either polarity.
+
+    The DR of a track is the mean of its channels', usually shown rounded
+    as e.g. DR12.
+
+    Block RMS levels go in a histogram of 1/16dB bins rather than a list,
+    so memory is fixed however long the track, and the loudest 20% are
+    summed from the top bin down. That is within 1/32dB of the exact
+    value. Every sample costs a compare, a multiply-add and a test for
+    clipping, done in the meter's read as a stage.
+
+    Results can be read at any time, and each track can be written as CSV
+    when it ends, one line per channel and one for all channels.
+*/
+
+//  Macros. -------------------------------------------------------------------
+
+#define DYNAMICS_BLOCK_MS  3000 // DR block length (ms).
+#define DYNAMICS_BINS      2048 // Histogram bins.
+#define DYNAMICS_BIN_STEPS 16   // Bins per dB.
+#define DYNAMICS_BIN_TOP   6    // Level of highest bin (dB).
+
+//  Types. --------------------------------------------------------------------
+
+struct dynamics_channel_t
+{
+    uint16_t peak;          // Highest absolute sample.
+    uint64_t sum_squares;   // Sum of squares of samples.
+    uint64_t clips;         // Samples at full scale.
+    uint64_t block_squares; // Sum of squares of current block.
+    uint16_t block_peak;    // Peak of current block.
+    uint16_t peaks[2];      // Highest and second highest block peaks.
+    uint32_t bins[DYNAMICS_BINS]; // Blocks by RMS level.
+};
+
+struct dynamics_result_t
+{
+    float    peak;  // Peak (dBFS).
+    float    rms;   // RMS (dBFS).
+    float    crest; // Crest factor (dB).
+    float    dr;    // DR (dB), NAN before a whole block.
+    uint64_t clips; // Clipped samples.
+};
+
+struct dynamics_t
+{
+    uint32_t rate;          // Sample rate of track.
+    uint8_t  channels;      // Channels of track.
+    bool     stopped;       // Stream stopped since the track started.
+    bool     written;       // Track has been written as CSV.
+    uint32_t track;         // Tracks started.
+    uint64_t frames;        // Frames of track.
+    uint32_t block_frames;  // Frames per block.
+    uint32_t block_fill;    // Frames in current block.
+    uint32_t blocks;        // Whole blocks.
+    FILE    *csv;           // Track results, if set.
+    float    power[DYNAMICS_BINS]; // Power of each bin.
+    struct   dynamics_channel_t channel[METER_CHANNELS_MAX]; // Channels.
+};
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Creates a dynamics stage. Returns NULL on failure.
+//  ---------------------------------------------------------------------------
+struct dynamics_t *dynamics_create( void );
+
+//  ---------------------------------------------------------------------------
+//  Frees a dynamics stage.
+//  ---------------------------------------------------------------------------
+void dynamics_destroy( struct dynamics_t *dynamics );
+
+//  ---------------------------------------------------------------------------
+//  Starts a new track if the stream stopped or the rate or channels changed.
+//  ---------------------------------------------------------------------------
+void dynamics_reset( void *dynamics, uint32_t rate, uint8_t channels );
+
+//  ---------------------------------------------------------------------------
+//  Adds interleaved frames to the track.
+//  ---------------------------------------------------------------------------
+void dynamics_process( void *dynamics, const int16_t *samples,
+                       uint32_t frames );
+
+//  ---------------------------------------------------------------------------
+//  Ends the track, writing it as CSV if set.
+//  ---------------------------------------------------------------------------
+/*
+    Called by the meter when the stream stops. Call it after the last read
+    to write a track that is still playing. Results stay readable until
+    the next track starts.
+*/
+void dynamics_stop( void *dynamics );
+
+//  ---------------------------------------------------------------------------
+//  Returns a meter stage for a dynamics stage.
+//  ---------------------------------------------------------------------------
+struct meter_stage_t dynamics_stage( struct dynamics_t *dynamics );
+
+//  ---------------------------------------------------------------------------
+//  Gets the results of a channel. Returns false if there is no channel.
+//  ---------------------------------------------------------------------------
+bool dynamics_get_channel( struct dynamics_t *dynamics, uint8_t channel,
+                           struct dynamics_result_t *result );
+
+//  ---------------------------------------------------------------------------
+//  Gets the results of all channels together.
+//  ---------------------------------------------------------------------------
+/*
+    Peak is the highest, RMS is of all samples, DR is the mean of the
+    channels' and clips are summed.
+*/
+void dynamics_get_all( struct dynamics_t *dynamics,
+                       struct dynamics_result_t *result );
+
+//  ---------------------------------------------------------------------------
+//  Writes each track as CSV as it ends, starting with a header line.
+//  ---------------------------------------------------------------------------
+/*
+    NULL stops writing. The file is not closed.
+*/
+void dynamics_set_csv( struct dynamics_t *dynamics, FILE *csv );
+
+//  ---------------------------------------------------------------------------
+//  Writes the results of the track so far as CSV lines.
+//  ---------------------------------------------------------------------------
+/*
+        track,channel,rate,seconds,blocks,peak_dBFS,rms_dBFS,crest_dB,
+        dr_dB,clips
+
+    One line per channel, numbered from 0, then one for "all".
+*/
+void dynamics_write_csv( struct dynamics_t *dynamics, FILE *csv );
+
+#endif // #ifndef METERPI_DYNAMICS_H
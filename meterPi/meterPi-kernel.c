@@ -0,0 +1,988 @@
+//  ===========================================================================
+/*
+    meterPi-kernel:
+
+    Accumulation kernels for meterPi. Computes sum of squares and absolute
+    peak per channel over spans of interleaved frames.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Compile with meterPi.c. The NEON kernel is only built when NEON is
+    enabled, i.e. with the Raspberry Pi v2 flags:
+
+        -march=armv7-a -mtune=cortex-a7 -mfloat-abi=hard -mfpu=neon-vfpv4
+        -ffast-math -pipe -O3
+
+    The SSE2 kernel is always built on x86.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+*/
+//  ===========================================================================
+
+//  Installed libraries -------------------------------------------------------
+
+#include <stdbool.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#if defined( __i386__ ) || defined( __x86_64__ )
+#include <emmintrin.h>
+#endif
+
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#include <arm_neon.h>
+#if defined( __arm__ )
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+//  Local libraries -----------------------------------------------------------
+
+#include "meterPi.h"
+#include "meterPi-kernel.h"
+
+//  Macros. -------------------------------------------------------------------
+
+#define METER_VECTORS_MAX 7 // Most SIMD vectors before channels repeat.
+
+//  Local variables. ----------------------------------------------------------
+
+static const uint8_t format_width[METER_FORMATS] = { 2, 3, 4, 4 };
+static const char   *format_names[METER_FORMATS] =
+    { "s16", "s24", "s32", "float" };
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Clears an accumulator.
+//  ---------------------------------------------------------------------------
+void meter_acc_clear( struct meter_acc_t *acc )
+{
+    memset( acc, 0, sizeof( struct meter_acc_t ));
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the size of a sample in a format (bytes).
+//  ---------------------------------------------------------------------------
+uint8_t meter_format_width( uint8_t format )
+{
+    return format < METER_FORMATS ? format_width[format] : 0;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the name of a sample format.
+//  ---------------------------------------------------------------------------
+const char *meter_format_name( uint8_t format )
+{
+    return format < METER_FORMATS ? format_names[format] : "unknown";
+}
+
+//  ---------------------------------------------------------------------------
+//  Splits a window of a ring buffer of any format into contiguous spans.
+//  ---------------------------------------------------------------------------
+uint8_t meter_format_spans( const void *ring, uint8_t format,
+                            uint8_t channels, uint32_t size, uint32_t start,
+                            uint32_t frames, struct meter_span_t span[2] )
+{
+    uint8_t  width = meter_format_width( format );
+    uint32_t first;
+
+    if ( channels == 0 || size < channels || frames == 0 ) return 0;
+
+    start %= size;
+    if ( frames > size / channels ) frames = size / channels;
+
+    // Frames before the end of the ring.
+    first = ( size - start ) / channels;
+
+    span[0].samples = (const uint8_t *) ring + start * width;
+    if ( frames <= first )
+    {
+        span[0].frames = frames;
+        return 1;
+    }
+
+    span[0].frames  = first;
+    span[1].samples = ring;
+    span[1].frames  = frames - first;
+
+    return 2;
+}
+
+//  ---------------------------------------------------------------------------
+//  Splits a window of a ring buffer into at most two contiguous spans.
+//  ---------------------------------------------------------------------------
+uint8_t meter_ring_spans( const int16_t *ring, uint32_t size, uint32_t start,
+                          uint32_t frames, struct meter_span_t span[2] )
+{
+    return meter_format_spans( ring, METER_S16, VIS_CHANNELS, size, start,
+                               frames, span );
+}
+
+//  ---------------------------------------------------------------------------
+//  Adds normalised sums and peaks to an accumulator.
+//  ---------------------------------------------------------------------------
+/*
+    Kernels keep their own sums at the resolution of their format and
+    normalise them once at the end.
+*/
+static inline void meter_acc_add( struct meter_acc_t *acc, uint8_t channel,
+                                  uint64_t sum, uint32_t peak, uint8_t shift )
+{
+    acc->sum_squares[channel] += sum << ( 2 * shift );
+    peak <<= shift;
+    if ( peak > acc->peak[channel] ) acc->peak[channel] = peak;
+}
+
+//  ---------------------------------------------------------------------------
+//  Reference kernel.
+//  ---------------------------------------------------------------------------
+void meter_kernel_scalar( const void *samples, uint32_t frames,
+                          uint8_t channels, struct meter_acc_t *acc )
+{
+    const int16_t *sample16 = samples;
+    uint64_t sum  [METER_CHANNELS_MAX] = { 0 };
+    uint32_t peak [METER_CHANNELS_MAX] = { 0 };
+    int32_t  sample;
+    uint32_t i;
+    uint8_t  channel;
+
+    for ( i = 0; i < frames; i++ )
+    {
+        for ( channel = 0; channel < channels; channel++ )
+        {
+            sample = *sample16++;
+            sum[channel] += (uint32_t)( sample * sample );
+            if ( sample < 0 ) sample = -sample;
+            if ( (uint32_t) sample > peak[channel] ) peak[channel] = sample;
+        }
+    }
+
+    for ( channel = 0; channel < channels; channel++ )
+        meter_acc_add( acc, channel, sum[channel], peak[channel], 8 );
+}
+
+//  ---------------------------------------------------------------------------
+//  Adds a normalised 24-bit sample to scalar sums.
+//  ---------------------------------------------------------------------------
+static inline void meter_add_s24( int32_t sample, uint64_t *sum,
+                                  uint32_t *peak )
+{
+    *sum += (uint64_t)( (int64_t) sample * sample );
+    if ( sample < 0 ) sample = -sample;
+    if ( (uint32_t) sample > *peak ) *peak = sample;
+}
+
+//  ---------------------------------------------------------------------------
+//  Reference kernel for 24-bit samples in 3 bytes.
+//  ---------------------------------------------------------------------------
+void meter_kernel_s24_scalar( const void *samples, uint32_t frames,
+                              uint8_t channels, struct meter_acc_t *acc )
+{
+    const uint8_t *bytes = samples;
+    uint64_t sum  [METER_CHANNELS_MAX] = { 0 };
+    uint32_t peak [METER_CHANNELS_MAX] = { 0 };
+    uint32_t i, sample;
+    uint8_t  channel;
+
+    for ( i = 0; i < frames; i++ )
+    {
+        for ( channel = 0; channel < channels; channel++ )
+        {
+            // Sign extended from the top byte.
+            sample = bytes[0] << 8 | bytes[1] << 16 | (uint32_t) bytes[2] << 24;
+            bytes += 3;
+            meter_add_s24( (int32_t) sample >> 8, &sum[channel],
+                           &peak[channel] );
+        }
+    }
+
+    for ( channel = 0; channel < channels; channel++ )
+        meter_acc_add( acc, channel, sum[channel], peak[channel], 0 );
+}
+
+//  ---------------------------------------------------------------------------
+//  Reference kernel for 32-bit samples.
+//  ---------------------------------------------------------------------------
+void meter_kernel_s32_scalar( const void *samples, uint32_t frames,
+                              uint8_t channels, struct meter_acc_t *acc )
+{
+    const int32_t *sample32 = samples;
+    uint64_t sum  [METER_CHANNELS_MAX] = { 0 };
+    uint32_t peak [METER_CHANNELS_MAX] = { 0 };
+    uint32_t i;
+    uint8_t  channel;
+
+    for ( i = 0; i < frames; i++ )
+        for ( channel = 0; channel < channels; channel++ )
+            meter_add_s24( *sample32++ >> 8, &sum[channel], &peak[channel] );
+
+    for ( channel = 0; channel < channels; channel++ )
+        meter_acc_add( acc, channel, sum[channel], peak[channel], 0 );
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns a float sample as a normalised 24-bit sample.
+//  ---------------------------------------------------------------------------
+/*
+    Clipped in the same order as the SIMD min and max so all kernels agree.
+*/
+static inline int32_t meter_float_s24( float sample )
+{
+    sample *= 8388608.0f;
+    sample = sample < 8388607.0f ? sample : 8388607.0f;
+    sample = sample > -8388608.0f ? sample : -8388608.0f;
+    return (int32_t) sample;
+}
+
+//  ---------------------------------------------------------------------------
+//  Reference kernel for float samples.
+//  ---------------------------------------------------------------------------
+void meter_kernel_float_scalar( const void *samples, uint32_t frames,
+                                uint8_t channels, struct meter_acc_t *acc )
+{
+    const float *samplef = samples;
+    uint64_t sum  [METER_CHANNELS_MAX] = { 0 };
+    uint32_t peak [METER_CHANNELS_MAX] = { 0 };
+    uint32_t i;
+    uint8_t  channel;
+
+    for ( i = 0; i < frames; i++ )
+        for ( channel = 0; channel < channels; channel++ )
+            meter_add_s24( meter_float_s24( *samplef++ ), &sum[channel],
+                           &peak[channel] );
+
+    for ( channel = 0; channel < channels; channel++ )
+        meter_acc_add( acc, channel, sum[channel], peak[channel], 0 );
+}
+
+#if defined( __i386__ ) || defined( __x86_64__ ) || \
+    defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+//  ---------------------------------------------------------------------------
+//  Returns the number of vectors before lanes hold the same channels again.
+//  ---------------------------------------------------------------------------
+/*
+    i.e. lcm( channels, lanes ) / lanes, which is 1 for 1, 2, 4 or 8
+    channels and at most METER_VECTORS_MAX.
+*/
+static uint8_t meter_lane_vectors( uint8_t channels, uint8_t lanes )
+{
+    uint8_t a = channels, b = lanes, t;
+
+    while ( b > 0 )
+    {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return channels / a;
+}
+
+//  ---------------------------------------------------------------------------
+//  Adds the sums and peaks of SIMD lanes to an accumulator.
+//  ---------------------------------------------------------------------------
+/*
+    Lane n of a run of vectors holds samples of channel n % channels.
+*/
+static void meter_acc_lanes( struct meter_acc_t *acc, uint8_t channels,
+                             const uint64_t *sums, const uint32_t *peaks,
+                             uint8_t lanes, uint8_t shift )
+{
+    uint64_t sum  [METER_CHANNELS_MAX] = { 0 };
+    uint32_t peak [METER_CHANNELS_MAX] = { 0 };
+    uint8_t  lane, channel;
+
+    for ( lane = 0, channel = 0; lane < lanes; lane++ )
+    {
+        sum[channel] += sums[lane];
+        if ( peaks[lane] > peak[channel] ) peak[channel] = peaks[lane];
+        if ( ++channel == channels ) channel = 0;
+    }
+
+    for ( channel = 0; channel < channels; channel++ )
+        meter_acc_add( acc, channel, sum[channel], peak[channel], shift );
+}
+#endif
+
+#if defined( __i386__ ) || defined( __x86_64__ )
+//  ---------------------------------------------------------------------------
+//  Adds runs of vectors of 16-bit samples to an accumulator with SSE2.
+//  ---------------------------------------------------------------------------
+/*
+    Inlined for each number of vectors so that the sums stay in registers.
+    If lanes 0-3 and 4-7 hold the same channels, i.e. for 1, 2 or 4
+    channels, their squares are paired before widening to 64-bit. SSE2 has
+    no 16-bit abs and negating -32768 saturates, so the maximum and minimum
+    are kept separately to keep the peak bit-exact. Returns the next sample.
+*/
+__attribute__(( target( "sse2" ), always_inline ))
+static inline const int16_t *meter_run_sse2( const int16_t *sample16,
+                                             uint32_t blocks, uint8_t vectors,
+                                             bool paired, uint8_t channels,
+                                             struct meter_acc_t *acc )
+{
+    __m128i  zero = _mm_setzero_si128();
+    __m128i  sum  [METER_VECTORS_MAX][4];
+    __m128i  vmax [METER_VECTORS_MAX];
+    __m128i  vmin [METER_VECTORS_MAX];
+    __m128i  x, lo, hi, sq_lo, sq_hi;
+    uint64_t sums  [METER_VECTORS_MAX * 8];
+    uint32_t peaks [METER_VECTORS_MAX * 8];
+    int16_t  maxs[8], mins[8];
+    uint32_t i;
+    uint8_t  v, k, lane;
+
+    for ( v = 0; v < vectors; v++ )
+    {
+        for ( k = 0; k < 4; k++ ) sum[v][k] = zero;
+        vmax[v] = zero;
+        vmin[v] = zero;
+    }
+
+    for ( i = 0; i < blocks; i++ )
+    {
+        for ( v = 0; v < vectors; v++ )
+        {
+            x = _mm_loadu_si128( (const __m128i *) sample16 );
+            sample16 += 8;
+
+            // 32-bit squares of lanes 0-3 and 4-7.
+            lo = _mm_mullo_epi16( x, x );
+            hi = _mm_mulhi_epi16( x, x );
+            sq_lo = _mm_unpacklo_epi16( lo, hi );
+            sq_hi = _mm_unpackhi_epi16( lo, hi );
+            if ( paired ) sq_lo = _mm_add_epi32( sq_lo, sq_hi );
+
+            // Widen to 64-bit in lane order.
+            sum[v][0] = _mm_add_epi64( sum[v][0],
+                                       _mm_unpacklo_epi32( sq_lo, zero ));
+            sum[v][1] = _mm_add_epi64( sum[v][1],
+                                       _mm_unpackhi_epi32( sq_lo, zero ));
+            if ( !paired )
+            {
+                sum[v][2] = _mm_add_epi64( sum[v][2],
+                                           _mm_unpacklo_epi32( sq_hi, zero ));
+                sum[v][3] = _mm_add_epi64( sum[v][3],
+                                           _mm_unpackhi_epi32( sq_hi, zero ));
+            }
+
+            vmax[v] = _mm_max_epi16( vmax[v], x );
+            vmin[v] = _mm_min_epi16( vmin[v], x );
+        }
+    }
+
+    for ( v = 0; v < vectors; v++ )
+    {
+        for ( k = 0; k < 4; k++ )
+            _mm_storeu_si128( (__m128i *)( sums + v * 8 + k * 2 ), sum[v][k] );
+        _mm_storeu_si128( (__m128i *) maxs, vmax[v] );
+        _mm_storeu_si128( (__m128i *) mins, vmin[v] );
+        for ( lane = 0; lane < 8; lane++ )
+            peaks[v * 8 + lane] = maxs[lane] > -mins[lane] ? maxs[lane]
+                                                           : -mins[lane];
+    }
+    meter_acc_lanes( acc, channels, sums, peaks, vectors * 8, 8 );
+
+    return sample16;
+}
+
+//  ---------------------------------------------------------------------------
+//  SSE2 kernel for x86 hosts.
+//  ---------------------------------------------------------------------------
+/*
+    Processes 8 samples per vector, whatever the number of channels.
+*/
+__attribute__(( target( "sse2" )))
+void meter_kernel_sse2( const void *samples, uint32_t frames,
+                        uint8_t channels, struct meter_acc_t *acc )
+{
+    const int16_t *sample16 = samples;
+    uint8_t  vectors = meter_lane_vectors( channels, 8 );
+    uint32_t block   = vectors * 8 / channels;
+    uint32_t blocks  = frames / block;
+
+    switch ( vectors )
+    {
+        case 1 :
+            if ( channels == 8 )
+                sample16 = meter_run_sse2( sample16, blocks, 1, false,
+                                           channels, acc );
+            else
+                sample16 = meter_run_sse2( sample16, blocks, 1, true,
+                                           channels, acc );
+            break;
+        case 3 :
+            sample16 = meter_run_sse2( sample16, blocks, 3, false,
+                                       channels, acc );
+            break;
+        case 5 :
+            sample16 = meter_run_sse2( sample16, blocks, 5, false,
+                                       channels, acc );
+            break;
+        default :
+            sample16 = meter_run_sse2( sample16, blocks, 7, false,
+                                       channels, acc );
+            break;
+    }
+
+    // Remaining frames.
+    meter_kernel_scalar( sample16, frames - blocks * block, channels, acc );
+}
+
+//  ---------------------------------------------------------------------------
+//  Adds runs of vectors of 32-bit or float samples to an accumulator.
+//  ---------------------------------------------------------------------------
+/*
+    Samples are normalised to 24-bit and abs'ed first so that the unsigned
+    32 x 32 bit multiply gives the 64-bit squares. It multiplies the even
+    lanes, so the odd lanes are shifted down for a second multiply. SSE2
+    has no 32-bit max but abs'ed samples can't overflow a compare. Returns
+    the next sample.
+*/
+__attribute__(( target( "sse2" ), always_inline ))
+static inline const int32_t *meter_run_s24_sse2( const int32_t *sample32,
+                                                 uint32_t blocks,
+                                                 uint8_t vectors,
+                                                 bool is_float,
+                                                 uint8_t channels,
+                                                 struct meter_acc_t *acc )
+{
+    __m128i  sum  [METER_VECTORS_MAX][2];
+    __m128i  vmax [METER_VECTORS_MAX];
+    __m128   scale = _mm_set1_ps( 8388608.0f );
+    __m128   high  = _mm_set1_ps( 8388607.0f );
+    __m128   low   = _mm_set1_ps( -8388608.0f );
+    __m128i  x, sign, more;
+    uint64_t even[2], odd[2];
+    uint64_t sums  [METER_VECTORS_MAX * 4];
+    uint32_t peaks [METER_VECTORS_MAX * 4];
+    uint32_t i;
+    uint8_t  v;
+
+    for ( v = 0; v < vectors; v++ )
+    {
+        sum[v][0] = _mm_setzero_si128();
+        sum[v][1] = _mm_setzero_si128();
+        vmax[v]   = _mm_setzero_si128();
+    }
+
+    for ( i = 0; i < blocks; i++ )
+    {
+        for ( v = 0; v < vectors; v++ )
+        {
+            if ( is_float )
+            {
+                __m128 f = _mm_mul_ps( _mm_loadu_ps( (const float *) sample32 ),
+                                       scale );
+                x = _mm_cvttps_epi32( _mm_max_ps( _mm_min_ps( f, high ),
+                                                  low ));
+            }
+            else x = _mm_srai_epi32(
+                     _mm_loadu_si128( (const __m128i *) sample32 ), 8 );
+            sample32 += 4;
+
+            sign = _mm_srai_epi32( x, 31 );
+            x = _mm_sub_epi32( _mm_xor_si128( x, sign ), sign );
+
+            sum[v][0] = _mm_add_epi64( sum[v][0], _mm_mul_epu32( x, x ));
+            sum[v][1] = _mm_add_epi64( sum[v][1],
+                                       _mm_mul_epu32( _mm_srli_epi64( x, 32 ),
+                                                      _mm_srli_epi64( x, 32 )));
+
+            more    = _mm_cmpgt_epi32( x, vmax[v] );
+            vmax[v] = _mm_or_si128( _mm_and_si128( more, x ),
+                                    _mm_andnot_si128( more, vmax[v] ));
+        }
+    }
+
+    // Even sums hold lanes 0 and 2, odd sums hold lanes 1 and 3.
+    for ( v = 0; v < vectors; v++ )
+    {
+        _mm_storeu_si128( (__m128i *) even, sum[v][0] );
+        _mm_storeu_si128( (__m128i *) odd, sum[v][1] );
+        sums[v * 4]     = even[0];
+        sums[v * 4 + 1] = odd[0];
+        sums[v * 4 + 2] = even[1];
+        sums[v * 4 + 3] = odd[1];
+        _mm_storeu_si128( (__m128i *)( peaks + v * 4 ), vmax[v] );
+    }
+    meter_acc_lanes( acc, channels, sums, peaks, vectors * 4, 0 );
+
+    return sample32;
+}
+
+//  ---------------------------------------------------------------------------
+//  Dispatches runs of 32-bit or float samples by number of vectors.
+//  ---------------------------------------------------------------------------
+__attribute__(( target( "sse2" ), always_inline ))
+static inline const int32_t *meter_runs_s24_sse2( const int32_t *sample32,
+                                                  uint32_t blocks,
+                                                  uint8_t vectors,
+                                                  bool is_float,
+                                                  uint8_t channels,
+                                                  struct meter_acc_t *acc )
+{
+    switch ( vectors )
+    {
+        case 1 :
+            return meter_run_s24_sse2( sample32, blocks, 1, is_float,
+                                       channels, acc );
+        case 2 :
+            return meter_run_s24_sse2( sample32, blocks, 2, is_float,
+                                       channels, acc );
+        case 3 :
+            return meter_run_s24_sse2( sample32, blocks, 3, is_float,
+                                       channels, acc );
+        case 5 :
+            return meter_run_s24_sse2( sample32, blocks, 5, is_float,
+                                       channels, acc );
+        default :
+            return meter_run_s24_sse2( sample32, blocks, 7, is_float,
+                                       channels, acc );
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  SSE2 kernel for 32-bit samples.
+//  ---------------------------------------------------------------------------
+__attribute__(( target( "sse2" )))
+void meter_kernel_s32_sse2( const void *samples, uint32_t frames,
+                            uint8_t channels, struct meter_acc_t *acc )
+{
+    const int32_t *sample32 = samples;
+    uint8_t  vectors = meter_lane_vectors( channels, 4 );
+    uint32_t block   = vectors * 4 / channels;
+    uint32_t blocks  = frames / block;
+
+    sample32 = meter_runs_s24_sse2( sample32, blocks, vectors, false,
+                                    channels, acc );
+
+    // Remaining frames.
+    meter_kernel_s32_scalar( sample32, frames - blocks * block, channels,
+                             acc );
+}
+
+//  ---------------------------------------------------------------------------
+//  SSE2 kernel for float samples.
+//  ---------------------------------------------------------------------------
+__attribute__(( target( "sse2" )))
+void meter_kernel_float_sse2( const void *samples, uint32_t frames,
+                              uint8_t channels, struct meter_acc_t *acc )
+{
+    const int32_t *sample32 = samples;
+    uint8_t  vectors = meter_lane_vectors( channels, 4 );
+    uint32_t block   = vectors * 4 / channels;
+    uint32_t blocks  = frames / block;
+
+    sample32 = meter_runs_s24_sse2( sample32, blocks, vectors, true,
+                                    channels, acc );
+
+    // Remaining frames.
+    meter_kernel_float_scalar( sample32, frames - blocks * block, channels,
+                               acc );
+}
+#endif
+
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+//  ---------------------------------------------------------------------------
+//  Adds runs of vectors of 16-bit samples to an accumulator with NEON.
+//  ---------------------------------------------------------------------------
+/*
+    As meter_run_sse2. Squares are widened into 64-bit sums in lane order.
+    Returns the next sample.
+*/
+__attribute__(( always_inline ))
+static inline const int16_t *meter_run_neon( const int16_t *sample16,
+                                             uint32_t blocks, uint8_t vectors,
+                                             bool paired, uint8_t channels,
+                                             struct meter_acc_t *acc )
+{
+    uint64x2_t sum  [METER_VECTORS_MAX][4];
+    int16x8_t  vmax [METER_VECTORS_MAX];
+    int16x8_t  vmin [METER_VECTORS_MAX];
+    int16x8_t  x;
+    uint32x4_t lo, hi;
+    uint64_t   sums  [METER_VECTORS_MAX * 8];
+    uint32_t   peaks [METER_VECTORS_MAX * 8];
+    int16_t    maxs[8], mins[8];
+    uint32_t   i;
+    uint8_t    v, k, lane;
+
+    for ( v = 0; v < vectors; v++ )
+    {
+        for ( k = 0; k < 4; k++ ) sum[v][k] = vdupq_n_u64( 0 );
+        vmax[v] = vdupq_n_s16( 0 );
+        vmin[v] = vdupq_n_s16( 0 );
+    }
+
+    for ( i = 0; i < blocks; i++ )
+    {
+        for ( v = 0; v < vectors; v++ )
+        {
+            x = vld1q_s16( sample16 );
+            sample16 += 8;
+
+            // Squares are never negative so accumulate as unsigned.
+            lo = vreinterpretq_u32_s32( vmull_s16( vget_low_s16( x ),
+                                                   vget_low_s16( x )));
+            hi = vreinterpretq_u32_s32( vmull_s16( vget_high_s16( x ),
+                                                   vget_high_s16( x )));
+            if ( paired ) lo = vaddq_u32( lo, hi );
+
+            sum[v][0] = vaddw_u32( sum[v][0], vget_low_u32( lo ));
+            sum[v][1] = vaddw_u32( sum[v][1], vget_high_u32( lo ));
+            if ( !paired )
+            {
+                sum[v][2] = vaddw_u32( sum[v][2], vget_low_u32( hi ));
+                sum[v][3] = vaddw_u32( sum[v][3], vget_high_u32( hi ));
+            }
+
+            vmax[v] = vmaxq_s16( vmax[v], x );
+            vmin[v] = vminq_s16( vmin[v], x );
+        }
+    }
+
+    for ( v = 0; v < vectors; v++ )
+    {
+        for ( k = 0; k < 4; k++ ) vst1q_u64( sums + v * 8 + k * 2, sum[v][k] );
+        vst1q_s16( maxs, vmax[v] );
+        vst1q_s16( mins, vmin[v] );
+        for ( lane = 0; lane < 8; lane++ )
+            peaks[v * 8 + lane] = maxs[lane] > -mins[lane] ? maxs[lane]
+                                                           : -mins[lane];
+    }
+    meter_acc_lanes( acc, channels, sums, peaks, vectors * 8, 8 );
+
+    return sample16;
+}
+
+//  ---------------------------------------------------------------------------
+//  NEON kernel for Raspberry Pi 2/3.
+//  ---------------------------------------------------------------------------
+/*
+    Processes 8 samples per vector, whatever the number of channels.
+*/
+void meter_kernel_neon( const void *samples, uint32_t frames,
+                        uint8_t channels, struct meter_acc_t *acc )
+{
+    const int16_t *sample16 = samples;
+    uint8_t  vectors = meter_lane_vectors( channels, 8 );
+    uint32_t block   = vectors * 8 / channels;
+    uint32_t blocks  = frames / block;
+
+    switch ( vectors )
+    {
+        case 1 :
+            if ( channels == 8 )
+                sample16 = meter_run_neon( sample16, blocks, 1, false,
+                                           channels, acc );
+            else
+                sample16 = meter_run_neon( sample16, blocks, 1, true,
+                                           channels, acc );
+            break;
+        case 3 :
+            sample16 = meter_run_neon( sample16, blocks, 3, false,
+                                       channels, acc );
+            break;
+        case 5 :
+            sample16 = meter_run_neon( sample16, blocks, 5, false,
+                                       channels, acc );
+            break;
+        default :
+            sample16 = meter_run_neon( sample16, blocks, 7, false,
+                                       channels, acc );
+            break;
+    }
+
+    // Remaining frames.
+    meter_kernel_scalar( sample16, frames - blocks * block, channels, acc );
+}
+
+//  ---------------------------------------------------------------------------
+//  Adds runs of vectors of 32-bit or float samples to an accumulator.
+//  ---------------------------------------------------------------------------
+/*
+    Normalised samples are 24-bit so abs can't overflow. vcvtq_s32_f32
+    truncates towards zero, as the scalar kernel does. Returns the next
+    sample.
+*/
+__attribute__(( always_inline ))
+static inline const int32_t *meter_run_s24_neon( const int32_t *sample32,
+                                                 uint32_t blocks,
+                                                 uint8_t vectors,
+                                                 bool is_float,
+                                                 uint8_t channels,
+                                                 struct meter_acc_t *acc )
+{
+    uint64x2_t  sum  [METER_VECTORS_MAX][2];
+    uint32x4_t  vmax [METER_VECTORS_MAX];
+    float32x4_t high = vdupq_n_f32( 8388607.0f );
+    float32x4_t low  = vdupq_n_f32( -8388608.0f );
+    float32x4_t f;
+    int32x4_t   x;
+    uint32x4_t  abs;
+    uint64_t    sums  [METER_VECTORS_MAX * 4];
+    uint32_t    peaks [METER_VECTORS_MAX * 4];
+    uint32_t    i;
+    uint8_t     v;
+
+    for ( v = 0; v < vectors; v++ )
+    {
+        sum[v][0] = vdupq_n_u64( 0 );
+        sum[v][1] = vdupq_n_u64( 0 );
+        vmax[v]   = vdupq_n_u32( 0 );
+    }
+
+    for ( i = 0; i < blocks; i++ )
+    {
+        for ( v = 0; v < vectors; v++ )
+        {
+            if ( is_float )
+            {
+                f = vmulq_n_f32( vld1q_f32( (const float *) sample32 ),
+                                 8388608.0f );
+                x = vcvtq_s32_f32( vmaxq_f32( vminq_f32( f, high ), low ));
+            }
+            else x = vshrq_n_s32( vld1q_s32( sample32 ), 8 );
+            sample32 += 4;
+
+            abs = vreinterpretq_u32_s32( vabsq_s32( x ));
+            sum[v][0] = vmlal_u32( sum[v][0], vget_low_u32( abs ),
+                                   vget_low_u32( abs ));
+            sum[v][1] = vmlal_u32( sum[v][1], vget_high_u32( abs ),
+                                   vget_high_u32( abs ));
+            vmax[v] = vmaxq_u32( vmax[v], abs );
+        }
+    }
+
+    for ( v = 0; v < vectors; v++ )
+    {
+        vst1q_u64( sums + v * 4, sum[v][0] );
+        vst1q_u64( sums + v * 4 + 2, sum[v][1] );
+        vst1q_u32( peaks + v * 4, vmax[v] );
+    }
+    meter_acc_lanes( acc, channels, sums, peaks, vectors * 4, 0 );
+
+    return sample32;
+}
+
+//  ---------------------------------------------------------------------------
+//  Dispatches runs of 32-bit or float samples by number of vectors.
+//  ---------------------------------------------------------------------------
+__attribute__(( always_inline ))
+static inline const int32_t *meter_runs_s24_neon( const int32_t *sample32,
+                                                  uint32_t blocks,
+                                                  uint8_t vectors,
+                                                  bool is_float,
+                                                  uint8_t channels,
+                                                  struct meter_acc_t *acc )
+{
+    switch ( vectors )
+    {
+        case 1 :
+            return meter_run_s24_neon( sample32, blocks, 1, is_float,
+                                       channels, acc );
+        case 2 :
+            return meter_run_s24_neon( sample32, blocks, 2, is_float,
+                                       channels, acc );
+        case 3 :
+            return meter_run_s24_neon( sample32, blocks, 3, is_float,
+                                       channels, acc );
+        case 5 :
+            return meter_run_s24_neon( sample32, blocks, 5, is_float,
+                                       channels, acc );
+        default :
+            return meter_run_s24_neon( sample32, blocks, 7, is_float,
+                                       channels, acc );
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  NEON kernel for 32-bit samples.
+//  ---------------------------------------------------------------------------
+void meter_kernel_s32_neon( const void *samples, uint32_t frames,
+                            uint8_t channels, struct meter_acc_t *acc )
+{
+    const int32_t *sample32 = samples;
+    uint8_t  vectors = meter_lane_vectors( channels, 4 );
+    uint32_t block   = vectors * 4 / channels;
+    uint32_t blocks  = frames / block;
+
+    sample32 = meter_runs_s24_neon( sample32, blocks, vectors, false,
+                                    channels, acc );
+
+    // Remaining frames.
+    meter_kernel_s32_scalar( sample32, frames - blocks * block, channels,
+                             acc );
+}
+
+//  ---------------------------------------------------------------------------
+//  NEON kernel for float samples.
+//  ---------------------------------------------------------------------------
+void meter_kernel_float_neon( const void *samples, uint32_t frames,
+                              uint8_t channels, struct meter_acc_t *acc )
+{
+    const int32_t *sample32 = samples;
+    uint8_t  vectors = meter_lane_vectors( channels, 4 );
+    uint32_t block   = vectors * 4 / channels;
+    uint32_t blocks  = frames / block;
+
+    sample32 = meter_runs_s24_neon( sample32, blocks, vectors, true,
+                                    channels, acc );
+
+    // Remaining frames.
+    meter_kernel_float_scalar( sample32, frames - blocks * block, channels,
+                               acc );
+}
+#endif
+
+//  ---------------------------------------------------------------------------
+//  Returns true if the running CPU has NEON.
+//  ---------------------------------------------------------------------------
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+static bool meter_has_neon( void )
+{
+#if defined( __arm__ )
+    // NEON is optional on ARMv7 so check the kernel reports it.
+    return getauxval( AT_HWCAP ) & HWCAP_NEON;
+#else
+    return true;
+#endif
+}
+#endif
+
+//  ---------------------------------------------------------------------------
+//  Returns the fastest kernel for a format supported by the running CPU.
+//  ---------------------------------------------------------------------------
+meter_kernel_t meter_kernel_select( uint8_t format )
+{
+    static const meter_kernel_t scalar[METER_FORMATS] =
+        { meter_kernel_scalar, meter_kernel_s24_scalar,
+          meter_kernel_s32_scalar, meter_kernel_float_scalar };
+
+    if ( format >= METER_FORMATS ) format = METER_S16;
+
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+    if ( meter_has_neon() )
+    {
+        static const meter_kernel_t neon[METER_FORMATS] =
+            { meter_kernel_neon, meter_kernel_s24_scalar,
+              meter_kernel_s32_neon, meter_kernel_float_neon };
+        return neon[format];
+    }
+#endif
+
+#if defined( __i386__ ) || defined( __x86_64__ )
+#if defined( __i386__ )
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "sse2" ))
+#endif
+    {
+        static const meter_kernel_t sse2[METER_FORMATS] =
+            { meter_kernel_sse2, meter_kernel_s24_scalar,
+              meter_kernel_s32_sse2, meter_kernel_float_sse2 };
+        return sse2[format];
+    }
+#endif
+
+    return scalar[format];
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the name of a kernel.
+//  ---------------------------------------------------------------------------
+const char *meter_kernel_name( meter_kernel_t kernel )
+{
+#if defined( __i386__ ) || defined( __x86_64__ )
+    if ( kernel == meter_kernel_sse2 ||
+         kernel == meter_kernel_s32_sse2 ||
+         kernel == meter_kernel_float_sse2 ) return "sse2";
+#endif
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+    if ( kernel == meter_kernel_neon ||
+         kernel == meter_kernel_s32_neon ||
+         kernel == meter_kernel_float_neon ) return "neon";
+#endif
+    if ( kernel == meter_kernel_scalar ||
+         kernel == meter_kernel_s24_scalar ||
+         kernel == meter_kernel_s32_scalar ||
+         kernel == meter_kernel_float_scalar ) return "scalar";
+    return "unknown";
+}
+
+//  ---------------------------------------------------------------------------
+//  Converts 24-bit frames in 3 bytes to 16-bit.
+//  ---------------------------------------------------------------------------
+static void meter_convert_s24( const void *samples, uint32_t frames,
+                               uint8_t channels, int16_t *buffer )
+{
+    const uint8_t *bytes = samples;
+    uint32_t i;
+
+    for ( i = 0; i < frames * channels; i++, bytes += 3 )
+        buffer[i] = (int16_t)( bytes[1] | bytes[2] << 8 );
+}
+
+//  ---------------------------------------------------------------------------
+//  Converts 32-bit frames to 16-bit.
+//  ---------------------------------------------------------------------------
+static void meter_convert_s32( const void *samples, uint32_t frames,
+                               uint8_t channels, int16_t *buffer )
+{
+    const int32_t *sample32 = samples;
+    uint32_t i;
+
+    for ( i = 0; i < frames * channels; i++ )
+        buffer[i] = sample32[i] >> 16;
+}
+
+//  ---------------------------------------------------------------------------
+//  Converts float frames to 16-bit.
+//  ---------------------------------------------------------------------------
+static void meter_convert_float( const void *samples, uint32_t frames,
+                                 uint8_t channels, int16_t *buffer )
+{
+    const float *samplef = samples;
+    uint32_t i;
+
+    for ( i = 0; i < frames * channels; i++ )
+        buffer[i] = meter_float_s24( samplef[i] ) >> 8;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the function that converts a format to 16-bit.
+//  ---------------------------------------------------------------------------
+meter_convert_t meter_convert_select( uint8_t format )
+{
+    switch ( format )
+    {
+        case METER_S24   : return meter_convert_s24;
+        case METER_S32   : return meter_convert_s32;
+        case METER_FLOAT : return meter_convert_float;
+        default          : return NULL;
+    }
+}
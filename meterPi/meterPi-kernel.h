@@ -0,0 +1,216 @@
+//  ===========================================================================
+/*
+    meterPi-kernel:
+
+    Accumulation kernels for meterPi. Computes sum of squares and absolute
+    peak per channel over spans of interleaved frames.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+
+    Changelog:
+
+        v01.00      Original version.
+        v01.01      Added 24-bit, 32-bit and float sample formats.
+        v01.02      Added runtime channel count.
+*/
+//  ===========================================================================
+
+#ifndef METERPI_KERNEL_H
+#define METERPI_KERNEL_H
+
+//  Info. ---------------------------------------------------------------------
+/*
+    The metering loop is the hottest part of meterPi so there are three
+    versions of it:
+
+        scalar - Reference version, used on the ARMv6 Pi 1 and Zero.
+        neon   - Pi 2/3, when compiled with -mfpu=neon-vfpv4 (or aarch64).
+        sse2   - x86 hosts, used for testing away from the Pi.
+
+    All versions must give bit-identical results to the scalar version.
+    The kernel is chosen at runtime by meter_kernel_select().
+
+    Kernels add to the accumulator rather than overwrite it, so a window
+    that wraps around the end of a ring buffer can be processed as two
+    contiguous spans without checking for the wrap on every sample.
+
+    There is a kernel for each sample format so the format is only checked
+    once per span, never per sample. All formats are normalised to 24-bit,
+    i.e. full scale is METER_FULL_SCALE whatever the source, so a meter
+    gives the same result for the same audio in any format:
+
+        S16   - 16-bit, shifted up by 8 bits.
+        S24   - 24-bit packed in 3 bytes (S24_3LE), used as is.
+        S32   - 32-bit, shifted down by 8 bits.
+        FLOAT - 32-bit float, +/-1.0 full scale, clipped to full scale and
+                truncated towards zero as every SIMD unit can do that.
+
+    S24 is scalar only as 3 byte samples don't suit SSE2 or NEON loads.
+    Float samples must not be NaN.
+
+    The number of interleaved channels is passed to each kernel, from 1 to
+    METER_CHANNELS_MAX. The SIMD kernels don't de-interleave. Interleaved
+    frames repeat their pattern of channels every lcm( channels, lanes )
+    samples, so each vector in a run of that many samples always holds the
+    same channels in the same lanes and keeps its own sums. All channels
+    are metered in one pass and the lanes are only added into channels at
+    the end, e.g. with 8 lanes of 16-bit samples:
+
+        channels    vectors per run    frames per run
+        1, 2, 4, 8  1                  8 / channels
+        3, 6        3                  24 / channels
+        5           5                  8
+        7           7                  8
+
+    Sums and peaks are kept as arrays per channel, i.e. structure of
+    arrays, so per-channel work after a kernel is a simple loop.
+*/
+
+//  Macros. -------------------------------------------------------------------
+
+#define METER_FORMATS    4       // Number of sample formats.
+#define METER_FULL_SCALE 8388608 // Full scale of normalised samples.
+
+//  Types. --------------------------------------------------------------------
+
+enum meter_format_t
+{
+    METER_S16,   // Signed 16-bit little endian.
+    METER_S24,   // Signed 24-bit little endian in 3 bytes.
+    METER_S32,   // Signed 32-bit little endian.
+    METER_FLOAT  // 32-bit float little endian.
+};
+
+struct meter_acc_t
+{
+    uint64_t sum_squares [METER_CHANNELS_MAX]; // Sum of squared samples.
+    uint32_t peak        [METER_CHANNELS_MAX]; // Absolute sample peak.
+};
+
+struct meter_span_t
+{
+    const void *samples; // First sample of span (interleaved frames).
+    uint32_t    frames;  // Number of frames in span.
+};
+
+typedef void ( *meter_kernel_t )( const void *samples, uint32_t frames,
+                                  uint8_t channels, struct meter_acc_t *acc );
+
+/*
+    Converts frames to 16-bit for analysis stages.
+*/
+typedef void ( *meter_convert_t )( const void *samples, uint32_t frames,
+                                   uint8_t channels, int16_t *buffer );
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Clears an accumulator.
+//  ---------------------------------------------------------------------------
+void meter_acc_clear( struct meter_acc_t *acc );
+
+//  ---------------------------------------------------------------------------
+//  Returns the size of a sample in a format (bytes).
+//  ---------------------------------------------------------------------------
+uint8_t meter_format_width( uint8_t format );
+
+//  ---------------------------------------------------------------------------
+//  Returns the name of a sample format.
+//  ---------------------------------------------------------------------------
+const char *meter_format_name( uint8_t format );
+
+//  ---------------------------------------------------------------------------
+//  Splits a window of a ring buffer into at most two contiguous spans.
+//  ---------------------------------------------------------------------------
+/*
+    For a ring of 16-bit stereo frames, i.e. a Squeezelite buffer. size and
+    start are in samples, frames is the length of the window. Returns the
+    number of spans used.
+*/
+uint8_t meter_ring_spans( const int16_t *ring, uint32_t size, uint32_t start,
+                          uint32_t frames, struct meter_span_t span[2] );
+
+//  ---------------------------------------------------------------------------
+//  Splits a window of a ring buffer of any format into contiguous spans.
+//  ---------------------------------------------------------------------------
+/*
+    As meter_ring_spans, for a ring of frames of channels in format.
+*/
+uint8_t meter_format_spans( const void *ring, uint8_t format,
+                            uint8_t channels, uint32_t size, uint32_t start,
+                            uint32_t frames, struct meter_span_t span[2] );
+
+//  ---------------------------------------------------------------------------
+//  Reference kernels.
+//  ---------------------------------------------------------------------------
+void meter_kernel_scalar( const void *samples, uint32_t frames,
+                          uint8_t channels, struct meter_acc_t *acc );
+void meter_kernel_s24_scalar( const void *samples, uint32_t frames,
+                              uint8_t channels, struct meter_acc_t *acc );
+void meter_kernel_s32_scalar( const void *samples, uint32_t frames,
+                              uint8_t channels, struct meter_acc_t *acc );
+void meter_kernel_float_scalar( const void *samples, uint32_t frames,
+                                uint8_t channels, struct meter_acc_t *acc );
+
+#if defined( __i386__ ) || defined( __x86_64__ )
+//  ---------------------------------------------------------------------------
+//  SSE2 kernels for x86 hosts.
+//  ---------------------------------------------------------------------------
+void meter_kernel_sse2( const void *samples, uint32_t frames,
+                        uint8_t channels, struct meter_acc_t *acc );
+void meter_kernel_s32_sse2( const void *samples, uint32_t frames,
+                            uint8_t channels, struct meter_acc_t *acc );
+void meter_kernel_float_sse2( const void *samples, uint32_t frames,
+                              uint8_t channels, struct meter_acc_t *acc );
+#endif
+
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+//  ---------------------------------------------------------------------------
+//  NEON kernels for Raspberry Pi 2/3.
+//  ---------------------------------------------------------------------------
+void meter_kernel_neon( const void *samples, uint32_t frames,
+                        uint8_t channels, struct meter_acc_t *acc );
+void meter_kernel_s32_neon( const void *samples, uint32_t frames,
+                            uint8_t channels, struct meter_acc_t *acc );
+void meter_kernel_float_neon( const void *samples, uint32_t frames,
+                              uint8_t channels, struct meter_acc_t *acc );
+#endif
+
+//  ---------------------------------------------------------------------------
+//  Returns the fastest kernel for a format supported by the running CPU.
+//  ---------------------------------------------------------------------------
+meter_kernel_t meter_kernel_select( uint8_t format );
+
+//  ---------------------------------------------------------------------------
+//  Returns the function that converts a format to 16-bit.
+//  ---------------------------------------------------------------------------
+/*
+    16-bit frames need no conversion so NULL is returned for METER_S16.
+*/
+meter_convert_t meter_convert_select( uint8_t format );
+
+//  ---------------------------------------------------------------------------
+//  Returns the name of a kernel.
+//  ---------------------------------------------------------------------------
+const char *meter_kernel_name( meter_kernel_t kernel );
+
+#endif // #ifndef METERPI_KERNEL_H
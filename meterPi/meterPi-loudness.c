@@ -0,0 +1,372 @@
+//  ===========================================================================
+/*
+    meterPi-loudness:
+
+    Loudness metering for meterPi as described in ITU-R BS.1770-4,
+    EBU R128, EBU Tech 3341 (momentary, short-term and integrated) and
+    EBU Tech 3342 (loudness range).
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Compile with meterPi.c.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+*/
+//  ===========================================================================
+
+//  Installed libraries -------------------------------------------------------
+
+#include <stdbool.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+
+//  Local libraries -----------------------------------------------------------
+
+#include "meterPi.h"
+#include "meterPi-loudness.h"
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Calculates K-weighting filter coefficients for a sample rate.
+//  ---------------------------------------------------------------------------
+/*
+    BS.1770 only gives coefficients for 48kHz. These are the analogue
+    prototypes of those filters, transformed for any rate, which give the
+    published coefficients at 48kHz.
+*/
+static void loudness_set_rate( struct loudness_t *loudness, uint32_t rate )
+{
+    double f0, gain, q, k, vh, vb, a0;
+
+    loudness->rate = rate;
+    loudness->hop_frames = ( rate * LOUDNESS_HOP_MS + 500 ) / 1000;
+    if ( rate == 0 ) return;
+
+    // High shelf.
+    f0   = 1681.974450955533;
+    gain = 3.999843853973347;
+    q    = 0.7071752369554196;
+    k    = tan( M_PI * f0 / rate );
+    vh   = pow( 10.0, gain / 20.0 );
+    vb   = pow( vh, 0.4996667741545416 );
+    a0   = 1.0 + k / q + k * k;
+
+    loudness->shelf.b0 = ( vh + vb * k / q + k * k ) / a0;
+    loudness->shelf.b1 = 2.0 * ( k * k - vh ) / a0;
+    loudness->shelf.b2 = ( vh - vb * k / q + k * k ) / a0;
+    loudness->shelf.a1 = 2.0 * ( k * k - 1.0 ) / a0;
+    loudness->shelf.a2 = ( 1.0 - k / q + k * k ) / a0;
+
+    // High pass.
+    f0 = 38.13547087602444;
+    q  = 0.5003270373238773;
+    k  = tan( M_PI * f0 / rate );
+    a0 = 1.0 + k / q + k * k;
+
+    loudness->highpass.b0 =  1.0;
+    loudness->highpass.b1 = -2.0;
+    loudness->highpass.b2 =  1.0;
+    loudness->highpass.a1 = 2.0 * ( k * k - 1.0 ) / a0;
+    loudness->highpass.a2 = ( 1.0 - k / q + k * k ) / a0;
+}
+
+//  ---------------------------------------------------------------------------
+//  Creates a loudness meter. Returns NULL if out of memory.
+//  ---------------------------------------------------------------------------
+struct loudness_t *loudness_create( void )
+{
+    struct loudness_t *loudness = calloc( 1, sizeof( struct loudness_t ));
+
+    return loudness;
+}
+
+//  ---------------------------------------------------------------------------
+//  Frees a loudness meter.
+//  ---------------------------------------------------------------------------
+void loudness_destroy( struct loudness_t *loudness )
+{
+    free( loudness );
+}
+
+//  ---------------------------------------------------------------------------
+//  Restarts the loudness windows after a gap or rate change.
+//  ---------------------------------------------------------------------------
+void loudness_reset( void *state, uint32_t rate, uint8_t channels )
+{
+    static const double surround[6] = { 1.0, 1.0, 1.0, 0.0, 1.41, 1.41 };
+    struct loudness_t *loudness = state;
+    uint8_t channel;
+
+    if ( rate != loudness->rate ) loudness_set_rate( loudness, rate );
+
+    loudness->channels = channels;
+    for ( channel = 0; channel < channels; channel++ )
+        loudness->weight[channel] = channels == 6 ? surround[channel] : 1.0;
+
+    memset( loudness->z,       0, sizeof( loudness->z ));
+    memset( loudness->hop_sum, 0, sizeof( loudness->hop_sum ));
+    loudness->hop_pos   = 0;
+    loudness->hop_index = 0;
+    loudness->hop_count = 0;
+}
+
+//  ---------------------------------------------------------------------------
+//  Clears integrated loudness, range and maximum momentary loudness.
+//  ---------------------------------------------------------------------------
+void loudness_clear( struct loudness_t *loudness )
+{
+    memset( &loudness->integrated, 0, sizeof( loudness->integrated ));
+    memset( &loudness->range,      0, sizeof( loudness->range ));
+    loudness->max_momentary = 0;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the loudness of an energy (LUFS).
+//  ---------------------------------------------------------------------------
+static double loudness_lufs( double energy )
+{
+    if ( energy <= 0 ) return -HUGE_VAL;
+    return -0.691 + 10 * log10( energy );
+}
+
+//  ---------------------------------------------------------------------------
+//  Adds a block to a histogram if it is above the absolute gate.
+//  ---------------------------------------------------------------------------
+static void loudness_hist_add( struct loudness_hist_t *hist, double energy )
+{
+    double  lufs = loudness_lufs( energy );
+    int32_t bin;
+
+    if ( lufs < LOUDNESS_FLOOR ) return;
+
+    bin = ( lufs - LOUDNESS_FLOOR ) * LOUDNESS_BINS_PER_LU;
+    if ( bin >= LOUDNESS_BINS ) bin = LOUDNESS_BINS - 1;
+
+    hist->count[bin]++;
+    hist->energy[bin] += energy;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the first histogram bin above a relative gate.
+//  ---------------------------------------------------------------------------
+/*
+    The gate is relative to the loudness of the mean energy of all blocks
+    in the histogram. Returns LOUDNESS_BINS if the histogram is empty.
+*/
+static uint16_t loudness_hist_gate( struct loudness_hist_t *hist,
+                                    int8_t gate )
+{
+    double   energy = 0;
+    uint32_t count  = 0;
+    double   threshold;
+    uint16_t bin;
+
+    for ( bin = 0; bin < LOUDNESS_BINS; bin++ )
+    {
+        count  += hist->count[bin];
+        energy += hist->energy[bin];
+    }
+    if ( count == 0 ) return LOUDNESS_BINS;
+
+    threshold = loudness_lufs( energy / count ) + gate;
+    if ( threshold < LOUDNESS_FLOOR ) return 0;
+
+    bin = ceil(( threshold - LOUDNESS_FLOOR ) * LOUDNESS_BINS_PER_LU );
+    return bin < LOUDNESS_BINS ? bin : LOUDNESS_BINS - 1;
+}
+
+//  ---------------------------------------------------------------------------
+//  Ends a hop and updates the blocks that end with it.
+//  ---------------------------------------------------------------------------
+static void loudness_hop( struct loudness_t *loudness )
+{
+    double  energy = 0;
+    uint8_t channel, i, hop;
+
+    for ( channel = 0; channel < loudness->channels; channel++ )
+    {
+        energy += loudness->weight[channel] * loudness->hop_sum[channel] /
+                  loudness->hop_frames;
+        loudness->hop_sum[channel] = 0;
+    }
+    loudness->hop_pos = 0;
+
+    loudness->hops[loudness->hop_index] = energy;
+    loudness->hop_index = ( loudness->hop_index + 1 ) % LOUDNESS_SHORT_HOPS;
+    if ( loudness->hop_count < LOUDNESS_SHORT_HOPS ) loudness->hop_count++;
+
+    // Momentary block, 75% overlap.
+    if ( loudness->hop_count >= LOUDNESS_MOMENTARY_HOPS )
+    {
+        energy = 0;
+        for ( i = 1; i <= LOUDNESS_MOMENTARY_HOPS; i++ )
+        {
+            hop = ( loudness->hop_index + LOUDNESS_SHORT_HOPS - i ) %
+                  LOUDNESS_SHORT_HOPS;
+            energy += loudness->hops[hop];
+        }
+        energy /= LOUDNESS_MOMENTARY_HOPS;
+
+        loudness_hist_add( &loudness->integrated, energy );
+        if ( energy > loudness->max_momentary )
+            loudness->max_momentary = energy;
+    }
+
+    // Short-term block, at the same 10Hz rate for range.
+    if ( loudness->hop_count >= LOUDNESS_SHORT_HOPS )
+    {
+        energy = 0;
+        for ( i = 0; i < LOUDNESS_SHORT_HOPS; i++ )
+            energy += loudness->hops[i];
+        loudness_hist_add( &loudness->range, energy / LOUDNESS_SHORT_HOPS );
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  K-weights interleaved frames and updates the loudness blocks.
+//  ---------------------------------------------------------------------------
+/*
+    Transposed direct form II biquads in double precision. The high pass
+    is at 38Hz, which is too close to DC for single precision at 384kHz.
+*/
+void loudness_process( void *state, const int16_t *samples, uint32_t frames )
+{
+    struct loudness_t        *loudness = state;
+    struct loudness_biquad_t *shelf    = &loudness->shelf;
+    struct loudness_biquad_t *highpass = &loudness->highpass;
+    double   x, y, *z;
+    uint32_t i;
+    uint8_t  channels = loudness->channels;
+    uint8_t  channel;
+
+    if ( loudness->hop_frames == 0 || channels == 0 ) return;
+
+    for ( i = 0; i < frames; i++ )
+    {
+        for ( channel = 0; channel < channels; channel++ )
+        {
+            z = loudness->z[channel];
+            x = *samples++ * ( 1.0 / 32768 );
+
+            y    = shelf->b0 * x + z[0];
+            z[0] = shelf->b1 * x - shelf->a1 * y + z[1];
+            z[1] = shelf->b2 * x - shelf->a2 * y;
+
+            x    = y;
+            y    = highpass->b0 * x + z[2];
+            z[2] = highpass->b1 * x - highpass->a1 * y + z[3];
+            z[3] = highpass->b2 * x - highpass->a2 * y;
+
+            loudness->hop_sum[channel] += y * y;
+        }
+
+        if ( ++loudness->hop_pos == loudness->hop_frames )
+            loudness_hop( loudness );
+    }
+
+    // Filter states decay to denormals in silence, which are very slow.
+    for ( channel = 0; channel < channels; channel++ )
+        for ( i = 0; i < 4; i++ )
+            if ( fabs( loudness->z[channel][i] ) < 1e-20 )
+                loudness->z[channel][i] = 0;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the loudness of the newest hops in a ring (LUFS).
+//  ---------------------------------------------------------------------------
+static float loudness_window( struct loudness_t *loudness, uint8_t hops )
+{
+    double  energy = 0;
+    uint8_t i;
+
+    if ( loudness->hop_count < hops ) return LOUDNESS_FLOOR;
+
+    for ( i = 1; i <= hops; i++ )
+        energy += loudness->hops[( loudness->hop_index +
+                                   LOUDNESS_SHORT_HOPS - i ) %
+                                 LOUDNESS_SHORT_HOPS];
+    energy = loudness_lufs( energy / hops );
+
+    return energy < LOUDNESS_FLOOR ? LOUDNESS_FLOOR : energy;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the current loudness readings.
+//  ---------------------------------------------------------------------------
+void loudness_read( struct loudness_t *loudness,
+                    struct loudness_meter_t *loudness_meter )
+{
+    struct   loudness_hist_t *hist;
+    double   energy = 0;
+    uint32_t count  = 0, total = 0, low, high;
+    uint16_t gate, bin;
+
+    loudness_meter->momentary =
+        loudness_window( loudness, LOUDNESS_MOMENTARY_HOPS );
+    loudness_meter->short_term =
+        loudness_window( loudness, LOUDNESS_SHORT_HOPS );
+
+    loudness_meter->max_momentary = loudness->max_momentary > 0 ?
+        loudness_lufs( loudness->max_momentary ) : LOUDNESS_FLOOR;
+    if ( loudness_meter->max_momentary < LOUDNESS_FLOOR )
+         loudness_meter->max_momentary = LOUDNESS_FLOOR;
+
+    // Integrated loudness is the mean energy of the gated blocks.
+    hist = &loudness->integrated;
+    gate = loudness_hist_gate( hist, LOUDNESS_GATE_INTEGRATED );
+    for ( bin = gate; bin < LOUDNESS_BINS; bin++ )
+    {
+        count  += hist->count[bin];
+        energy += hist->energy[bin];
+    }
+    loudness_meter->integrated = count ? loudness_lufs( energy / count )
+                                       : LOUDNESS_FLOOR;
+
+    /*
+        Range is the spread of the 10th and 95th percentiles of the gated
+        short-term blocks, to the resolution of the bins.
+    */
+    hist = &loudness->range;
+    gate = loudness_hist_gate( hist, LOUDNESS_GATE_RANGE );
+    for ( bin = gate; bin < LOUDNESS_BINS; bin++ ) total += hist->count[bin];
+
+    loudness_meter->range = 0;
+    if ( total == 0 ) return;
+
+    low = high = LOUDNESS_BINS;
+    count = 0;
+    for ( bin = gate; bin < LOUDNESS_BINS; bin++ )
+    {
+        count += hist->count[bin];
+        if ( low == LOUDNESS_BINS &&
+             (uint64_t) count * 100 > (uint64_t) total * 10 ) low = bin;
+        if ( high == LOUDNESS_BINS &&
+             (uint64_t) count * 100 >= (uint64_t) total * 95 ) high = bin;
+    }
+    loudness_meter->range = (float)( high - low ) / LOUDNESS_BINS_PER_LU;
+}
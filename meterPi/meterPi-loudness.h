@@ -0,0 +1,168 @@
+//  ===========================================================================
+/*
+    meterPi-loudness:
+
+    Loudness metering for meterPi as described in ITU-R BS.1770-4,
+    EBU R128, EBU Tech 3341 (momentary, short-term and integrated) and
+    EBU Tech 3342 (loudness range).
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+
+    Changelog:
+
+        v01.00      Original version.
+        v01.01      Added runtime channel count with 5.1 weights.
+*/
+//  ===========================================================================
+
+#ifndef METERPI_LOUDNESS_H
+#define METERPI_LOUDNESS_H
+
+//  Info. ---------------------------------------------------------------------
+/*
+    Loudness is the mean square of the K-weighted signal, summed over the
+    channels, in LUFS:
+
+        L = -0.691 + 10log10( sum( G[c] * mean( z[c]^2 )))
+
+    K-weighting is a high shelf (head effects) followed by a high pass
+    (RLB). G is 1 for left and right.
+
+    Momentary loudness is over 400ms and short-term loudness over 3s, both
+    updated every 100ms. The mean square of each 100ms hop is kept in a
+    small ring, so a refresh only filters the new frames and the windows
+    are sums over 4 or 30 hops.
+
+    Integrated loudness is gated. Blocks below -70LUFS are ignored and the
+    remaining blocks are gated again at 10LU below their mean. Loudness
+    range is the spread between the 10th and 95th percentiles of the
+    short-term loudness, gated at -70LUFS and 20LU below the mean. Rather
+    than keeping every block, blocks are counted into histograms of 0.1LU
+    bins from -70LUFS to +5LUFS, so memory and the cost of a read are fixed
+    however long the meter runs.
+*/
+
+//  Macros. -------------------------------------------------------------------
+
+#define LOUDNESS_HOP_MS          100  // Block update period (ms).
+#define LOUDNESS_MOMENTARY_HOPS  4    // Momentary window (hops).
+#define LOUDNESS_SHORT_HOPS      30   // Short-term window (hops).
+#define LOUDNESS_FLOOR          -70   // Absolute gate (LUFS).
+#define LOUDNESS_CEILING         5    // Top of histograms (LUFS).
+#define LOUDNESS_BINS_PER_LU     10   // Histogram resolution.
+#define LOUDNESS_BINS ( ( LOUDNESS_CEILING - LOUDNESS_FLOOR ) * \
+                        LOUDNESS_BINS_PER_LU )
+#define LOUDNESS_GATE_INTEGRATED -10  // Relative gate for integrated (LU).
+#define LOUDNESS_GATE_RANGE      -20  // Relative gate for range (LU).
+
+//  Types. --------------------------------------------------------------------
+
+struct loudness_biquad_t
+{
+    double b0, b1, b2; // Feed forward coefficients.
+    double a1, a2;     // Feedback coefficients (a0 = 1).
+};
+
+/*
+    Histogram of gated blocks. Energies are summed per bin so that the
+    gated means are exact, only the gate threshold is rounded to a bin.
+*/
+struct loudness_hist_t
+{
+    uint32_t count  [LOUDNESS_BINS]; // Blocks per bin.
+    double   energy [LOUDNESS_BINS]; // Sum of block energies per bin.
+};
+
+struct loudness_t
+{
+    uint32_t rate;                         // Sample rate of coefficients.
+    uint32_t hop_frames;                   // Frames per hop.
+    uint32_t hop_pos;                      // Frames in current hop.
+    struct   loudness_biquad_t shelf;      // Stage 1 of K-weighting.
+    struct   loudness_biquad_t highpass;   // Stage 2 of K-weighting.
+    uint8_t  channels;                     // Interleaved channels.
+    double   weight   [METER_CHANNELS_MAX];    // Channel weights.
+    double   z        [METER_CHANNELS_MAX][4]; // Filter states.
+    double   hop_sum  [METER_CHANNELS_MAX];    // Sum of squares in hop.
+    double   hops     [LOUDNESS_SHORT_HOPS]; // Mean square of recent hops.
+    uint8_t  hop_index;                    // Next hop in ring.
+    uint8_t  hop_count;                    // Hops in ring.
+    double   max_momentary;                // Largest momentary energy.
+    struct   loudness_hist_t integrated;   // Momentary blocks.
+    struct   loudness_hist_t range;        // Short-term blocks.
+};
+
+/*
+    Loudness readings in LUFS, or LOUDNESS_FLOOR if there isn't enough
+    audio yet. Range is in LU.
+*/
+struct loudness_meter_t
+{
+    float momentary;     // 400ms loudness.
+    float short_term;    // 3s loudness.
+    float integrated;    // Gated loudness since last clear.
+    float range;         // Loudness range (LRA) since last clear.
+    float max_momentary; // Largest momentary loudness since last clear.
+};
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Creates a loudness meter. Returns NULL if out of memory.
+//  ---------------------------------------------------------------------------
+struct loudness_t *loudness_create( void );
+
+//  ---------------------------------------------------------------------------
+//  Frees a loudness meter.
+//  ---------------------------------------------------------------------------
+void loudness_destroy( struct loudness_t *loudness );
+
+//  ---------------------------------------------------------------------------
+//  Restarts the loudness windows after a gap or rate change.
+//  ---------------------------------------------------------------------------
+/*
+    Integrated loudness and range carry on across gaps, e.g. between
+    tracks. Use loudness_clear to start them again. Channels are weighted
+    1.0 except for 6 channels, which are taken as 5.1 in WAV order
+    (L, R, C, LFE, Ls, Rs) and weighted as BS.1770, i.e. LFE is left out
+    and the surrounds are weighted 1.41.
+*/
+void loudness_reset( void *loudness, uint32_t rate, uint8_t channels );
+
+//  ---------------------------------------------------------------------------
+//  Clears integrated loudness, range and maximum momentary loudness.
+//  ---------------------------------------------------------------------------
+void loudness_clear( struct loudness_t *loudness );
+
+//  ---------------------------------------------------------------------------
+//  K-weights interleaved frames and updates the loudness blocks.
+//  ---------------------------------------------------------------------------
+void loudness_process( void *loudness, const int16_t *samples,
+                       uint32_t frames );
+
+//  ---------------------------------------------------------------------------
+//  Returns the current loudness readings.
+//  ---------------------------------------------------------------------------
+void loudness_read( struct loudness_t *loudness,
+                    struct loudness_meter_t *loudness_meter );
+
+#endif // #ifndef METERPI_LOUDNESS_H
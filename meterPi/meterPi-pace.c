@@ -0,0 +1,178 @@
+//  ===========================================================================
+/*
+    meterPi-pace:
+
+    Paced refresh loop for meterPi displays. Wakes at the display refresh
+    rate on absolute deadlines instead of polling.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Compile with meterPi.c.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+*/
+//  ===========================================================================
+
+//  Installed libraries -------------------------------------------------------
+
+#include <stdbool.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+//  Local libraries -----------------------------------------------------------
+
+#include "meterPi.h"
+#include "meterPi-pace.h"
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Returns the difference between two times (ns).
+//  ---------------------------------------------------------------------------
+static int64_t pace_diff( const struct timespec *a, const struct timespec *b )
+{
+    return ( a->tv_sec - b->tv_sec ) * 1000000000LL +
+           ( a->tv_nsec - b->tv_nsec );
+}
+
+//  ---------------------------------------------------------------------------
+//  Adds a number of ns to a time.
+//  ---------------------------------------------------------------------------
+static void pace_add( struct timespec *t, uint64_t ns )
+{
+    ns += t->tv_nsec;
+    t->tv_sec += ns / 1000000000;
+    t->tv_nsec = ns % 1000000000;
+}
+
+//  ---------------------------------------------------------------------------
+//  Initialises a paced loop with refresh and idle rates (Hz).
+//  ---------------------------------------------------------------------------
+void meter_pace_init( struct meter_pace_t *pace, uint16_t refresh_hz,
+                      uint16_t idle_hz )
+{
+    memset( pace, 0, sizeof( struct meter_pace_t ));
+
+    if ( refresh_hz == 0 ) refresh_hz = 1;
+    if ( idle_hz == 0 ) idle_hz = 1;
+    pace->period      = 1000000000ULL / refresh_hz;
+    pace->idle_period = 1000000000ULL / idle_hz;
+
+    clock_gettime( CLOCK_MONOTONIC, &pace->deadline );
+    pace->wall_start = pace->deadline;
+    clock_gettime( CLOCK_THREAD_CPUTIME_ID, &pace->cpu_start );
+}
+
+//  ---------------------------------------------------------------------------
+//  Sleeps until the next deadline. Returns true if there is work to do.
+//  ---------------------------------------------------------------------------
+bool meter_pace_wait( struct meter_pace_t *pace, struct meter_t *meter )
+{
+    struct   timespec now;
+    uint64_t period;
+    int64_t  late;
+    uint32_t index;
+    bool     running;
+
+    period = pace->valid && ( pace->running || pace->settling ) ?
+             pace->period : pace->idle_period;
+    pace_add( &pace->deadline, period );
+
+    while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME,
+                             &pace->deadline, NULL ) == EINTR );
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    pace->stats.wakeups++;
+
+    // Start again from now rather than catching up on missed periods.
+    late = pace_diff( &now, &pace->deadline );
+    if ( late > 0 && (uint64_t) late > pace->stats.late_max )
+        pace->stats.late_max = late;
+    if ( late > (int64_t) period )
+    {
+        pace->stats.missed++;
+        pace->deadline = now;
+    }
+
+    // Checking the source also reopens it if it has gone away.
+    meter_check( meter );
+    running = meter->status.running;
+    index   = meter->status.position;
+
+    // While stopped, carry on until the display has decayed.
+    if ( pace->valid && running == pace->running &&
+         ( running ? index == pace->index : !pace->settling ))
+    {
+        if ( running ) pace->stats.skipped++;
+        else           pace->stats.idle++;
+        return false;
+    }
+
+    pace->index   = index;
+    pace->running = running;
+    pace->valid   = true;
+    pace->stats.updates++;
+
+    return true;
+}
+
+//  ---------------------------------------------------------------------------
+//  Notes whether a peak meter's display has decayed to the floor.
+//  ---------------------------------------------------------------------------
+void meter_pace_settle( struct meter_pace_t *pace,
+                        const struct peak_meter_t *peak_meter )
+{
+    uint8_t channel;
+
+    pace->settling = false;
+    for ( channel = 0; channel < peak_meter->channels &&
+                       channel < METER_CHANNELS_MAX; channel++ )
+        if ( peak_meter->bar_index[channel] || peak_meter->dot_index[channel] ||
+             peak_meter->overload[channel] )
+            pace->settling = true;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the counters and CPU use since the last call and clears them.
+//  ---------------------------------------------------------------------------
+void meter_pace_stats( struct meter_pace_t *pace,
+                       struct meter_pace_stats_t *stats )
+{
+    struct  timespec cpu, wall;
+    int64_t wall_ns;
+
+    clock_gettime( CLOCK_THREAD_CPUTIME_ID, &cpu );
+    clock_gettime( CLOCK_MONOTONIC, &wall );
+
+    *stats = pace->stats;
+    wall_ns = pace_diff( &wall, &pace->wall_start );
+    stats->cpu = wall_ns > 0 ?
+                 100.0f * pace_diff( &cpu, &pace->cpu_start ) / wall_ns : 0;
+
+    memset( &pace->stats, 0, sizeof( pace->stats ));
+    pace->cpu_start  = cpu;
+    pace->wall_start = wall;
+}
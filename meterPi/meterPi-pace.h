@@ -0,0 +1,136 @@
+//  ===========================================================================
+/*
+    meterPi-pace:
+
+    Paced refresh loop for meterPi displays. Wakes at the display refresh
+    rate on absolute deadlines instead of polling.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+
+    Changelog:
+
+        v01.00      Original version.
+*/
+//  ===========================================================================
+
+#ifndef METERPI_PACE_H
+#define METERPI_PACE_H
+
+//  Info. ---------------------------------------------------------------------
+/*
+    A display can't show more than its refresh rate, so there is no point
+    metering faster than that. The loop sleeps until an absolute deadline
+    with clock_nanosleep, so the period doesn't drift with the time taken
+    to meter and draw.
+
+    While the stream is running the loop wakes at the refresh rate and
+    only returns true if the source has new frames since the last wake.
+    While the stream is stopped, or the source isn't open, it falls back
+    to a slow idle poll that only checks the source.
+
+    Peak hold dots and overload indicators decay by refreshes, so a
+    display passes its peak meter to meter_pace_settle after each update.
+    Once the stream stops, the loop carries on at the refresh rate until
+    bars, dots and overloads are all at the floor, and only then idles.
+
+    A deadline is missed if the loop wakes more than a period late, e.g.
+    because the display write took too long. Missed periods are skipped
+    rather than run back to back.
+
+    e.g.
+
+        struct meter_pace_t pace;
+
+        meter_pace_init( &pace, 30, 2 );
+        while ( 1 )
+        {
+            if ( !meter_pace_wait( &pace, meter )) continue;
+            meter_get_dBfs( meter, &peak_meter );
+            meter_get_dB_indices( meter, &peak_meter );
+            meter_pace_settle( &pace, &peak_meter );
+            ...
+        }
+*/
+
+//  Types. --------------------------------------------------------------------
+
+struct meter_pace_stats_t
+{
+    uint64_t wakeups;  // Number of wakes.
+    uint64_t updates;  // Wakes with new frames or a change of state.
+    uint64_t skipped;  // Wakes while running with no new frames.
+    uint64_t idle;     // Wakes while stopped.
+    uint64_t missed;   // Deadlines missed by more than a period.
+    uint64_t late_max; // Largest wake latency (ns).
+    float    cpu;      // CPU use of the calling thread (%).
+};
+
+struct meter_pace_t
+{
+    uint64_t period;              // Refresh period (ns).
+    uint64_t idle_period;         // Idle poll period (ns).
+    struct   timespec deadline;   // Next wake time.
+    uint32_t index;               // Source position at last update.
+    bool     running;             // Stream status at last wake.
+    bool     valid;               // Index and status are valid.
+    bool     settling;            // Display not yet decayed to the floor.
+    struct   timespec cpu_start;  // Thread CPU time at start of stats.
+    struct   timespec wall_start; // Time at start of stats.
+    struct   meter_pace_stats_t stats; // Counters since start of stats.
+};
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Initialises a paced loop with refresh and idle rates (Hz).
+//  ---------------------------------------------------------------------------
+void meter_pace_init( struct meter_pace_t *pace, uint16_t refresh_hz,
+                      uint16_t idle_hz );
+
+//  ---------------------------------------------------------------------------
+//  Sleeps until the next deadline. Returns true if there is work to do.
+//  ---------------------------------------------------------------------------
+/*
+    Returns true if frames have been written since the last true return or
+    the stream has started or stopped, so that the display can show the
+    meters falling to the floor when the stream stops. Also returns true
+    while stopped until meter_pace_settle finds the display at the floor.
+*/
+bool meter_pace_wait( struct meter_pace_t *pace, struct meter_t *meter );
+
+//  ---------------------------------------------------------------------------
+//  Notes whether a peak meter's display has decayed to the floor.
+//  ---------------------------------------------------------------------------
+/*
+    Call after meter_get_dB_indices. Loops that don't call it idle as soon
+    as the stream stops.
+*/
+void meter_pace_settle( struct meter_pace_t *pace,
+                        const struct peak_meter_t *peak_meter );
+
+//  ---------------------------------------------------------------------------
+//  Returns the counters and CPU use since the last call and clears them.
+//  ---------------------------------------------------------------------------
+void meter_pace_stats( struct meter_pace_t *pace,
+                       struct meter_pace_stats_t *stats );
+
+#endif // #ifndef METERPI_PACE_H
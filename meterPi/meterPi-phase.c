@@ -0,0 +1,294 @@
+//  ===========================================================================
+/*
+    meterPi-phase:
+
+    Phase correlation meter and goniometer (phase scope) for meterPi.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Compile with meterPi.c.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+*/
+//  ===========================================================================
+
+//  Installed libraries -------------------------------------------------------
+
+#include <stdbool.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+
+//  Local libraries -----------------------------------------------------------
+
+#include "meterPi.h"
+#include "meterPi-phase.h"
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Creates a phase meter. Returns NULL if the settings are invalid.
+//  ---------------------------------------------------------------------------
+struct phase_t *phase_create( const struct phase_config_t *config )
+{
+    struct phase_t *phase;
+
+    if ( config->integration < PHASE_HOPS || config->points == 0 ||
+         config->points > PHASE_POINTS_MAX || config->decimate == 0 )
+        return NULL;
+
+    phase = calloc( 1, sizeof( struct phase_t ));
+    if ( !phase ) return NULL;
+
+    phase->config = *config;
+
+    return phase;
+}
+
+//  ---------------------------------------------------------------------------
+//  Frees a phase meter.
+//  ---------------------------------------------------------------------------
+void phase_destroy( struct phase_t *phase )
+{
+    free( phase );
+}
+
+//  ---------------------------------------------------------------------------
+//  Empties the correlation sums and points after a gap or rate change.
+//  ---------------------------------------------------------------------------
+void phase_reset( void *state, uint32_t rate, uint8_t channels )
+{
+    struct phase_t *phase = state;
+
+    phase->rate       = rate;
+    phase->channels   = channels;
+    phase->hop_frames = ( (uint64_t) rate * phase->config.integration /
+                          PHASE_HOPS + 500 ) / 1000;
+    phase->hop_pos    = 0;
+    phase->hop_lr     = 0;
+    phase->hop_ll     = 0;
+    phase->hop_rr     = 0;
+    phase->hop_index  = 0;
+    phase->hop_count  = 0;
+    phase->since      = 0;
+    phase->pos        = 0;
+    phase->filled     = 0;
+}
+
+//  ---------------------------------------------------------------------------
+//  Ends a hop and moves its sums into the ring.
+//  ---------------------------------------------------------------------------
+static void phase_hop( struct phase_t *phase )
+{
+    phase->lr[phase->hop_index] = phase->hop_lr;
+    phase->ll[phase->hop_index] = phase->hop_ll;
+    phase->rr[phase->hop_index] = phase->hop_rr;
+    phase->hop_index = ( phase->hop_index + 1 ) % PHASE_HOPS;
+    if ( phase->hop_count < PHASE_HOPS ) phase->hop_count++;
+
+    phase->hop_lr  = 0;
+    phase->hop_ll  = 0;
+    phase->hop_rr  = 0;
+    phase->hop_pos = 0;
+}
+
+//  ---------------------------------------------------------------------------
+//  Adds interleaved frames to the correlation sums and points.
+//  ---------------------------------------------------------------------------
+/*
+    Frames are taken a run at a time up to the end of the hop so that the
+    sums and ring positions stay in registers.
+*/
+void phase_process( void *state, const int16_t *samples, uint32_t frames )
+{
+    struct phase_t *phase = state;
+    uint8_t  channels = phase->channels;
+    uint8_t  right    = channels > 1 ? 1 : 0;
+    uint16_t decimate = phase->config.decimate;
+    uint16_t points   = phase->config.points;
+    uint16_t since    = phase->since;
+    uint16_t pos      = phase->pos;
+    uint16_t filled   = phase->filled;
+    int64_t  lr, ll, rr;
+    int32_t  l, r;
+    uint32_t run, i;
+
+    if ( phase->hop_frames == 0 || channels == 0 ) return;
+
+    while ( frames > 0 )
+    {
+        run = phase->hop_frames - phase->hop_pos;
+        if ( run > frames ) run = frames;
+
+        lr = ll = rr = 0;
+        for ( i = 0; i < run; i++ )
+        {
+            l = samples[0];
+            r = samples[right];
+            samples += channels;
+
+            lr += l * r;
+            ll += l * l;
+            rr += r * r;
+
+            if ( ++since == decimate )
+            {
+                since = 0;
+                phase->mid[pos]  = ( l + r ) >> 1;
+                phase->side[pos] = ( l - r ) >> 1;
+                if ( ++pos == points ) pos = 0;
+                if ( filled < points ) filled++;
+            }
+        }
+
+        phase->hop_lr  += lr;
+        phase->hop_ll  += ll;
+        phase->hop_rr  += rr;
+        phase->hop_pos += run;
+        frames         -= run;
+
+        if ( phase->hop_pos == phase->hop_frames ) phase_hop( phase );
+    }
+
+    phase->since  = since;
+    phase->pos    = pos;
+    phase->filled = filled;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns a meter stage for a phase meter.
+//  ---------------------------------------------------------------------------
+struct meter_stage_t phase_stage( struct phase_t *phase )
+{
+    struct meter_stage_t stage =
+    {
+        .name    = "phase",
+        .state   = phase,
+        .reset   = phase_reset,
+        .process = phase_process
+    };
+
+    return stage;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the correlation over the integration time.
+//  ---------------------------------------------------------------------------
+float phase_get_correlation( struct phase_t *phase )
+{
+    int64_t lr = 0, ll = 0, rr = 0;
+    uint8_t i;
+
+    for ( i = 0; i < phase->hop_count; i++ )
+    {
+        lr += phase->lr[i];
+        ll += phase->ll[i];
+        rr += phase->rr[i];
+    }
+    if ( ll == 0 || rr == 0 ) return 0;
+
+    return lr / sqrt( (double) ll * rr );
+}
+
+//  ---------------------------------------------------------------------------
+//  Copies the goniometer points, oldest first. Returns the number copied.
+//  ---------------------------------------------------------------------------
+uint16_t phase_get_points( struct phase_t *phase, int16_t *mid,
+                           int16_t *side, uint16_t size )
+{
+    uint16_t points = phase->config.points;
+    uint16_t count  = phase->filled < size ? phase->filled : size;
+    uint16_t n      = ( phase->pos + points - count ) % points;
+    uint16_t i;
+
+    for ( i = 0; i < count; i++ )
+    {
+        mid[i]  = phase->mid[n];
+        side[i] = phase->side[n];
+        if ( ++n == points ) n = 0;
+    }
+
+    return count;
+}
+
+//  ---------------------------------------------------------------------------
+//  Maps a point to a pixel in a square of size pixels.
+//  ---------------------------------------------------------------------------
+static inline void phase_pixel( int16_t mid, int16_t side, uint16_t size,
+                                uint16_t *x, uint16_t *y )
+{
+    *x = ( (uint32_t)( side + 32768 ) * size ) >> 16;
+    *y = size - 1 - (( (uint32_t)( mid + 32768 ) * size ) >> 16 );
+}
+
+//  ---------------------------------------------------------------------------
+//  Draws the goniometer into a 4-bit greyscale frame buffer.
+//  ---------------------------------------------------------------------------
+void phase_draw( struct phase_t *phase, uint8_t *fb,
+                 uint16_t cols, uint16_t rows )
+{
+    uint16_t points = phase->config.points;
+    uint16_t size   = rows < cols ? rows : cols;
+    uint16_t left   = ( cols - size ) / 2;
+    uint16_t n, i, x, y;
+    uint8_t  grey;
+
+    memset( fb, 0, cols * rows );
+    if ( size == 0 ) return;
+
+    // Oldest first so that newer points are drawn over them.
+    n = ( phase->pos + points - phase->filled ) % points;
+    for ( i = 0; i < phase->filled; i++ )
+    {
+        phase_pixel( phase->mid[n], phase->side[n], size, &x, &y );
+        grey = 3 + 12 * ( i + 1 ) / phase->filled;
+        fb[( y + ( rows - size ) / 2 ) * cols + left + x] = grey;
+        if ( ++n == points ) n = 0;
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Draws the goniometer into a monochrome paged frame buffer.
+//  ---------------------------------------------------------------------------
+void phase_draw_pages( struct phase_t *phase, uint8_t *pages,
+                       uint16_t cols, uint16_t rows )
+{
+    uint16_t size = rows < cols ? rows : cols;
+    uint16_t left = ( cols - size ) / 2;
+    uint16_t top  = ( rows - size ) / 2;
+    uint16_t i, x, y;
+
+    memset( pages, 0, cols * ( rows / 8 ));
+    if ( size == 0 ) return;
+
+    for ( i = 0; i < phase->filled; i++ )
+    {
+        phase_pixel( phase->mid[i], phase->side[i], size, &x, &y );
+        y += top;
+        if ( y / 8 < rows / 8 )
+            pages[( y / 8 ) * cols + left + x] |= 1 << ( y % 8 );
+    }
+}
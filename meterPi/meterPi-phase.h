@@ -0,0 +1,158 @@
+//  ===========================================================================
+/*
+    meterPi-phase:
+
+    Phase correlation meter and goniometer (phase scope) for meterPi.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+
+    Changelog:
+
+        v01.00      Original version.
+*/
+//  ===========================================================================
+
+#ifndef METERPI_PHASE_H
+#define METERPI_PHASE_H
+
+//  Info. ---------------------------------------------------------------------
+/*
+    The correlation of the left and right channels is
+
+        r = sum( L * R ) / sqrt( sum( L * L ) * sum( R * R ))
+
+    from +1 for mono through 0 for unrelated channels to -1 when one
+    channel is inverted. The sums are over the integration time, kept as
+    PHASE_HOPS hops in a small ring as the loudness windows are, so a
+    refresh only adds the new frames. Sums are of 16-bit products in
+    64-bit integers, so they are exact and never overflow.
+
+    The goniometer plots mid, (L + R) / 2, upwards against side,
+    (L - R) / 2, across, i.e. left and right at 45 degrees. Mono is a
+    vertical line, wide stereo a cloud and an inverted channel a horizontal
+    line. One point is kept every decimate frames in a ring of the newest
+    points.
+
+    Only the first two channels are used, so with 5.1 or 7.1 it is the
+    front pair. A mono stream is taken as both channels.
+*/
+
+//  Macros. -------------------------------------------------------------------
+
+#define PHASE_HOPS        8    // Hops per integration time.
+#define PHASE_POINTS_MAX  1024 // Most points kept for the goniometer.
+
+//  Types. --------------------------------------------------------------------
+
+struct phase_config_t
+{
+    uint16_t integration; // Correlation integration time (ms).
+    uint16_t points;      // Points kept for the goniometer.
+    uint16_t decimate;    // Frames per point.
+};
+
+struct phase_t
+{
+    struct   phase_config_t config;  // Settings.
+    uint32_t rate;                   // Sample rate of hop length.
+    uint8_t  channels;               // Interleaved channels.
+    uint32_t hop_frames;             // Frames per hop.
+    uint32_t hop_pos;                // Frames in current hop.
+    int64_t  hop_lr;                 // Sums of products in current hop.
+    int64_t  hop_ll;
+    int64_t  hop_rr;
+    int64_t  lr [PHASE_HOPS];        // Sums of products of recent hops.
+    int64_t  ll [PHASE_HOPS];
+    int64_t  rr [PHASE_HOPS];
+    uint8_t  hop_index;              // Next hop in ring.
+    uint8_t  hop_count;              // Hops in ring.
+    uint16_t since;                  // Frames since last point.
+    uint16_t pos;                    // Next point in ring.
+    uint16_t filled;                 // Points in ring.
+    int16_t  mid  [PHASE_POINTS_MAX]; // Goniometer points.
+    int16_t  side [PHASE_POINTS_MAX];
+};
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Creates a phase meter. Returns NULL if the settings are invalid.
+//  ---------------------------------------------------------------------------
+struct phase_t *phase_create( const struct phase_config_t *config );
+
+//  ---------------------------------------------------------------------------
+//  Frees a phase meter.
+//  ---------------------------------------------------------------------------
+void phase_destroy( struct phase_t *phase );
+
+//  ---------------------------------------------------------------------------
+//  Empties the correlation sums and points after a gap or rate change.
+//  ---------------------------------------------------------------------------
+void phase_reset( void *phase, uint32_t rate, uint8_t channels );
+
+//  ---------------------------------------------------------------------------
+//  Adds interleaved frames to the correlation sums and points.
+//  ---------------------------------------------------------------------------
+void phase_process( void *phase, const int16_t *samples, uint32_t frames );
+
+//  ---------------------------------------------------------------------------
+//  Returns a meter stage for a phase meter.
+//  ---------------------------------------------------------------------------
+struct meter_stage_t phase_stage( struct phase_t *phase );
+
+//  ---------------------------------------------------------------------------
+//  Returns the correlation over the integration time.
+//  ---------------------------------------------------------------------------
+/*
+    From -1 to +1. 0 until the first hop is complete or if either channel
+    is silent.
+*/
+float phase_get_correlation( struct phase_t *phase );
+
+//  ---------------------------------------------------------------------------
+//  Copies the goniometer points, oldest first. Returns the number copied.
+//  ---------------------------------------------------------------------------
+uint16_t phase_get_points( struct phase_t *phase, int16_t *mid,
+                           int16_t *side, uint16_t size );
+
+//  ---------------------------------------------------------------------------
+//  Draws the goniometer into a 4-bit greyscale frame buffer.
+//  ---------------------------------------------------------------------------
+/*
+    The frame buffer has one byte (0 to 15) per pixel, row by row, as used
+    by the SSD1322 driver. The scope is a square of the height of the
+    frame buffer, centred, with newer points brighter.
+*/
+void phase_draw( struct phase_t *phase, uint8_t *fb,
+                 uint16_t cols, uint16_t rows );
+
+//  ---------------------------------------------------------------------------
+//  Draws the goniometer into a monochrome paged frame buffer.
+//  ---------------------------------------------------------------------------
+/*
+    The frame buffer is rows / 8 pages of cols bytes, each byte a column of
+    8 pixels with the top pixel in bit 0, as written to the AMG19264.
+*/
+void phase_draw_pages( struct phase_t *phase, uint8_t *pages,
+                       uint16_t cols, uint16_t rows );
+
+#endif // #ifndef METERPI_PHASE_H
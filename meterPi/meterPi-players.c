@@ -0,0 +1,415 @@
+//  ===========================================================================
+/*
+    meterPi-players:
+
+    Finds and meters every Squeezelite player on the host.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Compile with meterPi.c.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+*/
+//  ===========================================================================
+
+//  Installed libraries -------------------------------------------------------
+
+#include <stdbool.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <dirent.h>
+#include <sys/inotify.h>
+
+//  Local libraries -----------------------------------------------------------
+
+#include "meterPi.h"
+#include "meterPi-players.h"
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Compares shared memory object names for sorting.
+//  ---------------------------------------------------------------------------
+static int players_compare( const void *a, const void *b )
+{
+    return strcmp( a, b );
+}
+
+//  ---------------------------------------------------------------------------
+//  Lists the Squeezelite shared memory objects in a directory.
+//  ---------------------------------------------------------------------------
+/*
+    Sorted, so that players keep the same order from one start to the next.
+*/
+uint8_t meter_players_scan( const char *dir, char names[][VIS_NAME_LEN],
+                            uint8_t size )
+{
+    struct dirent *entry;
+    DIR     *stream = opendir( dir );
+    uint8_t count = 0;
+
+    if ( !stream ) return 0;
+
+    while ( count < size && ( entry = readdir( stream )))
+    {
+        if ( strncmp( entry->d_name, METER_PLAYERS_PREFIX,
+                      strlen( METER_PLAYERS_PREFIX )) != 0 )
+            continue;
+
+        // Names too long to hold are skipped rather than cut short.
+        if ( snprintf( names[count], VIS_NAME_LEN, "/%s",
+                       entry->d_name ) < VIS_NAME_LEN )
+            count++;
+    }
+    closedir( stream );
+
+    qsort( names, count, VIS_NAME_LEN, players_compare );
+
+    return count;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the index of a player, or -1 if it isn't being metered.
+//  ---------------------------------------------------------------------------
+static int8_t players_find( struct meter_players_t *players, const char *name )
+{
+    uint8_t i;
+
+    for ( i = 0; i < players->count; i++ )
+        if ( strcmp( players->players[i].name, name ) == 0 ) return i;
+
+    return -1;
+}
+
+//  ---------------------------------------------------------------------------
+//  Stops metering a player.
+//  ---------------------------------------------------------------------------
+static void players_remove( struct meter_players_t *players, const char *name )
+{
+    struct meter_t *meter;
+    int8_t index = players_find( players, name );
+
+    if ( index < 0 ) return;
+
+    pthread_mutex_lock( &players->lock );
+    meter = players->players[index].meter;
+    memmove( &players->players[index], &players->players[index + 1],
+             ( players->count - index - 1 ) *
+             sizeof( struct meter_player_t ));
+    players->count--;
+    players->changes++;
+    pthread_mutex_unlock( &players->lock );
+
+    meter_close( meter );
+}
+
+//  ---------------------------------------------------------------------------
+//  Starts metering a player, or opens its meter again if it has restarted.
+//  ---------------------------------------------------------------------------
+static void players_add( struct meter_players_t *players, const char *name )
+{
+    struct meter_player_t *player;
+    struct meter_t *meter;
+    size_t length = strlen( name );
+
+    if ( length >= VIS_NAME_LEN ) return;
+    players_remove( players, name );
+    if ( players->count == METER_PLAYERS_MAX ) return;
+
+    meter = meter_open( name );
+    if ( !meter ) return;
+
+    pthread_mutex_lock( &players->lock );
+    player = &players->players[players->count++];
+    memcpy( player->name, name, length + 1 );
+    player->meter      = meter;
+    player->work       = players->config;
+    player->peak_meter = players->config;
+    players->changes++;
+    pthread_mutex_unlock( &players->lock );
+}
+
+//  ---------------------------------------------------------------------------
+//  Scans for players, adding new ones and removing those that have gone.
+//  ---------------------------------------------------------------------------
+static void players_rescan( struct meter_players_t *players )
+{
+    char    names[METER_PLAYERS_MAX][VIS_NAME_LEN];
+    uint8_t count, i, j;
+
+    count = meter_players_scan( VIS_SHM_DIR, names, METER_PLAYERS_MAX );
+
+    for ( i = players->count; i-- > 0; )
+    {
+        for ( j = 0; j < count; j++ )
+            if ( strcmp( players->players[i].name, names[j] ) == 0 ) break;
+        if ( j == count ) players_remove( players, players->players[i].name );
+    }
+
+    for ( j = 0; j < count; j++ )
+        if ( players_find( players, names[j] ) < 0 )
+            players_add( players, names[j] );
+
+    players->lastscan = time( NULL );
+}
+
+//  ---------------------------------------------------------------------------
+//  Adds and removes players for the inotify events waiting.
+//  ---------------------------------------------------------------------------
+static void players_notified( struct meter_players_t *players )
+{
+    char buffer[4096]
+         __attribute__(( aligned( __alignof__( struct inotify_event ))));
+    const struct inotify_event *event;
+    char    name[VIS_NAME_LEN];
+    ssize_t length;
+    char    *next;
+
+    while (( length = read( players->notify_fd, buffer,
+                            sizeof( buffer ))) > 0 )
+    {
+        for ( next = buffer; next < buffer + length;
+              next += sizeof( struct inotify_event ) + event->len )
+        {
+            event = (const struct inotify_event *) next;
+
+            // Events have been lost, so start again from the directory.
+            if ( event->mask & IN_Q_OVERFLOW )
+            {
+                players_rescan( players );
+                continue;
+            }
+
+            if ( event->len == 0 ||
+                 strncmp( event->name, METER_PLAYERS_PREFIX,
+                          strlen( METER_PLAYERS_PREFIX )) != 0 ||
+                 strlen( event->name ) + 2 > VIS_NAME_LEN )
+                continue;
+            snprintf( name, sizeof( name ), "/%s", event->name );
+
+            if ( event->mask & ( IN_CREATE | IN_MOVED_TO ))
+                players_add( players, name );
+            else if ( event->mask & ( IN_DELETE | IN_MOVED_FROM ))
+                players_remove( players, name );
+        }
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns true if the worker thread is to exit.
+//  ---------------------------------------------------------------------------
+static bool players_stopping( struct meter_players_t *players )
+{
+    bool stop;
+
+    pthread_mutex_lock( &players->lock );
+    stop = players->stop;
+    pthread_mutex_unlock( &players->lock );
+
+    return stop;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the time in ns from one time to another.
+//  ---------------------------------------------------------------------------
+static int64_t players_ns( const struct timespec *from,
+                           const struct timespec *to )
+{
+    return ( to->tv_sec - from->tv_sec ) * 1000000000LL +
+           ( to->tv_nsec - from->tv_nsec );
+}
+
+//  ---------------------------------------------------------------------------
+//  Meters every player at the refresh rate and handles changes between.
+//  ---------------------------------------------------------------------------
+/*
+    Waits for inotify events until the next deadline, so players are added
+    as soon as they appear but metering keeps to the refresh rate. As with
+    meterPi-pace, missed deadlines are skipped rather than run back to back.
+*/
+static void *players_worker( void *data )
+{
+    struct meter_players_t *players = data;
+    struct meter_player_t  *player;
+    struct pollfd   notify = { .fd = players->notify_fd, .events = POLLIN };
+    struct timespec deadline, now;
+    int64_t wait;
+    uint8_t i;
+
+    clock_gettime( CLOCK_MONOTONIC, &deadline );
+
+    while ( !players_stopping( players ))
+    {
+        deadline.tv_nsec += players->period;
+        deadline.tv_sec  += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+
+        while ( 1 )
+        {
+            clock_gettime( CLOCK_MONOTONIC, &now );
+            wait = players_ns( &now, &deadline );
+            if ( wait <= 0 ) break;
+            if ( poll( &notify, notify.fd >= 0, ( wait + 999999 ) / 1000000 )
+                 > 0 )
+                players_notified( players );
+        }
+        if ( wait < -(int64_t) players->period ) deadline = now;
+
+        if ( players->notify_fd < 0 &&
+             time( NULL ) - players->lastscan >= VIS_REOPEN_TIME )
+            players_rescan( players );
+
+        for ( i = 0; i < players->count; i++ )
+        {
+            player = &players->players[i];
+            meter_get_dBfs( player->meter, &player->work );
+            meter_get_dB_indices( player->meter, &player->work );
+
+            pthread_mutex_lock( &players->lock );
+            player->peak_meter = player->work;
+            pthread_mutex_unlock( &players->lock );
+        }
+    }
+
+    return NULL;
+}
+
+//  ---------------------------------------------------------------------------
+//  Starts metering every player with a worker thread.
+//  ---------------------------------------------------------------------------
+struct meter_players_t *meter_players_start( uint16_t refresh_hz,
+                                    const struct peak_meter_t *peak_meter )
+{
+    struct meter_players_t *players;
+
+    if ( refresh_hz == 0 ) return NULL;
+
+    players = calloc( 1, sizeof( struct meter_players_t ));
+    if ( !players ) return NULL;
+
+    pthread_mutex_init( &players->lock, NULL );
+    players->period = 1000000000ULL / refresh_hz;
+    players->config = *peak_meter;
+
+    // Watch before the first scan so that no player is missed.
+    players->notify_fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+    if ( players->notify_fd >= 0 &&
+         inotify_add_watch( players->notify_fd, VIS_SHM_DIR,
+                            IN_CREATE | IN_MOVED_TO |
+                            IN_DELETE | IN_MOVED_FROM ) < 0 )
+    {
+        close( players->notify_fd );
+        players->notify_fd = -1;
+    }
+    players_rescan( players );
+
+    if ( pthread_create( &players->thread, NULL, players_worker, players ))
+    {
+        players->stop = true;
+        meter_players_stop( players );
+        return NULL;
+    }
+
+    return players;
+}
+
+//  ---------------------------------------------------------------------------
+//  Stops the worker thread and closes every meter.
+//  ---------------------------------------------------------------------------
+void meter_players_stop( struct meter_players_t *players )
+{
+    uint8_t i;
+
+    if ( !players ) return;
+
+    pthread_mutex_lock( &players->lock );
+    if ( !players->stop )
+    {
+        players->stop = true;
+        pthread_mutex_unlock( &players->lock );
+        pthread_join( players->thread, NULL );
+    }
+    else pthread_mutex_unlock( &players->lock );
+
+    for ( i = 0; i < players->count; i++ )
+        meter_close( players->players[i].meter );
+    if ( players->notify_fd >= 0 ) close( players->notify_fd );
+    pthread_mutex_destroy( &players->lock );
+    free( players );
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the number of players being metered.
+//  ---------------------------------------------------------------------------
+uint8_t meter_players_count( struct meter_players_t *players )
+{
+    uint8_t count;
+
+    pthread_mutex_lock( &players->lock );
+    count = players->count;
+    pthread_mutex_unlock( &players->lock );
+
+    return count;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns a count that changes whenever players are added or removed.
+//  ---------------------------------------------------------------------------
+uint32_t meter_players_changes( struct meter_players_t *players )
+{
+    uint32_t changes;
+
+    pthread_mutex_lock( &players->lock );
+    changes = players->changes;
+    pthread_mutex_unlock( &players->lock );
+
+    return changes;
+}
+
+//  ---------------------------------------------------------------------------
+//  Copies the name and levels of a player at the last refresh.
+//  ---------------------------------------------------------------------------
+bool meter_players_get( struct meter_players_t *players, uint8_t index,
+                        char *name, size_t size,
+                        struct peak_meter_t *peak_meter )
+{
+    bool found;
+
+    pthread_mutex_lock( &players->lock );
+    found = index < players->count;
+    if ( found )
+    {
+        if ( name )
+            snprintf( name, size, "%s", players->players[index].name );
+        if ( peak_meter ) *peak_meter = players->players[index].peak_meter;
+    }
+    pthread_mutex_unlock( &players->lock );
+
+    return found;
+}
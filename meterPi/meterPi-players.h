@@ -0,0 +1,146 @@
+//  ===========================================================================
+/*
+    meterPi-players:
+
+    Finds and meters every Squeezelite player on the host.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+
+    Changelog:
+
+        v01.00      Original version.
+*/
+//  ===========================================================================
+
+#ifndef METERPI_PLAYERS_H
+#define METERPI_PLAYERS_H
+
+//  Info. ---------------------------------------------------------------------
+/*
+    Each Squeezelite player started with -v has a shared memory object
+    named from its MAC address, or from the address given with -m, so
+    several players on one host all show up in VIS_SHM_DIR as
+    squeezelite-<mac>. vis_get_name only finds the player using the MAC
+    address of the first interface.
+
+    meter_players_start scans VIS_SHM_DIR for these objects and then
+    watches it with inotify, so players are added as soon as they start
+    and removed when they exit. A player that restarts replaces its
+    object, so its meter is opened again. Without inotify the directory is
+    scanned again every VIS_REOPEN_TIME seconds.
+
+    Every player has its own meter context but they are all run by one
+    worker thread at the refresh rate, so the cost is one thread however
+    many players there are. The worker copies the levels of each player
+    under a lock once metered, so displays in other threads can read them
+    at any time with meter_players_get.
+
+    e.g.
+
+        players = meter_players_start( 30, &peak_meter );
+        while ( 1 )
+        {
+            for ( i = 0; i < meter_players_count( players ); i++ )
+                if ( meter_players_get( players, i, name, sizeof( name ),
+                                        &peak_meter ))
+                    ...
+        }
+*/
+
+//  Macros. -------------------------------------------------------------------
+
+#define METER_PLAYERS_MAX     8              // Most players metered.
+#define METER_PLAYERS_PREFIX  "squeezelite-" // Start of object names.
+
+//  Types. --------------------------------------------------------------------
+
+struct meter_player_t
+{
+    char     name[VIS_NAME_LEN];      // Shared memory object name.
+    struct   meter_t *meter;          // Meter, only used by the worker.
+    struct   peak_meter_t work;       // Levels, only used by the worker.
+    struct   peak_meter_t peak_meter; // Levels at last refresh, locked.
+};
+
+struct meter_players_t
+{
+    pthread_t       thread;          // Worker thread.
+    pthread_mutex_t lock;            // Protects players and stop.
+    bool            stop;            // Worker is to exit.
+    int             notify_fd;       // Watch on VIS_SHM_DIR, or -1.
+    uint64_t        period;          // Refresh period (ns).
+    time_t          lastscan;        // Last scan without inotify.
+    uint32_t        changes;         // Incremented when players change.
+    struct peak_meter_t   config;    // Settings for every player.
+    struct meter_player_t players[METER_PLAYERS_MAX]; // Players metered.
+    uint8_t               count;     // Number of players.
+};
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Lists the Squeezelite shared memory objects in a directory.
+//  ---------------------------------------------------------------------------
+/*
+    Names are returned as for shm_open, i.e. "/squeezelite-<mac>". Returns
+    the number found, up to size.
+*/
+uint8_t meter_players_scan( const char *dir, char names[][VIS_NAME_LEN],
+                            uint8_t size );
+
+//  ---------------------------------------------------------------------------
+//  Starts metering every player with a worker thread.
+//  ---------------------------------------------------------------------------
+/*
+    Every player is metered with a copy of peak_meter at refresh_hz.
+    Returns NULL if the thread can't be started.
+*/
+struct meter_players_t *meter_players_start( uint16_t refresh_hz,
+                                    const struct peak_meter_t *peak_meter );
+
+//  ---------------------------------------------------------------------------
+//  Stops the worker thread and closes every meter.
+//  ---------------------------------------------------------------------------
+void meter_players_stop( struct meter_players_t *players );
+
+//  ---------------------------------------------------------------------------
+//  Returns the number of players being metered.
+//  ---------------------------------------------------------------------------
+uint8_t meter_players_count( struct meter_players_t *players );
+
+//  ---------------------------------------------------------------------------
+//  Returns a count that changes whenever players are added or removed.
+//  ---------------------------------------------------------------------------
+uint32_t meter_players_changes( struct meter_players_t *players );
+
+//  ---------------------------------------------------------------------------
+//  Copies the name and levels of a player at the last refresh.
+//  ---------------------------------------------------------------------------
+/*
+    Returns false if there is no player at index, e.g. because it has just
+    been removed.
+*/
+bool meter_players_get( struct meter_players_t *players, uint8_t index,
+                        char *name, size_t size,
+                        struct peak_meter_t *peak_meter );
+
+#endif // #ifndef METERPI_PLAYERS_H
@@ -0,0 +1,291 @@
+//  ===========================================================================
+/*
+    meterPi-publish:
+
+    Publishes meter results to a shared memory object so that any number
+    of display processes can read them without metering the stream again.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Compile with meterPi.c.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+*/
+//  ===========================================================================
+
+//  Installed libraries -------------------------------------------------------
+
+#include <stdbool.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//  Local libraries -----------------------------------------------------------
+
+#include "meterPi.h"
+#include "meterPi-publish.h"
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Returns the monotonic time in ns.
+//  ---------------------------------------------------------------------------
+static uint64_t publish_time_ns( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+//  ---------------------------------------------------------------------------
+//  Creates a shared memory object for results. Returns NULL on failure.
+//  ---------------------------------------------------------------------------
+struct meter_publisher_t *meter_publisher_create( const char *name )
+{
+    struct meter_publisher_t *publisher;
+    int fd;
+
+    publisher = calloc( 1, sizeof( struct meter_publisher_t ));
+    if ( !publisher ) return NULL;
+    snprintf( publisher->name, sizeof( publisher->name ), "%s",
+              name ? name : METER_RESULTS_NAME );
+
+    // Readable by anyone, so displays can run as other users.
+    shm_unlink( publisher->name );
+    fd = shm_open( publisher->name, O_CREAT | O_RDWR | O_EXCL, 0644 );
+    if ( fd < 0 )
+    {
+        free( publisher );
+        return NULL;
+    }
+    if ( ftruncate( fd, sizeof( struct meter_results_shm_t )) != 0 )
+    {
+        close( fd );
+        shm_unlink( publisher->name );
+        free( publisher );
+        return NULL;
+    }
+
+    publisher->shm = mmap( NULL, sizeof( struct meter_results_shm_t ),
+                           PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
+    if ( publisher->shm == MAP_FAILED )
+    {
+        shm_unlink( publisher->name );
+        free( publisher );
+        return NULL;
+    }
+
+    // The object is zero filled, so readers ignore it until magic is set.
+    publisher->shm->version = METER_RESULTS_VERSION;
+    publisher->shm->size    = sizeof( struct meter_results_shm_t );
+    __atomic_store_n( &publisher->shm->magic, METER_RESULTS_MAGIC,
+                      __ATOMIC_RELEASE );
+
+    return publisher;
+}
+
+//  ---------------------------------------------------------------------------
+//  Removes a results object.
+//  ---------------------------------------------------------------------------
+void meter_publisher_destroy( struct meter_publisher_t *publisher )
+{
+    if ( !publisher ) return;
+
+    munmap( publisher->shm, sizeof( struct meter_results_shm_t ));
+    shm_unlink( publisher->name );
+    free( publisher );
+}
+
+//  ---------------------------------------------------------------------------
+//  Publishes results, setting count and publish_ns.
+//  ---------------------------------------------------------------------------
+/*
+    The release fence keeps the writes of the results after the odd
+    sequence, and the release store keeps them before the even one.
+*/
+void meter_publish( struct meter_publisher_t *publisher,
+                    struct meter_results_t *results )
+{
+    struct meter_results_shm_t *shm = publisher->shm;
+    uint32_t sequence = shm->sequence;
+
+    results->count      = ++publisher->count;
+    results->publish_ns = publish_time_ns();
+
+    __atomic_store_n( &shm->sequence, sequence + 1, __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+    memcpy( &shm->results, results, sizeof( struct meter_results_t ));
+    __atomic_store_n( &shm->sequence, sequence + 2, __ATOMIC_RELEASE );
+}
+
+//  ---------------------------------------------------------------------------
+//  Copies levels, indices and overloads from a peak meter into results.
+//  ---------------------------------------------------------------------------
+void meter_results_set_peak( struct meter_results_t *results,
+                             const struct peak_meter_t *peak_meter )
+{
+    results->channels   = peak_meter->channels;
+    results->num_levels = peak_meter->num_levels;
+    memcpy( results->dBfs, peak_meter->dBfs, sizeof( results->dBfs ));
+    memcpy( results->peak, peak_meter->peak, sizeof( results->peak ));
+    memcpy( results->dBtp, peak_meter->dBtp, sizeof( results->dBtp ));
+    memcpy( results->overload, peak_meter->overload,
+            sizeof( results->overload ));
+    memcpy( results->bar_index, peak_meter->bar_index,
+            sizeof( results->bar_index ));
+    memcpy( results->dot_index, peak_meter->dot_index,
+            sizeof( results->dot_index ));
+}
+
+//  ---------------------------------------------------------------------------
+//  Unmaps a results object.
+//  ---------------------------------------------------------------------------
+static void subscriber_unmap( struct meter_subscriber_t *subscriber )
+{
+    if ( subscriber->shm )
+        munmap( subscriber->shm, sizeof( struct meter_results_shm_t ));
+    subscriber->shm = NULL;
+}
+
+//  ---------------------------------------------------------------------------
+//  Maps a results object if there is a new one.
+//  ---------------------------------------------------------------------------
+/*
+    Checks at most once a second, so the cost of a read is normally just
+    the copy. A publisher that restarts replaces the object, so the inode
+    changes.
+*/
+static void subscriber_check( struct meter_subscriber_t *subscriber )
+{
+    struct meter_results_shm_t *shm;
+    struct stat st;
+    time_t now = time( NULL );
+    int    fd;
+
+    if ( now == subscriber->lastcheck ) return;
+    subscriber->lastcheck = now;
+
+    fd = shm_open( subscriber->name, O_RDONLY, 0 );
+    if ( fd < 0 )
+    {
+        subscriber_unmap( subscriber );
+        return;
+    }
+    if ( fstat( fd, &st ) != 0 ||
+         st.st_size < (off_t) sizeof( struct meter_results_shm_t ) ||
+         ( subscriber->shm && st.st_ino == subscriber->inode ))
+    {
+        close( fd );
+        return;
+    }
+
+    shm = mmap( NULL, sizeof( struct meter_results_shm_t ), PROT_READ,
+                MAP_SHARED, fd, 0 );
+    close( fd );
+    if ( shm == MAP_FAILED ) return;
+
+    subscriber_unmap( subscriber );
+    subscriber->shm      = shm;
+    subscriber->inode    = st.st_ino;
+    subscriber->sequence = 0;
+}
+
+//  ---------------------------------------------------------------------------
+//  Subscribes to a results object. Returns NULL if out of memory.
+//  ---------------------------------------------------------------------------
+struct meter_subscriber_t *meter_subscriber_open( const char *name )
+{
+    struct meter_subscriber_t *subscriber;
+
+    subscriber = calloc( 1, sizeof( struct meter_subscriber_t ));
+    if ( !subscriber ) return NULL;
+    snprintf( subscriber->name, sizeof( subscriber->name ), "%s",
+              name ? name : METER_RESULTS_NAME );
+
+    return subscriber;
+}
+
+//  ---------------------------------------------------------------------------
+//  Unsubscribes from a results object.
+//  ---------------------------------------------------------------------------
+void meter_subscriber_close( struct meter_subscriber_t *subscriber )
+{
+    if ( !subscriber ) return;
+
+    subscriber_unmap( subscriber );
+    free( subscriber );
+}
+
+//  ---------------------------------------------------------------------------
+//  Copies the latest results. Returns true if they are new since last read.
+//  ---------------------------------------------------------------------------
+/*
+    The acquire load keeps the copy after the first read of the sequence
+    and the acquire fence keeps it before the second.
+*/
+bool meter_subscriber_read( struct meter_subscriber_t *subscriber,
+                            struct meter_results_t *results )
+{
+    struct meter_results_shm_t *shm;
+    uint32_t before, after, tries;
+
+    subscriber_check( subscriber );
+
+    shm = subscriber->shm;
+    if ( !shm ||
+         __atomic_load_n( &shm->magic, __ATOMIC_ACQUIRE ) !=
+         METER_RESULTS_MAGIC ||
+         shm->version != METER_RESULTS_VERSION ||
+         shm->size != sizeof( struct meter_results_shm_t ))
+        return false;
+
+    for ( tries = 0; tries < METER_RESULTS_RETRIES; tries++ )
+    {
+        before = __atomic_load_n( &shm->sequence, __ATOMIC_ACQUIRE );
+        if ( before == subscriber->sequence ) return false;
+        if ( before & 1 ) continue;
+
+        memcpy( results, &shm->results, sizeof( struct meter_results_t ));
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );
+        after = __atomic_load_n( &shm->sequence, __ATOMIC_RELAXED );
+
+        if ( before == after )
+        {
+            subscriber->sequence = before;
+            return true;
+        }
+        subscriber->retries++;
+    }
+
+    return false;
+}
@@ -0,0 +1,191 @@
+//  ===========================================================================
+/*
+    meterPi-publish:
+
+    Publishes meter results to a shared memory object so that any number
+    of display processes can read them without metering the stream again.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+
+    Changelog:
+
+        v01.00      Original version.
+*/
+//  ===========================================================================
+
+#ifndef METERPI_PUBLISH_H
+#define METERPI_PUBLISH_H
+
+//  Info. ---------------------------------------------------------------------
+/*
+    One process, e.g. publishmeterPi, meters the stream and publishes the
+    results. Displays subscribe to the results instead of opening the
+    Squeezelite buffer, so the DSP is done once and only the publisher
+    ever takes Squeezelite's lock.
+
+    The results are guarded by a sequence lock rather than a mutex, so a
+    reader can never hold up the publisher, or another reader, and a
+    reader that dies can't leave anything locked. The publisher makes the
+    sequence odd, writes the results and makes it even again. A reader
+    copies the results and keeps the copy only if the sequence was even
+    and unchanged throughout, otherwise it tries again.
+
+    Times are CLOCK_MONOTONIC, which is the same in every process, so a
+    reader can tell how old the results are. update_ns is when the
+    publisher saw the newest frames and publish_ns is when the results were
+    published, so publish_ns - update_ns is the publisher's latency.
+
+    e.g.
+
+        struct meter_subscriber_t *subscriber;
+        struct meter_results_t     results;
+
+        subscriber = meter_subscriber_open( NULL );
+        while ( 1 )
+        {
+            if ( meter_subscriber_read( subscriber, &results ))
+                ... draw results.bar_index etc ...
+            ...
+        }
+*/
+
+//  Macros. -------------------------------------------------------------------
+
+#define METER_RESULTS_NAME    "/meterPi-results" // Default object name.
+#define METER_RESULTS_MAGIC   0x6950746d         // "mtPi".
+#define METER_RESULTS_VERSION 1                  // Layout of results.
+#define METER_RESULTS_BANDS   64                 // Most spectrum bands.
+#define METER_RESULTS_RETRIES 1000               // Reads before giving up.
+
+//  Types. --------------------------------------------------------------------
+
+/*
+    Results of one refresh. Per-channel values are as in peak_meter_t.
+    Spectrum levels are in dBFS, loudness values as in loudness_meter_t.
+*/
+struct meter_results_t
+{
+    uint64_t update_ns;   // Time the newest frames were seen.
+    uint64_t publish_ns;  // Time the results were published.
+    uint32_t count;       // Number of results published.
+    uint32_t rate;        // Stream sample rate (Hz).
+    bool     running;     // Stream is playing.
+    uint8_t  channels;    // Channels metered.
+    uint8_t  num_levels;  // Number of display levels.
+    uint8_t  bands;       // Number of spectrum bands, 0 if none.
+    bool     loudness;    // Loudness values are valid.
+    float    dBfs      [METER_CHANNELS_MAX]; // dBfs values.
+    uint32_t peak      [METER_CHANNELS_MAX]; // Absolute sample peaks.
+    float    dBtp      [METER_CHANNELS_MAX]; // True-peak values (dBTP).
+    bool     overload  [METER_CHANNELS_MAX]; // Overload flags.
+    uint8_t  bar_index [METER_CHANNELS_MAX]; // Index for bar display.
+    uint8_t  dot_index [METER_CHANNELS_MAX]; // Index for peak hold.
+    float    spectrum  [METER_RESULTS_BANDS]; // Band levels (dBFS).
+    float    momentary;     // 400ms loudness (LUFS).
+    float    short_term;    // 3s loudness (LUFS).
+    float    integrated;    // Gated loudness (LUFS).
+    float    range;         // Loudness range (LU).
+    float    max_momentary; // Largest momentary loudness (LUFS).
+};
+
+/*
+    Layout of the shared memory object.
+*/
+struct meter_results_shm_t
+{
+    uint32_t magic;    // METER_RESULTS_MAGIC once set up.
+    uint32_t version;  // METER_RESULTS_VERSION.
+    uint32_t size;     // Size of the object.
+    uint32_t sequence; // Odd while results are being written.
+    struct   meter_results_t results; // Latest results.
+};
+
+struct meter_publisher_t
+{
+    char     name[VIS_NAME_LEN];        // Shared memory object name.
+    struct   meter_results_shm_t *shm;  // Mapped object.
+    uint32_t count;                     // Results published.
+};
+
+struct meter_subscriber_t
+{
+    char     name[VIS_NAME_LEN];        // Shared memory object name.
+    struct   meter_results_shm_t *shm;  // Mapped object, if open.
+    ino_t    inode;                     // Object mapped.
+    time_t   lastcheck;                 // Last check for a new object.
+    uint32_t sequence;                  // Sequence of last read.
+    uint32_t retries;                   // Reads retried since opened.
+};
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Creates a shared memory object for results. Returns NULL on failure.
+//  ---------------------------------------------------------------------------
+/*
+    name is NULL for METER_RESULTS_NAME. Any object of the same name is
+    replaced, so subscribers move to the new one within a second.
+*/
+struct meter_publisher_t *meter_publisher_create( const char *name );
+
+//  ---------------------------------------------------------------------------
+//  Removes a results object.
+//  ---------------------------------------------------------------------------
+void meter_publisher_destroy( struct meter_publisher_t *publisher );
+
+//  ---------------------------------------------------------------------------
+//  Publishes results, setting count and publish_ns.
+//  ---------------------------------------------------------------------------
+void meter_publish( struct meter_publisher_t *publisher,
+                    struct meter_results_t *results );
+
+//  ---------------------------------------------------------------------------
+//  Copies levels, indices and overloads from a peak meter into results.
+//  ---------------------------------------------------------------------------
+void meter_results_set_peak( struct meter_results_t *results,
+                             const struct peak_meter_t *peak_meter );
+
+//  ---------------------------------------------------------------------------
+//  Subscribes to a results object. Returns NULL if out of memory.
+//  ---------------------------------------------------------------------------
+/*
+    name is NULL for METER_RESULTS_NAME. The object doesn't need to exist
+    yet.
+*/
+struct meter_subscriber_t *meter_subscriber_open( const char *name );
+
+//  ---------------------------------------------------------------------------
+//  Unsubscribes from a results object.
+//  ---------------------------------------------------------------------------
+void meter_subscriber_close( struct meter_subscriber_t *subscriber );
+
+//  ---------------------------------------------------------------------------
+//  Copies the latest results. Returns true if they are new since last read.
+//  ---------------------------------------------------------------------------
+/*
+    Returns false if there is no publisher, the results haven't changed
+    or the publisher was always mid-write, e.g. because it died there.
+*/
+bool meter_subscriber_read( struct meter_subscriber_t *subscriber,
+                            struct meter_results_t *results );
+
+#endif // #ifndef METERPI_PUBLISH_H
@@ -0,0 +1,354 @@
+//  ===========================================================================
+/*
+    meterPi-source-alsa:
+
+    ALSA capture source for meterPi. Reads the capture ring in place with
+    the mmap functions so frames are never copied.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Compile with meterPi.c and link with -lasound.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+*/
+//  ===========================================================================
+
+//  Installed libraries -------------------------------------------------------
+
+#include <stdbool.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <alsa/asoundlib.h>
+
+//  Local libraries -----------------------------------------------------------
+
+#include "meterPi.h"
+#include "meterPi-source.h"
+
+//  Info. ---------------------------------------------------------------------
+/*
+    With interleaved mmap access the capture buffer is one ring of
+    buffer_size frames. snd_pcm_mmap_begin only returns frames up to the
+    end of the ring, so when the new frames wrap, the second span is taken
+    from the start of the same ring. Those frames are safe to read because
+    the device can't write to frames that haven't been committed. On end,
+    the first span is committed and the second is begun and committed in
+    turn, as ALSA requires.
+
+    Formats are tried in order of resolution so that 24 and 32-bit devices
+    are metered at full resolution. Plug devices can convert to any of
+    them, so the first is always used with those.
+*/
+
+//  Local variables. ----------------------------------------------------------
+
+static const struct
+{
+    snd_pcm_format_t alsa;   // ALSA format.
+    uint8_t          format; // Meter format.
+}
+alsa_formats[] =
+{
+    { SND_PCM_FORMAT_S32_LE,   METER_S32   },
+    { SND_PCM_FORMAT_S24_3LE,  METER_S24   },
+    { SND_PCM_FORMAT_FLOAT_LE, METER_FLOAT },
+    { SND_PCM_FORMAT_S16_LE,   METER_S16   }
+};
+
+//  Types. --------------------------------------------------------------------
+
+struct source_alsa_t
+{
+    snd_pcm_t        *pcm;          // Capture device, if open.
+    char              device[64];   // Device name.
+    uint32_t          rate;         // Requested rate.
+    uint32_t          actual;       // Rate the device is running at.
+    uint8_t           channels;     // Interleaved channels.
+    uint8_t           format;       // Format the device is running at.
+    uint8_t           width;        // Bytes per sample.
+    snd_pcm_uframes_t buffer_size;  // Frames in capture ring.
+    time_t            lastopen;     // Last attempt to open device.
+    bool              valid;        // Nothing missed since last read.
+    uint32_t          position;     // Frames committed.
+    snd_pcm_uframes_t offset;       // Ring offset of first span.
+    snd_pcm_uframes_t commit[2];    // Frames to commit from each span.
+};
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Closes an ALSA capture device.
+//  ---------------------------------------------------------------------------
+static void alsa_shut( struct source_alsa_t *alsa )
+{
+    if ( alsa->pcm ) snd_pcm_close( alsa->pcm );
+    alsa->pcm   = NULL;
+    alsa->valid = false;
+}
+
+//  ---------------------------------------------------------------------------
+//  Opens an ALSA capture device for interleaved mmap access and starts it.
+//  ---------------------------------------------------------------------------
+static void alsa_reopen( struct source_alsa_t *alsa )
+{
+    snd_pcm_hw_params_t *hw;
+    unsigned int rate = alsa->rate;
+    unsigned int time = SOURCE_ALSA_BUFFER;
+    uint8_t      i;
+
+    alsa_shut( alsa );
+    if ( snd_pcm_open( &alsa->pcm, alsa->device, SND_PCM_STREAM_CAPTURE,
+                       SND_PCM_NONBLOCK ) < 0 )
+    {
+        alsa->pcm = NULL;
+        return;
+    }
+
+    snd_pcm_hw_params_alloca( &hw );
+    if ( snd_pcm_hw_params_any( alsa->pcm, hw ) < 0 ||
+         snd_pcm_hw_params_set_access( alsa->pcm, hw,
+                                       SND_PCM_ACCESS_MMAP_INTERLEAVED ) < 0 )
+    {
+        alsa_shut( alsa );
+        return;
+    }
+
+    for ( i = 0; i < sizeof( alsa_formats ) / sizeof( alsa_formats[0] ); i++ )
+        if ( snd_pcm_hw_params_test_format( alsa->pcm, hw,
+                                            alsa_formats[i].alsa ) == 0 )
+            break;
+
+    if ( i == sizeof( alsa_formats ) / sizeof( alsa_formats[0] ) ||
+         snd_pcm_hw_params_set_format( alsa->pcm, hw,
+                                       alsa_formats[i].alsa ) < 0 ||
+         snd_pcm_hw_params_set_channels( alsa->pcm, hw,
+                                         alsa->channels ) < 0 ||
+         snd_pcm_hw_params_set_rate_near( alsa->pcm, hw, &rate, 0 ) < 0 ||
+         snd_pcm_hw_params_set_buffer_time_near( alsa->pcm, hw,
+                                                 &time, 0 ) < 0 ||
+         snd_pcm_hw_params( alsa->pcm, hw ) < 0 ||
+         snd_pcm_hw_params_get_buffer_size( hw, &alsa->buffer_size ) < 0 ||
+         snd_pcm_prepare( alsa->pcm ) < 0 ||
+         snd_pcm_start( alsa->pcm ) < 0 )
+    {
+        alsa_shut( alsa );
+        return;
+    }
+    alsa->actual = rate;
+    alsa->format = alsa_formats[i].format;
+    alsa->width  = meter_format_width( alsa->format );
+}
+
+//  ---------------------------------------------------------------------------
+//  Recovers from an overrun or suspend. Returns false if the device is gone.
+//  ---------------------------------------------------------------------------
+static bool alsa_recover( struct source_alsa_t *alsa, int err )
+{
+    alsa->valid = false;
+
+    if ( snd_pcm_recover( alsa->pcm, err, 1 ) < 0 ||
+         ( snd_pcm_state( alsa->pcm ) == SND_PCM_STATE_PREPARED &&
+           snd_pcm_start( alsa->pcm ) < 0 ))
+    {
+        alsa_shut( alsa );
+        return false;
+    }
+
+    return true;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the status of an ALSA capture device, opening it if necessary.
+//  ---------------------------------------------------------------------------
+static void alsa_check( void *state, struct meter_status_t *status )
+{
+    struct source_alsa_t *alsa = state;
+    snd_pcm_sframes_t avail;
+    time_t now = time( NULL );
+
+    status->running = false;
+    status->rate    = alsa->actual;
+
+    if ( !alsa->pcm )
+    {
+        if ( now - alsa->lastopen > 5 )
+        {
+            alsa_reopen( alsa );
+            alsa->lastopen = now;
+        }
+        if ( !alsa->pcm ) return;
+    }
+
+    avail = snd_pcm_avail_update( alsa->pcm );
+    if ( avail < 0 )
+    {
+        if ( !alsa_recover( alsa, avail )) return;
+        avail = 0;
+    }
+
+    status->running  = snd_pcm_state( alsa->pcm ) == SND_PCM_STATE_RUNNING;
+    status->rate     = alsa->actual;
+    status->position = alsa->position + avail;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns captured frames in place.
+//  ---------------------------------------------------------------------------
+static bool alsa_begin( void *state, struct meter_read_t *read,
+                        uint32_t frames )
+{
+    struct source_alsa_t *alsa = state;
+    const  snd_pcm_channel_area_t *areas;
+    const  uint8_t *ring;
+    snd_pcm_sframes_t avail;
+    snd_pcm_uframes_t first, skip;
+    int    err;
+
+    if ( !alsa->pcm ) return false;
+
+    avail = snd_pcm_avail_update( alsa->pcm );
+    if ( avail < 0 )
+    {
+        alsa_recover( alsa, avail );
+        return false;
+    }
+    if ( snd_pcm_state( alsa->pcm ) != SND_PCM_STATE_RUNNING )
+    {
+        alsa->valid = false;
+        return false;
+    }
+
+    first = avail;
+    err = snd_pcm_mmap_begin( alsa->pcm, &areas, &alsa->offset, &first );
+    if ( err < 0 )
+    {
+        alsa_recover( alsa, err );
+        return false;
+    }
+
+    // Interleaved frames, so the ring is the first channel's area.
+    ring = (const uint8_t *) areas[0].addr + areas[0].first / 8;
+    if ( areas[0].step != alsa->channels * alsa->width * 8u )
+    {
+        snd_pcm_mmap_commit( alsa->pcm, alsa->offset, 0 );
+        alsa_shut( alsa );
+        return false;
+    }
+
+    alsa->commit[0] = first;
+    alsa->commit[1] = avail - first;
+
+    read->rate       = alsa->actual;
+    read->format     = alsa->format;
+    read->channels   = alsa->channels;
+    read->continuous = alsa->valid;
+    read->spans      = meter_format_spans( ring, alsa->format, alsa->channels,
+                                           alsa->buffer_size * alsa->channels,
+                                           alsa->offset * alsa->channels,
+                                           avail, read->span );
+
+    // After a gap only the newest frames are wanted, but all are committed.
+    if ( !alsa->valid && (snd_pcm_uframes_t) avail > frames )
+    {
+        skip = avail - frames;
+        if ( read->spans == 2 && skip >= read->span[0].frames )
+        {
+            skip -= read->span[0].frames;
+            read->span[0] = read->span[1];
+            read->spans = 1;
+        }
+        read->span[0].samples = (const uint8_t *) read->span[0].samples +
+                                skip * alsa->channels * alsa->width;
+        read->span[0].frames  -= skip;
+    }
+
+    alsa->valid = true;
+
+    return true;
+}
+
+//  ---------------------------------------------------------------------------
+//  Commits frames that have been read.
+//  ---------------------------------------------------------------------------
+static void alsa_end( void *state, const struct meter_read_t *read )
+{
+    struct source_alsa_t *alsa = state;
+    const  snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t offset, second;
+    snd_pcm_sframes_t err;
+
+    (void) read;
+    if ( !alsa->pcm ) return;
+
+    err = snd_pcm_mmap_commit( alsa->pcm, alsa->offset, alsa->commit[0] );
+    if ( err >= 0 && alsa->commit[1] > 0 )
+    {
+        second = alsa->commit[1];
+        err = snd_pcm_mmap_begin( alsa->pcm, &areas, &offset, &second );
+        if ( err >= 0 )
+            err = snd_pcm_mmap_commit( alsa->pcm, offset, second );
+    }
+
+    if ( err < 0 ) alsa_recover( alsa, err );
+    else alsa->position += alsa->commit[0] + alsa->commit[1];
+}
+
+//  ---------------------------------------------------------------------------
+//  Closes an ALSA capture device and frees its source.
+//  ---------------------------------------------------------------------------
+static void alsa_close( void *state )
+{
+    alsa_shut( state );
+    free( state );
+}
+
+//  ---------------------------------------------------------------------------
+//  Creates a source for an ALSA capture device.
+//  ---------------------------------------------------------------------------
+bool source_alsa( struct meter_source_t *source, const char *device,
+                  uint32_t rate, uint8_t channels )
+{
+    struct source_alsa_t *alsa;
+
+    if ( channels == 0 || channels > METER_CHANNELS_MAX ) return false;
+
+    alsa = calloc( 1, sizeof( struct source_alsa_t ));
+    if ( !alsa ) return false;
+
+    snprintf( alsa->device, sizeof( alsa->device ), "%s", device );
+    alsa->rate     = rate;
+    alsa->channels = channels;
+
+    source->name  = "alsa";
+    source->state = alsa;
+    source->check = alsa_check;
+    source->begin = alsa_begin;
+    source->end   = alsa_end;
+    source->close = alsa_close;
+
+    return true;
+}
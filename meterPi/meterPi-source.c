@@ -0,0 +1,418 @@
+//  ===========================================================================
+/*
+    meterPi-source:
+
+    Audio sources for meterPi other than Squeezelite. ALSA capture, WAV
+    files and raw PCM from a pipe.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Compile with meterPi.c. The ALSA source is in meterPi-source-alsa.c.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+*/
+//  ===========================================================================
+
+//  Installed libraries -------------------------------------------------------
+
+#include <stdbool.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//  Local libraries -----------------------------------------------------------
+
+#include "meterPi.h"
+#include "meterPi-source.h"
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Returns little endian values from a WAV header.
+//  ---------------------------------------------------------------------------
+static uint16_t wav_u16( const uint8_t *p )
+{
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t wav_u32( const uint8_t *p )
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+//  ---------------------------------------------------------------------------
+//  Finds the format and data in a mapped WAV file.
+//  ---------------------------------------------------------------------------
+/*
+    16, 24 and 32-bit PCM and 32-bit float with up to METER_CHANNELS_MAX
+    channels are accepted, in either the plain or extensible format. Chunks are padded
+    to even sizes so 16-bit data is always aligned, but 32-bit data that
+    isn't aligned is refused rather than read a byte at a time.
+*/
+static bool wav_parse( struct source_wav_t *wav )
+{
+    const uint8_t *file = wav->map;
+    const uint8_t *chunk;
+    size_t   pos = 12;
+    uint32_t size;
+    uint16_t format = 0, channels = 0, bits = 0;
+    uint8_t  width;
+
+    if ( wav->map_size < 12 || memcmp( file, "RIFF", 4 ) ||
+         memcmp( file + 8, "WAVE", 4 ))
+        return false;
+
+    while ( pos + 8 <= wav->map_size )
+    {
+        chunk = file + pos;
+        size  = wav_u32( chunk + 4 );
+        if ( size > wav->map_size - pos - 8 ) size = wav->map_size - pos - 8;
+
+        if ( memcmp( chunk, "fmt ", 4 ) == 0 && size >= 16 )
+        {
+            format    = wav_u16( chunk + 8 );
+            channels  = wav_u16( chunk + 10 );
+            wav->rate = wav_u32( chunk + 12 );
+            bits      = wav_u16( chunk + 22 );
+            if ( format == 0xfffe && size >= 26 )
+                format = wav_u16( chunk + 32 );
+        }
+        else if ( memcmp( chunk, "data", 4 ) == 0 && format != 0 )
+        {
+            if ( format == 1 && bits == 16 )      wav->format = METER_S16;
+            else if ( format == 1 && bits == 24 ) wav->format = METER_S24;
+            else if ( format == 1 && bits == 32 ) wav->format = METER_S32;
+            else if ( format == 3 && bits == 32 ) wav->format = METER_FLOAT;
+            else return false;
+
+            width = meter_format_width( wav->format );
+            if ( channels == 0 || channels > METER_CHANNELS_MAX ||
+                 wav->rate == 0 ||
+                 ( width != 3 && ( pos + 8 ) % width ))
+                return false;
+            wav->channels = channels;
+            wav->data     = chunk + 8;
+            wav->frames   = size / ( channels * width );
+            return wav->frames > 0;
+        }
+        pos += 8 + size + ( size & 1 );
+    }
+
+    return false;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the number of frames of a WAV file that have been played.
+//  ---------------------------------------------------------------------------
+static uint64_t wav_target( struct source_wav_t *wav )
+{
+    struct   timespec now;
+    uint64_t target;
+
+    if ( !wav->valid ) return 0;
+
+    if ( wav->block > 0 ) target = wav->pos + wav->block;
+    else
+    {
+        clock_gettime( CLOCK_MONOTONIC, &now );
+        target = (( now.tv_sec - wav->start.tv_sec ) * 1000000000ULL +
+                  ( now.tv_nsec - wav->start.tv_nsec )) * wav->rate /
+                 1000000000ULL;
+    }
+    if ( !wav->loop && target > wav->frames ) target = wav->frames;
+
+    return target;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the status of a WAV file.
+//  ---------------------------------------------------------------------------
+static void wav_check( void *state, struct meter_status_t *status )
+{
+    struct source_wav_t *wav = state;
+
+    status->running  = wav->loop || wav->pos < wav->frames;
+    status->rate     = wav->rate;
+    status->position = wav_target( wav );
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns frames of a WAV file in place.
+//  ---------------------------------------------------------------------------
+static bool wav_begin( void *state, struct meter_read_t *read,
+                       uint32_t frames )
+{
+    struct source_wav_t *wav = state;
+    uint64_t target, start;
+
+    if ( !wav->loop && wav->pos >= wav->frames ) return false;
+
+    // Playing starts with the first read.
+    if ( !wav->valid )
+    {
+        clock_gettime( CLOCK_MONOTONIC, &wav->start );
+        wav->pos   = 0;
+        wav->valid = true;
+        read->continuous = false;
+    }
+    else read->continuous = true;
+
+    target = wav_target( wav );
+    start  = wav->pos;
+
+    // The reader has fallen more than the whole file behind.
+    if ( target - start > wav->frames )
+    {
+        if ( frames > wav->frames ) frames = wav->frames;
+        start = target - frames;
+        read->continuous = false;
+    }
+
+    read->rate     = wav->rate;
+    read->format   = wav->format;
+    read->channels = wav->channels;
+    read->spans    = meter_format_spans( wav->data, wav->format,
+                                         wav->channels,
+                                         wav->frames * wav->channels,
+                                         ( start % wav->frames ) *
+                                         wav->channels,
+                                         target - start, read->span );
+    wav->pos = target;
+
+    return true;
+}
+
+//  ---------------------------------------------------------------------------
+//  Unmaps a WAV file and frees its source.
+//  ---------------------------------------------------------------------------
+static void wav_close( void *state )
+{
+    struct source_wav_t *wav = state;
+
+    munmap( wav->map, wav->map_size );
+    free( wav );
+}
+
+//  ---------------------------------------------------------------------------
+//  Creates a source for a WAV file.
+//  ---------------------------------------------------------------------------
+bool source_wav( struct meter_source_t *source, const char *path,
+                 uint32_t block, bool loop )
+{
+    struct source_wav_t *wav;
+    struct stat info;
+    int    fd;
+
+    wav = calloc( 1, sizeof( struct source_wav_t ));
+    if ( !wav ) return false;
+
+    fd = open( path, O_RDONLY );
+    if ( fd < 0 || fstat( fd, &info ) != 0 || info.st_size == 0 )
+    {
+        if ( fd >= 0 ) close( fd );
+        free( wav );
+        return false;
+    }
+
+    wav->map_size = info.st_size;
+    wav->map = mmap( NULL, wav->map_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if ( wav->map == MAP_FAILED )
+    {
+        free( wav );
+        return false;
+    }
+
+    if ( !wav_parse( wav ))
+    {
+        wav_close( wav );
+        return false;
+    }
+    madvise( wav->map, wav->map_size, MADV_SEQUENTIAL );
+
+    wav->block = block;
+    wav->loop  = loop;
+
+    source->name  = "wav";
+    source->state = wav;
+    source->check = wav_check;
+    source->begin = wav_begin;
+    source->end   = NULL;
+    source->close = wav_close;
+
+    return true;
+}
+
+//  ---------------------------------------------------------------------------
+//  Reads everything waiting in a pipe into its ring.
+//  ---------------------------------------------------------------------------
+/*
+    Bytes go straight into the ring, so a frame split across two reads is
+    completed by the next. Only a ring full is read per call so a fast
+    writer can't keep the reader here.
+*/
+static void pipe_drain( struct source_pipe_t *pipe )
+{
+    uint8_t *ring = pipe->ring;
+    size_t   size = pipe->frames * pipe->frame_size;
+    size_t   total = 0, offset, space;
+    ssize_t  bytes;
+
+    while ( !pipe->eof && total < size )
+    {
+        offset = pipe->bytes % size;
+        space  = size - offset;
+
+        bytes = read( pipe->fd, ring + offset, space );
+        if ( bytes > 0 )
+        {
+            pipe->bytes += bytes;
+            total += bytes;
+            clock_gettime( CLOCK_MONOTONIC, &pipe->received );
+        }
+        else if ( bytes == 0 ) pipe->eof = true;
+        else if ( errno != EINTR ) break;
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns whether data has arrived through a pipe recently.
+//  ---------------------------------------------------------------------------
+static bool pipe_running( struct source_pipe_t *pipe )
+{
+    struct timespec now;
+
+    if ( pipe->eof || pipe->bytes == 0 ) return false;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return now.tv_sec - pipe->received.tv_sec < SOURCE_PIPE_TIMEOUT ||
+           ( now.tv_sec - pipe->received.tv_sec == SOURCE_PIPE_TIMEOUT &&
+             now.tv_nsec < pipe->received.tv_nsec );
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the status of a pipe.
+//  ---------------------------------------------------------------------------
+static void pipe_check( void *state, struct meter_status_t *status )
+{
+    struct source_pipe_t *pipe = state;
+
+    pipe_drain( pipe );
+
+    status->running  = pipe_running( pipe );
+    status->rate     = pipe->rate;
+    status->position = pipe->bytes / pipe->frame_size;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns frames from a pipe's ring in place.
+//  ---------------------------------------------------------------------------
+static bool pipe_begin( void *state, struct meter_read_t *read,
+                        uint32_t frames )
+{
+    struct source_pipe_t *pipe = state;
+    uint64_t written, start;
+
+    pipe_drain( pipe );
+    if ( !pipe_running( pipe ))
+    {
+        pipe->valid = false;
+        return false;
+    }
+
+    /*
+        The slot after the newest frame may hold part of the next frame,
+        so at most a ring full less one frame can be read.
+    */
+    written = pipe->bytes / pipe->frame_size;
+    start   = pipe->pos;
+    read->continuous = pipe->valid && written - start < pipe->frames;
+    if ( !read->continuous )
+    {
+        if ( frames > pipe->frames - 1 ) frames = pipe->frames - 1;
+        start = written > frames ? written - frames : 0;
+    }
+
+    read->rate     = pipe->rate;
+    read->format   = pipe->format;
+    read->channels = pipe->channels;
+    read->spans    = meter_format_spans( pipe->ring, pipe->format,
+                                         pipe->channels,
+                                         pipe->frames * pipe->channels,
+                                         ( start % pipe->frames ) *
+                                         pipe->channels,
+                                         written - start, read->span );
+    pipe->pos   = written;
+    pipe->valid = true;
+
+    return true;
+}
+
+//  ---------------------------------------------------------------------------
+//  Frees a pipe source.
+//  ---------------------------------------------------------------------------
+static void pipe_close( void *state )
+{
+    free( state );
+}
+
+//  ---------------------------------------------------------------------------
+//  Creates a source for raw PCM from a file descriptor.
+//  ---------------------------------------------------------------------------
+bool source_pipe( struct meter_source_t *source, int fd, uint32_t rate,
+                  uint8_t format, uint8_t channels )
+{
+    struct source_pipe_t *pipe;
+
+    if ( format >= METER_FORMATS || channels == 0 ||
+         channels > METER_CHANNELS_MAX ) return false;
+    if ( posix_memalign( (void **) &pipe, VIS_ALIGN,
+                         sizeof( struct source_pipe_t )))
+        return false;
+    memset( pipe, 0, sizeof( struct source_pipe_t ));
+
+    pipe->fd         = fd;
+    pipe->rate       = rate;
+    pipe->format     = format;
+    pipe->channels   = channels;
+    pipe->frame_size = channels * meter_format_width( format );
+    pipe->frames     = sizeof( pipe->ring ) / pipe->frame_size;
+    if ( pipe->frames > SOURCE_PIPE_FRAMES ) pipe->frames = SOURCE_PIPE_FRAMES;
+    fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+
+    source->name  = "pipe";
+    source->state = pipe;
+    source->check = pipe_check;
+    source->begin = pipe_begin;
+    source->end   = NULL;
+    source->close = pipe_close;
+
+    return true;
+}
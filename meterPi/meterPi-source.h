@@ -0,0 +1,152 @@
+//  ===========================================================================
+/*
+    meterPi-source:
+
+    Audio sources for meterPi other than Squeezelite. ALSA capture, WAV
+    files and raw PCM from a pipe.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+
+    Changelog:
+
+        v01.00      Original version.
+        v01.01      Added 24-bit, 32-bit and float sample formats.
+        v01.02      Added runtime channel count.
+*/
+//  ===========================================================================
+
+#ifndef METERPI_SOURCE_H
+#define METERPI_SOURCE_H
+
+//  Info. ---------------------------------------------------------------------
+/*
+    Each function fills in a struct meter_source_t to pass to
+    meter_open_source, which owns it from then on. All sources are little
+    endian interleaved frames of 1 to METER_CHANNELS_MAX channels, in any
+    of the formats in meterPi-kernel.h.
+
+    e.g.
+
+        struct meter_source_t source;
+        struct meter_t *meter = NULL;
+
+        if ( source_alsa( &source, "hw:1,0", 48000, 2 ))
+            meter = meter_open_source( &source );
+
+    ALSA:   Captures from a device, e.g. a loopback device that a player is
+            also writing to. The capture ring is read in place with
+            snd_pcm_mmap_begin and commit, so frames are never copied. The
+            format with the most resolution the device has is used, from
+            S32_LE, S24_3LE, FLOAT_LE and S16_LE. The device is reopened if
+            it goes away, as for Squeezelite. Compile with
+            meterPi-source-alsa.c and link with -lasound.
+
+    WAV:    Maps a file and reads it in place. With block set to 0 frames
+            are read at the file's rate as though it were playing.
+            Otherwise each read returns block frames, however often it is
+            called, which gives the same input on every run for tests and
+            benchmarks. The file can loop or stop at the end.
+
+    Pipe:   Raw PCM at a given rate and format from a file descriptor, e.g.
+            stdin, is read without blocking into a ring. The stream is
+            stopped if no data arrives for a second and at end of file.
+            The ring holds SOURCE_PIPE_FRAMES stereo frames of any format
+            but fewer frames of more channels.
+*/
+
+//  Macros. -------------------------------------------------------------------
+
+#define SOURCE_PIPE_FRAMES  16384 // Most frames in pipe ring.
+#define SOURCE_PIPE_TIMEOUT 1     // Seconds without data before stopped.
+#define SOURCE_ALSA_BUFFER  500000 // ALSA capture buffer time (us).
+
+//  Types. --------------------------------------------------------------------
+
+struct source_wav_t
+{
+    void           *map;      // Mapped file.
+    size_t          map_size; // Size of mapping.
+    const void     *data;     // First sample.
+    uint32_t        frames;   // Frames in file.
+    uint32_t        rate;     // Sample rate.
+    uint8_t         format;   // Sample format.
+    uint8_t         channels; // Interleaved channels.
+    uint32_t        block;    // Frames per read, 0 for real time.
+    bool            loop;     // Start again at end of file.
+    bool            valid;    // Position is valid.
+    uint64_t        pos;      // Frames read.
+    struct timespec start;    // Time of first read.
+};
+
+struct source_pipe_t
+{
+    int             fd;       // Descriptor to read.
+    uint32_t        rate;     // Sample rate.
+    uint8_t         format;   // Sample format.
+    uint8_t         channels; // Interleaved channels.
+    uint8_t         frame_size; // Bytes per frame.
+    uint32_t        frames;   // Frames the ring holds.
+    bool            eof;      // Writer has closed the pipe.
+    bool            valid;    // Position is valid.
+    uint64_t        bytes;    // Bytes received.
+    uint64_t        pos;      // Frames read.
+    struct timespec received; // Time data was last received.
+    uint8_t         ring[SOURCE_PIPE_FRAMES * VIS_CHANNELS *
+                         sizeof( int32_t )]
+                    __attribute__(( aligned( VIS_ALIGN )));
+};
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Creates a source for an ALSA capture device.
+//  ---------------------------------------------------------------------------
+/*
+    The device does not need to exist yet. rate is the nearest the device
+    supports but it must support the number of channels. Returns false if
+    the number of channels isn't supported or out of memory.
+*/
+bool source_alsa( struct meter_source_t *source, const char *device,
+                  uint32_t rate, uint8_t channels );
+
+//  ---------------------------------------------------------------------------
+//  Creates a source for a WAV file.
+//  ---------------------------------------------------------------------------
+/*
+    Returns false if the file can't be read, has more than
+    METER_CHANNELS_MAX channels or isn't in one of the sample formats.
+*/
+bool source_wav( struct meter_source_t *source, const char *path,
+                 uint32_t block, bool loop );
+
+//  ---------------------------------------------------------------------------
+//  Creates a source for raw PCM from a file descriptor.
+//  ---------------------------------------------------------------------------
+/*
+    format is one of the sample formats in meterPi-kernel.h. The descriptor
+    is set non-blocking. It isn't closed with the source. Returns false if
+    the format or number of channels isn't supported or out of memory.
+*/
+bool source_pipe( struct meter_source_t *source, int fd, uint32_t rate,
+                  uint8_t format, uint8_t channels );
+
+#endif // #ifndef METERPI_SOURCE_H
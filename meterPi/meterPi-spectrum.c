@@ -0,0 +1,504 @@
+//  ===========================================================================
+/*
+    meterPi-spectrum:
+
+    Spectrum analyser for meterPi. Windowed fixed-point FFT of the stream
+    binned into logarithmic frequency bands with bar graph ballistics.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Compile with meterPi.c. The NEON FFT is only built with the Raspberry
+    Pi v2 flags.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+*/
+//  ===========================================================================
+
+//  Installed libraries -------------------------------------------------------
+
+#include <stdbool.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#include <arm_neon.h>
+#if defined( __arm__ )
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+//  Local libraries -----------------------------------------------------------
+
+#include "meterPi.h"
+#include "meterPi-spectrum.h"
+
+//  Macros. -------------------------------------------------------------------
+
+/*
+    Power of the bins of a full scale sine. The transform is scaled by 1/N
+    so a sine of amplitude A peaks at A/4 with the Hann window, and the
+    main lobe holds 1.5 times the power of its peak bin.
+*/
+#define SPECTRUM_REF ( 1.5f * 8192 * 8192 )
+
+//  Local variables. ----------------------------------------------------------
+
+const uint8_t spectrum_hd44780_chars[8][8] =
+    {{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f },
+     { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f, 0x1f },
+     { 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f, 0x1f, 0x1f },
+     { 0x00, 0x00, 0x00, 0x00, 0x1f, 0x1f, 0x1f, 0x1f },
+     { 0x00, 0x00, 0x00, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f },
+     { 0x00, 0x00, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f },
+     { 0x00, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f },
+     { 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f }};
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Q15 multiply, rounded as vqrdmulh.
+//  ---------------------------------------------------------------------------
+static inline int16_t spectrum_mul( int16_t a, int16_t b )
+{
+    return ( a * b + 0x4000 ) >> 15;
+}
+
+//  ---------------------------------------------------------------------------
+//  One radix-2 stage of the complex FFT.
+//  ---------------------------------------------------------------------------
+static void spectrum_fft_stage( int16_t *re, int16_t *im, uint16_t points,
+                                uint16_t half, const int16_t *wr,
+                                const int16_t *wi )
+{
+    uint16_t g, j, a, b;
+    int16_t  tr, ti;
+
+    for ( g = 0; g < points; g += half << 1 )
+    {
+        for ( j = 0; j < half; j++ )
+        {
+            a = g + j;
+            b = a + half;
+
+            tr = spectrum_mul( re[b], wr[j] ) - spectrum_mul( im[b], wi[j] );
+            ti = spectrum_mul( re[b], wi[j] ) + spectrum_mul( im[b], wr[j] );
+
+            re[b] = ( re[a] - tr ) >> 1;
+            im[b] = ( im[a] - ti ) >> 1;
+            re[a] = ( re[a] + tr ) >> 1;
+            im[a] = ( im[a] + ti ) >> 1;
+        }
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Reference complex FFT kernel.
+//  ---------------------------------------------------------------------------
+/*
+    Input is in bit reversed order. Twiddles for the stage with butterflies
+    half apart start at half - 1.
+*/
+void spectrum_fft_scalar( int16_t *re, int16_t *im, uint16_t points,
+                          const int16_t *wr, const int16_t *wi )
+{
+    uint16_t half;
+
+    for ( half = 1; half < points; half <<= 1 )
+        spectrum_fft_stage( re, im, points, half, wr + half - 1,
+                            wi + half - 1 );
+}
+
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+//  ---------------------------------------------------------------------------
+//  NEON complex FFT kernel.
+//  ---------------------------------------------------------------------------
+/*
+    Stages with at least 8 butterflies per group do 8 at a time. The first
+    three stages are done by the scalar code.
+*/
+void spectrum_fft_neon( int16_t *re, int16_t *im, uint16_t points,
+                        const int16_t *wr, const int16_t *wi )
+{
+    int16x8_t ar, ai, br, bi, cr, ci, tr, ti;
+    uint16_t  half, g, j, a, b;
+
+    for ( half = 1; half < points && half < 8; half <<= 1 )
+        spectrum_fft_stage( re, im, points, half, wr + half - 1,
+                            wi + half - 1 );
+
+    for ( ; half < points; half <<= 1 )
+    {
+        for ( g = 0; g < points; g += half << 1 )
+        {
+            for ( j = 0; j < half; j += 8 )
+            {
+                a = g + j;
+                b = a + half;
+
+                ar = vld1q_s16( re + a );
+                ai = vld1q_s16( im + a );
+                br = vld1q_s16( re + b );
+                bi = vld1q_s16( im + b );
+                cr = vld1q_s16( wr + half - 1 + j );
+                ci = vld1q_s16( wi + half - 1 + j );
+
+                tr = vsubq_s16( vqrdmulhq_s16( br, cr ),
+                                vqrdmulhq_s16( bi, ci ));
+                ti = vaddq_s16( vqrdmulhq_s16( br, ci ),
+                                vqrdmulhq_s16( bi, cr ));
+
+                vst1q_s16( re + b, vhsubq_s16( ar, tr ));
+                vst1q_s16( im + b, vhsubq_s16( ai, ti ));
+                vst1q_s16( re + a, vhaddq_s16( ar, tr ));
+                vst1q_s16( im + a, vhaddq_s16( ai, ti ));
+            }
+        }
+    }
+}
+#endif
+
+//  ---------------------------------------------------------------------------
+//  Returns the fastest FFT kernel supported by the running CPU.
+//  ---------------------------------------------------------------------------
+static spectrum_fft_t spectrum_fft_select( void )
+{
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#if defined( __arm__ )
+    if ( getauxval( AT_HWCAP ) & HWCAP_NEON ) return spectrum_fft_neon;
+#else
+    return spectrum_fft_neon;
+#endif
+#endif
+
+    return spectrum_fft_scalar;
+}
+
+//  ---------------------------------------------------------------------------
+//  Creates a spectrum analyser. Returns NULL if the settings are invalid.
+//  ---------------------------------------------------------------------------
+struct spectrum_t *spectrum_create( const struct spectrum_config_t *config )
+{
+    struct spectrum_t *spectrum;
+    uint16_t points, half, i, j, m;
+    uint8_t  bit;
+
+    if ( config->size < SPECTRUM_SIZE_MIN ||
+         config->size > SPECTRUM_SIZE_MAX ||
+         ( config->size & ( config->size - 1 )) ||
+         config->hop == 0 || config->bands == 0 ||
+         config->bands > SPECTRUM_BANDS_MAX ||
+         config->low == 0 || config->low >= config->high ||
+         config->floor >= 0 )
+        return NULL;
+
+    if ( posix_memalign( (void **) &spectrum, VIS_ALIGN,
+                         sizeof( struct spectrum_t )))
+        return NULL;
+    memset( spectrum, 0, sizeof( struct spectrum_t ));
+
+    spectrum->config = *config;
+    spectrum->fft    = spectrum_fft_select();
+
+    points = config->size / 2;
+    spectrum->bits = __builtin_ctz( points );
+
+    // Bit reversed order of complex input.
+    for ( i = 0; i < points; i++ )
+    {
+        for ( m = 0, bit = 0; bit < spectrum->bits; bit++ )
+            if ( i & ( 1 << bit )) m |= 1 << ( spectrum->bits - 1 - bit );
+        spectrum->bitrev[i] = m;
+    }
+
+    // Hann window.
+    for ( i = 0; i < config->size; i++ )
+        spectrum->window[i] = lrint( 32767 * 0.5 *
+                              ( 1 - cos( 2 * M_PI * i / config->size )));
+
+    // Complex FFT twiddles, one run per stage.
+    for ( half = 1; half < points; half <<= 1 )
+    {
+        for ( j = 0; j < half; j++ )
+        {
+            spectrum->wr[half - 1 + j] = lrint(  32767 * cos( M_PI * j / half ));
+            spectrum->wi[half - 1 + j] = lrint( -32767 * sin( M_PI * j / half ));
+        }
+    }
+
+    // Twiddles to split the complex FFT into the real spectrum.
+    for ( i = 0; i <= points; i++ )
+    {
+        spectrum->split_r[i] =  cos( M_PI * i / points );
+        spectrum->split_i[i] = -sin( M_PI * i / points );
+    }
+
+    spectrum_reset( spectrum, 0, 0 );
+
+    return spectrum;
+}
+
+//  ---------------------------------------------------------------------------
+//  Frees a spectrum analyser.
+//  ---------------------------------------------------------------------------
+void spectrum_destroy( struct spectrum_t *spectrum )
+{
+    free( spectrum );
+}
+
+//  ---------------------------------------------------------------------------
+//  Empties the history and maps bins to bands for a sample rate.
+//  ---------------------------------------------------------------------------
+void spectrum_reset( void *state, uint32_t rate, uint8_t channels )
+{
+    struct spectrum_t        *spectrum = state;
+    struct spectrum_config_t *config   = &spectrum->config;
+    uint16_t points = config->size / 2;
+    uint16_t lo, hi, prev = 1;
+    double   ratio, hop_ms;
+    uint8_t  band;
+
+    spectrum->channels   = channels;
+    spectrum->pos        = 0;
+    spectrum->filled     = 0;
+    spectrum->since      = 0;
+    spectrum->transforms = 0;
+    for ( band = 0; band < config->bands; band++ )
+        spectrum->level[band] = config->floor;
+
+    if ( rate == 0 || rate == spectrum->rate ) return;
+    spectrum->rate = rate;
+
+    // Logarithmic band edges, at least one bin per band while bins last.
+    ratio = (double) config->high / config->low;
+    for ( band = 0; band < config->bands; band++ )
+    {
+        lo = lrint( config->low * pow( ratio, (double) band / config->bands )
+                    * config->size / rate );
+        hi = lrint( config->low *
+                    pow( ratio, (double)( band + 1 ) / config->bands )
+                    * config->size / rate );
+        if ( lo < prev ) lo = prev;
+        if ( hi <= lo ) hi = lo + 1;
+        if ( lo > points + 1 ) lo = points + 1;
+        if ( hi > points + 1 ) hi = points + 1;
+
+        spectrum->band_lo[band] = lo;
+        spectrum->band_hi[band] = hi;
+        prev = hi;
+    }
+
+    // Ballistics coefficients for one hop.
+    hop_ms = 1000.0 * config->hop / rate;
+    spectrum->attack = config->attack ?
+                       1 - exp( -hop_ms / config->attack ) : 1;
+    spectrum->decay  = config->decay ?
+                       1 - exp( -hop_ms / config->decay ) : 1;
+}
+
+//  ---------------------------------------------------------------------------
+//  Transforms the history and updates the band levels.
+//  ---------------------------------------------------------------------------
+static void spectrum_transform( struct spectrum_t *spectrum )
+{
+    struct spectrum_config_t *config = &spectrum->config;
+    uint16_t points = config->size / 2;
+    uint16_t mask   = config->size - 1;
+    uint16_t i, k, n;
+    float    ar, ai, br, bi, evr, evi, odr, odi, xr, xi, sum, dB;
+    uint8_t  band;
+
+    // Window and halve the oldest to newest samples, packed as complex.
+    for ( i = 0; i < points; i++ )
+    {
+        n = ( spectrum->pos + 2 * i ) & mask;
+        spectrum->re[spectrum->bitrev[i]] =
+            ( spectrum->ring[n] * spectrum->window[2 * i] + 0x8000 ) >> 16;
+        n = ( n + 1 ) & mask;
+        spectrum->im[spectrum->bitrev[i]] =
+            ( spectrum->ring[n] * spectrum->window[2 * i + 1] + 0x8000 ) >> 16;
+    }
+
+    spectrum->fft( spectrum->re, spectrum->im, points,
+                   spectrum->wr, spectrum->wi );
+
+    // Split into the spectrum of the real input.
+    for ( k = 0; k <= points; k++ )
+    {
+        ar =  spectrum->re[k % points];
+        ai =  spectrum->im[k % points];
+        br =  spectrum->re[( points - k ) % points];
+        bi = -spectrum->im[( points - k ) % points];
+
+        // Twice the transforms of the even and odd samples.
+        evr = ar + br;
+        evi = ai + bi;
+        odr = ai - bi;
+        odi = br - ar;
+
+        xr = evr + odr * spectrum->split_r[k] - odi * spectrum->split_i[k];
+        xi = evi + odr * spectrum->split_i[k] + odi * spectrum->split_r[k];
+
+        spectrum->power[k] = ( xr * xr + xi * xi ) * 0.25f;
+    }
+
+    // Band levels with ballistics.
+    for ( band = 0; band < config->bands; band++ )
+    {
+        sum = 0;
+        for ( k = spectrum->band_lo[band]; k < spectrum->band_hi[band]; k++ )
+            if ( k <= points ) sum += spectrum->power[k];
+
+        dB = sum > 0 ? 10 * log10f( sum / SPECTRUM_REF ) : config->floor;
+        if ( dB < config->floor ) dB = config->floor;
+
+        spectrum->level[band] += ( dB - spectrum->level[band] ) *
+                                 ( dB > spectrum->level[band] ?
+                                   spectrum->attack : spectrum->decay );
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Adds interleaved frames, transforming every hop frames.
+//  ---------------------------------------------------------------------------
+void spectrum_process( void *state, const int16_t *samples, uint32_t frames )
+{
+    struct spectrum_t *spectrum = state;
+    uint16_t mask = spectrum->config.size - 1;
+    int32_t  mono;
+    uint32_t i;
+    uint8_t  channels = spectrum->channels;
+    uint8_t  channel;
+
+    if ( spectrum->rate == 0 || channels == 0 ) return;
+
+    for ( i = 0; i < frames; i++ )
+    {
+        mono = 0;
+        for ( channel = 0; channel < channels; channel++ )
+            mono += *samples++;
+        spectrum->ring[spectrum->pos] = mono / channels;
+        spectrum->pos = ( spectrum->pos + 1 ) & mask;
+
+        if ( spectrum->filled < spectrum->config.size ) spectrum->filled++;
+
+        if ( ++spectrum->since >= spectrum->config.hop &&
+             spectrum->filled == spectrum->config.size )
+        {
+            spectrum_transform( spectrum );
+            spectrum->since = 0;
+            spectrum->transforms++;
+        }
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns a meter stage for a spectrum analyser.
+//  ---------------------------------------------------------------------------
+struct meter_stage_t spectrum_stage( struct spectrum_t *spectrum )
+{
+    struct meter_stage_t stage =
+    {
+        .name    = "spectrum",
+        .state   = spectrum,
+        .reset   = spectrum_reset,
+        .process = spectrum_process
+    };
+
+    return stage;
+}
+
+//  ---------------------------------------------------------------------------
+//  Converts band levels to bar heights.
+//  ---------------------------------------------------------------------------
+void spectrum_get_bars( struct spectrum_t *spectrum, uint8_t *bars,
+                        uint8_t height )
+{
+    float   floor = spectrum->config.floor;
+    int32_t bar;
+    uint8_t band;
+
+    for ( band = 0; band < spectrum->config.bands; band++ )
+    {
+        bar = lrintf(( spectrum->level[band] - floor ) / -floor * height );
+        if ( bar < 0 ) bar = 0;
+        if ( bar > height ) bar = height;
+        bars[band] = bar;
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Produces one row of a bar graph for a HD44780 display.
+//  ---------------------------------------------------------------------------
+void spectrum_hd44780_row( const uint8_t *bars, uint8_t bands, uint8_t row,
+                           uint8_t rows, char *string )
+{
+    int16_t pixels;
+    uint8_t band;
+
+    for ( band = 0; band < bands; band++ )
+    {
+        // Pixels of this bar in this row of cells.
+        pixels = bars[band] - ( rows - 1 - row ) * 8;
+
+        if ( pixels <= 0 )      string[band] = ' ';
+        else if ( pixels >= 8 ) string[band] = 0xff; // Full block in ROM.
+        else                    string[band] = pixels - 1;
+    }
+    string[bands] = '\0';
+}
+
+//  ---------------------------------------------------------------------------
+//  Draws the bands as bars into a 4-bit greyscale frame buffer.
+//  ---------------------------------------------------------------------------
+void spectrum_draw( struct spectrum_t *spectrum, uint8_t *fb,
+                    uint16_t cols, uint16_t rows )
+{
+    uint8_t  bars[SPECTRUM_BANDS_MAX];
+    uint8_t  bands = spectrum->config.bands;
+    uint16_t width, gap, x, y, band;
+    uint8_t  grey;
+
+    memset( fb, 0, cols * rows );
+    if ( rows < 2 || cols < bands ) return;
+
+    spectrum_get_bars( spectrum, bars, rows > 255 ? 255 : rows );
+
+    width = cols / bands;
+    gap   = width > 2 ? 1 : 0;
+
+    // Bars get brighter towards the top.
+    for ( band = 0; band < bands; band++ )
+    {
+        for ( y = 0; y < bars[band]; y++ )
+        {
+            grey = 3 + 12 * y / ( rows - 1 );
+            for ( x = band * width; x < ( band + 1 ) * width - gap; x++ )
+                fb[( rows - 1 - y ) * cols + x] = grey;
+        }
+    }
+}
@@ -0,0 +1,192 @@
+//  ===========================================================================
+/*
+    meterPi-spectrum:
+
+    Spectrum analyser for meterPi. Windowed fixed-point FFT of the stream
+    binned into logarithmic frequency bands with bar graph ballistics.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+
+    Changelog:
+
+        v01.00      Original version.
+        v01.01      Added runtime channel count.
+        v01.02      Added count of transforms.
+*/
+//  ===========================================================================
+
+#ifndef METERPI_SPECTRUM_H
+#define METERPI_SPECTRUM_H
+
+//  Info. ---------------------------------------------------------------------
+/*
+    The left and right channels are mixed to mono and kept in a ring of the
+    last FFT size samples. Every hop frames the ring is multiplied by a
+    Hann window and transformed with a real FFT of size N, done as a
+    complex FFT of N/2 points on the even and odd samples followed by a
+    split into the N/2 + 1 bins of the real spectrum.
+
+    The complex FFT is radix-2 decimation in time in Q15 fixed point with
+    the real and imaginary parts in separate arrays, so butterflies map
+    straight onto SIMD lanes. Each stage halves its outputs so nothing can
+    overflow. Multiplies round as the NEON vqrdmulh instruction does and
+    halving adds truncate as vhadd does, so the NEON and scalar paths are
+    bit-exact.
+
+    Bins are summed into bands with logarithmically spaced edges. Each band
+    level follows the new level with separate attack and decay time
+    constants, like the ballistics of an analogue bar graph.
+
+    The FFT plan, window, bin map and all buffers are set up when the
+    analyser is created or the rate changes. Nothing is allocated while
+    processing.
+*/
+
+//  Macros. -------------------------------------------------------------------
+
+#define SPECTRUM_SIZE_MIN   64   // Smallest FFT size.
+#define SPECTRUM_SIZE_MAX   4096 // Largest FFT size.
+#define SPECTRUM_BANDS_MAX  64   // Largest number of bands.
+
+//  Types. --------------------------------------------------------------------
+
+struct spectrum_config_t
+{
+    uint16_t size;    // FFT size (power of 2).
+    uint16_t hop;     // Frames between transforms.
+    uint8_t  bands;   // Number of bands (bars).
+    uint16_t low;     // Lower edge of lowest band (Hz).
+    uint16_t high;    // Upper edge of highest band (Hz).
+    uint16_t attack;  // Attack time constant (ms).
+    uint16_t decay;   // Decay time constant (ms).
+    int8_t   floor;   // Lowest band level (dBFS).
+};
+
+typedef void ( *spectrum_fft_t )( int16_t *re, int16_t *im, uint16_t points,
+                                  const int16_t *wr, const int16_t *wi );
+
+struct spectrum_t
+{
+    struct   spectrum_config_t config;       // Settings.
+    uint32_t rate;                           // Sample rate of bin map.
+    uint8_t  channels;                       // Channels mixed to mono.
+    uint8_t  bits;                           // log2 of complex points.
+    uint16_t pos;                            // Next write in ring.
+    uint16_t filled;                         // Samples in ring.
+    uint16_t since;                          // Frames since transform.
+    uint32_t transforms;                     // Transforms since reset.
+    float    attack;                         // Attack coefficient per hop.
+    float    decay;                          // Decay coefficient per hop.
+    spectrum_fft_t fft;                      // Complex FFT kernel.
+    uint16_t band_lo [SPECTRUM_BANDS_MAX];   // First bin of band.
+    uint16_t band_hi [SPECTRUM_BANDS_MAX];   // Last bin of band + 1.
+    float    level   [SPECTRUM_BANDS_MAX];   // Band levels (dBFS).
+    uint16_t bitrev  [SPECTRUM_SIZE_MAX / 2];     // Bit reversed indices.
+    int16_t  window  [SPECTRUM_SIZE_MAX];         // Hann window (Q15).
+    int16_t  ring    [SPECTRUM_SIZE_MAX];         // Mono history.
+    float    split_r [SPECTRUM_SIZE_MAX / 2 + 1]; // Real FFT twiddles.
+    float    split_i [SPECTRUM_SIZE_MAX / 2 + 1];
+    float    power   [SPECTRUM_SIZE_MAX / 2 + 1]; // Power of bins.
+    int16_t  wr      [SPECTRUM_SIZE_MAX / 2]
+                     __attribute__(( aligned( VIS_ALIGN ))); // Twiddles,
+    int16_t  wi      [SPECTRUM_SIZE_MAX / 2]                 // per stage.
+                     __attribute__(( aligned( VIS_ALIGN )));
+    int16_t  re      [SPECTRUM_SIZE_MAX / 2]
+                     __attribute__(( aligned( VIS_ALIGN ))); // FFT data.
+    int16_t  im      [SPECTRUM_SIZE_MAX / 2]
+                     __attribute__(( aligned( VIS_ALIGN )));
+};
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Creates a spectrum analyser. Returns NULL if the settings are invalid.
+//  ---------------------------------------------------------------------------
+struct spectrum_t *spectrum_create( const struct spectrum_config_t *config );
+
+//  ---------------------------------------------------------------------------
+//  Frees a spectrum analyser.
+//  ---------------------------------------------------------------------------
+void spectrum_destroy( struct spectrum_t *spectrum );
+
+//  ---------------------------------------------------------------------------
+//  Empties the history and maps bins to bands for a sample rate.
+//  ---------------------------------------------------------------------------
+void spectrum_reset( void *spectrum, uint32_t rate, uint8_t channels );
+
+//  ---------------------------------------------------------------------------
+//  Adds interleaved frames, transforming every hop frames.
+//  ---------------------------------------------------------------------------
+void spectrum_process( void *spectrum, const int16_t *samples,
+                       uint32_t frames );
+
+//  ---------------------------------------------------------------------------
+//  Returns a meter stage for a spectrum analyser.
+//  ---------------------------------------------------------------------------
+struct meter_stage_t spectrum_stage( struct spectrum_t *spectrum );
+
+//  ---------------------------------------------------------------------------
+//  Converts band levels to bar heights.
+//  ---------------------------------------------------------------------------
+/*
+    Heights are from 0 at the floor to height at 0dBFS.
+*/
+void spectrum_get_bars( struct spectrum_t *spectrum, uint8_t *bars,
+                        uint8_t height );
+
+//  ---------------------------------------------------------------------------
+//  Produces one row of a bar graph for a HD44780 display.
+//  ---------------------------------------------------------------------------
+/*
+    bars are heights in pixels, from 0 to rows * 8, as from
+    spectrum_get_bars. Row 0 is the top row. Partly filled cells use
+    custom characters 0 to 6 from spectrum_hd44780_chars, so write the
+    string with its length rather than as a null terminated string.
+*/
+void spectrum_hd44780_row( const uint8_t *bars, uint8_t bands, uint8_t row,
+                           uint8_t rows, char *string );
+
+//  ---------------------------------------------------------------------------
+//  Draws the bands as bars into a 4-bit greyscale frame buffer.
+//  ---------------------------------------------------------------------------
+/*
+    The frame buffer has one byte (0 to 15) per pixel, row by row, as used
+    by the SSD1322 driver.
+*/
+void spectrum_draw( struct spectrum_t *spectrum, uint8_t *fb,
+                    uint16_t cols, uint16_t rows );
+
+//  ---------------------------------------------------------------------------
+//  Complex FFT kernels.
+//  ---------------------------------------------------------------------------
+void spectrum_fft_scalar( int16_t *re, int16_t *im, uint16_t points,
+                          const int16_t *wr, const int16_t *wi );
+
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+void spectrum_fft_neon( int16_t *re, int16_t *im, uint16_t points,
+                        const int16_t *wr, const int16_t *wi );
+#endif
+
+// Custom characters for partly filled HD44780 cells, 1 to 7 lines.
+extern const uint8_t spectrum_hd44780_chars[8][8];
+
+#endif // #ifndef METERPI_SPECTRUM_H
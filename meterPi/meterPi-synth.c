@@ -0,0 +1,306 @@
+//  ===========================================================================
+/*
+    meterPi-synth:
+
+    Synthetic Squeezelite visualisation buffer for testing meterPi without
+    a player. Generates test signals and writes them to a shared memory
+    object with the same layout and ring semantics as Squeezelite.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Compile with meterPi.c.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+*/
+//  ===========================================================================
+
+//  Installed libraries -------------------------------------------------------
+
+#include <stdbool.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+//  Local libraries -----------------------------------------------------------
+
+#include "meterPi.h"
+#include "meterPi-synth.h"
+
+//  Macros. -------------------------------------------------------------------
+
+#define SYNTH_PINK_RMS 1.76f // RMS of pink filter for uniform white noise.
+
+//  Local variables. ----------------------------------------------------------
+
+static const char *synth_names[] =
+    { "sine", "pink", "burst", "silence", "square" };
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Initialises a signal generator. Returns false if the settings are invalid.
+//  ---------------------------------------------------------------------------
+bool synth_init( struct synth_t *synth, const struct synth_config_t *config )
+{
+    if ( config->signal > SYNTH_SQUARE ) return false;
+    if ( config->rate < SYNTH_RATE_MIN || config->rate > SYNTH_RATE_MAX )
+        return false;
+    if (( config->signal != SYNTH_PINK && config->signal != SYNTH_SILENCE ) &&
+        ( config->frequency <= 0 || config->frequency >= config->rate / 2 ))
+        return false;
+
+    memset( synth, 0, sizeof( struct synth_t ));
+    synth->config = *config;
+
+    synth->step = (double) config->frequency / config->rate;
+    synth->amplitude = 32767 * powf( 10, config->level / 20 );
+    if ( config->signal == SYNTH_SQUARE )
+        synth->amplitude *= powf( 10, config->drive / 20 );
+
+    synth->burst_on     = (uint64_t) config->burst_on * config->rate / 1000;
+    synth->burst_period = synth->burst_on +
+                          (uint64_t) config->burst_off * config->rate / 1000;
+    synth->seed = 0x2545f491;
+
+    return true;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns a uniform random number between -1 and 1.
+//  ---------------------------------------------------------------------------
+static inline float synth_white( struct synth_t *synth )
+{
+    uint32_t x = synth->seed;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    synth->seed = x;
+
+    return (int32_t) x * ( 1.0f / 2147483648.0f );
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the next pink noise sample for a channel.
+//  ---------------------------------------------------------------------------
+static inline float synth_pink( struct synth_t *synth, uint8_t channel )
+{
+    float *b = synth->pink[channel];
+    float white = synth_white( synth );
+    float pink;
+
+    b[0] = 0.99886f * b[0] + white * 0.0555179f;
+    b[1] = 0.99332f * b[1] + white * 0.0750759f;
+    b[2] = 0.96900f * b[2] + white * 0.1538520f;
+    b[3] = 0.86650f * b[3] + white * 0.3104856f;
+    b[4] = 0.55000f * b[4] + white * 0.5329522f;
+    b[5] = -0.7616f * b[5] - white * 0.0168980f;
+    pink = b[0] + b[1] + b[2] + b[3] + b[4] + b[5] + b[6] + white * 0.5362f;
+    b[6] = white * 0.115926f;
+
+    return pink * ( 1.0f / SYNTH_PINK_RMS );
+}
+
+//  ---------------------------------------------------------------------------
+//  Converts a sample to 16-bit with hard clipping.
+//  ---------------------------------------------------------------------------
+static inline int16_t synth_clip( float sample )
+{
+    if ( sample >  32767 ) return  32767;
+    if ( sample < -32768 ) return -32768;
+    return lrintf( sample );
+}
+
+//  ---------------------------------------------------------------------------
+//  Generates interleaved frames.
+//  ---------------------------------------------------------------------------
+void synth_fill( struct synth_t *synth, int16_t *samples, uint32_t frames )
+{
+    uint32_t i;
+    uint8_t  channel;
+    float    sample;
+    bool     on;
+
+    for ( i = 0; i < frames; i++ )
+    {
+        switch ( synth->config.signal )
+        {
+            case SYNTH_PINK :
+                for ( channel = 0; channel < VIS_CHANNELS; channel++ )
+                    samples[channel] = synth_clip( synth->amplitude *
+                                                   synth_pink( synth,
+                                                               channel ));
+                break;
+            case SYNTH_SILENCE :
+                for ( channel = 0; channel < VIS_CHANNELS; channel++ )
+                    samples[channel] = 0;
+                break;
+            default :
+                on = true;
+                if ( synth->config.signal == SYNTH_BURST &&
+                     synth->burst_period > 0 )
+                {
+                    on = synth->burst_pos < synth->burst_on;
+                    if ( ++synth->burst_pos >= synth->burst_period )
+                        synth->burst_pos = 0;
+                }
+                sample = on ? synth->amplitude *
+                              sin( 2 * M_PI * synth->phase ) : 0;
+                for ( channel = 0; channel < VIS_CHANNELS; channel++ )
+                    samples[channel] = synth_clip( sample );
+
+                // Keep the phase small so it doesn't lose precision.
+                synth->phase += synth->step;
+                if ( synth->phase >= 1 ) synth->phase -= 1;
+                break;
+        }
+        samples += VIS_CHANNELS;
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns a signal type from its name, or -1 if not known.
+//  ---------------------------------------------------------------------------
+int8_t synth_signal( const char *name )
+{
+    int8_t i;
+
+    for ( i = 0; i <= SYNTH_SQUARE; i++ )
+        if ( strcmp( name, synth_names[i] ) == 0 ) return i;
+
+    return -1;
+}
+
+//  ---------------------------------------------------------------------------
+//  Creates and maps a visualisation buffer shared memory object.
+//  ---------------------------------------------------------------------------
+struct vis_t *synth_vis_create( const char *name )
+{
+    struct vis_t *vis;
+    pthread_rwlockattr_t attr;
+    int fd, err;
+
+    shm_unlink( name );
+    fd = shm_open( name, O_CREAT | O_RDWR | O_EXCL, 0666 );
+    if ( fd < 0 ) return NULL;
+
+    if ( ftruncate( fd, sizeof( struct vis_t )) != 0 )
+    {
+        err = errno;
+        close( fd );
+        shm_unlink( name );
+        errno = err;
+        return NULL;
+    }
+
+    vis = mmap( NULL, sizeof( struct vis_t ), PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd, 0 );
+    err = errno;
+    close( fd );
+    if ( vis == MAP_FAILED )
+    {
+        shm_unlink( name );
+        errno = err;
+        return NULL;
+    }
+
+    // The object is zero filled, i.e. not running with an empty ring.
+    pthread_rwlockattr_init( &attr );
+    pthread_rwlockattr_setpshared( &attr, PTHREAD_PROCESS_SHARED );
+    pthread_rwlock_init( &vis->rwlock, &attr );
+    pthread_rwlockattr_destroy( &attr );
+
+    vis->buf_size = VIS_BUF_SIZE;
+    vis->updated  = time( NULL );
+
+    return vis;
+}
+
+//  ---------------------------------------------------------------------------
+//  Unmaps and removes a visualisation buffer shared memory object.
+//  ---------------------------------------------------------------------------
+void synth_vis_destroy( struct vis_t *vis, const char *name )
+{
+    if ( vis )
+    {
+        synth_vis_running( vis, false );
+        munmap( vis, sizeof( struct vis_t ));
+    }
+    shm_unlink( name );
+}
+
+//  ---------------------------------------------------------------------------
+//  Writes interleaved frames to a visualisation buffer as Squeezelite does.
+//  ---------------------------------------------------------------------------
+void synth_vis_write( struct vis_t *vis, const int16_t *samples,
+                      uint32_t frames, uint32_t rate )
+{
+    uint32_t samples_left = frames * VIS_CHANNELS;
+    uint32_t size;
+
+    pthread_rwlock_wrlock( &vis->rwlock );
+
+    vis->updated = time( NULL );
+    vis->running = true;
+    vis->rate    = rate;
+
+    // Only the most recent buffer full can be kept.
+    if ( samples_left > vis->buf_size )
+    {
+        samples += samples_left - vis->buf_size;
+        samples_left = vis->buf_size;
+    }
+
+    while ( samples_left > 0 )
+    {
+        size = vis->buf_size - vis->buf_index;
+        if ( size > samples_left ) size = samples_left;
+
+        memcpy( vis->buffer + vis->buf_index, samples,
+                size * sizeof( int16_t ));
+        samples      += size;
+        samples_left -= size;
+
+        vis->buf_index += size;
+        if ( vis->buf_index >= vis->buf_size ) vis->buf_index = 0;
+    }
+
+    pthread_rwlock_unlock( &vis->rwlock );
+}
+
+//  ---------------------------------------------------------------------------
+//  Sets the stream status of a visualisation buffer.
+//  ---------------------------------------------------------------------------
+void synth_vis_running( struct vis_t *vis, bool running )
+{
+    pthread_rwlock_wrlock( &vis->rwlock );
+    vis->running = running;
+    vis->updated = time( NULL );
+    pthread_rwlock_unlock( &vis->rwlock );
+}
@@ -0,0 +1,143 @@
+//  ===========================================================================
+/*
+    meterPi-synth:
+
+    Synthetic Squeezelite visualisation buffer for testing meterPi without
+    a player. Generates test signals and writes them to a shared memory
+    object with the same layout and ring semantics as Squeezelite.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+
+    Changelog:
+
+        v01.00      Original version.
+*/
+//  ===========================================================================
+
+#ifndef METERPI_SYNTH_H
+#define METERPI_SYNTH_H
+
+//  Info. ---------------------------------------------------------------------
+/*
+    Squeezelite started with -v creates a shared memory object holding a
+    struct vis_t. For every block it plays, it takes the write lock, copies
+    the block into the ring at buf_index, wraps buf_index at buf_size and
+    sets updated, rate and running. synth_vis_write does the same, so any
+    meter can be run against a known signal on any Linux box.
+
+    Signals:
+
+        sine     Sine at frequency, peak at level.
+        pink     Uncorrelated pink noise on each channel, RMS at level.
+        burst    Sine at frequency and level, switched on and off.
+        silence  Digital silence.
+        square   Sine at frequency driven drive dB into hard clipping,
+                 i.e. a square wave with runs of full scale samples.
+
+    Pink noise is white noise from a xorshift generator through Paul
+    Kellet's filter, accurate to 0.05dB above 9Hz at 44.1kHz.
+*/
+
+//  Macros. -------------------------------------------------------------------
+
+#define SYNTH_RATE_MIN  8000   // Lowest sample rate.
+#define SYNTH_RATE_MAX  384000 // Highest sample rate.
+
+//  Types. --------------------------------------------------------------------
+
+enum synth_signal_t
+{
+    SYNTH_SINE,
+    SYNTH_PINK,
+    SYNTH_BURST,
+    SYNTH_SILENCE,
+    SYNTH_SQUARE
+};
+
+struct synth_config_t
+{
+    enum     synth_signal_t signal; // Signal type.
+    uint32_t rate;                  // Sample rate (Hz).
+    float    frequency;             // Tone frequency (Hz).
+    float    level;                 // Level (dBFS).
+    uint16_t burst_on;              // Burst on time (ms).
+    uint16_t burst_off;             // Burst off time (ms).
+    float    drive;                 // Overdrive of clipped square (dB).
+};
+
+struct synth_t
+{
+    struct   synth_config_t config; // Settings.
+    double   phase;                 // Tone phase (cycles).
+    double   step;                  // Tone phase per frame (cycles).
+    float    amplitude;             // Tone peak or noise RMS.
+    uint32_t burst_pos;             // Frames into burst cycle.
+    uint32_t burst_on;              // Burst on frames.
+    uint32_t burst_period;          // Burst cycle frames.
+    uint32_t seed;                  // Noise generator state.
+    float    pink[VIS_CHANNELS][7]; // Pink noise filter states.
+};
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Initialises a signal generator. Returns false if the settings are invalid.
+//  ---------------------------------------------------------------------------
+bool synth_init( struct synth_t *synth, const struct synth_config_t *config );
+
+//  ---------------------------------------------------------------------------
+//  Generates interleaved frames.
+//  ---------------------------------------------------------------------------
+void synth_fill( struct synth_t *synth, int16_t *samples, uint32_t frames );
+
+//  ---------------------------------------------------------------------------
+//  Returns a signal type from its name, or -1 if not known.
+//  ---------------------------------------------------------------------------
+int8_t synth_signal( const char *name );
+
+//  ---------------------------------------------------------------------------
+//  Creates and maps a visualisation buffer shared memory object.
+//  ---------------------------------------------------------------------------
+/*
+    Replaces any existing object of the same name, as Squeezelite does.
+    The lock is process shared so meters in other processes can use it.
+    Returns NULL on failure with errno set.
+*/
+struct vis_t *synth_vis_create( const char *name );
+
+//  ---------------------------------------------------------------------------
+//  Unmaps and removes a visualisation buffer shared memory object.
+//  ---------------------------------------------------------------------------
+void synth_vis_destroy( struct vis_t *vis, const char *name );
+
+//  ---------------------------------------------------------------------------
+//  Writes interleaved frames to a visualisation buffer as Squeezelite does.
+//  ---------------------------------------------------------------------------
+void synth_vis_write( struct vis_t *vis, const int16_t *samples,
+                      uint32_t frames, uint32_t rate );
+
+//  ---------------------------------------------------------------------------
+//  Sets the stream status of a visualisation buffer.
+//  ---------------------------------------------------------------------------
+void synth_vis_running( struct vis_t *vis, bool running );
+
+#endif // #ifndef METERPI_SYNTH_H
@@ -0,0 +1,356 @@
+//  ===========================================================================
+/*
+    meterPi-truepeak:
+
+    True-peak (inter-sample peak) metering for meterPi using 4x polyphase
+    oversampling as described in ITU-R BS.1770-4 Annex 2.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Compile with meterPi.c and meterPi-kernel.c. As with the accumulation
+    kernels, the NEON filter is only built with the Raspberry Pi v2 flags.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+*/
+//  ===========================================================================
+
+//  Installed libraries -------------------------------------------------------
+
+#include <stdbool.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+
+#if defined( __i386__ ) || defined( __x86_64__ )
+#include <emmintrin.h>
+#endif
+
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#include <arm_neon.h>
+#if defined( __arm__ )
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+//  Local libraries -----------------------------------------------------------
+
+#include "meterPi.h"
+#include "meterPi-truepeak.h"
+
+//  Local variables. ----------------------------------------------------------
+
+static const int16_t truepeak_table[TRUEPEAK_PHASES][TRUEPEAK_TAPS] =
+    TRUEPEAK_TABLE;
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Creates a true-peak meter. Returns NULL if out of memory.
+//  ---------------------------------------------------------------------------
+struct truepeak_t *truepeak_create( void )
+{
+    struct truepeak_t *truepeak;
+    uint8_t phase, tap;
+
+    if ( posix_memalign( (void **) &truepeak, VIS_ALIGN,
+                         sizeof( struct truepeak_t )))
+        return NULL;
+    memset( truepeak, 0, sizeof( struct truepeak_t ));
+
+    /*
+        Coefficients are reversed so that tap 0 multiplies the oldest
+        sample, and padded with zeros to a whole number of SIMD vectors.
+    */
+    for ( phase = 0; phase < TRUEPEAK_PHASES; phase++ )
+        for ( tap = 0; tap < TRUEPEAK_TAPS; tap++ )
+            truepeak->coefs[phase][tap] =
+                truepeak_table[phase][TRUEPEAK_TAPS - 1 - tap];
+
+    truepeak->kernel = truepeak_kernel_select();
+
+    return truepeak;
+}
+
+//  ---------------------------------------------------------------------------
+//  Frees a true-peak meter.
+//  ---------------------------------------------------------------------------
+void truepeak_destroy( struct truepeak_t *truepeak )
+{
+    free( truepeak );
+}
+
+//  ---------------------------------------------------------------------------
+//  Clears filter history and peaks, e.g. after a gap or rate change.
+//  ---------------------------------------------------------------------------
+void truepeak_reset( void *state, uint32_t rate, uint8_t channels )
+{
+    struct truepeak_t *truepeak = state;
+
+    truepeak->rate     = rate;
+    truepeak->channels = channels;
+    truepeak->frames   = 0;
+    memset( truepeak->peak, 0, sizeof( truepeak->peak ));
+    memset( truepeak->buf,  0, sizeof( truepeak->buf ));
+}
+
+//  ---------------------------------------------------------------------------
+//  Filters interleaved frames and updates the peaks.
+//  ---------------------------------------------------------------------------
+void truepeak_process( void *state, const int16_t *samples, uint32_t frames )
+{
+    struct truepeak_t *truepeak = state;
+    uint32_t block, i, peak;
+    uint8_t  channels = truepeak->channels;
+    uint8_t  channel;
+    int16_t  *buf;
+
+    truepeak->frames += frames;
+
+    while ( frames > 0 )
+    {
+        block = frames < TRUEPEAK_BLOCK ? frames : TRUEPEAK_BLOCK;
+
+        for ( channel = 0; channel < channels; channel++ )
+        {
+            buf = truepeak->buf[channel];
+
+            // De-interleave after the history of the previous block.
+            for ( i = 0; i < block; i++ )
+                buf[TRUEPEAK_TAPS - 1 + i] = samples[i * channels + channel];
+
+            peak = truepeak->kernel( buf, block, truepeak->coefs );
+            if ( peak > truepeak->peak[channel] )
+                truepeak->peak[channel] = peak;
+
+            // Keep the newest samples as history for the next block.
+            memmove( buf, buf + block,
+                     ( TRUEPEAK_TAPS - 1 ) * sizeof( int16_t ));
+        }
+
+        samples += block * channels;
+        frames  -= block;
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the peaks since the last read in dBTP and clears them.
+//  ---------------------------------------------------------------------------
+bool truepeak_read( struct truepeak_t *truepeak, float *dBtp,
+                    bool *overshoot )
+{
+    uint8_t channel;
+
+    if ( truepeak->frames == 0 ) return false;
+
+    for ( channel = 0; channel < truepeak->channels; channel++ )
+    {
+        if ( truepeak->peak[channel] == 0 )
+            dBtp[channel] = TRUEPEAK_FLOOR;
+        else
+            dBtp[channel] = 20 * log10f( (float) truepeak->peak[channel] /
+                                         ( 32768.0f * ( 1 << TRUEPEAK_SHIFT )));
+        if ( dBtp[channel] < TRUEPEAK_FLOOR ) dBtp[channel] = TRUEPEAK_FLOOR;
+
+        overshoot[channel] = truepeak->peak[channel] >
+                             ( 32768U << TRUEPEAK_SHIFT );
+        truepeak->peak[channel] = 0;
+    }
+    truepeak->frames = 0;
+
+    return true;
+}
+
+//  ---------------------------------------------------------------------------
+//  Reference filter kernel.
+//  ---------------------------------------------------------------------------
+uint32_t truepeak_kernel_scalar( const int16_t *buf, uint32_t n,
+                    const int16_t coefs[TRUEPEAK_PHASES][TRUEPEAK_PAD] )
+{
+    int32_t  acc;
+    uint32_t peak = 0;
+    uint32_t i;
+    uint8_t  phase, tap;
+
+    for ( i = 0; i < n; i++ )
+    {
+        for ( phase = 0; phase < TRUEPEAK_PHASES; phase++ )
+        {
+            acc = 0;
+            for ( tap = 0; tap < TRUEPEAK_TAPS; tap++ )
+                acc += coefs[phase][tap] * buf[i + tap];
+            if ( acc < 0 ) acc = -acc;
+            if ( (uint32_t) acc > peak ) peak = acc;
+        }
+    }
+
+    return peak;
+}
+
+#if defined( __i386__ ) || defined( __x86_64__ )
+//  ---------------------------------------------------------------------------
+//  SSE2 filter kernel.
+//  ---------------------------------------------------------------------------
+/*
+    Each phase is two madd instructions over 16 padded taps. The four
+    phase sums are added across lanes together so that one vector holds
+    the four upsampled outputs for an input sample.
+*/
+__attribute__(( target( "sse2" )))
+uint32_t truepeak_kernel_sse2( const int16_t *buf, uint32_t n,
+                    const int16_t coefs[TRUEPEAK_PHASES][TRUEPEAK_PAD] )
+{
+    __m128i  c[TRUEPEAK_PHASES][2];
+    __m128i  x0, x1, a[TRUEPEAK_PHASES], t0, t1, t2, t3, y, sign, gt;
+    __m128i  vmax = _mm_setzero_si128();
+    uint32_t peaks[4], peak = 0;
+    uint32_t i;
+    uint8_t  phase;
+
+    for ( phase = 0; phase < TRUEPEAK_PHASES; phase++ )
+    {
+        c[phase][0] = _mm_load_si128( (const __m128i *) coefs[phase] );
+        c[phase][1] = _mm_load_si128( (const __m128i *)( coefs[phase] + 8 ));
+    }
+
+    for ( i = 0; i < n; i++ )
+    {
+        x0 = _mm_loadu_si128( (const __m128i *)( buf + i ));
+        x1 = _mm_loadu_si128( (const __m128i *)( buf + i + 8 ));
+
+        for ( phase = 0; phase < TRUEPEAK_PHASES; phase++ )
+            a[phase] = _mm_add_epi32( _mm_madd_epi16( x0, c[phase][0] ),
+                                      _mm_madd_epi16( x1, c[phase][1] ));
+
+        // Horizontal sums of all four phases in one vector.
+        t0 = _mm_unpacklo_epi32( a[0], a[1] );
+        t1 = _mm_unpackhi_epi32( a[0], a[1] );
+        t2 = _mm_unpacklo_epi32( a[2], a[3] );
+        t3 = _mm_unpackhi_epi32( a[2], a[3] );
+        t0 = _mm_add_epi32( t0, t1 );
+        t2 = _mm_add_epi32( t2, t3 );
+        y  = _mm_add_epi32( _mm_unpacklo_epi64( t0, t2 ),
+                            _mm_unpackhi_epi64( t0, t2 ));
+
+        // Absolute value and maximum without SSE4.1.
+        sign = _mm_srai_epi32( y, 31 );
+        y    = _mm_sub_epi32( _mm_xor_si128( y, sign ), sign );
+        gt   = _mm_cmpgt_epi32( y, vmax );
+        vmax = _mm_or_si128( _mm_and_si128( gt, y ),
+                             _mm_andnot_si128( gt, vmax ));
+    }
+
+    _mm_storeu_si128( (__m128i *) peaks, vmax );
+    for ( phase = 0; phase < 4; phase++ )
+        if ( peaks[phase] > peak ) peak = peaks[phase];
+
+    return peak;
+}
+#endif
+
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+//  ---------------------------------------------------------------------------
+//  NEON filter kernel.
+//  ---------------------------------------------------------------------------
+/*
+    12 taps are exactly three 4 lane multiply-accumulates per phase.
+*/
+uint32_t truepeak_kernel_neon( const int16_t *buf, uint32_t n,
+                    const int16_t coefs[TRUEPEAK_PHASES][TRUEPEAK_PAD] )
+{
+    int16x4_t c[TRUEPEAK_PHASES][3];
+    int16x4_t x0, x1, x2;
+    int32x4_t a[TRUEPEAK_PHASES], y;
+    int32x4_t vmax = vdupq_n_s32( 0 );
+    int32x2_t s01, s23;
+    int32_t   peaks[4];
+    uint32_t  peak = 0;
+    uint32_t  i;
+    uint8_t   phase;
+
+    for ( phase = 0; phase < TRUEPEAK_PHASES; phase++ )
+    {
+        c[phase][0] = vld1_s16( coefs[phase] );
+        c[phase][1] = vld1_s16( coefs[phase] + 4 );
+        c[phase][2] = vld1_s16( coefs[phase] + 8 );
+    }
+
+    for ( i = 0; i < n; i++ )
+    {
+        x0 = vld1_s16( buf + i );
+        x1 = vld1_s16( buf + i + 4 );
+        x2 = vld1_s16( buf + i + 8 );
+
+        for ( phase = 0; phase < TRUEPEAK_PHASES; phase++ )
+        {
+            a[phase] = vmull_s16( x0, c[phase][0] );
+            a[phase] = vmlal_s16( a[phase], x1, c[phase][1] );
+            a[phase] = vmlal_s16( a[phase], x2, c[phase][2] );
+        }
+
+        // Horizontal sums of all four phases in one vector.
+        s01 = vpadd_s32( vpadd_s32( vget_low_s32( a[0] ),
+                                    vget_high_s32( a[0] )),
+                         vpadd_s32( vget_low_s32( a[1] ),
+                                    vget_high_s32( a[1] )));
+        s23 = vpadd_s32( vpadd_s32( vget_low_s32( a[2] ),
+                                    vget_high_s32( a[2] )),
+                         vpadd_s32( vget_low_s32( a[3] ),
+                                    vget_high_s32( a[3] )));
+        y = vabsq_s32( vcombine_s32( s01, s23 ));
+        vmax = vmaxq_s32( vmax, y );
+    }
+
+    vst1q_s32( peaks, vmax );
+    for ( phase = 0; phase < 4; phase++ )
+        if ( (uint32_t) peaks[phase] > peak ) peak = peaks[phase];
+
+    return peak;
+}
+#endif
+
+//  ---------------------------------------------------------------------------
+//  Returns the fastest filter kernel supported by the running CPU.
+//  ---------------------------------------------------------------------------
+truepeak_kernel_t truepeak_kernel_select( void )
+{
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#if defined( __arm__ )
+    if ( getauxval( AT_HWCAP ) & HWCAP_NEON ) return truepeak_kernel_neon;
+#else
+    return truepeak_kernel_neon;
+#endif
+#endif
+
+#if defined( __x86_64__ )
+    return truepeak_kernel_sse2;
+#elif defined( __i386__ )
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "sse2" )) return truepeak_kernel_sse2;
+#endif
+
+    return truepeak_kernel_scalar;
+}
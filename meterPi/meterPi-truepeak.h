@@ -0,0 +1,153 @@
+//  ===========================================================================
+/*
+    meterPi-truepeak:
+
+    True-peak (inter-sample peak) metering for meterPi using 4x polyphase
+    oversampling as described in ITU-R BS.1770-4 Annex 2.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+
+    Changelog:
+
+        v01.00      Original version.
+        v01.01      Added runtime channel count.
+*/
+//  ===========================================================================
+
+#ifndef METERPI_TRUEPEAK_H
+#define METERPI_TRUEPEAK_H
+
+//  Info. ---------------------------------------------------------------------
+/*
+    A DAC reconstructs the continuous waveform between samples, which can
+    peak above the largest sample value. This is the DAC overshoot in the
+    overload description in meterPi.h. BS.1770 estimates the true peak by
+    upsampling 4x with a 48 tap FIR filter and taking the largest absolute
+    value of the upsampled signal.
+
+    The filter is split into 4 phases of 12 taps, one per output sample, so
+    only the input samples are multiplied. The coefficients in the standard
+    are multiples of 1/8192, so they are held exactly as Q13 integers and
+    the filter is calculated in 32-bit fixed point without rounding. The
+    largest sum of absolute coefficients is 2.02, so the accumulator can't
+    overflow for 16-bit input.
+
+    1.0 (0dBTP) in the output is 32768 << 13.
+*/
+
+//  Macros. -------------------------------------------------------------------
+
+#define TRUEPEAK_PHASES  4   // Oversampling ratio.
+#define TRUEPEAK_TAPS    12  // Taps per phase.
+#define TRUEPEAK_PAD     16  // Taps per phase padded for SIMD.
+#define TRUEPEAK_BLOCK   256 // Frames filtered per block.
+#define TRUEPEAK_SHIFT   13  // Fractional bits of coefficients.
+#define TRUEPEAK_FLOOR  -96  // Lowest reported level (dBTP).
+
+// BS.1770-4 Annex 2 coefficients, Q13, one row per phase.
+#define TRUEPEAK_TABLE \
+    {{   14,    90,  -161,   272,  -487,  1125,  7964,  -838,   390,  -218,   122,   -68 },\
+     { -239,   240,  -424,   730, -1364,  3810,  6388, -1641,   832,  -477,   271,  -155 },\
+     { -155,   271,  -477,   832, -1641,  6388,  3810, -1364,   730,  -424,   240,  -239 },\
+     {  -68,   122,  -218,   390,  -838,  7964,  1125,  -487,   272,  -161,    90,    14 }}
+
+//  Types. --------------------------------------------------------------------
+
+/*
+    Returns the largest absolute output of all phases for n input samples.
+    buf holds TRUEPEAK_TAPS - 1 history samples followed by the n samples
+    and must be readable for TRUEPEAK_PAD - TRUEPEAK_TAPS samples beyond.
+*/
+typedef uint32_t ( *truepeak_kernel_t )
+                 ( const int16_t *buf, uint32_t n,
+                   const int16_t coefs[TRUEPEAK_PHASES][TRUEPEAK_PAD] );
+
+struct truepeak_t
+{
+    uint32_t          rate;                  // Stream sample rate.
+    uint32_t          frames;                // Frames since last read.
+    uint8_t           channels;              // Interleaved channels.
+    uint32_t          peak [METER_CHANNELS_MAX]; // Largest since read.
+    truepeak_kernel_t kernel;                // Filter kernel.
+    int16_t           coefs[TRUEPEAK_PHASES][TRUEPEAK_PAD]
+                      __attribute__(( aligned( VIS_ALIGN ))); // Reversed.
+    int16_t           buf  [METER_CHANNELS_MAX][TRUEPEAK_PAD + TRUEPEAK_BLOCK]
+                      __attribute__(( aligned( VIS_ALIGN ))); // History.
+};
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Creates a true-peak meter. Returns NULL if out of memory.
+//  ---------------------------------------------------------------------------
+struct truepeak_t *truepeak_create( void );
+
+//  ---------------------------------------------------------------------------
+//  Frees a true-peak meter.
+//  ---------------------------------------------------------------------------
+void truepeak_destroy( struct truepeak_t *truepeak );
+
+//  ---------------------------------------------------------------------------
+//  Clears filter history and peaks, e.g. after a gap or rate change.
+//  ---------------------------------------------------------------------------
+void truepeak_reset( void *truepeak, uint32_t rate, uint8_t channels );
+
+//  ---------------------------------------------------------------------------
+//  Filters interleaved frames and updates the peaks.
+//  ---------------------------------------------------------------------------
+void truepeak_process( void *truepeak, const int16_t *samples,
+                       uint32_t frames );
+
+//  ---------------------------------------------------------------------------
+//  Returns the peaks since the last read in dBTP and clears them.
+//  ---------------------------------------------------------------------------
+/*
+    Returns false, leaving dBtp and overshoot unchanged, if no frames have
+    been processed since the last read. overshoot is set for channels that
+    have exceeded 0dBTP. One value is returned for each channel given at
+    the last reset.
+*/
+bool truepeak_read( struct truepeak_t *truepeak, float *dBtp,
+                    bool *overshoot );
+
+//  ---------------------------------------------------------------------------
+//  Filter kernels.
+//  ---------------------------------------------------------------------------
+uint32_t truepeak_kernel_scalar( const int16_t *buf, uint32_t n,
+                    const int16_t coefs[TRUEPEAK_PHASES][TRUEPEAK_PAD] );
+
+#if defined( __i386__ ) || defined( __x86_64__ )
+uint32_t truepeak_kernel_sse2( const int16_t *buf, uint32_t n,
+                    const int16_t coefs[TRUEPEAK_PHASES][TRUEPEAK_PAD] );
+#endif
+
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+uint32_t truepeak_kernel_neon( const int16_t *buf, uint32_t n,
+                    const int16_t coefs[TRUEPEAK_PHASES][TRUEPEAK_PAD] );
+#endif
+
+//  ---------------------------------------------------------------------------
+//  Returns the fastest filter kernel supported by the running CPU.
+//  ---------------------------------------------------------------------------
+truepeak_kernel_t truepeak_kernel_select( void );
+
+#endif // #ifndef METERPI_TRUEPEAK_H
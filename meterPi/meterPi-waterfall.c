@@ -0,0 +1,212 @@
+//  ===========================================================================
+/*
+    meterPi-waterfall:
+
+    Scrolling spectrogram of spectrum analyser bands, kept packed for 4-bit
+    greyscale OLED displays.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Compile with meterPi.c and meterPi-spectrum.c.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+*/
+//  ===========================================================================
+
+//  Installed libraries -------------------------------------------------------
+
+#include <stdbool.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+//  Local libraries -----------------------------------------------------------
+
+#include "meterPi.h"
+#include "meterPi-spectrum.h"
+#include "meterPi-waterfall.h"
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Creates a waterfall of a spectrum analyser's bands.
+//  ---------------------------------------------------------------------------
+struct waterfall_t *waterfall_create( const struct waterfall_config_t *config,
+                                      struct spectrum_t *spectrum )
+{
+    struct waterfall_t *waterfall;
+    uint8_t bands, y;
+
+    if ( !spectrum || config->cols < 2 || config->cols % 2 ||
+         config->cols > WATERFALL_COLS_MAX || config->rows == 0 ||
+         config->rows > WATERFALL_ROWS_MAX ||
+         config->floor >= config->ceiling )
+        return NULL;
+
+    waterfall = calloc( 1, sizeof( struct waterfall_t ));
+    if ( !waterfall ) return NULL;
+
+    waterfall->config   = *config;
+    waterfall->spectrum = spectrum;
+    waterfall->scale    = 15.0f / ( config->ceiling - config->floor );
+
+    // Lowest band at the bottom.
+    bands = spectrum->config.bands;
+    for ( y = 0; y < config->rows; y++ )
+        waterfall->band[y] = ( config->rows - 1 - y ) * bands / config->rows;
+
+    return waterfall;
+}
+
+//  ---------------------------------------------------------------------------
+//  Frees a waterfall.
+//  ---------------------------------------------------------------------------
+void waterfall_destroy( struct waterfall_t *waterfall )
+{
+    free( waterfall );
+}
+
+//  ---------------------------------------------------------------------------
+//  Clears the waterfall and resets its analyser.
+//  ---------------------------------------------------------------------------
+void waterfall_reset( void *state, uint32_t rate, uint8_t channels )
+{
+    struct waterfall_t *waterfall = state;
+
+    spectrum_reset( waterfall->spectrum, rate, channels );
+
+    memset( waterfall->packed, 0, sizeof( waterfall->packed ));
+    waterfall->pos     = 0;
+    waterfall->columns = 0;
+}
+
+//  ---------------------------------------------------------------------------
+//  Sets one pixel of a packed row.
+//  ---------------------------------------------------------------------------
+static inline void waterfall_set( uint8_t *row, uint16_t nibble, uint8_t grey )
+{
+    uint8_t *byte = &row[nibble >> 1];
+
+    if ( nibble & 1 ) *byte = ( *byte & 0xf0 ) | grey;
+    else              *byte = ( *byte & 0x0f ) | grey << 4;
+}
+
+//  ---------------------------------------------------------------------------
+//  Adds the analyser's current band levels as the newest column.
+//  ---------------------------------------------------------------------------
+/*
+    Column x is at pixels x and x + cols of each row's two cycles, which
+    are nibbles x and x + cols of copy 0 and one less in copy 1. Pixel 0
+    isn't in copy 1 as no frame from that copy starts with it.
+*/
+void waterfall_add_column( struct waterfall_t *waterfall )
+{
+    struct   spectrum_t *spectrum = waterfall->spectrum;
+    uint16_t cols  = waterfall->config.cols;
+    uint16_t x     = waterfall->pos;
+    float    floor = waterfall->config.floor;
+    int32_t  grey;
+    uint8_t  y;
+
+    for ( y = 0; y < waterfall->config.rows; y++ )
+    {
+        grey = lrintf(( spectrum->level[waterfall->band[y]] - floor ) *
+                      waterfall->scale );
+        if ( grey < 0 )  grey = 0;
+        if ( grey > 15 ) grey = 15;
+
+        waterfall_set( waterfall->packed[0][y], x, grey );
+        waterfall_set( waterfall->packed[0][y], x + cols, grey );
+        if ( x > 0 ) waterfall_set( waterfall->packed[1][y], x - 1, grey );
+        waterfall_set( waterfall->packed[1][y], x + cols - 1, grey );
+    }
+
+    if ( ++waterfall->pos == cols ) waterfall->pos = 0;
+    waterfall->columns++;
+}
+
+//  ---------------------------------------------------------------------------
+//  Feeds interleaved frames to the analyser, adding a column per transform.
+//  ---------------------------------------------------------------------------
+/*
+    Frames are fed in runs that end on the frame that completes the next
+    transform, so there is never more than one transform per run.
+*/
+void waterfall_process( void *state, const int16_t *samples, uint32_t frames )
+{
+    struct   waterfall_t *waterfall = state;
+    struct   spectrum_t  *spectrum  = waterfall->spectrum;
+    uint16_t hop  = spectrum->config.hop;
+    uint16_t size = spectrum->config.size;
+    uint32_t run, transforms;
+
+    if ( spectrum->rate == 0 || spectrum->channels == 0 ) return;
+
+    while ( frames > 0 )
+    {
+        run = spectrum->since < hop ? hop - spectrum->since : 1;
+        if ( spectrum->filled + run < size ) run = size - spectrum->filled;
+        if ( run > frames ) run = frames;
+
+        transforms = spectrum->transforms;
+        spectrum_process( spectrum, samples, run );
+        if ( spectrum->transforms != transforms )
+            waterfall_add_column( waterfall );
+
+        samples += run * spectrum->channels;
+        frames  -= run;
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns a meter stage for a waterfall, instead of its analyser's stage.
+//  ---------------------------------------------------------------------------
+struct meter_stage_t waterfall_stage( struct waterfall_t *waterfall )
+{
+    struct meter_stage_t stage =
+    {
+        .name    = "waterfall",
+        .state   = waterfall,
+        .reset   = waterfall_reset,
+        .process = waterfall_process
+    };
+
+    return stage;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the packed frame, oldest column on the left.
+//  ---------------------------------------------------------------------------
+const uint8_t *waterfall_get_frame( struct waterfall_t *waterfall,
+                                    uint16_t *stride )
+{
+    uint16_t pos = waterfall->pos;
+
+    *stride = WATERFALL_COLS_MAX;
+
+    if ( pos % 2 == 0 ) return &waterfall->packed[0][0][pos / 2];
+    else                return &waterfall->packed[1][0][( pos - 1 ) / 2];
+}
@@ -0,0 +1,143 @@
+//  ===========================================================================
+/*
+    meterPi-waterfall:
+
+    Scrolling spectrogram of spectrum analyser bands, kept packed for 4-bit
+    greyscale OLED displays.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+
+    Changelog:
+
+        v01.00      Original version.
+*/
+//  ===========================================================================
+
+#ifndef METERPI_WATERFALL_H
+#define METERPI_WATERFALL_H
+
+//  Info. ---------------------------------------------------------------------
+/*
+    A waterfall draws each transform of the spectrum analyser as a column
+    of pixels, lowest band at the bottom, with the level as a grey from 0
+    at the floor to 15 at the ceiling of a dB range. Columns scroll left
+    as new ones are added on the right.
+
+    The SSD1322 takes its RAM two pixels to a byte, left pixel in the high
+    nibble, row by row. Drawing a frame buffer of one byte per pixel means
+    packing all 16k pixels for every frame sent, and scrolling it means
+    moving all of them as well. Instead, each column is packed once, when
+    it is added, into a ring of columns that is already in the display's
+    format, so sending a frame is a pointer and nothing else.
+
+    For the frame to be contiguous rows of packed bytes wherever the ring
+    starts, each row of the ring is held twice over, so that the oldest
+    column is always followed by the rest in order. That is only at the
+    start of a byte for every other column, so there is a second copy one
+    pixel along, and the frame is taken from whichever copy starts on a
+    byte. Adding a column writes four nibbles per row.
+
+        Copy 0:  | 0 1 | 2 3 | ... | c-2 c-1 |  0  1 | ... | c-2 c-1 |
+        Copy 1:  | 1 2 | 3 4 | ... | c-1  0  |  1  2 | ... | c-1  -  |
+
+    The waterfall is a meter stage that feeds its own spectrum analyser,
+    in place of the analyser's stage, stopping at each transform to add a
+    column, so every transform gets its own column however many frames
+    each read brings.
+*/
+
+//  Macros. -------------------------------------------------------------------
+
+#define WATERFALL_COLS_MAX 256 // Most columns, as the SSD1322 display.
+#define WATERFALL_ROWS_MAX 64  // Most rows, as the SSD1322 display.
+
+//  Types. --------------------------------------------------------------------
+
+struct waterfall_config_t
+{
+    uint16_t cols;    // Columns (even).
+    uint8_t  rows;    // Rows.
+    int8_t   floor;   // Level for grey 0 (dBFS).
+    int8_t   ceiling; // Level for grey 15 (dBFS).
+};
+
+struct waterfall_t
+{
+    struct   waterfall_config_t config;     // Settings.
+    struct   spectrum_t *spectrum;          // Analyser fed by the stage.
+    uint16_t pos;                           // Next column in ring.
+    uint32_t columns;                       // Columns added since reset.
+    float    scale;                         // Greys per dB.
+    uint8_t  band[WATERFALL_ROWS_MAX];      // Band shown in each row.
+    uint8_t  packed[2][WATERFALL_ROWS_MAX][WATERFALL_COLS_MAX]; // Copies.
+};
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Creates a waterfall of a spectrum analyser's bands.
+//  ---------------------------------------------------------------------------
+/*
+    Returns NULL if the settings are invalid. The analyser is only
+    borrowed, so destroy it after the waterfall.
+*/
+struct waterfall_t *waterfall_create( const struct waterfall_config_t *config,
+                                      struct spectrum_t *spectrum );
+
+//  ---------------------------------------------------------------------------
+//  Frees a waterfall.
+//  ---------------------------------------------------------------------------
+void waterfall_destroy( struct waterfall_t *waterfall );
+
+//  ---------------------------------------------------------------------------
+//  Clears the waterfall and resets its analyser.
+//  ---------------------------------------------------------------------------
+void waterfall_reset( void *waterfall, uint32_t rate, uint8_t channels );
+
+//  ---------------------------------------------------------------------------
+//  Feeds interleaved frames to the analyser, adding a column per transform.
+//  ---------------------------------------------------------------------------
+void waterfall_process( void *waterfall, const int16_t *samples,
+                        uint32_t frames );
+
+//  ---------------------------------------------------------------------------
+//  Returns a meter stage for a waterfall, instead of its analyser's stage.
+//  ---------------------------------------------------------------------------
+struct meter_stage_t waterfall_stage( struct waterfall_t *waterfall );
+
+//  ---------------------------------------------------------------------------
+//  Adds the analyser's current band levels as the newest column.
+//  ---------------------------------------------------------------------------
+void waterfall_add_column( struct waterfall_t *waterfall );
+
+//  ---------------------------------------------------------------------------
+//  Returns the packed frame, oldest column on the left.
+//  ---------------------------------------------------------------------------
+/*
+    Each row is cols / 2 bytes, two pixels to a byte with the left pixel
+    in the high nibble, and rows start stride bytes apart. The frame is
+    in the waterfall itself, so changes as columns are added.
+*/
+const uint8_t *waterfall_get_frame( struct waterfall_t *waterfall,
+                                    uint16_t *stride );
+
+#endif // #ifndef METERPI_WATERFALL_H
@@ -0,0 +1,376 @@
+//  ===========================================================================
+/*
+    meterPi-waveform:
+
+    Min, max and RMS pyramid of recent frames for scrolling waveform
+    displays.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Compile with meterPi.c.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+*/
+//  ===========================================================================
+
+//  Installed libraries -------------------------------------------------------
+
+#include <stdbool.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+//  Local libraries -----------------------------------------------------------
+
+#include "meterPi.h"
+#include "meterPi-waveform.h"
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Creates a waveform pyramid. Returns NULL if the settings are invalid.
+//  ---------------------------------------------------------------------------
+struct waveform_t *waveform_create( const struct waveform_config_t *config )
+{
+    struct waveform_t *waveform;
+
+    if ( config->base == 0 || config->levels == 0 ||
+         config->levels > WAVEFORM_LEVELS_MAX ||
+         ( config->levels > 1 && config->factor < 2 ) ||
+         config->buckets == 0 || config->buckets > WAVEFORM_BUCKETS_MAX )
+        return NULL;
+
+    waveform = calloc( 1, sizeof( struct waveform_t ));
+    if ( !waveform ) return NULL;
+
+    waveform->config = *config;
+    waveform_reset( waveform, 0, 0 );
+
+    return waveform;
+}
+
+//  ---------------------------------------------------------------------------
+//  Frees a waveform pyramid.
+//  ---------------------------------------------------------------------------
+void waveform_destroy( struct waveform_t *waveform )
+{
+    free( waveform );
+}
+
+//  ---------------------------------------------------------------------------
+//  Empties a bucket being filled.
+//  ---------------------------------------------------------------------------
+static inline void waveform_acc_clear( struct waveform_acc_t *acc )
+{
+    acc->min = INT16_MAX;
+    acc->max = INT16_MIN;
+    acc->sum_squares = 0;
+}
+
+//  ---------------------------------------------------------------------------
+//  Empties every level after a gap or rate change.
+//  ---------------------------------------------------------------------------
+/*
+    Rings are not cleared, only marked empty.
+*/
+void waveform_reset( void *state, uint32_t rate, uint8_t channels )
+{
+    struct waveform_t *waveform = state;
+    struct waveform_level_t *level;
+    uint8_t l, c;
+
+    waveform->rate     = rate;
+    waveform->channels = channels;
+    waveform->kept     = channels > 1 ? WAVEFORM_CHANNELS : 1;
+
+    for ( l = 0; l < waveform->config.levels; l++ )
+    {
+        level = &waveform->level[l];
+        for ( c = 0; c < WAVEFORM_CHANNELS; c++ )
+            waveform_acc_clear( &level->acc[c] );
+        level->fill   = 0;
+        level->pos    = 0;
+        level->filled = 0;
+        level->count  = 0;
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Ends the bucket being filled at a level and folds it into the next.
+//  ---------------------------------------------------------------------------
+static void waveform_push( struct waveform_t *waveform, uint8_t l )
+{
+    struct waveform_level_t  *level = &waveform->level[l];
+    struct waveform_level_t  *up    = NULL;
+    struct waveform_bucket_t *bucket;
+    struct waveform_acc_t    *acc;
+    uint8_t c;
+
+    if ( l + 1 < waveform->config.levels ) up = &waveform->level[l + 1];
+
+    for ( c = 0; c < waveform->kept; c++ )
+    {
+        acc    = &level->acc[c];
+        bucket = &level->ring[c][level->pos];
+        bucket->min = acc->min;
+        bucket->max = acc->max;
+        bucket->mean_square = acc->sum_squares / level->fill;
+
+        if ( up )
+        {
+            if ( acc->min < up->acc[c].min ) up->acc[c].min = acc->min;
+            if ( acc->max > up->acc[c].max ) up->acc[c].max = acc->max;
+            up->acc[c].sum_squares += bucket->mean_square;
+        }
+        waveform_acc_clear( acc );
+    }
+
+    level->fill = 0;
+    if ( ++level->pos == waveform->config.buckets ) level->pos = 0;
+    if ( level->filled < waveform->config.buckets ) level->filled++;
+    level->count++;
+
+    if ( up && ++up->fill == waveform->config.factor )
+        waveform_push( waveform, l + 1 );
+}
+
+//  ---------------------------------------------------------------------------
+//  Adds interleaved frames to the pyramid.
+//  ---------------------------------------------------------------------------
+/*
+    Frames are taken a run at a time up to the end of the level 0 bucket,
+    one channel at a time, so that the bucket stays in registers.
+*/
+void waveform_process( void *state, const int16_t *samples, uint32_t frames )
+{
+    struct waveform_t       *waveform = state;
+    struct waveform_level_t *level    = &waveform->level[0];
+    struct waveform_acc_t   *acc;
+    const  int16_t *p;
+    uint8_t  channels = waveform->channels;
+    uint16_t base     = waveform->config.base;
+    uint64_t sum;
+    int32_t  sample;
+    int16_t  lo, hi;
+    uint32_t run, i;
+    uint8_t  c;
+
+    if ( channels == 0 ) return;
+
+    while ( frames > 0 )
+    {
+        run = base - level->fill;
+        if ( run > frames ) run = frames;
+
+        for ( c = 0; c < waveform->kept; c++ )
+        {
+            acc = &level->acc[c];
+            lo  = acc->min;
+            hi  = acc->max;
+            sum = 0;
+            p   = samples + c;
+            for ( i = 0; i < run; i++ )
+            {
+                sample = p[0];
+                p += channels;
+                if ( sample < lo ) lo = sample;
+                if ( sample > hi ) hi = sample;
+                sum += (uint32_t)( sample * sample );
+            }
+            acc->min = lo;
+            acc->max = hi;
+            acc->sum_squares += sum;
+        }
+
+        samples     += run * channels;
+        frames      -= run;
+        level->fill += run;
+
+        if ( level->fill == base ) waveform_push( waveform, 0 );
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns a meter stage for a waveform pyramid.
+//  ---------------------------------------------------------------------------
+struct meter_stage_t waveform_stage( struct waveform_t *waveform )
+{
+    struct meter_stage_t stage =
+    {
+        .name    = "waveform",
+        .state   = waveform,
+        .reset   = waveform_reset,
+        .process = waveform_process
+    };
+
+    return stage;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the number of frames in a bucket of a level.
+//  ---------------------------------------------------------------------------
+uint32_t waveform_bucket_frames( struct waveform_t *waveform, uint8_t level )
+{
+    uint32_t frames = waveform->config.base;
+
+    while ( level-- > 0 ) frames *= waveform->config.factor;
+
+    return frames;
+}
+
+//  ---------------------------------------------------------------------------
+//  Copies the newest buckets of a level, oldest first.
+//  ---------------------------------------------------------------------------
+uint16_t waveform_get_buckets( struct waveform_t *waveform, uint8_t level,
+                               uint8_t channel,
+                               struct waveform_bucket_t *buckets,
+                               uint16_t size )
+{
+    struct waveform_level_t *ring;
+    uint16_t total = waveform->config.buckets;
+    uint16_t count, n, i;
+
+    if ( level >= waveform->config.levels ) return 0;
+    if ( channel >= waveform->kept ) channel = 0;
+
+    ring  = &waveform->level[level];
+    count = ring->filled < size ? ring->filled : size;
+    n     = ( ring->pos + total - count ) % total;
+
+    for ( i = 0; i < count; i++ )
+    {
+        buckets[i] = ring->ring[channel][n];
+        if ( ++n == total ) n = 0;
+    }
+
+    return count;
+}
+
+//  ---------------------------------------------------------------------------
+//  Works out columns of a number of frames each, newest last.
+//  ---------------------------------------------------------------------------
+/*
+    Bucket i of a run is at i % buckets in the ring and is still there if
+    it is one of the newest filled.
+*/
+uint32_t waveform_get_columns( struct waveform_t *waveform, uint8_t channel,
+                               uint32_t frames,
+                               struct waveform_bucket_t *columns,
+                               uint16_t width )
+{
+    const struct waveform_bucket_t *ring;
+    struct waveform_level_t *level;
+    struct waveform_bucket_t *column;
+    uint16_t total = waveform->config.buckets;
+    uint32_t bucket_frames, group, end, oldest, first, i;
+    uint64_t sum;
+    uint8_t  l = 0;
+    uint16_t x;
+
+    if ( channel >= waveform->kept ) channel = 0;
+
+    // Longest buckets that fit in a column.
+    while ( l + 1 < waveform->config.levels &&
+            waveform_bucket_frames( waveform, l + 1 ) <= frames ) l++;
+    bucket_frames = waveform_bucket_frames( waveform, l );
+    group = frames / bucket_frames;
+    if ( group == 0 ) group = 1;
+
+    level  = &waveform->level[l];
+    ring   = level->ring[channel];
+    end    = level->count - level->count % group;
+    oldest = level->count - level->filled;
+
+    for ( x = width; x-- > 0; )
+    {
+        column = &columns[x];
+        memset( column, 0, sizeof( struct waveform_bucket_t ));
+        if ( end < group || end - group < oldest ) continue;
+
+        first = end - group;
+        column->min = INT16_MAX;
+        column->max = INT16_MIN;
+        sum = 0;
+        for ( i = first; i < end; i++ )
+        {
+            if ( ring[i % total].min < column->min )
+                column->min = ring[i % total].min;
+            if ( ring[i % total].max > column->max )
+                column->max = ring[i % total].max;
+            sum += ring[i % total].mean_square;
+        }
+        column->mean_square = sum / group;
+        end = first;
+    }
+
+    return group * bucket_frames;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the row of a sample in a band of rows.
+//  ---------------------------------------------------------------------------
+static inline uint16_t waveform_row( int32_t sample, uint16_t top,
+                                     uint16_t rows )
+{
+    return top + (( INT16_MAX - sample ) * ( rows - 1 ) + 32767 ) / 65535;
+}
+
+//  ---------------------------------------------------------------------------
+//  Draws the waveform into a 4-bit greyscale frame buffer.
+//  ---------------------------------------------------------------------------
+void waveform_draw( struct waveform_t *waveform, uint8_t *fb,
+                    uint16_t cols, uint16_t rows, uint32_t frames )
+{
+    struct   waveform_bucket_t columns[WAVEFORM_BUCKETS_MAX];
+    uint16_t band = rows / waveform->kept;
+    uint16_t x, y, top, bottom, width;
+    int32_t  rms;
+    uint8_t  c;
+
+    memset( fb, 0, cols * rows );
+    width = cols < WAVEFORM_BUCKETS_MAX ? cols : WAVEFORM_BUCKETS_MAX;
+    if ( band == 0 ) return;
+
+    for ( c = 0; c < waveform->kept; c++ )
+    {
+        waveform_get_columns( waveform, c, frames, columns, width );
+
+        for ( x = 0; x < width; x++ )
+        {
+            top    = waveform_row( columns[x].max, c * band, band );
+            bottom = waveform_row( columns[x].min, c * band, band );
+            for ( y = top; y <= bottom; y++ ) fb[y * cols + x] = 5;
+
+            // RMS about zero, inside the range.
+            rms = sqrtf( columns[x].mean_square );
+            if ( rms > columns[x].max ) rms = columns[x].max;
+            if ( rms <= 0 ) continue;
+            top    = waveform_row( rms, c * band, band );
+            bottom = waveform_row( -rms, c * band, band );
+            for ( y = top; y <= bottom; y++ ) fb[y * cols + x] = 15;
+        }
+    }
+}
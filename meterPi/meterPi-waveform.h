@@ -0,0 +1,189 @@
+//  ===========================================================================
+/*
+    meterPi-waveform:
+
+    Min, max and RMS pyramid of recent frames for scrolling waveform
+    displays.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+
+    Changelog:
+
+        v01.00      Original version.
+*/
+//  ===========================================================================
+
+#ifndef METERPI_WAVEFORM_H
+#define METERPI_WAVEFORM_H
+
+//  Info. ---------------------------------------------------------------------
+/*
+    A waveform display draws each pixel column as the range of the samples
+    it covers. Working that out from the samples on every refresh costs
+    the number of frames on screen, e.g. 256 columns of 1024 frames is
+    256k samples per channel per refresh, which is too much for a Pi 1.
+
+    Instead each level of the pyramid holds a ring of buckets, each the
+    min, max and mean square of a fixed number of frames. Level 0 buckets
+    are base frames and each level up is factor times longer, e.g. 64, 256
+    and 1024 frames. Frames are added to level 0 as they arrive and each
+    full bucket is folded into the level above, so the cost is a compare
+    and a multiply-add per sample plus a little per bucket, however many
+    levels there are.
+
+    A display then draws any zoom from the level with the longest buckets
+    that fit in a column, combining whole buckets, so drawing costs the
+    width of the display and not the frames shown. Columns are rounded
+    down to a whole number of buckets. Zooms between levels combine up to
+    factor buckets per column, so for every zoom to fill the display the
+    rings should hold factor times its width, e.g. 1024 buckets for 256
+    columns with a factor of 4.
+
+    Every ring is allocated with the pyramid, so memory is fixed. Only the
+    first two channels are kept, so with 5.1 or 7.1 it is the front pair.
+*/
+
+//  Macros. -------------------------------------------------------------------
+
+#define WAVEFORM_CHANNELS    2    // Channels kept.
+#define WAVEFORM_LEVELS_MAX  4    // Most levels.
+#define WAVEFORM_BUCKETS_MAX 1024 // Most buckets per level.
+
+//  Types. --------------------------------------------------------------------
+
+struct waveform_config_t
+{
+    uint16_t base;    // Frames per bucket at level 0.
+    uint8_t  factor;  // Buckets folded into each bucket of next level.
+    uint8_t  levels;  // Number of levels.
+    uint16_t buckets; // Buckets kept per level, e.g. width * factor.
+};
+
+struct waveform_bucket_t
+{
+    int16_t  min;         // Lowest sample.
+    int16_t  max;         // Highest sample.
+    uint32_t mean_square; // Mean of squares of samples.
+};
+
+/*
+    Bucket being filled. The sum is 64-bit so that it is exact.
+*/
+struct waveform_acc_t
+{
+    int16_t  min;         // Lowest sample.
+    int16_t  max;         // Highest sample.
+    uint64_t sum_squares; // Sum of squares, or of mean squares above 0.
+};
+
+struct waveform_level_t
+{
+    struct   waveform_acc_t acc[WAVEFORM_CHANNELS]; // Bucket being filled.
+    uint32_t fill;                                  // Frames or buckets in it.
+    uint16_t pos;                                   // Next bucket in ring.
+    uint16_t filled;                                // Buckets in ring.
+    uint32_t count;                                 // Buckets completed.
+    struct   waveform_bucket_t ring[WAVEFORM_CHANNELS][WAVEFORM_BUCKETS_MAX];
+};
+
+struct waveform_t
+{
+    struct  waveform_config_t config;   // Settings.
+    uint32_t rate;                      // Sample rate.
+    uint8_t  channels;                  // Interleaved channels.
+    uint8_t  kept;                      // Channels kept, 1 or 2.
+    struct   waveform_level_t level[WAVEFORM_LEVELS_MAX]; // Levels.
+};
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Creates a waveform pyramid. Returns NULL if the settings are invalid.
+//  ---------------------------------------------------------------------------
+struct waveform_t *waveform_create( const struct waveform_config_t *config );
+
+//  ---------------------------------------------------------------------------
+//  Frees a waveform pyramid.
+//  ---------------------------------------------------------------------------
+void waveform_destroy( struct waveform_t *waveform );
+
+//  ---------------------------------------------------------------------------
+//  Empties every level after a gap or rate change.
+//  ---------------------------------------------------------------------------
+void waveform_reset( void *waveform, uint32_t rate, uint8_t channels );
+
+//  ---------------------------------------------------------------------------
+//  Adds interleaved frames to the pyramid.
+//  ---------------------------------------------------------------------------
+void waveform_process( void *waveform, const int16_t *samples,
+                       uint32_t frames );
+
+//  ---------------------------------------------------------------------------
+//  Returns a meter stage for a waveform pyramid.
+//  ---------------------------------------------------------------------------
+struct meter_stage_t waveform_stage( struct waveform_t *waveform );
+
+//  ---------------------------------------------------------------------------
+//  Returns the number of frames in a bucket of a level.
+//  ---------------------------------------------------------------------------
+uint32_t waveform_bucket_frames( struct waveform_t *waveform, uint8_t level );
+
+//  ---------------------------------------------------------------------------
+//  Copies the newest buckets of a level, oldest first.
+//  ---------------------------------------------------------------------------
+/*
+    Returns the number copied, up to size.
+*/
+uint16_t waveform_get_buckets( struct waveform_t *waveform, uint8_t level,
+                               uint8_t channel,
+                               struct waveform_bucket_t *buckets,
+                               uint16_t size );
+
+//  ---------------------------------------------------------------------------
+//  Works out columns of a number of frames each, newest last.
+//  ---------------------------------------------------------------------------
+/*
+    frames is rounded down to whole buckets of the level with the longest
+    buckets that fit. Columns only hold whole groups of buckets counted
+    from the start of the run, so a column doesn't change as the display
+    scrolls. Columns with no frames yet, on the left, are left empty (min
+    and max 0). A channel not kept, e.g. the right of a mono stream, gives
+    the left. Returns the frames in each column.
+*/
+uint32_t waveform_get_columns( struct waveform_t *waveform, uint8_t channel,
+                               uint32_t frames,
+                               struct waveform_bucket_t *columns,
+                               uint16_t width );
+
+//  ---------------------------------------------------------------------------
+//  Draws the waveform into a 4-bit greyscale frame buffer.
+//  ---------------------------------------------------------------------------
+/*
+    The frame buffer has one byte (0 to 15) per pixel, row by row, as used
+    by the SSD1322 driver. Each column is frames long, the newest on the
+    right. The range of each column is drawn dim with its RMS bright over
+    it. Stereo is drawn as left above right.
+*/
+void waveform_draw( struct waveform_t *waveform, uint8_t *fb,
+                    uint16_t cols, uint16_t rows, uint32_t frames );
+
+#endif // #ifndef METERPI_WAVEFORM_H
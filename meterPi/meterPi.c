@@ -28,8 +28,19 @@
 /*
     For a shared library, compile with:
 
-        gcc -c -Wall -fpic meterPi.c -lm -lpthread -lrt -lasound -lncurses
-        gcc -shared -o libmeterPi.so meterPi.o
+        gcc -c -Wall -fpic meterPi.c meterPi-kernel.c meterPi-truepeak.c
+            meterPi-loudness.c meterPi-spectrum.c meterPi-phase.c
+            meterPi-pace.c meterPi-synth.c meterPi-source.c
+            meterPi-source-alsa.c meterPi-players.c meterPi-publish.c
+            meterPi-capture.c meterPi-waveform.c meterPi-waterfall.c
+            meterPi-dynamics.c
+            -lm -lpthread -lrt -lasound -lncurses
+        gcc -shared -o libmeterPi.so meterPi.o meterPi-kernel.o
+            meterPi-truepeak.o meterPi-loudness.o meterPi-spectrum.o
+            meterPi-phase.o meterPi-pace.o meterPi-synth.o meterPi-source.o
+            meterPi-source-alsa.o meterPi-players.o meterPi-publish.o
+            meterPi-capture.o meterPi-waveform.o meterPi-waterfall.o
+            meterPi-dynamics.o
 
     For Raspberry Pi v1 optimisation use the following flags:
 
@@ -59,6 +70,7 @@
 #include <stdint.h>
 #include <math.h>
 #include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <stdlib.h>
@@ -66,36 +78,21 @@
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
 #include <net/if.h>
 
 //  Local libraries -----------------------------------------------------------
 
 #include "meterPi.h"
+#include "meterPi-kernel.h"
+#include "meterPi-truepeak.h"
+#include "meterPi-loudness.h"
 
-//  Types. --------------------------------------------------------------------
-
-/*
-    This is the structure of the shared memory object defined in Squeezelite.
-    See https://github.com/ralph-irving/squeezelite/blob/master/output_vis.c.
-    It looks like the samples in this buffer are fixed to 16-bit.
-    Audio samples > 16-bit are right shifted so that only the higher 16-bits
-    are used.
-*/
-static struct vis_t
-{
-    pthread_rwlock_t rwlock;
-    uint32_t buf_size;
-    uint32_t buf_index;
-    bool     running;
-    uint32_t rate;
-    time_t   updated;
-    int16_t  buffer[VIS_BUF_SIZE];
-}  *vis_mmap = NULL;
+//  Local variables. ----------------------------------------------------------
 
-
-static bool running = false;
-static int  vis_fd = -1;
-static char *mac_address = NULL;
+static struct meter_t *default_meter = NULL; // Meter for legacy functions.
+static pthread_once_t default_once = PTHREAD_ONCE_INIT;
 
 //  Functions. ----------------------------------------------------------------
 
@@ -107,7 +104,7 @@ static char *mac_address = NULL;
     has been largely used as it is based on the Squeezelite code and therefore
     has some synergy!
 */
-static char *get_mac_address()
+static void get_mac_address( char *macaddr )
 {
     struct  ifconf ifc;
     struct  ifreq  *ifr, *ifend;
@@ -124,7 +121,7 @@ static char *get_mac_address()
 
     // Create a socket for ioctl function.
     int sd = socket( AF_INET, SOCK_DGRAM, 0 );
-    if ( sd < 0 ) return mac_address;
+    if ( sd < 0 ) return;
 
     // Get some interface info.
     ifc.ifc_len = sizeof( ifs );
@@ -155,136 +152,467 @@ static char *get_mac_address()
     // Close socket.
     close( sd );
 
-    char *macaddr = malloc( 18 );
-
     // Construct MAC address string.
     sprintf( macaddr, "%02x:%02x:%02x:%02x:%02x:%02x",
                       mac[0], mac[1], mac[2], mac[3], mac[4], mac[5] );
+}
 
-	return macaddr;
+//  ---------------------------------------------------------------------------
+//  Returns the Squeezelite shared memory object name for this machine.
+//  ---------------------------------------------------------------------------
+void vis_get_name( char *name, size_t size )
+{
+	char mac_address[18];
+
+    mac_address[0] = '\0';
+    get_mac_address( mac_address );
+    snprintf( name, size, "/squeezelite-%s", mac_address );
+}
+
+//  ---------------------------------------------------------------------------
+//  Watches for changes to shared memory objects while a buffer is unmapped.
+//  ---------------------------------------------------------------------------
+/*
+    Leaves notify_fd at -1 if inotify isn't available, so that reopen falls
+    back to a timer.
+*/
+static void vis_source_watch( struct vis_source_t *source )
+{
+    source->notify_fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+    if ( source->notify_fd >= 0 &&
+         inotify_add_watch( source->notify_fd, VIS_SHM_DIR,
+                            IN_CREATE | IN_MOVED_TO | IN_MODIFY ) < 0 )
+    {
+        close( source->notify_fd );
+        source->notify_fd = -1;
+    }
 }
 
 //  ---------------------------------------------------------------------------
 //  Reopens squeezelite shared memory and maps memory block.
 //  ---------------------------------------------------------------------------
-static void reopen( void )
+static void reopen( struct vis_source_t *source )
 /*
     Jivelite code.
 */
 {
-	char shm_path[40];
+    struct stat st;
+
+    // A buffer owned by the caller is never remapped.
+    if ( source->attached ) return;
 
     // Unmap memory if it is already mapped.
-	if ( vis_mmap )
+	if ( source->vis )
 	{
-		munmap( vis_mmap, sizeof( struct vis_t ));
-		vis_mmap = NULL;
+		munmap( source->vis, sizeof( struct vis_t ));
+		source->vis = NULL;
 	}
 
     // Close file access if it exists.
-	if ( vis_fd != -1 )
-	{
-		close( vis_fd );
-		vis_fd = -1;
-	}
-
-    // Get MAC adddress if not already determined.
-	if ( !mac_address )
+	if ( source->vis_fd != -1 )
 	{
-		mac_address = get_mac_address();
+		close( source->vis_fd );
+		source->vis_fd = -1;
 	}
 
     /*
         The shared memory object is defined by Squeezelite and is identified
         by a name made up from the MAC address.
     */
-	sprintf( shm_path, "/squeezelite-%s", mac_address ? mac_address : "" );
+	if ( source->shm_name[0] == '\0' )
+        vis_get_name( source->shm_name, sizeof( source->shm_name ));
+
+    // Watch before opening so that a change in between isn't missed.
+    if ( source->notify_fd == -1 ) vis_source_watch( source );
 
-    // Open shared memory.
-	vis_fd = shm_open( shm_path, O_RDWR, 0666 );
-	if ( vis_fd > 0 )
+    /*
+        Open shared memory. The object is created before it is sized, so
+        it is only mapped once it is big enough to hold the buffer.
+    */
+	source->vis_fd = shm_open( source->shm_name, O_RDWR, 0666 );
+	if ( source->vis_fd > 0 &&
+	     ( fstat( source->vis_fd, &st ) != 0 ||
+	       st.st_size < (off_t) sizeof( struct vis_t )))
+	{
+		close( source->vis_fd );
+		source->vis_fd = -1;
+	}
+	if ( source->vis_fd > 0 )
 	{
         // Map memory.
-        vis_mmap = mmap( NULL, sizeof( struct vis_t ),
-                         PROT_READ | PROT_WRITE,
-                         MAP_SHARED, vis_fd, 0 );
+        source->vis = mmap( NULL, sizeof( struct vis_t ),
+                            PROT_READ | PROT_WRITE,
+                            MAP_SHARED, source->vis_fd, 0 );
 
-        if ( vis_mmap == MAP_FAILED )
+        if ( source->vis == MAP_FAILED )
         {
-            close( vis_fd );
-            vis_fd = -1;
-            vis_mmap = NULL;
+            close( source->vis_fd );
+            source->vis_fd = -1;
+            source->vis = NULL;
         }
     }
+
+    // Only watched while unmapped, so events don't queue up while playing.
+    if ( source->vis && source->notify_fd != -1 )
+    {
+        close( source->notify_fd );
+        source->notify_fd = -1;
+    }
+    source->valid = false;
 }
 
 //  ---------------------------------------------------------------------------
-//  Checks status of mmap and attempt to open/reopen if not updated recently.
+//  Returns true if a Squeezelite object has changed since the last call.
 //  ---------------------------------------------------------------------------
-void vis_check( void )
+/*
+    Drains the inotify events for VIS_SHM_DIR without blocking. Creating,
+    renaming and sizing the object all count as changes.
+*/
+static bool vis_source_notified( struct vis_source_t *source )
+{
+    char buffer[4096]
+         __attribute__(( aligned( __alignof__( struct inotify_event ))));
+    const struct inotify_event *event;
+    ssize_t length;
+    char    *next;
+    bool    changed = false;
+
+    while (( length = read( source->notify_fd, buffer,
+                            sizeof( buffer ))) > 0 )
+    {
+        for ( next = buffer; next < buffer + length;
+              next += sizeof( struct inotify_event ) + event->len )
+        {
+            event = (const struct inotify_event *) next;
+            if ( event->len > 0 &&
+                 strcmp( event->name, source->shm_name + 1 ) == 0 )
+                changed = true;
+        }
+    }
+
+    return changed;
+}
+
+//  ---------------------------------------------------------------------------
+//  Checks status of a Squeezelite buffer and maps it again if necessary.
+//  ---------------------------------------------------------------------------
+static void vis_source_check( void *state, struct meter_status_t *status )
 /*
     Jivelite code.
-    This function maps the shared memory object if it has not already done so
-    within the last 5 seconds.
+    This function maps the shared memory object if it has changed since the
+    last attempt, or if it has not already done so within the last 5
+    seconds when inotify isn't available.
     The buffer can contain 16384 samples, which at the highest sample rate of
     384kHz, is enough for around 42ms. This increases to 371ms for 44.1kHz.
     Shouldn't the shared memory object be mapped more frequently?
 */
 {
-    static time_t lastopen = 0;
+    struct vis_source_t *source = state;
     time_t now = time( NULL );
 
-    if ( !vis_mmap )
+    status->running = false;
+
+    if ( !source->vis )
     {
-        if ( now - lastopen > 5 )
+        if ( source->lastopen == 0 ||
+             ( source->notify_fd >= 0 ? vis_source_notified( source ) :
+               now - source->lastopen > VIS_REOPEN_TIME ))
         {
-            reopen();
-            lastopen = now;
+            reopen( source );
+            source->lastopen = now;
         }
-        if ( !vis_mmap ) return;
+        if ( !source->vis ) return;
     }
 
-    pthread_rwlock_rdlock( &vis_mmap->rwlock );
+    pthread_rwlock_rdlock( &source->vis->rwlock );
 
-    running = vis_mmap->running;
+    status->running  = source->vis->running;
+    status->rate     = source->vis->rate;
+    status->position = source->vis->buf_index;
 
-    if ( running && now - vis_mmap->updated > 5 )
+    if ( status->running && now - source->vis->updated > VIS_REOPEN_TIME &&
+         !source->attached )
     {
-        pthread_rwlock_unlock(&vis_mmap->rwlock );
-        reopen();
-        lastopen = now;
+        pthread_rwlock_unlock( &source->vis->rwlock );
+        reopen( source );
+        source->lastopen = now;
+        status->running = false;
     } else
     {
-        pthread_rwlock_unlock( &vis_mmap->rwlock );
+        pthread_rwlock_unlock( &source->vis->rwlock );
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Copies new frames from a Squeezelite buffer.
+//  ---------------------------------------------------------------------------
+/*
+    The frames are copied so that the lock is not held while metering.
+*/
+static bool vis_source_begin( void *state, struct meter_read_t *read,
+                              uint32_t frames )
+{
+    struct vis_source_t   *source   = state;
+    struct vis_snapshot_t *snapshot = &source->snapshot;
+    struct timespec now;
+    uint64_t elapsed_us;
+    bool     overrun = false;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    /*
+        If the writer has gone all the way round the ring since the last
+        read the number of new frames can't be worked out from the index.
+        Use the time since the last read to catch this.
+    */
+    if ( source->valid && source->rate > 0 )
+    {
+        elapsed_us = ( now.tv_sec  - source->read_time.tv_sec ) * 1000000ULL +
+                     ( now.tv_nsec - source->read_time.tv_nsec ) / 1000;
+        overrun = elapsed_us * source->rate / 1000000 >=
+                  VIS_BUF_SIZE / VIS_CHANNELS;
     }
+
+    if ( source->valid && !overrun )
+        vis_snapshot_since( source->vis, snapshot, source->index,
+                            VIS_BUF_SIZE / VIS_CHANNELS );
+    else
+        vis_snapshot( source->vis, snapshot, frames );
+
+    if ( !snapshot->running )
+    {
+        source->valid = false;
+        return false;
+    }
+
+    // Frames since the last read may span a change of rate.
+    read->continuous = source->valid && !overrun;
+    if ( read->continuous && snapshot->rate != source->rate )
+    {
+        vis_snapshot( source->vis, snapshot, frames );
+        read->continuous = false;
+    }
+
+    read->rate            = snapshot->rate;
+    read->format          = METER_S16;
+    read->channels        = VIS_CHANNELS;
+    read->spans           = snapshot->frames > 0;
+    read->span[0].samples = snapshot->buffer;
+    read->span[0].frames  = snapshot->frames;
+
+    source->index     = snapshot->buf_index;
+    source->rate      = snapshot->rate;
+    source->read_time = now;
+    source->valid     = true;
+
+    return true;
 }
 
+//  ---------------------------------------------------------------------------
+//  Unmaps a Squeezelite buffer and frees its source.
+//  ---------------------------------------------------------------------------
+static void vis_source_close( void *state )
+{
+    struct vis_source_t *source = state;
+
+    if ( !source->attached )
+    {
+        if ( source->vis ) munmap( source->vis, sizeof( struct vis_t ));
+        if ( source->vis_fd != -1 ) close( source->vis_fd );
+    }
+    if ( source->notify_fd != -1 ) close( source->notify_fd );
+    free( source );
+}
+
+//  ---------------------------------------------------------------------------
+//  Creates a source for a Squeezelite buffer.
+//  ---------------------------------------------------------------------------
+static bool vis_source( struct meter_source_t *source, const char *name,
+                        struct vis_t *vis )
+{
+    struct vis_source_t *state;
+
+    // The snapshot is aligned for the SIMD kernels.
+    if ( posix_memalign( (void **) &state, VIS_ALIGN,
+                         sizeof( struct vis_source_t )))
+        return false;
+    memset( state, 0, sizeof( struct vis_source_t ));
+
+    state->vis_fd    = -1;
+    state->notify_fd = -1;
+    if ( name )
+        snprintf( state->shm_name, sizeof( state->shm_name ), "%s", name );
+    if ( vis )
+    {
+        state->vis = vis;
+        state->attached = true;
+    }
+
+    source->name  = "squeezelite";
+    source->state = state;
+    source->check = vis_source_check;
+    source->begin = vis_source_begin;
+    source->end   = NULL;
+    source->close = vis_source_close;
+
+    return true;
+}
 
 //  ---------------------------------------------------------------------------
-//  Locks the memory mapping thread.
+//  Creates a meter for an audio source.
 //  ---------------------------------------------------------------------------
-static void vis_lock( void )
+struct meter_t *meter_open_source( const struct meter_source_t *source )
 {
-    if ( !vis_mmap ) return;
-    pthread_rwlock_rdlock( &vis_mmap->rwlock );
+    struct meter_t *meter;
+    uint8_t format;
+
+    // Sample buffers in the meter are aligned for the SIMD kernels.
+    if ( posix_memalign( (void **) &meter, VIS_ALIGN,
+                         sizeof( struct meter_t )))
+    {
+        if ( source->close ) source->close( source->state );
+        return NULL;
+    }
+    memset( meter, 0, sizeof( struct meter_t ));
+
+    meter->source = *source;
+    for ( format = 0; format < METER_FORMATS; format++ )
+    {
+        meter->kernel[format]  = meter_kernel_select( format );
+        meter->convert[format] = meter_convert_select( format );
+    }
+
+    return meter;
 }
 
 //  ---------------------------------------------------------------------------
-//  Unlocks the memory mapping thread.
+//  Creates a meter for a Squeezelite shared memory object.
 //  ---------------------------------------------------------------------------
-static void vis_unlock( void )
+struct meter_t *meter_open( const char *name )
 {
-    if ( !vis_mmap ) return;
-    pthread_rwlock_unlock( &vis_mmap->rwlock );
+    struct meter_source_t source;
+
+    if ( !vis_source( &source, name, NULL )) return NULL;
+    return meter_open_source( &source );
+}
+
+//  ---------------------------------------------------------------------------
+//  Creates a meter for a visualisation buffer owned by the caller.
+//  ---------------------------------------------------------------------------
+struct meter_t *meter_attach( struct vis_t *vis )
+{
+    struct meter_source_t source;
+
+    if ( !vis_source( &source, NULL, vis )) return NULL;
+    return meter_open_source( &source );
+}
+
+//  ---------------------------------------------------------------------------
+//  Closes the source of a meter and frees it.
+//  ---------------------------------------------------------------------------
+void meter_close( struct meter_t *meter )
+{
+    if ( !meter ) return;
+
+    if ( meter->source.close ) meter->source.close( meter->source.state );
+
+    truepeak_destroy( meter->truepeak );
+    loudness_destroy( meter->loudness );
+    free( meter );
+}
+
+//  ---------------------------------------------------------------------------
+//  Adds an analysis stage to a meter.
+//  ---------------------------------------------------------------------------
+bool meter_add_stage( struct meter_t *meter,
+                      const struct meter_stage_t *stage )
+{
+    if ( meter->num_stages >= METER_STAGES_MAX ) return false;
+
+    meter->stages[meter->num_stages] = *stage;
+    if ( stage->reset )
+        stage->reset( stage->state, meter->window.rate,
+                      meter->window.channels );
+    meter->num_stages++;
+
+    return true;
+}
+
+//  ---------------------------------------------------------------------------
+//  Starts or stops counting the time spent in a meter's kernel and stages.
+//  ---------------------------------------------------------------------------
+void meter_profile( struct meter_t *meter, bool enabled )
+{
+    memset( &meter->profile, 0, sizeof( struct meter_profile_t ));
+    meter->profile.enabled = enabled;
+}
+
+//  ---------------------------------------------------------------------------
+//  Copies the time spent in a meter's kernel and stages.
+//  ---------------------------------------------------------------------------
+void meter_get_profile( struct meter_t *meter,
+                        struct meter_profile_t *profile )
+{
+    *profile = meter->profile;
+}
+
+//  ---------------------------------------------------------------------------
+//  Checks status of a meter's source and reopens it if necessary.
+//  ---------------------------------------------------------------------------
+void meter_check( struct meter_t *meter )
+{
+    meter->source.check( meter->source.state, &meter->status );
 }
 
 //  ---------------------------------------------------------------------------
 //  Returns the stream status.
 //  ---------------------------------------------------------------------------
-static bool vis_get_playing( void )
+static bool meter_get_playing( struct meter_t *meter )
+{
+    return meter->status.running;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the stream bit rate for a meter.
+//  ---------------------------------------------------------------------------
+uint32_t meter_get_rate( struct meter_t *meter )
+{
+    return meter->status.rate;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the number of channels metered by a meter.
+//  ---------------------------------------------------------------------------
+uint8_t meter_get_channels( struct meter_t *meter )
+{
+    return meter->window.channels;
+}
+
+//  ---------------------------------------------------------------------------
+//  Creates the default meter used by the legacy functions.
+//  ---------------------------------------------------------------------------
+static void default_meter_open( void )
 {
-    if ( !vis_mmap ) return false;
-    return running;
+    default_meter = meter_open( NULL );
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the default meter, creating it on first use.
+//  ---------------------------------------------------------------------------
+static struct meter_t *get_default_meter( void )
+{
+    pthread_once( &default_once, default_meter_open );
+    return default_meter;
+}
+
+//  ---------------------------------------------------------------------------
+//  Checks status of mmap and attempt to open/reopen if not updated recently.
+//  ---------------------------------------------------------------------------
+void vis_check( void )
+{
+    struct meter_t *meter = get_default_meter();
+
+    if ( meter ) meter_check( meter );
 }
 
 //  ---------------------------------------------------------------------------
@@ -292,175 +620,719 @@ static bool vis_get_playing( void )
 //  ---------------------------------------------------------------------------
 uint32_t vis_get_rate( void )
 {
-    if ( !vis_mmap ) return 0;
-    return vis_mmap->rate;
+    struct meter_t *meter = get_default_meter();
+
+    if ( !meter ) return 0;
+    return meter_get_rate( meter );
 }
 
 //  ---------------------------------------------------------------------------
-//  Returns the shared audio buffer.
+//  Returns the default meter, e.g. to pace a loop with meterPi-pace.
 //  ---------------------------------------------------------------------------
-static int16_t *vis_get_buffer( void )
+struct meter_t *vis_get_meter( void )
 {
-    if ( !vis_mmap ) return NULL;
-    return vis_mmap->buffer;
+    return get_default_meter();
 }
 
 //  ---------------------------------------------------------------------------
-//  Returns the length of the shared audio buffer.
+//  Copies frames from a visualisation buffer. Call with read lock held.
 //  ---------------------------------------------------------------------------
-static uint32_t vis_get_buffer_len( void )
+static void vis_copy( struct vis_t *vis, struct vis_snapshot_t *snapshot,
+                      uint32_t size, uint32_t samples )
 {
-    if ( !vis_mmap ) return 0;
-    return vis_mmap->buf_size;
+    struct meter_span_t span[2];
+    uint8_t  spans, i;
+    int16_t  *dest;
+
+    // Window ends at buf_index, so may wrap around the end of the ring.
+    spans = meter_ring_spans( vis->buffer, size,
+                              snapshot->buf_index % size + size - samples,
+                              samples / VIS_CHANNELS, span );
+    dest = snapshot->buffer;
+    for ( i = 0; i < spans; i++ )
+    {
+        memcpy( dest, span[i].samples,
+                span[i].frames * VIS_CHANNELS * sizeof( int16_t ));
+        dest += span[i].frames * VIS_CHANNELS;
+        snapshot->frames += span[i].frames;
+    }
 }
 
 //  ---------------------------------------------------------------------------
-//  Returns the index into the shared audio buffer.
+//  Locks a visualisation buffer and reads its status.
 //  ---------------------------------------------------------------------------
-static uint32_t vis_get_buffer_idx( void )
+static uint32_t vis_snapshot_begin( struct vis_t *vis,
+                                    struct vis_snapshot_t *snapshot )
 {
-    if ( !vis_mmap ) return 0;
-    return vis_mmap->buf_index;
+    uint32_t size;
+
+    pthread_rwlock_rdlock( &vis->rwlock );
+
+    snapshot->frames    = 0;
+    snapshot->running   = vis->running;
+    snapshot->rate      = vis->rate;
+    snapshot->buf_index = vis->buf_index;
+    snapshot->updated   = vis->updated;
+
+    // Never trust the shared buffer size beyond the local definition.
+    size = vis->buf_size;
+    if ( size > VIS_BUF_SIZE ) size = VIS_BUF_SIZE;
+    size -= size % VIS_CHANNELS;
+
+    return size;
 }
 
 //  ---------------------------------------------------------------------------
-//  Calculates peak dBfs values (L & R) of a number of stream samples.
+//  Copies the last number of frames from a visualisation buffer.
 //  ---------------------------------------------------------------------------
-void get_dBfs( struct peak_meter_t *peak_meter )
+bool vis_snapshot( struct vis_t *vis, struct vis_snapshot_t *snapshot,
+                   uint32_t frames )
 {
-	int16_t  *ptr;
-	int16_t  sample;
-	uint64_t sample_squared[METER_CHANNELS];
-	uint16_t sample_rms[METER_CHANNELS];
-    uint8_t  channel;
-	size_t   i, wrap;
-	int      offs;
+    uint32_t size, samples;
 
-	vis_check();
+    snapshot->frames = 0;
+    snapshot->running = false;
+    if ( !vis ) return false;
 
-    for ( channel = 0; channel < METER_CHANNELS; channel++ )
-        sample_squared[channel] = 0;
+    size = vis_snapshot_begin( vis, snapshot );
 
-	if ( vis_get_playing() )
-	{
-		vis_lock();
+    samples = frames * VIS_CHANNELS;
+    if ( samples > size ) samples = size;
+
+    if ( snapshot->running && samples > 0 )
+        vis_copy( vis, snapshot, size, samples );
+
+    pthread_rwlock_unlock( &vis->rwlock );
+
+    return snapshot->running;
+}
+
+//  ---------------------------------------------------------------------------
+//  Copies the frames written to a visualisation buffer since an index.
+//  ---------------------------------------------------------------------------
+bool vis_snapshot_since( struct vis_t *vis, struct vis_snapshot_t *snapshot,
+                         uint32_t index, uint32_t frames )
+{
+    uint32_t size, samples;
+
+    snapshot->frames = 0;
+    snapshot->running = false;
+    if ( !vis ) return false;
+
+    size = vis_snapshot_begin( vis, snapshot );
+
+    if ( snapshot->running && size > 0 )
+    {
+        samples = ( snapshot->buf_index % size + size - index % size ) % size;
+        if ( samples > frames * VIS_CHANNELS )
+             samples = frames * VIS_CHANNELS;
+        if ( samples > 0 ) vis_copy( vis, snapshot, size, samples );
+    }
+
+    pthread_rwlock_unlock( &vis->rwlock );
+
+    return snapshot->running;
+}
+
+//  ---------------------------------------------------------------------------
+//  Empties an integration window and sets its length.
+//  ---------------------------------------------------------------------------
+static void window_reset( struct meter_window_t *window, uint32_t frames,
+                          uint32_t rate )
+{
+    uint8_t channel;
 
-		offs = vis_get_buffer_idx() - ( peak_meter->samples * METER_CHANNELS );
-		while ( offs < 0 ) offs += vis_get_buffer_len();
+    window->frames = frames;
+    window->filled = 0;
+    window->pos    = 0;
+    window->rate   = rate;
+    window->valid  = false;
 
-		ptr = vis_get_buffer() + offs;
-		wrap = vis_get_buffer_len() - offs;
+    for ( channel = 0; channel < METER_CHANNELS_MAX; channel++ )
+    {
+        window->sum_squares[channel] = 0;
+        window->peak[channel] = 0;
+    }
+}
 
-		for ( i = 0; i < peak_meter->samples; i++ )
-		{
-            for ( channel = 0; channel < METER_CHANNELS; channel++ )
+//  ---------------------------------------------------------------------------
+//  Adds new frames to an integration window, removing the oldest frames.
+//  ---------------------------------------------------------------------------
+/*
+    Frames leaving the window are subtracted using the same kernel that
+    added them, so the running sums are exact and never drift.
+*/
+static void window_push( struct meter_window_t *window, meter_kernel_t kernel,
+                         const void *frames_in, uint32_t frames )
+{
+    struct meter_span_t span[2];
+    struct meter_acc_t  acc;
+    const  uint8_t *samples = frames_in;
+    uint8_t  channels = window->channels;
+    uint32_t size  = window->frames * channels;
+    uint32_t width = meter_format_width( window->format ) * channels;
+    uint32_t leaving, copy;
+    uint8_t  spans, i, channel;
+
+    if ( frames == 0 ) return;
+
+    // Only the newest window of frames can contribute.
+    if ( frames >= window->frames )
+    {
+        samples += ( frames - window->frames ) * width;
+        frames = window->frames;
+        window->filled = 0;
+        window->pos = 0;
+        for ( channel = 0; channel < channels; channel++ )
+            window->sum_squares[channel] = 0;
+    }
+
+    // Remove the oldest frames that are about to be overwritten.
+    leaving = window->filled + frames;
+    leaving = leaving > window->frames ? leaving - window->frames : 0;
+    if ( leaving > 0 )
+    {
+        meter_acc_clear( &acc );
+        spans = meter_format_spans( window->history, window->format,
+                                    channels, size,
+                                    ( window->pos + window->frames -
+                                      window->filled ) * channels,
+                                    leaving, span );
+        for ( i = 0; i < spans; i++ )
+            kernel( span[i].samples, span[i].frames, channels, &acc );
+        for ( channel = 0; channel < channels; channel++ )
+            window->sum_squares[channel] -= acc.sum_squares[channel];
+        window->filled -= leaving;
+    }
+
+    // Add the new frames.
+    meter_acc_clear( &acc );
+    kernel( samples, frames, channels, &acc );
+    for ( channel = 0; channel < channels; channel++ )
+    {
+        window->sum_squares[channel] += acc.sum_squares[channel];
+        if ( acc.peak[channel] > window->peak[channel] )
+            window->peak[channel] = acc.peak[channel];
+    }
+
+    // Store the new frames in the history ring.
+    copy = window->frames - window->pos;
+    if ( copy > frames ) copy = frames;
+    memcpy( window->history + window->pos * width, samples, copy * width );
+    memcpy( window->history, samples + copy * width, ( frames - copy ) * width );
+
+    window->pos = ( window->pos + frames ) % window->frames;
+    window->filled += frames;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the monotonic time in ns, for profiling.
+//  ---------------------------------------------------------------------------
+static uint64_t meter_time_ns( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+//  ---------------------------------------------------------------------------
+//  Feeds a span of frames to a meter's stages.
+//  ---------------------------------------------------------------------------
+/*
+    Frames that aren't 16-bit are converted a buffer full at a time.
+*/
+static void stages_process( struct meter_t *meter, const void *samples,
+                            uint32_t frames, uint8_t format, uint8_t channels )
+{
+    struct meter_profile_t *profile = &meter->profile;
+    meter_convert_t convert = meter->convert[format];
+    uint64_t start = 0;
+    uint32_t chunk;
+    uint8_t  i;
+
+    while ( frames > 0 )
+    {
+        chunk = frames;
+        if ( convert )
+        {
+            if ( chunk > VIS_BUF_SIZE / channels )
+                 chunk = VIS_BUF_SIZE / channels;
+            if ( profile->enabled ) start = meter_time_ns();
+            convert( samples, chunk, channels, meter->stage_buffer );
+            if ( profile->enabled )
+                profile->convert_ns += meter_time_ns() - start;
+        }
+
+        for ( i = 0; i < meter->num_stages; i++ )
+        {
+            if ( profile->enabled ) start = meter_time_ns();
+            meter->stages[i].process( meter->stages[i].state,
+                                      convert ? meter->stage_buffer : samples,
+                                      chunk );
+            if ( profile->enabled )
+                profile->stage_ns[i] += meter_time_ns() - start;
+        }
+
+        samples = (const uint8_t *) samples +
+                  chunk * channels * meter_format_width( format );
+        frames -= chunk;
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns a window length that fits the history for a number of channels.
+//  ---------------------------------------------------------------------------
+static uint32_t window_length( uint32_t frames, uint8_t channels )
+{
+    // Until the first frames are read, assume a Squeezelite buffer.
+    if ( channels == 0 ) channels = VIS_CHANNELS;
+
+    return frames > VIS_BUF_SIZE / channels ? VIS_BUF_SIZE / channels
+                                            : frames;
+}
+
+//  ---------------------------------------------------------------------------
+//  Reads new frames from a meter's source into its window and stages.
+//  ---------------------------------------------------------------------------
+static void window_update( struct meter_t *meter, uint32_t frames )
+{
+    struct meter_window_t *window = &meter->window;
+    struct meter_source_t *source = &meter->source;
+    struct meter_profile_t *profile = &meter->profile;
+    struct meter_read_t    read;
+    uint64_t start = 0;
+    uint32_t length;
+    uint8_t  i, j, channel;
+    bool     valid;
+
+    if ( frames < 1 ) frames = 1;
+    length = window_length( frames, window->channels );
+    /*
+        A new window length fills from new frames only. The read position
+        is kept so that stages don't see any frames twice.
+    */
+    if ( window->frames != length )
+    {
+        valid = window->valid;
+        window_reset( window, length, window->rate );
+        window->valid = valid;
+    }
+
+    /*
+        All new frames are read, not just a window's worth, as analysis
+        stages need every frame.
+    */
+    if ( !source->begin( source->state, &read, window->frames ))
+    {
+        window_reset( window, window->frames, 0 );
+        return;
+    }
+
+    /*
+        Start again if frames were missed or the rate, format or channels
+        changed. The window length depends on the channels.
+    */
+    if ( read.format >= METER_FORMATS || read.channels == 0 ||
+         read.channels > METER_CHANNELS_MAX ) read.spans = 0;
+    if ( !read.continuous || read.rate != window->rate ||
+         read.format != window->format ||
+         ( read.spans > 0 && read.channels != window->channels ))
+    {
+        if ( read.spans > 0 ) window->channels = read.channels;
+        window_reset( window, window_length( frames, window->channels ),
+                      read.rate );
+        window->format = read.format;
+    }
+
+    // Stages start again with each continuous run of frames.
+    if ( !window->valid )
+        for ( i = 0; i < meter->num_stages; i++ )
+            if ( meter->stages[i].reset )
+                meter->stages[i].reset( meter->stages[i].state, read.rate,
+                                        window->channels );
+
+    // Peaks are of the new frames, or held if there are none.
+    if ( read.spans > 0 )
+        for ( channel = 0; channel < window->channels; channel++ )
+            window->peak[channel] = 0;
+
+    for ( j = 0; j < read.spans; j++ )
+    {
+        if ( profile->enabled )
+        {
+            start = meter_time_ns();
+            profile->frames += read.span[j].frames;
+        }
+        window_push( window, meter->kernel[read.format],
+                     read.span[j].samples, read.span[j].frames );
+        if ( profile->enabled ) profile->kernel_ns += meter_time_ns() - start;
+        stages_process( meter, read.span[j].samples, read.span[j].frames,
+                        read.format, read.channels );
+    }
+    if ( source->end ) source->end( source->state, &read );
+
+    window->valid = true;
+}
+
+//  ---------------------------------------------------------------------------
+//  Reads new frames into a meter if the stream is playing.
+//  ---------------------------------------------------------------------------
+static void meter_update( struct meter_t *meter, uint32_t frames )
+{
+    uint8_t i;
+
+	if ( meter_get_playing( meter ))
+    {
+        meter->stopped = false;
+        window_update( meter, frames );
+    }
+    else
+    {
+        if ( !meter->stopped )
+            for ( i = 0; i < meter->num_stages; i++ )
+                if ( meter->stages[i].stop )
+                    meter->stages[i].stop( meter->stages[i].state );
+        meter->stopped = true;
+        window_reset( &meter->window, meter->window.frames, 0 );
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the bucket in a dB table for a mean square energy.
+//  ---------------------------------------------------------------------------
+uint16_t get_dB_bucket( uint64_t energy )
+{
+    uint8_t  exponent;
+    uint64_t mantissa;
+
+    if ( energy == 0 ) return 0;
+
+    // Octave and the bits following the leading 1.
+    exponent = 63 - __builtin_clzll( energy );
+    if ( exponent >= DB_TABLE_BITS )
+         mantissa = energy >> ( exponent - DB_TABLE_BITS );
+    else mantissa = energy << ( DB_TABLE_BITS - exponent );
+    mantissa &= ( 1 << DB_TABLE_BITS ) - 1;
+
+    return 1 + ( exponent << DB_TABLE_BITS ) + mantissa;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns true if a dB table was built for the settings of a peak meter.
+//  ---------------------------------------------------------------------------
+static bool dB_table_matches( struct meter_dB_table_t *table,
+                              struct peak_meter_t *peak_meter )
+{
+    return table->built &&
+           table->reference  == peak_meter->reference &&
+           table->floor      == peak_meter->floor &&
+           table->num_levels == peak_meter->num_levels &&
+           memcmp( table->scale, peak_meter->scale,
+                   sizeof( table->scale )) == 0;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the scale index for a dBfs value from a dB table.
+//  ---------------------------------------------------------------------------
+static uint8_t dB_table_index( struct meter_dB_table_t *table, float dBfs )
+{
+    // Truncated towards zero as the original calculation was.
+    int16_t dB = dBfs < DB_INDEX_MIN ? DB_INDEX_MIN : (int16_t) dBfs;
+
+    if ( dB > DB_INDEX_MIN + 255 ) dB = DB_INDEX_MIN + 255;
+    return table->bar_index[dB - DB_INDEX_MIN];
+}
+
+//  ---------------------------------------------------------------------------
+//  Builds dBfs and scale lookup tables for a peak meter.
+//  ---------------------------------------------------------------------------
+void set_dB_scale( struct meter_dB_table_t *table,
+                   struct peak_meter_t *peak_meter )
+{
+    double   energy, dBfs;
+    uint16_t bucket;
+    uint8_t  exponent, mantissa, i;
+    int16_t  dB;
+
+    table->reference  = peak_meter->reference;
+    table->floor      = peak_meter->floor;
+    table->num_levels = peak_meter->num_levels;
+    memcpy( table->scale, peak_meter->scale, sizeof( table->scale ));
+
+    // Energy buckets to dBfs, using the lower edge of each bucket.
+    table->dBfs[0] = peak_meter->floor;
+    for ( exponent = 0; exponent < 64; exponent++ )
+    {
+        for ( mantissa = 0; mantissa < ( 1 << DB_TABLE_BITS ); mantissa++ )
+        {
+            bucket = 1 + ( exponent << DB_TABLE_BITS ) + mantissa;
+            energy = ldexp( 1.0 + (double) mantissa / ( 1 << DB_TABLE_BITS ),
+                            exponent - DB_ENERGY_SHIFT );
+            dBfs = 10 * log10( energy ) -
+                   20 * log10( (double) peak_meter->reference );
+
+            if ( dBfs < peak_meter->floor ) dBfs = peak_meter->floor;
+            table->dBfs[bucket] = dBfs;
+        }
+    }
+
+    // dBfs to the lowest scale interval that contains it.
+    for ( dB = DB_INDEX_MIN; dB < DB_INDEX_MIN + 256; dB++ )
+    {
+        table->bar_index[dB - DB_INDEX_MIN] = peak_meter->num_levels ?
+                                              peak_meter->num_levels - 1 : 0;
+        for ( i = 0; i < peak_meter->num_levels; i++ )
+        {
+            if ( dB <= peak_meter->scale[i] )
             {
-			    sample = *ptr++;
-                sample_squared[channel] += sample * sample;
+                table->bar_index[dB - DB_INDEX_MIN] = i;
+                break;
             }
-            // Check for buffer wrap and refresh if necessary.
-			wrap -= 2;
-			if ( wrap <= 0 )
-			{
-				ptr = vis_get_buffer();
-				wrap = vis_get_buffer_len();
-			}
-		}
-		vis_unlock();
-	}
+        }
+    }
+
+    table->built = true;
+}
+
+//  ---------------------------------------------------------------------------
+//  Reads new frames into a meter and its stages.
+//  ---------------------------------------------------------------------------
+void meter_read( struct meter_t *meter )
+{
+    // Shares the window of meter_get_dBfs, so keep its length.
+    meter_check( meter );
+    meter_update( meter, meter->window.frames );
+}
 
-    for ( channel = 0; channel < METER_CHANNELS; channel++ )
+//  ---------------------------------------------------------------------------
+//  Adds a true-peak stage to a meter.
+//  ---------------------------------------------------------------------------
+static bool meter_enable_true_peak( struct meter_t *meter )
+{
+    struct meter_stage_t stage =
     {
-        sample_rms[channel] = round( sqrt( sample_squared[channel] ));
-        peak_meter->dBfs[channel] = 20 * log10( (float) sample_rms[channel] /
-                                                (float) peak_meter->reference );
-        if ( peak_meter->dBfs[channel] < peak_meter->floor )
+        .name    = "truepeak",
+        .reset   = truepeak_reset,
+        .process = truepeak_process
+    };
+
+    if ( meter->truepeak ) return true;
+
+    stage.state = meter->truepeak = truepeak_create();
+    if ( !meter->truepeak ) return false;
+
+    if ( !meter_add_stage( meter, &stage ))
+    {
+        truepeak_destroy( meter->truepeak );
+        meter->truepeak = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+//  ---------------------------------------------------------------------------
+//  Calculates peak dBfs values for a meter.
+//  ---------------------------------------------------------------------------
+void meter_get_dBfs( struct meter_t *meter, struct peak_meter_t *peak_meter )
+{
+    struct meter_window_t *window = &meter->window;
+    uint64_t energy, sum;
+    uint8_t  channel;
+
+	meter_check( meter );
+
+    // True-peak metering is only paid for once it is asked for.
+    if ( peak_meter->true_peak && !meter_enable_true_peak( meter ))
+        peak_meter->true_peak = false;
+
+    if ( !dB_table_matches( &meter->dB_table, peak_meter ))
+        set_dB_scale( &meter->dB_table, peak_meter );
+
+    meter_update( meter, peak_meter->samples );
+
+    peak_meter->channels = window->channels;
+
+    // Levels are held if there are no new frames since the last call.
+    if ( peak_meter->true_peak &&
+         !truepeak_read( meter->truepeak, peak_meter->dBtp,
+                         peak_meter->overshoot ) && !window->valid )
+    {
+        for ( channel = 0; channel < window->channels; channel++ )
         {
-             peak_meter->dBfs[channel] = peak_meter->floor;
+            peak_meter->dBtp[channel] = TRUEPEAK_FLOOR;
+            peak_meter->overshoot[channel] = false;
         }
     }
+
+    for ( channel = 0; channel < window->channels; channel++ )
+    {
+        peak_meter->peak[channel] = window->peak[channel];
+
+        /*
+            A mono window of VIS_BUF_SIZE full scale frames sums to 2^60,
+            so the mean is taken before the fraction bits are added and
+            the remainder gives the fraction.
+        */
+        sum    = window->sum_squares[channel];
+        energy = window->filled ?
+                 (( sum / window->filled ) << DB_ENERGY_SHIFT ) +
+                 (( sum % window->filled ) << DB_ENERGY_SHIFT ) /
+                 window->filled : 0;
+        peak_meter->dBfs[channel] =
+            meter->dB_table.dBfs[ get_dB_bucket( energy )];
+    }
 }
 
+//  ---------------------------------------------------------------------------
+//  Calculates loudness values for a meter.
+//  ---------------------------------------------------------------------------
+void meter_get_loudness( struct meter_t *meter,
+                         struct loudness_meter_t *loudness_meter )
+{
+    struct meter_stage_t stage =
+    {
+        .name    = "loudness",
+        .reset   = loudness_reset,
+        .process = loudness_process
+    };
+
+    if ( !meter->loudness )
+    {
+        stage.state = meter->loudness = loudness_create();
+        if ( meter->loudness && !meter_add_stage( meter, &stage ))
+        {
+            loudness_destroy( meter->loudness );
+            meter->loudness = NULL;
+        }
+        if ( !meter->loudness )
+        {
+            memset( loudness_meter, 0, sizeof( struct loudness_meter_t ));
+            loudness_meter->momentary     = LOUDNESS_FLOOR;
+            loudness_meter->short_term    = LOUDNESS_FLOOR;
+            loudness_meter->integrated    = LOUDNESS_FLOOR;
+            loudness_meter->max_momentary = LOUDNESS_FLOOR;
+            return;
+        }
+    }
+
+    meter_read( meter );
+    loudness_read( meter->loudness, loudness_meter );
+}
 
 //  ---------------------------------------------------------------------------
-//  Calculates the indices for string representations of the peak levels.
+//  Starts integrated loudness and loudness range again for a meter.
 //  ---------------------------------------------------------------------------
-void get_dB_indices( struct peak_meter_t *peak_meter )
+void meter_clear_loudness( struct meter_t *meter )
+{
+    if ( meter->loudness ) loudness_clear( meter->loudness );
+}
+
+//  ---------------------------------------------------------------------------
+//  Calculates the indices for string representations for a meter.
+//  ---------------------------------------------------------------------------
+void meter_get_dB_indices( struct meter_t *meter,
+                           struct peak_meter_t *peak_meter )
 {
-    uint8_t         channel;
-    uint8_t         i;
-    static bool     falling = false;
-    static uint16_t hold_inc[METER_CHANNELS] = { 0, 0 };
-    static uint16_t fall_inc[METER_CHANNELS] = { 0, 0 };
-    static uint16_t over_inc[METER_CHANNELS] = { 0, 0 };
-    static uint8_t  over_cnt[METER_CHANNELS] = { 0, 0 };
+    struct meter_ballistics_t *state = &meter->ballistics;
+    uint8_t channel;
+    uint8_t index;
 
-    for ( channel = 0; channel < METER_CHANNELS; channel++ )
+    if ( !dB_table_matches( &meter->dB_table, peak_meter ))
+        set_dB_scale( &meter->dB_table, peak_meter );
+
+    for ( channel = 0; channel < peak_meter->channels &&
+                       channel < METER_CHANNELS_MAX; channel++ )
     {
-        // Overload check;
-        if ( peak_meter->dBfs[channel] == 0 )
+        /*
+            Overload check. With true-peak metering an overload is a real
+            overshoot rather than a number of consecutive 0dBFS readings.
+        */
+        if ( peak_meter->true_peak )
+        {
+            if ( peak_meter->overshoot[channel] )
+            {
+                peak_meter->overload[channel] = true;
+                state->over_inc[channel] = 0;
+            }
+        }
+        else if ( peak_meter->dBfs[channel] > -1 )
         {
-            over_cnt[channel]++;
-            if ( over_cnt[channel] > peak_meter->over_peaks )
+            state->over_cnt[channel]++;
+            if ( state->over_cnt[channel] > peak_meter->over_peaks )
             {
                 peak_meter->overload[channel] = true;
-                over_inc[channel] = 0;
+                state->over_inc[channel] = 0;
             }
         }
-        else over_cnt[channel] = 0;
+        else state->over_cnt[channel] = 0;
 
         // Countdown for overload reset.
         if ( peak_meter->overload[channel] )
         {
-            if ( over_inc[channel] > peak_meter->over_incs )
+            if ( state->over_inc[channel] > peak_meter->over_incs )
             {
                 peak_meter->overload[channel] = false;
-                over_inc[channel] = 0;
+                state->over_inc[channel] = 0;
             }
-            else over_inc[channel]++;
+            else state->over_inc[channel]++;
         }
-        // Concatenate output meter string.
-        for ( i = 0; i < peak_meter->num_levels; i++ )
+
+        // Look up scale index. A new peak restarts the hold time.
+        index = dB_table_index( &meter->dB_table, peak_meter->dBfs[channel] );
+        peak_meter->bar_index[channel] = index;
+        if ( index > peak_meter->dot_index[channel] )
         {
-            if ( peak_meter->dBfs[channel] <= peak_meter->scale[i] )
-            {
-                peak_meter->bar_index[channel] = i;
-                if ( i > peak_meter->dot_index[channel] )
-                {
-                    peak_meter->dot_index[channel] = i;
-                    peak_meter->elapsed[channel] = 0;
-                    falling = false;
-                    hold_inc[channel] = 0;
-                    fall_inc[channel] = 0;
-                }
-                else
-                {
-                    i = peak_meter->num_levels;
-                }
-            }
+            peak_meter->dot_index[channel] = index;
+            peak_meter->elapsed[channel] = 0;
+            state->falling[channel] = false;
+            state->hold_inc[channel] = 0;
+            state->fall_inc[channel] = 0;
         }
 
         // Rudimentary peak hold routine until proper timing is introduced.
-        if ( falling )
+        if ( state->falling[channel] )
         {
-            fall_inc[channel]++;
-            if ( fall_inc[channel] >= peak_meter->fall_incs )
+            state->fall_inc[channel]++;
+            if ( state->fall_inc[channel] >= peak_meter->fall_incs )
             {
-                fall_inc[channel] = 0;
+                state->fall_inc[channel] = 0;
                 if ( peak_meter->dot_index[channel] > 0 )
                      peak_meter->dot_index[channel]--;
             }
         }
         else
         {
-            hold_inc[channel]++;
-            if ( hold_inc[channel] >= peak_meter->hold_incs )
+            state->hold_inc[channel]++;
+            if ( state->hold_inc[channel] >= peak_meter->hold_incs )
             {
-                hold_inc[channel] = 0;
-                falling = true;
+                state->hold_inc[channel] = 0;
+                state->falling[channel] = true;
                 if ( peak_meter->dot_index[channel] > 0 )
                      peak_meter->dot_index[channel]--;
             }
         }
     }
 }
+
+//  ---------------------------------------------------------------------------
+//  Calculates peak dBfs values (L & R) of a number of stream samples.
+//  ---------------------------------------------------------------------------
+void get_dBfs( struct peak_meter_t *peak_meter )
+{
+    struct meter_t *meter = get_default_meter();
+
+    if ( meter ) meter_get_dBfs( meter, peak_meter );
+}
+
+//  ---------------------------------------------------------------------------
+//  Calculates the indices for string representations of the peak levels.
+//  ---------------------------------------------------------------------------
+void get_dB_indices( struct peak_meter_t *peak_meter )
+{
+    struct meter_t *meter = get_default_meter();
+
+    if ( meter ) meter_get_dB_indices( meter, peak_meter );
+}
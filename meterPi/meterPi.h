@@ -32,6 +32,26 @@
         v01.01      Renamed and converted to library.
         v01.02      Added hold and fall timing.
         v01.03      Added overload detection.
+        v01.04      Added snapshot reader for the visualisation buffer.
+        v01.05      Added SIMD accumulation kernels.
+        v01.06      Added incremental sliding window integration.
+        v01.07      Added lookup tables for dBfs and scale indices.
+        v01.08      Moved all state into meter contexts for multiple meters.
+        v01.09      Added analysis stages and true-peak metering.
+        v01.10      Added EBU R128 loudness metering.
+        v01.11      Added spectrum analyser stage.
+        v01.12      Added paced refresh loop.
+        v01.13      Added synthetic visualisation buffer for testing.
+        v01.14      Added audio source layer.
+        v01.15      Added 24-bit, 32-bit and float sample formats.
+        v01.16      Added runtime channel count, up to 8 channels.
+        v01.17      Added phase correlation and goniometer stage.
+        v01.18      Reopen shared memory on inotify events, multi-player.
+        v01.19      Added publishing of results to shared memory.
+        v01.20      Added profiling of kernel and stage times.
+        v01.21      Added waveform pyramid stage.
+        v01.22      Added packed spectrogram waterfall stage.
+        v01.23      Added stage stop callback and dynamics statistics.
 */
 //  ===========================================================================
 
@@ -140,13 +160,63 @@
 
 #define VIS_BUF_SIZE 16384 // Predefined in Squeezelite.
 #define PEAK_METER_LEVELS_MAX 48 // Number of peak meter intervals / LEDs.
-#define METER_CHANNELS 2 // Number of metered channels.
+#define METER_CHANNELS_MAX 8 // Maximum number of metered channels.
+#define VIS_CHANNELS 2 // Channels in a Squeezelite buffer.
 #define OVERLOAD_PEAKS 3 // Number of consecutive 0dBFS peaks for overload.
+#define VIS_ALIGN 16 // Alignment of private sample buffers (bytes).
+#define DB_TABLE_BITS 5 // Mantissa bits per octave of energy in dB table.
+#define DB_TABLE_SIZE ( 1 + ( 64 << DB_TABLE_BITS )) // dB table entries.
+#define DB_ENERGY_SHIFT 4 // Fraction bits of mean square energy.
+#define DB_INDEX_MIN -192 // Lowest dBfs in scale index table.
+#define VIS_NAME_LEN 40 // Maximum length of shared memory object name.
+#define VIS_SHM_DIR "/dev/shm" // Where shared memory objects are listed.
+#define VIS_REOPEN_TIME 5 // Seconds between reopens without inotify.
+#define METER_STAGES_MAX 8 // Maximum number of analysis stages per meter.
+
+//  Local libraries -----------------------------------------------------------
+
+#include "meterPi-kernel.h"
 
 //  Types. --------------------------------------------------------------------
 
+/*
+    This is the structure of the shared memory object defined in Squeezelite.
+    See https://github.com/ralph-irving/squeezelite/blob/master/output_vis.c.
+    It looks like the samples in this buffer are fixed to 16-bit.
+    Audio samples > 16-bit are right shifted so that only the higher 16-bits
+    are used.
+*/
+struct vis_t
+{
+    pthread_rwlock_t rwlock;
+    uint32_t buf_size;
+    uint32_t buf_index;
+    bool     running;
+    uint32_t rate;
+    time_t   updated;
+    int16_t  buffer[VIS_BUF_SIZE];
+};
+
+/*
+    Private copy of the most recent frames in the visualisation buffer.
+    Squeezelite takes the write lock for every block it outputs, so holding
+    the read lock while metering stalls playback. Only the memcpy of the
+    required window is done under the lock and all metering is done on the
+    copy, which is always contiguous (oldest frame first).
+*/
+struct vis_snapshot_t
+{
+    bool     running;   // Stream status at time of copy.
+    uint32_t rate;      // Stream sample rate at time of copy.
+    uint32_t buf_index; // Buffer index at time of copy.
+    time_t   updated;   // Time of last buffer update by Squeezelite.
+    uint32_t frames;    // Number of frames copied.
+    int16_t  buffer[VIS_BUF_SIZE] __attribute__(( aligned( VIS_ALIGN )));
+};
+
 struct peak_meter_t
 {
+    bool     true_peak;  // Meter inter-sample peaks (BS.1770).
     uint16_t int_time;   // Integration time (ms).
     uint16_t samples;    // Samples for integration time.
     uint16_t hold_time;  // Peak hold time (ms).
@@ -157,19 +227,344 @@ struct peak_meter_t
     uint16_t over_time;  // Overload indicator time (ms).
     uint16_t over_incs;  // Overload indicator count.
     uint8_t  num_levels; // Number of display levels
-    int8_t   floor;      // Noise floor for meter (dB).
-    uint16_t reference;  // Reference level.
-    bool     overload  [METER_CHANNELS]; // Overload flags.
-    int8_t   dBfs      [METER_CHANNELS]; // dBfs values.
-    uint8_t  bar_index [METER_CHANNELS]; // Index for bar display.
-    uint8_t  dot_index [METER_CHANNELS]; // Index for dot display (peak hold).
-    uint32_t elapsed   [METER_CHANNELS]; // Elapsed time (us).
+    int16_t  floor;      // Noise floor for meter (dB), down to -192.
+    uint32_t reference;  // Reference level, METER_FULL_SCALE for dBFS.
+    uint8_t  channels;   // Channels metered, set by meter_get_dBfs.
+    bool     overload  [METER_CHANNELS_MAX]; // Overload flags.
+    float    dBfs      [METER_CHANNELS_MAX]; // dBfs values.
+    uint32_t peak      [METER_CHANNELS_MAX]; // Absolute sample peaks (24-bit).
+    float    dBtp      [METER_CHANNELS_MAX]; // True-peak values (dBTP).
+    bool     overshoot [METER_CHANNELS_MAX]; // True peak above full scale.
+    uint8_t  bar_index [METER_CHANNELS_MAX]; // Index for bar display.
+    uint8_t  dot_index [METER_CHANNELS_MAX]; // Index for dot display (peak hold).
+    uint32_t elapsed   [METER_CHANNELS_MAX]; // Elapsed time (us).
     int16_t  scale     [PEAK_METER_LEVELS_MAX]; // Scale intervals.
 };
 
 
+/*
+    Lookup tables for converting mean square energy to dBfs and dBfs to an
+    index in the display scale. These replace sqrt, log10 and a scan of the
+    scale on every refresh so the per-refresh path is integer only.
+
+    Energy is bucketed by its exponent (octave) and the top DB_TABLE_BITS
+    of its mantissa, i.e. a resolution of 10log10(1 + 1/32) = 0.13dB. The
+    lower edge of each bucket is used so full scale is exactly 0dBfs.
+
+    Samples are normalised to 24-bit and mean square energy has
+    DB_ENERGY_SHIFT fraction bits, so levels below one 24-bit step can be
+    shown, i.e. down to about -150dBfs. Scale indices are looked up by whole
+    dB from DB_INDEX_MIN.
+
+    The tables are built for the reference, floor and scale of a peak meter
+    and are rebuilt automatically if any of these change.
+*/
+struct meter_dB_table_t
+{
+    bool     built;                              // Tables are valid.
+    uint32_t reference;                          // Built for reference.
+    int16_t  floor;                              // Built for floor.
+    uint8_t  num_levels;                         // Built for levels.
+    int16_t  scale     [PEAK_METER_LEVELS_MAX];  // Built for scale.
+    float    dBfs      [DB_TABLE_SIZE];          // Energy bucket to dBfs.
+    uint8_t  bar_index [256];                    // dBfs - min to index.
+};
+
+/*
+    Sliding integration window. The frames in the window are kept in a
+    private ring so that frames leaving the window can be subtracted from
+    the running sums exactly, using the same kernel that added them. The
+    ring holds frames in the source's format and channels, so the window
+    starts again if either changes. The ring holds VIS_BUF_SIZE samples
+    whatever the number of channels, so the longest window is
+    VIS_BUF_SIZE / channels frames.
+*/
+struct meter_window_t
+{
+    uint32_t frames;     // Window length (frames).
+    uint32_t filled;     // Frames currently in window.
+    uint32_t pos;        // Next write position in history (frames).
+    uint32_t rate;       // Stream rate when window was filled.
+    uint8_t  format;     // Sample format of history.
+    uint8_t  channels;   // Channels in history.
+    bool     valid;      // Window holds a continuous run of frames.
+    uint64_t sum_squares [METER_CHANNELS_MAX]; // Sum of squares over window.
+    uint32_t peak        [METER_CHANNELS_MAX]; // Peak of most recent frames.
+    uint8_t  history[VIS_BUF_SIZE * sizeof( int32_t )]
+             __attribute__(( aligned( VIS_ALIGN )));
+};
+
+/*
+    Peak hold, fall and overload counters.
+*/
+struct meter_ballistics_t
+{
+    bool     falling  [METER_CHANNELS_MAX]; // Peak hold time has expired.
+    uint16_t hold_inc [METER_CHANNELS_MAX]; // Hold time counter.
+    uint16_t fall_inc [METER_CHANNELS_MAX]; // Fall time counter.
+    uint16_t over_inc [METER_CHANNELS_MAX]; // Overload indicator counter.
+    uint8_t  over_cnt [METER_CHANNELS_MAX]; // Consecutive 0dBFS readings.
+};
+
+/*
+    Analysis stage. Each stage is fed every new frame read by a meter, in
+    the order the stages were added, and is reset with the stream rate at
+    the start of each continuous run of frames, i.e. after the stream
+    stops, changes rate or the reader falls behind. Frames may point
+    straight into a source's buffer so are only valid during the call, but
+    stages never hold a buffer lock. Stages are always fed 16-bit frames,
+    converted from the source's format if necessary, with the number of
+    channels given at the last reset. If set, stop is called once when the
+    stream stops, so a stage can tell the end of a track from a gap.
+*/
+struct meter_stage_t
+{
+    const char *name;                      // Name for reports.
+    void       *state;                     // Passed to functions.
+    void      ( *reset )( void *state, uint32_t rate, uint8_t channels );
+    void      ( *process )( void *state, const int16_t *samples,
+                            uint32_t frames );
+    void      ( *stop )( void *state );
+};
+
+/*
+    Status of an audio source.
+*/
+struct meter_status_t
+{
+    bool     running;  // Stream is playing.
+    uint32_t rate;     // Sample rate (Hz).
+    uint32_t position; // Changes whenever there are new frames.
+};
+
+/*
+    New frames from an audio source as at most two spans of interleaved
+    frames, oldest first.
+*/
+struct meter_read_t
+{
+    uint32_t rate;       // Sample rate of frames.
+    uint8_t  format;     // Sample format of frames, see meterPi-kernel.h.
+    uint8_t  channels;   // Interleaved channels, 1 to METER_CHANNELS_MAX.
+    bool     continuous; // Frames follow the last read with none missing.
+    uint8_t  spans;      // Number of spans.
+    struct   meter_span_t span[2]; // New frames.
+};
+
+/*
+    Audio source. A meter reads all of its frames through one of these so
+    that it can meter any player. See meterPi-source.h for the backends.
+
+    check opens or reopens the source if necessary and returns its status.
+    It is called on every refresh so must be cheap.
+
+    begin returns false if the source isn't running. Otherwise it returns
+    every frame since the last read. If frames have been missed, e.g. on
+    the first read, after a change of rate or if the reader fell behind,
+    it returns the most recent frames only, up to the number asked for,
+    and clears continuous. end is called once the frames have been used
+    and releases them.
+*/
+struct meter_source_t
+{
+    const char *name;                      // Name for reports.
+    void       *state;                     // Passed to functions.
+    void      ( *check )( void *state, struct meter_status_t *status );
+    bool      ( *begin )( void *state, struct meter_read_t *read,
+                          uint32_t frames );
+    void      ( *end )( void *state, const struct meter_read_t *read );
+    void      ( *close )( void *state );
+};
+
+/*
+    Source state for a Squeezelite buffer. Frames are copied from the ring
+    under the read lock and metered from the copy. While the object can't
+    be mapped, VIS_SHM_DIR is watched with inotify so that it is mapped as
+    soon as it is created rather than on a timer.
+*/
+struct vis_source_t
+{
+    struct vis_t   *vis;                   // Visualisation buffer.
+    int            vis_fd;                 // Shared memory descriptor.
+    bool           attached;               // Buffer is owned by caller.
+    char           shm_name[VIS_NAME_LEN]; // Shared memory object name.
+    time_t         lastopen;               // Last attempt to map buffer.
+    int            notify_fd;              // Watch while unmapped, or -1.
+    bool           valid;                  // Index is valid.
+    uint32_t       index;                  // Buffer index of last read.
+    uint32_t       rate;                   // Stream rate at last read.
+    struct timespec read_time;             // Time of last read.
+    struct vis_snapshot_t snapshot;        // Private copy of new frames.
+};
+
+struct truepeak_t;
+struct loudness_t;
+struct loudness_meter_t;
+
+/*
+    Time spent metering, counted while enabled with meter_profile. Stage
+    times are in the order the stages were added.
+*/
+struct meter_profile_t
+{
+    bool     enabled;                    // Times are being counted.
+    uint64_t frames;                     // Frames read.
+    uint64_t kernel_ns;                  // Time in integration window (ns).
+    uint64_t convert_ns;                 // Time converting for stages (ns).
+    uint64_t stage_ns[METER_STAGES_MAX]; // Time in each stage (ns).
+};
+
+/*
+    Meter context. Holds everything needed to meter one stream so that any
+    number of meters can run independently, in the same thread or in
+    different threads, e.g. a fast PPM and a slow VU on the same stream or
+    meters for several players. A context must only be used by one thread
+    at a time. Several contexts can read the same Squeezelite buffer.
+*/
+struct meter_t
+{
+    struct meter_source_t source;          // Audio source.
+    struct meter_status_t status;          // Source status at last check.
+    meter_kernel_t  kernel[METER_FORMATS]; // Accumulation kernels.
+    meter_convert_t convert[METER_FORMATS]; // Conversions for stages.
+    struct meter_dB_table_t   dB_table;    // dBfs and scale lookup tables.
+    struct meter_ballistics_t ballistics;  // Hold, fall and overload.
+    struct meter_window_t     window;      // Integration window.
+    struct meter_stage_t      stages[METER_STAGES_MAX]; // Analysis stages.
+    uint8_t                   num_stages;  // Number of stages.
+    bool                      stopped;     // Stages told stream stopped.
+    struct truepeak_t        *truepeak;    // True-peak stage, if enabled.
+    struct loudness_t        *loudness;    // Loudness stage, if enabled.
+    struct meter_profile_t    profile;     // Times, if enabled.
+    int16_t stage_buffer[VIS_BUF_SIZE]     // Frames converted for stages.
+            __attribute__(( aligned( VIS_ALIGN )));
+};
+
 //  Functions. ----------------------------------------------------------------
 
+//  ---------------------------------------------------------------------------
+//  Returns the Squeezelite shared memory object name for this machine.
+//  ---------------------------------------------------------------------------
+/*
+    Squeezelite names the object from the MAC address of the first
+    interface, e.g. "/squeezelite-b8:27:eb:01:02:03".
+*/
+void vis_get_name( char *name, size_t size );
+
+//  ---------------------------------------------------------------------------
+//  Creates a meter for a Squeezelite shared memory object.
+//  ---------------------------------------------------------------------------
+/*
+    name is the shared memory object name, e.g. "/squeezelite-<mac>", or
+    NULL to use the MAC address of the first interface as Squeezelite does.
+    The object does not need to exist yet. Returns NULL if out of memory.
+*/
+struct meter_t *meter_open( const char *name );
+
+//  ---------------------------------------------------------------------------
+//  Creates a meter for an audio source.
+//  ---------------------------------------------------------------------------
+/*
+    The source is copied and closed with the meter. It is also closed if
+    the meter can't be created. Returns NULL if out of memory.
+*/
+struct meter_t *meter_open_source( const struct meter_source_t *source );
+
+//  ---------------------------------------------------------------------------
+//  Creates a meter for a visualisation buffer owned by the caller.
+//  ---------------------------------------------------------------------------
+struct meter_t *meter_attach( struct vis_t *vis );
+
+//  ---------------------------------------------------------------------------
+//  Closes the source of a meter and frees it.
+//  ---------------------------------------------------------------------------
+void meter_close( struct meter_t *meter );
+
+//  ---------------------------------------------------------------------------
+//  Checks status of a meter's source and reopens it if necessary.
+//  ---------------------------------------------------------------------------
+void meter_check( struct meter_t *meter );
+
+//  ---------------------------------------------------------------------------
+//  Adds an analysis stage to a meter.
+//  ---------------------------------------------------------------------------
+/*
+    The stage is copied and is reset before it is first fed. Returns false
+    if the meter already has METER_STAGES_MAX stages. State is owned by the
+    caller.
+*/
+bool meter_add_stage( struct meter_t *meter,
+                      const struct meter_stage_t *stage );
+
+//  ---------------------------------------------------------------------------
+//  Starts or stops counting the time spent in a meter's kernel and stages.
+//  ---------------------------------------------------------------------------
+/*
+    Counters are cleared. While enabled every read costs two clock reads
+    for the kernel and for each stage.
+*/
+void meter_profile( struct meter_t *meter, bool enabled );
+
+//  ---------------------------------------------------------------------------
+//  Copies the time spent in a meter's kernel and stages.
+//  ---------------------------------------------------------------------------
+void meter_get_profile( struct meter_t *meter,
+                        struct meter_profile_t *profile );
+
+//  ---------------------------------------------------------------------------
+//  Returns the stream bit rate for a meter at the last check.
+//  ---------------------------------------------------------------------------
+uint32_t meter_get_rate( struct meter_t *meter );
+
+//  ---------------------------------------------------------------------------
+//  Returns the number of channels metered by a meter.
+//  ---------------------------------------------------------------------------
+/*
+    0 until the first frames have been read.
+*/
+uint8_t meter_get_channels( struct meter_t *meter );
+
+//  ---------------------------------------------------------------------------
+//  Calculates peak dBfs values for a meter.
+//  ---------------------------------------------------------------------------
+void meter_get_dBfs( struct meter_t *meter, struct peak_meter_t *peak_meter );
+
+//  ---------------------------------------------------------------------------
+//  Reads new frames into a meter and its stages.
+//  ---------------------------------------------------------------------------
+/*
+    For meters that only feed stages, e.g. a spectrum analyser added with
+    meter_add_stage. meter_get_dBfs and meter_get_loudness also do this.
+*/
+void meter_read( struct meter_t *meter );
+
+//  ---------------------------------------------------------------------------
+//  Calculates loudness values for a meter.
+//  ---------------------------------------------------------------------------
+/*
+    Loudness metering starts on the first call. It reads the same frames as
+    meter_get_dBfs, so the two can be called in any order on each refresh
+    and each frame is only read once. See meterPi-loudness.h.
+*/
+void meter_get_loudness( struct meter_t *meter,
+                         struct loudness_meter_t *loudness_meter );
+
+//  ---------------------------------------------------------------------------
+//  Starts integrated loudness and loudness range again for a meter.
+//  ---------------------------------------------------------------------------
+void meter_clear_loudness( struct meter_t *meter );
+
+//  ---------------------------------------------------------------------------
+//  Calculates the indices for string representations for a meter.
+//  ---------------------------------------------------------------------------
+void meter_get_dB_indices( struct meter_t *meter,
+                           struct peak_meter_t *peak_meter );
+
+/*
+    The following functions use a default meter for the Squeezelite object
+    named from the MAC address, created on first use.
+*/
+
 //  ---------------------------------------------------------------------------
 //  Checks status of mmap and attempt to open/reopen if not updated recently.
 //  ---------------------------------------------------------------------------
@@ -180,11 +575,58 @@ void vis_check( void );
 //  ---------------------------------------------------------------------------
 uint32_t vis_get_rate( void );
 
+//  ---------------------------------------------------------------------------
+//  Returns the default meter, e.g. to pace a loop with meterPi-pace.
+//  ---------------------------------------------------------------------------
+struct meter_t *vis_get_meter( void );
+
+//  ---------------------------------------------------------------------------
+//  Copies the last number of frames from a visualisation buffer.
+//  ---------------------------------------------------------------------------
+/*
+    The read lock is held only for the copy, which is at most two memcpy
+    calls if the window wraps around the end of the ring. Returns the
+    stream status. No frames are copied if the stream is not running.
+*/
+bool vis_snapshot( struct vis_t *vis, struct vis_snapshot_t *snapshot,
+                   uint32_t frames );
+
+//  ---------------------------------------------------------------------------
+//  Copies the frames written to a visualisation buffer since an index.
+//  ---------------------------------------------------------------------------
+/*
+    As vis_snapshot but copies only frames written after index, up to the
+    newest number of frames. The new index is returned in the snapshot.
+*/
+bool vis_snapshot_since( struct vis_t *vis, struct vis_snapshot_t *snapshot,
+                         uint32_t index, uint32_t frames );
+
 //  ---------------------------------------------------------------------------
 //  Calculates peak dBfs values (L & R) of a number of stream samples.
 //  ---------------------------------------------------------------------------
+/*
+    Integration is incremental. Only frames written since the last call are
+    read and a running sum of squares is kept over peak_meter->samples
+    frames, so the cost of each call depends on the amount of new audio
+    rather than on the integration time.
+*/
 void get_dBfs( struct peak_meter_t *peak_meter );
 
+//  ---------------------------------------------------------------------------
+//  Builds dBfs and scale lookup tables for a peak meter.
+//  ---------------------------------------------------------------------------
+/*
+    Called automatically by get_dBfs when the reference, floor or scale of
+    the peak meter changes. Call directly to avoid the cost at first use.
+*/
+void set_dB_scale( struct meter_dB_table_t *table,
+                   struct peak_meter_t *peak_meter );
+
+//  ---------------------------------------------------------------------------
+//  Returns the bucket in a dB table for a mean square energy.
+//  ---------------------------------------------------------------------------
+uint16_t get_dB_bucket( uint64_t energy );
+
 //  ---------------------------------------------------------------------------
 //  Calculates the indices for string representations of the peak levels.
 //  ---------------------------------------------------------------------------
@@ -0,0 +1,370 @@
+//  ===========================================================================
+/*
+    publishmeterPi:
+
+    Meter daemon. Meters a Squeezelite stream once and publishes the
+    results to shared memory for any number of displays.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Compile with:
+
+        gcc -Wall meterPi.c meterPi-kernel.c meterPi-truepeak.c
+            meterPi-loudness.c meterPi-spectrum.c meterPi-pace.c
+            meterPi-source.c meterPi-publish.c publishmeterPi.c
+            -o publishmeterPi -lm -lpthread -lrt
+
+    For Raspberry Pi v1 optimisation use the following flags:
+
+        -march=armv6zk -mtune=arm1176jzf-s -mfloat-abi=hard -mfpu=vfp
+        -ffast-math -pipe -O3
+
+    For Raspberry Pi v2 optimisation use the following flags:
+
+        -march=armv7-a -mtune=cortex-a7 -mfloat-abi=hard -mfpu=neon-vfpv4
+        -ffast-math -pipe -O3
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+*/
+//  ===========================================================================
+
+//  Installed libraries -------------------------------------------------------
+
+#include <stdbool.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <argp.h>
+#include <sys/types.h>
+
+//  Local libraries -----------------------------------------------------------
+
+#include "meterPi.h"
+#include "meterPi-loudness.h"
+#include "meterPi-spectrum.h"
+#include "meterPi-pace.h"
+#include "meterPi-publish.h"
+
+//  Info. ---------------------------------------------------------------------
+/*
+    Runs the meter at the refresh rate of the fastest display and publishes
+    the results on every refresh with new frames, and on every idle poll
+    while the stream is stopped so that displays see it stop.
+
+    e.g. peak meters, 16 spectrum bands and loudness at 60Hz, reporting
+    the publish latency every second:
+
+        publishmeterPi -r 60 -b 16 -l -v
+
+    Displays then read the results with meter_subscriber_read.
+*/
+
+//  Macros. -------------------------------------------------------------------
+
+#define Version "Version 0.1"
+
+#define PUBLISH_IDLE   2  // Poll rate while stopped (Hz).
+#define PUBLISH_LEVELS 41 // Peak meter levels, -40dB to 0dB.
+
+//  Types. --------------------------------------------------------------------
+
+struct publish_args_t
+{
+    char     name[VIS_NAME_LEN];    // Squeezelite object name.
+    char     results[VIS_NAME_LEN]; // Results object name.
+    uint16_t refresh;               // Refresh rate (Hz).
+    uint16_t int_time;              // Integration time (ms).
+    uint8_t  bands;                 // Spectrum bands, 0 for none.
+    bool     loudness;              // Publish loudness.
+    bool     true_peak;             // Meter true peaks.
+    bool     verbose;               // Report latency every second.
+    bool     error;                 // Invalid argument.
+};
+
+/*
+    Publish latency, update to publish, since the last report.
+*/
+struct publish_latency_t
+{
+    uint32_t count; // Results published.
+    uint64_t sum;   // Sum of latencies (ns).
+    uint64_t max;   // Largest latency (ns).
+};
+
+//  Local variables. ----------------------------------------------------------
+
+static volatile sig_atomic_t stopped = 0;
+
+//  argp documentation. -------------------------------------------------------
+
+const char *argp_program_version = Version;
+const char *argp_program_bug_address = "darren@alidaf.co.uk";
+static char doc[] = "Meters a Squeezelite stream and publishes the results "
+                    "to shared memory.";
+static char args_doc[] = "publishmeterPi <options>";
+
+static struct argp_option options[] =
+{
+    { 0, 0, 0, 0, "Objects:" },
+    { "name", 'n', "<name>", 0, "Squeezelite object name." },
+    { "results", 'o', "<name>", 0,
+      "Results object name (default " METER_RESULTS_NAME ")." },
+    { 0, 0, 0, 0, "Metering:" },
+    { "refresh", 'r', "<Hz>", 0, "Refresh rate (default 30)." },
+    { "integration", 'i', "<ms>", 0, "Integration time (default 50)." },
+    { "bands", 'b', "<n>", 0, "Spectrum bands (default 0, none)." },
+    { "loudness", 'l', 0, 0, "Publish EBU R128 loudness." },
+    { "true-peak", 't', 0, 0, "Meter true peaks." },
+    { "verbose", 'v', 0, 0, "Report publish latency every second." },
+    { 0 }
+};
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Command line argument parser.
+//  ---------------------------------------------------------------------------
+static int parse_opt( int param, char *arg, struct argp_state *state )
+{
+    struct publish_args_t *args = state->input;
+
+    switch( param )
+    {
+        case 'n' :
+            snprintf( args->name, sizeof( args->name ), "%s", arg );
+            break;
+        case 'o' :
+            snprintf( args->results, sizeof( args->results ), "%s", arg );
+            break;
+        case 'r' :
+            args->refresh = atoi( arg );
+            if ( args->refresh == 0 ) args->error = true;
+            break;
+        case 'i' :
+            args->int_time = atoi( arg );
+            if ( args->int_time == 0 ) args->error = true;
+            break;
+        case 'b' :
+            args->bands = atoi( arg );
+            if ( args->bands > METER_RESULTS_BANDS ) args->error = true;
+            break;
+        case 'l' :
+            args->loudness = true;
+            break;
+        case 't' :
+            args->true_peak = true;
+            break;
+        case 'v' :
+            args->verbose = true;
+            break;
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+//  ---------------------------------------------------------------------------
+//  Stops the daemon on a signal.
+//  ---------------------------------------------------------------------------
+static void publish_stop( int signal )
+{
+    (void) signal;
+    stopped = 1;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the monotonic time in ns.
+//  ---------------------------------------------------------------------------
+static uint64_t time_ns( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+//  ---------------------------------------------------------------------------
+//  Main.
+//  ---------------------------------------------------------------------------
+int main( int argc, char *argv[] )
+{
+    struct publish_args_t args =
+    {
+        .results  = METER_RESULTS_NAME,
+        .refresh  = 30,
+        .int_time = 50
+    };
+    struct peak_meter_t peak_meter =
+    {
+        .hold_time  = 1000,
+        .fall_time  = 50,
+        .over_peaks = 10,
+        .over_time  = 3000,
+        .num_levels = PUBLISH_LEVELS,
+        .floor      = -96,
+        .reference  = METER_FULL_SCALE,
+        .scale      =
+            { -40, -39, -38, -37, -36, -35, -34, -33, -32, -31,
+              -30, -29, -28, -27, -26, -25, -24, -23, -22, -21,
+              -20, -19, -18, -17, -16, -15, -14, -13, -12, -11,
+              -10,  -9,  -8,  -7,  -6,  -5,  -4,  -3,  -2,  -1,   0 }
+    };
+    struct spectrum_config_t spectrum_config =
+        { .size = 2048, .hop = 512, .low = 50, .high = 16000,
+          .attack = 10, .decay = 300, .floor = -80 };
+    struct meter_t            *meter;
+    struct meter_publisher_t  *publisher;
+    struct spectrum_t         *spectrum = NULL;
+    struct meter_stage_t       stage;
+    struct meter_pace_t        pace;
+    struct meter_results_t     results;
+    struct loudness_meter_t    loudness;
+    struct publish_latency_t   latency = { 0, 0, 0 };
+    uint64_t update_ns, report_ns, elapsed;
+    uint32_t rate = 0, samples;
+
+    argp_parse( &argp, argc, argv, 0, 0, &args );
+    if ( args.error )
+    {
+        fprintf( stderr, "Invalid settings, see publishmeterPi --help.\n" );
+        return 1;
+    }
+
+    peak_meter.true_peak = args.true_peak;
+    peak_meter.int_time  = args.int_time;
+    peak_meter.hold_incs = peak_meter.hold_time * args.refresh / 1000;
+    peak_meter.fall_incs = peak_meter.fall_time * args.refresh / 1000;
+    peak_meter.over_incs = peak_meter.over_time * args.refresh / 1000;
+    if ( peak_meter.fall_incs == 0 ) peak_meter.fall_incs = 1;
+
+    meter = meter_open( args.name[0] ? args.name : NULL );
+    if ( !meter )
+    {
+        fprintf( stderr, "Couldn't create meter.\n" );
+        return 1;
+    }
+
+    if ( args.bands > 0 )
+    {
+        spectrum_config.bands = args.bands;
+        spectrum = spectrum_create( &spectrum_config );
+        stage = spectrum_stage( spectrum );
+        if ( !spectrum || !meter_add_stage( meter, &stage ))
+        {
+            fprintf( stderr, "Couldn't create spectrum analyser.\n" );
+            meter_close( meter );
+            spectrum_destroy( spectrum );
+            return 1;
+        }
+    }
+
+    publisher = meter_publisher_create( args.results );
+    if ( !publisher )
+    {
+        fprintf( stderr, "Couldn't create %s: %s.\n", args.results,
+                 strerror( errno ));
+        meter_close( meter );
+        spectrum_destroy( spectrum );
+        return 1;
+    }
+
+    signal( SIGINT, publish_stop );
+    signal( SIGTERM, publish_stop );
+
+    memset( &results, 0, sizeof( results ));
+    meter_pace_init( &pace, args.refresh, PUBLISH_IDLE );
+    report_ns = time_ns();
+
+    while ( !stopped )
+    {
+        if ( !meter_pace_wait( &pace, meter )) continue;
+        update_ns = time_ns();
+
+        // Integration window follows the stream rate.
+        if ( meter_get_rate( meter ) != rate )
+        {
+            rate = meter_get_rate( meter );
+            samples = (uint64_t) rate * args.int_time / 1000;
+            if ( samples < 1 ) samples = 1;
+            if ( samples > VIS_BUF_SIZE / VIS_CHANNELS )
+                samples = VIS_BUF_SIZE / VIS_CHANNELS;
+            peak_meter.samples = samples;
+        }
+
+        meter_get_dBfs( meter, &peak_meter );
+        meter_get_dB_indices( meter, &peak_meter );
+        meter_pace_settle( &pace, &peak_meter );
+        meter_results_set_peak( &results, &peak_meter );
+        results.update_ns = update_ns;
+        results.rate      = rate;
+        results.running   = meter->status.running;
+
+        if ( spectrum )
+        {
+            results.bands = spectrum->config.bands;
+            memcpy( results.spectrum, spectrum->level,
+                    results.bands * sizeof( float ));
+        }
+
+        if ( args.loudness )
+        {
+            meter_get_loudness( meter, &loudness );
+            results.loudness      = true;
+            results.momentary     = loudness.momentary;
+            results.short_term    = loudness.short_term;
+            results.integrated    = loudness.integrated;
+            results.range         = loudness.range;
+            results.max_momentary = loudness.max_momentary;
+        }
+
+        meter_publish( publisher, &results );
+
+        elapsed = results.publish_ns - results.update_ns;
+        latency.count++;
+        latency.sum += elapsed;
+        if ( elapsed > latency.max ) latency.max = elapsed;
+
+        if ( args.verbose && results.publish_ns - report_ns >= 1000000000 )
+        {
+            printf( "\r%5u results/s, latency mean %6.1fus, max %6.1fus",
+                    latency.count, latency.sum / 1e3 / latency.count,
+                    latency.max / 1e3 );
+            fflush( stdout );
+            memset( &latency, 0, sizeof( latency ));
+            report_ns = results.publish_ns;
+        }
+    }
+    if ( args.verbose ) printf( "\n" );
+
+    meter_publisher_destroy( publisher );
+    meter_close( meter );
+    spectrum_destroy( spectrum );
+
+    return 0;
+}
@@ -0,0 +1,290 @@
+//  ===========================================================================
+/*
+    synthmeterPi:
+
+    Synthetic Squeezelite visualisation buffer producer. Writes test
+    signals to a shared memory object so that meterPi can be tested and
+    benchmarked without a player.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Compile with:
+
+        gcc -Wall meterPi.c meterPi-kernel.c meterPi-truepeak.c
+            meterPi-loudness.c meterPi-spectrum.c meterPi-pace.c
+            meterPi-synth.c synthmeterPi.c
+            -o synthmeterPi -lm -lpthread -lrt
+
+    For Raspberry Pi v1 optimisation use the following flags:
+
+        -march=armv6zk -mtune=arm1176jzf-s -mfloat-abi=hard -mfpu=vfp
+        -ffast-math -pipe -O3
+
+    For Raspberry Pi v2 optimisation use the following flags:
+
+        -march=armv7-a -mtune=cortex-a7 -mfloat-abi=hard -mfpu=neon-vfpv4
+        -ffast-math -pipe -O3
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+*/
+//  ===========================================================================
+
+//  Installed libraries -------------------------------------------------------
+
+#include <stdbool.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <argp.h>
+
+//  Local libraries -----------------------------------------------------------
+
+#include "meterPi.h"
+#include "meterPi-synth.h"
+
+//  Info. ---------------------------------------------------------------------
+/*
+    Blocks are written at the block period, as Squeezelite writes each
+    block it plays. Deadlines are absolute so the stream runs at the sample
+    rate however long the writes take.
+
+    e.g. a full scale 1kHz burst, 200ms on and 800ms off, at 192kHz on the
+    object that meters on this machine open by default:
+
+        synthmeterPi -s burst -r 192000 -l 0 -b 200,800
+
+    Run meters against another name with meter_open, e.g. for tests:
+
+        synthmeterPi -n /squeezelite-test -s pink -l -20
+*/
+
+//  Macros. -------------------------------------------------------------------
+
+#define Version "Version 0.1"
+
+//  Types. --------------------------------------------------------------------
+
+struct synth_args_t
+{
+    char     name[VIS_NAME_LEN]; // Shared memory object name.
+    struct   synth_config_t config; // Signal settings.
+    uint16_t block;              // Block period (ms).
+    uint32_t duration;           // Run time (s), 0 for no limit.
+    bool     error;              // Invalid argument.
+};
+
+//  Local variables. ----------------------------------------------------------
+
+static volatile sig_atomic_t stopped = 0;
+
+//  argp documentation. -------------------------------------------------------
+
+const char *argp_program_version = Version;
+const char *argp_program_bug_address = "darren@alidaf.co.uk";
+static char doc[] = "Writes test signals to a Squeezelite visualisation "
+                    "buffer for meterPi.";
+static char args_doc[] = "synthmeterPi <options>";
+
+static struct argp_option options[] =
+{
+    { 0, 0, 0, 0, "Buffer:" },
+    { "name", 'n', "<name>", 0, "Shared memory object name." },
+    { "block", 'p', "<ms>", 0, "Block period (default 10)." },
+    { "time", 't', "<s>", 0, "Run time (default 0, until interrupted)." },
+    { 0, 0, 0, 0, "Signal:" },
+    { "signal", 's', "<type>", 0,
+      "sine, pink, burst, silence or square (default sine)." },
+    { "rate", 'r', "<Hz>", 0, "Sample rate, 8000 to 384000 (default 44100)." },
+    { "frequency", 'f', "<Hz>", 0, "Tone frequency (default 1000)." },
+    { "level", 'l', "<dB>", 0, "Level (dBFS, default -6)." },
+    { "burst", 'b', "<on,off>", 0, "Burst on and off times (ms)." },
+    { "drive", 'd', "<dB>", 0, "Overdrive of square (default 20)." },
+    { 0 }
+};
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Command line argument parser.
+//  ---------------------------------------------------------------------------
+static int parse_opt( int param, char *arg, struct argp_state *state )
+{
+    struct synth_args_t *args = state->input;
+    int8_t signal;
+
+    switch( param )
+    {
+        case 'n' :
+            snprintf( args->name, sizeof( args->name ), "%s", arg );
+            break;
+        case 'p' :
+            args->block = atoi( arg );
+            if ( args->block == 0 ) args->error = true;
+            break;
+        case 't' :
+            args->duration = atoi( arg );
+            break;
+        case 's' :
+            signal = synth_signal( arg );
+            if ( signal < 0 ) args->error = true;
+            else args->config.signal = signal;
+            break;
+        case 'r' :
+            args->config.rate = atoi( arg );
+            break;
+        case 'f' :
+            args->config.frequency = atof( arg );
+            break;
+        case 'l' :
+            args->config.level = atof( arg );
+            break;
+        case 'b' :
+            if ( sscanf( arg, "%hu,%hu", &args->config.burst_on,
+                                         &args->config.burst_off ) != 2 )
+                args->error = true;
+            break;
+        case 'd' :
+            args->config.drive = atof( arg );
+            break;
+    }
+    return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+//  ---------------------------------------------------------------------------
+//  Stops the producer on a signal.
+//  ---------------------------------------------------------------------------
+static void synth_stop( int signal )
+{
+    (void) signal;
+    stopped = 1;
+}
+
+//  ---------------------------------------------------------------------------
+//  Main.
+//  ---------------------------------------------------------------------------
+int main( int argc, char *argv[] )
+{
+    struct synth_args_t args =
+    {
+        .name     = "",
+        .config   = { .signal = SYNTH_SINE, .rate = 44100, .frequency = 1000,
+                      .level = -6, .burst_on = 200, .burst_off = 800,
+                      .drive = 20 },
+        .block    = 10,
+        .duration = 0,
+        .error    = false
+    };
+    struct   synth_t  synth;
+    struct   vis_t   *vis;
+    struct   timespec deadline;
+    int16_t  *samples;
+    uint32_t frames, remainder, total, seconds;
+
+    argp_parse( &argp, argc, argv, 0, 0, &args );
+
+    if ( args.error || !synth_init( &synth, &args.config ))
+    {
+        fprintf( stderr, "Invalid settings, see synthmeterPi --help.\n" );
+        return 1;
+    }
+    if ( args.name[0] == '\0' ) vis_get_name( args.name, sizeof( args.name ));
+
+    /*
+        Blocks are rate * block / 1000 frames, with the remainder spread
+        over the blocks so that the rate is exact over each second.
+    */
+    frames = (uint64_t) args.config.rate * args.block / 1000;
+    samples = malloc(( frames + 1 ) * VIS_CHANNELS * sizeof( int16_t ));
+    if ( !samples || frames == 0 )
+    {
+        fprintf( stderr, "Invalid block period.\n" );
+        return 1;
+    }
+
+    vis = synth_vis_create( args.name );
+    if ( !vis )
+    {
+        fprintf( stderr, "Couldn't create %s: %s.\n", args.name,
+                 strerror( errno ));
+        free( samples );
+        return 1;
+    }
+
+    signal( SIGINT, synth_stop );
+    signal( SIGTERM, synth_stop );
+
+    printf( "Writing to %s at %uHz, %ums blocks. Ctrl-C to stop.\n",
+            args.name, args.config.rate, args.block );
+
+    clock_gettime( CLOCK_MONOTONIC, &deadline );
+    remainder = 0;
+    total = 0;
+    seconds = 0;
+    while ( !stopped )
+    {
+        uint32_t block_frames = frames;
+
+        remainder += (uint64_t) args.config.rate * args.block % 1000;
+        if ( remainder >= 1000 )
+        {
+            remainder -= 1000;
+            block_frames++;
+        }
+
+        synth_fill( &synth, samples, block_frames );
+        synth_vis_write( vis, samples, block_frames, args.config.rate );
+        total += block_frames;
+
+        // Report once a second.
+        if ( total >= args.config.rate )
+        {
+            total -= args.config.rate;
+            seconds++;
+            printf( "\r%us", seconds );
+            fflush( stdout );
+            if ( args.duration > 0 && seconds >= args.duration ) break;
+        }
+
+        deadline.tv_nsec += (uint32_t) args.block * 1000000;
+        while ( deadline.tv_nsec >= 1000000000 )
+        {
+            deadline.tv_nsec -= 1000000000;
+            deadline.tv_sec++;
+        }
+        while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME,
+                                 &deadline, NULL ) == EINTR && !stopped );
+    }
+    printf( "\n" );
+
+    synth_vis_destroy( vis, args.name );
+    free( samples );
+
+    return 0;
+}
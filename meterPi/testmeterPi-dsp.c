@@ -0,0 +1,2176 @@
+//  ===========================================================================
+/*
+    testmeterPi-dsp:
+
+    Tests the meterPi processing functions without a display or Squeezelite.
+    Returns 0 if all tests pass.
+
+    Copyright 2016 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+//  ===========================================================================
+/*
+    Compile with:
+
+        gcc -Wall meterPi.c meterPi-kernel.c meterPi-truepeak.c
+            meterPi-loudness.c meterPi-spectrum.c meterPi-phase.c
+            meterPi-pace.c meterPi-synth.c meterPi-source.c
+            meterPi-players.c meterPi-publish.c meterPi-capture.c
+            meterPi-waveform.c meterPi-waterfall.c meterPi-dynamics.c
+            testmeterPi-dsp.c
+            -o testmeterPi-dsp -lm -lpthread -lrt
+*/
+//  ===========================================================================
+/*
+    Authors:        D.Faulke            13/02/2016
+
+    Contributors:
+*/
+//  ===========================================================================
+
+//  Installed libraries -------------------------------------------------------
+
+#include <stdbool.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+//  Local libraries -----------------------------------------------------------
+
+#include "meterPi.h"
+#include "meterPi-kernel.h"
+#include "meterPi-truepeak.h"
+#include "meterPi-loudness.h"
+#include "meterPi-spectrum.h"
+#include "meterPi-phase.h"
+#include "meterPi-pace.h"
+#include "meterPi-synth.h"
+#include "meterPi-source.h"
+#include "meterPi-players.h"
+#include "meterPi-publish.h"
+#include "meterPi-capture.h"
+#include "meterPi-waveform.h"
+#include "meterPi-waterfall.h"
+#include "meterPi-dynamics.h"
+
+//  Macros. -------------------------------------------------------------------
+
+#define TEST_FRAMES 1024 // Maximum frames per kernel test.
+#define TEST_LOOPS  200  // Random buffers per kernel test.
+#define TEST_PUBLISHES 200000 // Results published in seqlock test.
+
+//  Local variables. ----------------------------------------------------------
+
+static uint16_t failures = 0;
+
+//  Functions. ----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Records and prints a test result.
+//  ---------------------------------------------------------------------------
+static void test_result( const char *name, bool passed )
+{
+    printf( "\t%-48s %s\n", name, passed ? "pass" : "FAIL" );
+    if ( !passed ) failures++;
+}
+
+//  ---------------------------------------------------------------------------
+//  Fills a buffer with random samples, including full scale extremes.
+//  ---------------------------------------------------------------------------
+static void test_fill( int16_t *buffer, uint32_t samples )
+{
+    uint32_t i;
+
+    for ( i = 0; i < samples; i++ )
+    {
+        switch ( rand() % 16 )
+        {
+            case 0:  buffer[i] = -32768; break;
+            case 1:  buffer[i] =  32767; break;
+            default: buffer[i] = rand() - RAND_MAX / 2; break;
+        }
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Stores a 32-bit sample in a buffer in a format.
+//  ---------------------------------------------------------------------------
+/*
+    The sample is scaled to the format, so float samples are 1.25 times
+    full scale at the extremes to check clipping.
+*/
+static void test_store( void *buffer, uint8_t format, uint32_t i,
+                        int32_t sample )
+{
+    uint8_t *bytes = (uint8_t *) buffer + i * 3;
+
+    switch ( format )
+    {
+        case METER_S16 :
+            ((int16_t *) buffer)[i] = sample >> 16;
+            break;
+        case METER_S24 :
+            bytes[0] = sample >> 8;
+            bytes[1] = sample >> 16;
+            bytes[2] = sample >> 24;
+            break;
+        case METER_S32 :
+            ((int32_t *) buffer)[i] = sample;
+            break;
+        case METER_FLOAT :
+            ((float *) buffer)[i] = sample * ( 1.25f / 2147483648.0f );
+            break;
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests a kernel against the scalar kernel for bit-exact results.
+//  ---------------------------------------------------------------------------
+/*
+    Every number of channels is tested, as each has its own pattern of
+    lanes in the SIMD kernels.
+*/
+static void test_kernel( const char *name, uint8_t format,
+                         meter_kernel_t kernel )
+{
+    static const meter_kernel_t scalar[METER_FORMATS] =
+        { meter_kernel_scalar, meter_kernel_s24_scalar,
+          meter_kernel_s32_scalar, meter_kernel_float_scalar };
+    static int32_t buffer[TEST_FRAMES * METER_CHANNELS_MAX + 8]
+                   __attribute__(( aligned( VIS_ALIGN )));
+    uint8_t  width = meter_format_width( format );
+    uint8_t  *start;
+    struct   meter_acc_t ref, acc;
+    uint32_t frames, offset, sample, i;
+    uint8_t  channels, channel;
+    char     label[64];
+    bool     passed = true;
+
+    srand( 1 );
+
+    for ( channels = 1; channels <= METER_CHANNELS_MAX && passed; channels++ )
+    {
+        for ( i = 0; i < TEST_LOOPS && passed; i++ )
+        {
+            // Random lengths and misaligned starts to exercise the tails.
+            frames = rand() % TEST_FRAMES;
+            offset = rand() % 8;
+            for ( sample = 0; sample < frames * channels + 8; sample++ )
+                switch ( rand() % 16 )
+                {
+                    case 0:  test_store( buffer, format, sample, INT32_MIN );
+                             break;
+                    case 1:  test_store( buffer, format, sample, INT32_MAX );
+                             break;
+                    default: test_store( buffer, format, sample,
+                                         (uint32_t) rand() << 16 ^ rand() );
+                }
+            start = (uint8_t *) buffer + offset * width;
+
+            meter_acc_clear( &ref );
+            meter_acc_clear( &acc );
+            scalar[format]( start, frames, channels, &ref );
+            kernel( start, frames, channels, &acc );
+
+            passed = memcmp( &ref, &acc, sizeof( ref )) == 0;
+        }
+
+        // All samples at the minimum is the worst case for abs and overflow.
+        for ( i = 0; i < TEST_FRAMES * channels; i++ )
+            test_store( buffer, format, i, INT32_MIN );
+        meter_acc_clear( &ref );
+        meter_acc_clear( &acc );
+        scalar[format]( buffer, TEST_FRAMES, channels, &ref );
+        kernel( buffer, TEST_FRAMES, channels, &acc );
+        passed = passed && memcmp( &ref, &acc, sizeof( ref )) == 0;
+        for ( channel = 0; channel < channels; channel++ )
+            passed = passed && ref.peak[channel] == METER_FULL_SCALE;
+    }
+
+    snprintf( label, sizeof( label ), "Kernel %s %s bit-exact, 1-%d channels",
+              meter_format_name( format ), name, METER_CHANNELS_MAX );
+    test_result( label, passed );
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests that a wrapped window gives the same result as a linear one.
+//  ---------------------------------------------------------------------------
+static void test_ring_spans( void )
+{
+    static int16_t ring[VIS_BUF_SIZE];
+    static int16_t linear[VIS_BUF_SIZE];
+    struct meter_span_t span[2];
+    struct meter_acc_t  ref, acc;
+    uint32_t start, frames, i, n;
+    uint8_t  spans, s;
+    bool     passed = true;
+
+    test_fill( ring, VIS_BUF_SIZE );
+
+    for ( i = 0; i < TEST_LOOPS && passed; i++ )
+    {
+        start  = ( rand() % ( VIS_BUF_SIZE / VIS_CHANNELS )) *
+                 VIS_CHANNELS;
+        frames = rand() % ( VIS_BUF_SIZE / VIS_CHANNELS ) + 1;
+
+        // Linear copy of the window for reference.
+        for ( n = 0; n < frames * VIS_CHANNELS; n++ )
+            linear[n] = ring[( start + n ) % VIS_BUF_SIZE];
+
+        meter_acc_clear( &ref );
+        meter_kernel_scalar( linear, frames, VIS_CHANNELS, &ref );
+
+        meter_acc_clear( &acc );
+        spans = meter_ring_spans( ring, VIS_BUF_SIZE, start, frames, span );
+        for ( s = 0; s < spans; s++ )
+            meter_kernel_select( METER_S16 )( span[s].samples,
+                                              span[s].frames, VIS_CHANNELS,
+                                              &acc );
+
+        passed = spans >= 1 && spans <= 2 &&
+                 memcmp( &ref, &acc, sizeof( ref )) == 0;
+    }
+
+    test_result( "Ring window split into contiguous spans", passed );
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests dBfs and scale lookup tables against direct calculation.
+//  ---------------------------------------------------------------------------
+static void test_dB_table( void )
+{
+    static struct meter_dB_table_t table;
+    struct peak_meter_t peak_meter =
+    {
+        .num_levels = 16,
+        .floor      = -144,
+        .reference  = METER_FULL_SCALE,
+        .scale      = {  -48,  -42,  -36,  -30,  -24,  -20,  -18,  -16,
+                         -14,  -12,  -10,   -8,   -6,   -4,   -2,    0  }
+    };
+    uint64_t energy;
+    uint32_t i;
+    double   direct, dB_fs;
+    int16_t  dB;
+    uint8_t  index;
+    bool     passed = true;
+
+    set_dB_scale( &table, &peak_meter );
+
+    // Bucket is at most 10log10(1 + 1/32) = 0.134dB below.
+    for ( i = 0; i < 100000 && passed; i++ )
+    {
+        energy = ((uint64_t) rand() << 31 | rand() ) %
+                 ( 1ULL << ( rand() % 51 ));
+        direct = energy ? 10 * log10( energy / (double)( 1 << DB_ENERGY_SHIFT ))
+                          - 20 * log10( METER_FULL_SCALE ) : -999;
+        if ( direct < peak_meter.floor ) direct = peak_meter.floor;
+        dB_fs = table.dBfs[ get_dB_bucket( energy )];
+        passed = dB_fs <= direct + 1e-4 && dB_fs > direct - 0.135;
+    }
+    energy = (uint64_t) METER_FULL_SCALE * METER_FULL_SCALE;
+    passed = passed &&
+             table.dBfs[ get_dB_bucket( energy << DB_ENERGY_SHIFT )] == 0 &&
+             table.dBfs[ get_dB_bucket( 0 )] == -144;
+    test_result( "dB table within one bucket of log10", passed );
+
+    // Scale index is the lowest interval that contains the level.
+    for ( dB = DB_INDEX_MIN; dB < DB_INDEX_MIN + 256 && passed; dB++ )
+    {
+        for ( index = 0; index < peak_meter.num_levels - 1; index++ )
+            if ( dB <= peak_meter.scale[index] ) break;
+        passed = table.bar_index[dB - DB_INDEX_MIN] == index;
+    }
+    test_result( "Scale index table matches scale", passed );
+}
+
+//  ---------------------------------------------------------------------------
+//  Creates a local visualisation buffer filled with a stereo sine.
+//  ---------------------------------------------------------------------------
+static struct vis_t *test_vis_create( uint32_t rate, int16_t amplitude )
+{
+    struct vis_t *vis;
+    pthread_rwlockattr_t attr;
+    uint32_t i;
+
+    vis = calloc( 1, sizeof( struct vis_t ));
+    if ( !vis ) return NULL;
+
+    pthread_rwlockattr_init( &attr );
+    pthread_rwlockattr_setpshared( &attr, PTHREAD_PROCESS_SHARED );
+    pthread_rwlock_init( &vis->rwlock, &attr );
+    pthread_rwlockattr_destroy( &attr );
+
+    vis->buf_size = VIS_BUF_SIZE;
+    vis->running  = true;
+    vis->rate     = rate;
+    vis->updated  = time( NULL );
+
+    for ( i = 0; i < VIS_BUF_SIZE / VIS_CHANNELS; i++ )
+    {
+        vis->buffer[i * 2]     = amplitude * sin( 2 * M_PI * 1000 * i / rate );
+        vis->buffer[i * 2 + 1] = amplitude * sin( 2 * M_PI * 250 * i / rate );
+    }
+
+    return vis;
+}
+
+struct test_meter_t
+{
+    struct meter_t      *meter;      // Meter context under test.
+    struct peak_meter_t peak_meter;  // Settings and results.
+    uint32_t            loops;       // Number of refreshes.
+};
+
+//  ---------------------------------------------------------------------------
+//  Refreshes a meter a number of times. Thread function.
+//  ---------------------------------------------------------------------------
+static void *test_meter_run( void *params )
+{
+    struct test_meter_t *test = params;
+    uint32_t i;
+
+    for ( i = 0; i < test->loops; i++ )
+    {
+        meter_get_dBfs( test->meter, &test->peak_meter );
+        meter_get_dB_indices( test->meter, &test->peak_meter );
+    }
+
+    return NULL;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns true if two peak meters have the same results.
+//  ---------------------------------------------------------------------------
+static bool test_meter_equal( struct peak_meter_t *a, struct peak_meter_t *b )
+{
+    uint8_t channel;
+
+    for ( channel = 0; channel < VIS_CHANNELS; channel++ )
+    {
+        if ( a->dBfs[channel]      != b->dBfs[channel] ||
+             a->peak[channel]      != b->peak[channel] ||
+             a->overload[channel]  != b->overload[channel] ||
+             a->bar_index[channel] != b->bar_index[channel] ||
+             a->dot_index[channel] != b->dot_index[channel] )
+            return false;
+    }
+
+    return true;
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests that two meter contexts running in parallel do not interfere.
+//  ---------------------------------------------------------------------------
+/*
+    A fast PPM on a loud stream and a slow meter on a quiet stream with a
+    different scale are run in parallel threads. Each must give the same
+    results as the same meter run on its own.
+*/
+static void test_meter_contexts( void )
+{
+    struct peak_meter_t fast =
+    {
+        .samples = 220, .hold_incs = 7, .fall_incs = 2, .over_peaks = 3,
+        .over_incs = 10, .num_levels = 16, .floor = -80, .reference = METER_FULL_SCALE,
+        .scale = { -48, -42, -36, -30, -24, -20, -18, -16,
+                   -14, -12, -10,  -8,  -6,  -4,  -2,   0 }
+    };
+    struct peak_meter_t slow =
+    {
+        .samples = 8000, .hold_incs = 50, .fall_incs = 5, .over_peaks = 10,
+        .over_incs = 150, .num_levels = 8, .floor = -96, .reference = METER_FULL_SCALE,
+        .scale = { -60, -50, -40, -30, -20, -10, -5, 0 }
+    };
+    struct test_meter_t test[2], ref[2];
+    struct vis_t *vis[2];
+    pthread_t    thread[2];
+    uint8_t      i;
+    bool         passed = true;
+
+    vis[0] = test_vis_create( 44100, 32767 );
+    vis[1] = test_vis_create( 96000, 100 );
+    if ( !vis[0] || !vis[1] ) return;
+
+    // Each meter run on its own for reference.
+    for ( i = 0; i < 2; i++ )
+    {
+        ref[i].meter = meter_attach( vis[i] );
+        ref[i].peak_meter = i ? slow : fast;
+        ref[i].loops = 1000 + i * 37;
+        test_meter_run( &ref[i] );
+        meter_close( ref[i].meter );
+    }
+
+    // Both meters in parallel.
+    for ( i = 0; i < 2; i++ )
+    {
+        test[i].meter = meter_attach( vis[i] );
+        test[i].peak_meter = i ? slow : fast;
+        test[i].loops = 1000 + i * 37;
+        pthread_create( &thread[i], NULL, test_meter_run, &test[i] );
+    }
+    for ( i = 0; i < 2; i++ )
+    {
+        pthread_join( thread[i], NULL );
+        meter_close( test[i].meter );
+        passed = passed && test_meter_equal( &test[i].peak_meter,
+                                             &ref[i].peak_meter );
+    }
+
+    // The streams are different so the results must be too.
+    passed = passed && test[0].peak_meter.dBfs[0] != test[1].peak_meter.dBfs[0];
+
+    test_result( "Parallel meter contexts do not interfere", passed );
+
+    for ( i = 0; i < 2; i++ )
+    {
+        pthread_rwlock_destroy( &vis[i]->rwlock );
+        free( vis[i] );
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests a true-peak kernel against the scalar kernel for bit-exact results.
+//  ---------------------------------------------------------------------------
+static void test_truepeak_kernel( const char *name, truepeak_kernel_t kernel )
+{
+    struct   truepeak_t *truepeak = truepeak_create();
+    int16_t  buffer[TRUEPEAK_PAD + TRUEPEAK_BLOCK]
+             __attribute__(( aligned( VIS_ALIGN )));
+    uint32_t frames, i;
+    char     label[64];
+    bool     passed = true;
+
+    if ( !truepeak ) return;
+    srand( 2 );
+
+    for ( i = 0; i < TEST_LOOPS && passed; i++ )
+    {
+        frames = rand() % ( TRUEPEAK_BLOCK + 1 );
+        test_fill( buffer, sizeof( buffer ) / sizeof( buffer[0] ));
+        passed = truepeak_kernel_scalar( buffer, frames, truepeak->coefs ) ==
+                 kernel( buffer, frames, truepeak->coefs );
+    }
+
+    // Alternating extremes give the largest filter outputs.
+    for ( i = 0; i < sizeof( buffer ) / sizeof( buffer[0] ); i++ )
+        buffer[i] = ( i / 2 ) & 1 ? -32768 : 32767;
+    passed = passed &&
+             truepeak_kernel_scalar( buffer, TRUEPEAK_BLOCK, truepeak->coefs )
+             == kernel( buffer, TRUEPEAK_BLOCK, truepeak->coefs );
+
+    snprintf( label, sizeof( label ), "True-peak %s bit-exact with scalar",
+              name );
+    test_result( label, passed );
+
+    truepeak_destroy( truepeak );
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests true-peak levels of a sine with peaks between samples.
+//  ---------------------------------------------------------------------------
+/*
+    A sine at a quarter of the sample rate with a 45 degree phase has all
+    of its samples at 1/sqrt(2) of its peak, so the sample peak is 3dB
+    below the true peak. The full scale version must be an overload with
+    true-peak metering but not with sample metering.
+*/
+static void test_truepeak_level( void )
+{
+    struct peak_meter_t peak_meter =
+    {
+        .samples = 220, .hold_incs = 7, .fall_incs = 2, .over_peaks = 3,
+        .over_incs = 10, .num_levels = 16, .floor = -80, .reference = METER_FULL_SCALE,
+        .scale = { -48, -42, -36, -30, -24, -20, -18, -16,
+                   -14, -12, -10,  -8,  -6,  -4,  -2,   0 }
+    };
+    struct truepeak_t *truepeak = truepeak_create();
+    struct meter_t    *meter;
+    struct vis_t      *vis;
+    float    dBtp[VIS_CHANNELS];
+    bool     overshoot[VIS_CHANNELS];
+    uint32_t i;
+    bool     passed;
+
+    vis = test_vis_create( 44100, 0 );
+    if ( !truepeak || !vis ) return;
+
+    for ( i = 0; i < VIS_BUF_SIZE; i++ )
+        vis->buffer[i] = 16384 * sin( M_PI / 2 * ( i / 2 ) + M_PI / 4 );
+
+    truepeak_reset( truepeak, 44100, VIS_CHANNELS );
+    truepeak_process( truepeak, vis->buffer, VIS_BUF_SIZE / VIS_CHANNELS );
+    passed = truepeak_read( truepeak, dBtp, overshoot ) &&
+             fabsf( dBtp[0] + 6.02f ) < 0.2f && !overshoot[0] &&
+             !truepeak_read( truepeak, dBtp, overshoot );
+    test_result( "True peak 3dB above sample peak", passed );
+    truepeak_destroy( truepeak );
+
+    // Full scale through a meter.
+    for ( i = 0; i < VIS_BUF_SIZE; i++ ) vis->buffer[i] *= 2;
+    vis->buf_index = VIS_BUF_SIZE / 2;
+
+    meter = meter_attach( vis );
+    if ( !meter ) return;
+    for ( i = 0; i < 10; i++ )
+    {
+        meter_get_dBfs( meter, &peak_meter );
+        meter_get_dB_indices( meter, &peak_meter );
+    }
+    passed = !peak_meter.overload[0];
+
+    peak_meter.true_peak = true;
+    vis->buf_index = 0;
+    meter_get_dBfs( meter, &peak_meter );
+    meter_get_dB_indices( meter, &peak_meter );
+    passed = passed && peak_meter.overload[0] && peak_meter.overshoot[0] &&
+             peak_meter.dBtp[0] > 0 && peak_meter.dBtp[0] < 0.2f;
+    test_result( "True-peak overshoot sets overload", passed );
+
+    meter_close( meter );
+    pthread_rwlock_destroy( &vis->rwlock );
+    free( vis );
+}
+
+//  ---------------------------------------------------------------------------
+//  Feeds a 1kHz stereo sine to a loudness meter in random sized chunks.
+//  ---------------------------------------------------------------------------
+static void test_loudness_sine( struct loudness_t *loudness, uint32_t rate,
+                                double dBfs, uint32_t seconds, bool chunked )
+{
+    static int16_t buffer[VIS_BUF_SIZE];
+    double   amplitude = 32768 * pow( 10, dBfs / 20 );
+    uint32_t frames = rate * seconds;
+    uint32_t phase = 0, chunk, i;
+
+    while ( frames > 0 )
+    {
+        chunk = chunked ? 1 + rand() % ( VIS_BUF_SIZE / VIS_CHANNELS )
+                        : VIS_BUF_SIZE / VIS_CHANNELS;
+        if ( chunk > frames ) chunk = frames;
+
+        for ( i = 0; i < chunk; i++, phase++ )
+            buffer[i * 2] = buffer[i * 2 + 1] =
+                lrint( amplitude * sin( 2 * M_PI * 1000 * phase / rate ));
+
+        loudness_process( loudness, buffer, chunk );
+        frames -= chunk;
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests loudness against EBU Tech 3341 and 3342 test signals.
+//  ---------------------------------------------------------------------------
+/*
+    A 1kHz stereo sine at -23dBFS must read -23LUFS (+/-0.1LU). 20s at
+    -20dBFS followed by 20s at -30dBFS must have a range of 10LU (+/-1LU).
+    Feeding the same audio in different sized chunks must give exactly the
+    same results, as for a meter refreshed at any rate.
+*/
+static void test_loudness( void )
+{
+    struct loudness_t       *chunked = loudness_create();
+    struct loudness_t       *whole   = loudness_create();
+    struct loudness_meter_t a, b;
+    bool   passed;
+
+    if ( !chunked || !whole ) return;
+    srand( 3 );
+
+    loudness_reset( chunked, 48000, VIS_CHANNELS );
+    loudness_reset( whole, 48000, VIS_CHANNELS );
+    test_loudness_sine( chunked, 48000, -23, 20, true );
+    test_loudness_sine( whole, 48000, -23, 20, false );
+    loudness_read( chunked, &a );
+    loudness_read( whole, &b );
+
+    passed = fabsf( a.momentary  + 23 ) < 0.1f &&
+             fabsf( a.short_term + 23 ) < 0.1f &&
+             fabsf( a.integrated + 23 ) < 0.1f &&
+             fabsf( a.max_momentary + 23 ) < 0.1f;
+    test_result( "Loudness of -23dBFS sine is -23LUFS", passed );
+
+    passed = memcmp( &a, &b, sizeof( a )) == 0;
+    test_result( "Loudness independent of refresh size", passed );
+
+    loudness_clear( whole );
+    loudness_reset( whole, 44100, VIS_CHANNELS );
+    test_loudness_sine( whole, 44100, -20, 20, true );
+    test_loudness_sine( whole, 44100, -30, 20, true );
+    loudness_read( whole, &b );
+    passed = fabsf( b.range - 10 ) < 1.0f;
+    test_result( "Loudness range of -20/-30dBFS sines is 10LU", passed );
+
+    loudness_destroy( chunked );
+    loudness_destroy( whole );
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests an FFT kernel against a double precision DFT.
+//  ---------------------------------------------------------------------------
+/*
+    The kernel output is scaled by 1/points. Rounding at each stage must
+    stay within a few LSBs. A SIMD kernel must also match the scalar
+    kernel exactly.
+*/
+static void test_spectrum_fft( const char *name, spectrum_fft_t fft )
+{
+    struct spectrum_config_t config =
+        { .size = 1024, .hop = 512, .bands = 16, .low = 50, .high = 16000,
+          .floor = -80 };
+    struct spectrum_t *spectrum = spectrum_create( &config );
+    static int16_t re[512], im[512], ref_re[512], ref_im[512];
+    static int16_t out_re[512], out_im[512];
+    double   sr, si, error = 0;
+    uint16_t points = 512, i, k;
+    char     label[64];
+    bool     passed;
+
+    if ( !spectrum ) return;
+    srand( 4 );
+
+    // Half scale input, as the analyser halves samples for headroom.
+    for ( i = 0; i < points; i++ )
+    {
+        ref_re[i] = ( rand() % 32768 ) - 16384;
+        ref_im[i] = ( rand() % 32768 ) - 16384;
+        re[spectrum->bitrev[i]] = ref_re[i];
+        im[spectrum->bitrev[i]] = ref_im[i];
+    }
+    fft( re, im, points, spectrum->wr, spectrum->wi );
+
+    for ( k = 0; k < points; k++ )
+    {
+        sr = si = 0;
+        for ( i = 0; i < points; i++ )
+        {
+            sr += ref_re[i] * cos( 2 * M_PI * i * k / points ) +
+                  ref_im[i] * sin( 2 * M_PI * i * k / points );
+            si += ref_im[i] * cos( 2 * M_PI * i * k / points ) -
+                  ref_re[i] * sin( 2 * M_PI * i * k / points );
+        }
+        sr = fabs( sr / points - re[k] );
+        si = fabs( si / points - im[k] );
+        if ( sr > error ) error = sr;
+        if ( si > error ) error = si;
+    }
+    passed = error < 8;
+
+    // Same again with the scalar kernel for an exact match.
+    for ( i = 0; i < points; i++ )
+    {
+        out_re[spectrum->bitrev[i]] = ref_re[i];
+        out_im[spectrum->bitrev[i]] = ref_im[i];
+    }
+    spectrum_fft_scalar( out_re, out_im, points, spectrum->wr, spectrum->wi );
+    passed = passed && memcmp( re, out_re, sizeof( re )) == 0 &&
+                       memcmp( im, out_im, sizeof( im )) == 0;
+
+    snprintf( label, sizeof( label ), "FFT %s within 8 LSB of DFT", name );
+    test_result( label, passed );
+
+    spectrum_destroy( spectrum );
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests that a tone shows in the right band at the right level.
+//  ---------------------------------------------------------------------------
+static void test_spectrum_tone( void )
+{
+    struct spectrum_config_t config =
+        { .size = 2048, .hop = 1024, .bands = 16, .low = 50, .high = 16000,
+          .attack = 0, .decay = 0, .floor = -80 };
+    struct spectrum_t *spectrum = spectrum_create( &config );
+    static int16_t buffer[VIS_BUF_SIZE];
+    uint8_t  bars[SPECTRUM_BANDS_MAX], band, tone = 0;
+    char     row[SPECTRUM_BANDS_MAX + 1];
+    uint32_t i;
+    bool     passed = true;
+
+    if ( !spectrum ) return;
+
+    spectrum_reset( spectrum, 48000, VIS_CHANNELS );
+    for ( i = 0; i < VIS_BUF_SIZE / VIS_CHANNELS; i++ )
+        buffer[i * 2] = buffer[i * 2 + 1] =
+            lrint( 32767 * sin( 2 * M_PI * 1000 * i / 48000.0 ));
+    spectrum_process( spectrum, buffer, VIS_BUF_SIZE / VIS_CHANNELS );
+
+    for ( band = 0; band < config.bands; band++ )
+    {
+        if ( spectrum->band_lo[band] * 48000 / config.size <= 1000 &&
+             spectrum->band_hi[band] * 48000 / config.size > 1000 )
+            tone = band;
+    }
+    for ( band = 0; band < config.bands; band++ )
+    {
+        if ( band == tone )
+            passed = passed && fabsf( spectrum->level[band] ) < 1;
+        else if ( band < tone - 1 || band > tone + 1 )
+            passed = passed && spectrum->level[band] < -50;
+    }
+    test_result( "Full scale tone at 0dBFS in its band only", passed );
+
+    // 2 row HD44780: full cell on the bottom row only for a half bar.
+    spectrum_get_bars( spectrum, bars, 16 );
+    spectrum_hd44780_row( bars, config.bands, 0, 2, row );
+    passed = (uint8_t) row[tone] == 0xff;
+    bars[tone] = 8;
+    spectrum_hd44780_row( bars, config.bands, 0, 2, row );
+    passed = passed && row[tone] == ' ';
+    spectrum_hd44780_row( bars, config.bands, 1, 2, row );
+    passed = passed && (uint8_t) row[tone] == 0xff;
+    bars[tone] = 3;
+    spectrum_hd44780_row( bars, config.bands, 1, 2, row );
+    passed = passed && row[tone] == 2 && row[config.bands] == '\0';
+    test_result( "HD44780 bar rows", passed );
+
+    spectrum_destroy( spectrum );
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests the packed waterfall against columns drawn from a second analyser.
+//  ---------------------------------------------------------------------------
+/*
+    A rising tone is fed to the waterfall in odd sized blocks and to a
+    second analyser a frame at a time, drawing a column of greys after
+    each of its transforms. After every block the unpacked frame must be
+    the newest of those columns, so frames from both packed copies are
+    checked as the ring wraps.
+*/
+static void test_waterfall( void )
+{
+    struct spectrum_config_t spectrum_config =
+        { .size = 256, .hop = 64, .bands = 16, .low = 100, .high = 20000,
+          .attack = 0, .decay = 50, .floor = -80 };
+    struct waterfall_config_t config =
+        { .cols = 10, .rows = 32, .floor = -80, .ceiling = 0 };
+    struct spectrum_t  *spectrum  = spectrum_create( &spectrum_config );
+    struct spectrum_t  *reference = spectrum_create( &spectrum_config );
+    struct waterfall_t *waterfall = NULL;
+    static uint8_t expected[64][32];
+    static int16_t buffer[37 * VIS_CHANNELS];
+    const  uint8_t *frame;
+    uint32_t columns = 0, frames = 0, transforms, i;
+    uint16_t stride, x;
+    int32_t  grey, column;
+    uint8_t  y, pixel;
+    bool     passed;
+    double   phase = 0;
+
+    if ( spectrum && reference )
+        waterfall = waterfall_create( &config, spectrum );
+    passed = waterfall != NULL;
+    if ( passed )
+    {
+        waterfall_reset( waterfall, 48000, VIS_CHANNELS );
+        spectrum_reset( reference, 48000, VIS_CHANNELS );
+    }
+
+    while ( passed && columns < 64 )
+    {
+        for ( i = 0; i < 37; i++ )
+        {
+            phase += 2 * M_PI * ( 200 + 150.0 * ( frames + i )) / 48000;
+            buffer[i * 2] = buffer[i * 2 + 1] = lrint( 16384 * sin( phase ));
+
+            transforms = reference->transforms;
+            spectrum_process( reference, &buffer[i * 2], 1 );
+            if ( reference->transforms == transforms || columns == 64 )
+                continue;
+            for ( y = 0; y < config.rows; y++ )
+            {
+                grey = lrintf(( reference->level[
+                                ( config.rows - 1 - y ) *
+                                spectrum_config.bands / config.rows] + 80 ) *
+                              15 / 80 );
+                expected[columns][y] = grey < 0 ? 0 : grey > 15 ? 15 : grey;
+            }
+            columns++;
+        }
+        waterfall_process( waterfall, buffer, 37 );
+        frames += 37;
+
+        passed = waterfall->columns == columns;
+        frame  = waterfall_get_frame( waterfall, &stride );
+        for ( y = 0; passed && y < config.rows; y++ )
+        {
+            for ( x = 0; passed && x < config.cols; x++ )
+            {
+                pixel  = frame[y * stride + x / 2];
+                pixel  = x % 2 ? pixel & 0x0f : pixel >> 4;
+                column = (int32_t) columns - config.cols + x;
+                passed = pixel == ( column < 0 ? 0 : expected[column][y] );
+            }
+        }
+    }
+    test_result( "Waterfall frame packed column by column", passed );
+
+    waterfall_destroy( waterfall );
+    spectrum_destroy( reference );
+    spectrum_destroy( spectrum );
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests that a paced loop only reports work when the stream changes.
+//  ---------------------------------------------------------------------------
+static void test_pace( void )
+{
+    struct meter_pace_t       pace;
+    struct meter_pace_stats_t stats;
+    struct peak_meter_t       peak_meter;
+    struct meter_t *meter;
+    struct vis_t   *vis;
+    struct timespec start, end;
+    bool   passed;
+
+    vis = test_vis_create( 44100, 0 );
+    if ( !vis ) return;
+    meter = meter_attach( vis );
+    if ( !meter ) return;
+
+    meter_pace_init( &pace, 1000, 100 );
+    passed = meter_pace_wait( &pace, meter ) &&
+             !meter_pace_wait( &pace, meter );
+    vis->buf_index = 100;
+    passed = passed && meter_pace_wait( &pace, meter ) &&
+             !meter_pace_wait( &pace, meter );
+    test_result( "Pace skips refreshes with no new frames", passed );
+
+    // Once more when the stream stops, then at the idle rate.
+    vis->running = false;
+    passed = meter_pace_wait( &pace, meter );
+    clock_gettime( CLOCK_MONOTONIC, &start );
+    passed = passed && !meter_pace_wait( &pace, meter ) &&
+             !meter_pace_wait( &pace, meter );
+    clock_gettime( CLOCK_MONOTONIC, &end );
+    passed = passed && ( end.tv_sec - start.tv_sec ) * 1000000000LL +
+                       ( end.tv_nsec - start.tv_nsec ) >= 15000000;
+    vis->running = true;
+    passed = passed && meter_pace_wait( &pace, meter );
+    test_result( "Pace polls at idle rate while stopped", passed );
+
+    meter_pace_stats( &pace, &stats );
+    passed = stats.wakeups == 8 && stats.updates == 4 &&
+             stats.skipped == 2 && stats.idle == 2 &&
+             stats.cpu >= 0 && stats.cpu <= 100;
+    test_result( "Pace stats", passed );
+
+    // Refreshes while stopped until the peak hold dot has fallen.
+    memset( &peak_meter, 0, sizeof( peak_meter ));
+    peak_meter.channels     = 1;
+    peak_meter.dot_index[0] = 2;
+    vis->running = false;
+    passed = meter_pace_wait( &pace, meter );
+    meter_pace_settle( &pace, &peak_meter );
+    clock_gettime( CLOCK_MONOTONIC, &start );
+    passed = passed && meter_pace_wait( &pace, meter ) &&
+             meter_pace_wait( &pace, meter );
+    clock_gettime( CLOCK_MONOTONIC, &end );
+    passed = passed && ( end.tv_sec - start.tv_sec ) * 1000000000LL +
+                       ( end.tv_nsec - start.tv_nsec ) < 15000000;
+    peak_meter.dot_index[0] = 0;
+    meter_pace_settle( &pace, &peak_meter );
+    passed = passed && !meter_pace_wait( &pace, meter );
+    test_result( "Pace refreshes until display decays", passed );
+
+    meter_close( meter );
+    pthread_rwlock_destroy( &vis->rwlock );
+    free( vis );
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests synthetic signals through a shared memory object and a meter.
+//  ---------------------------------------------------------------------------
+static void test_synth( void )
+{
+    struct peak_meter_t peak_meter =
+    {
+        .samples = 4800, .hold_incs = 7, .fall_incs = 2, .over_peaks = 3,
+        .over_incs = 10, .num_levels = 16, .floor = -80, .reference = METER_FULL_SCALE,
+        .scale = { -48, -42, -36, -30, -24, -20, -18, -16,
+                   -14, -12, -10,  -8,  -6,  -4,  -2,   0 }
+    };
+    struct synth_config_t config =
+        { .signal = SYNTH_SINE, .rate = 48000, .frequency = 1000,
+          .level = -6, .burst_on = 10, .burst_off = 30, .drive = 20 };
+    static int16_t samples[VIS_BUF_SIZE * 2];
+    struct synth_t  synth;
+    struct meter_t *meter;
+    struct vis_t   *vis;
+    char     name[VIS_NAME_LEN];
+    double   sum;
+    uint32_t i, on;
+    bool     passed;
+
+    config.rate = SYNTH_RATE_MIN - 1;
+    passed = !synth_init( &synth, &config );
+    config.rate = SYNTH_RATE_MAX + 1;
+    passed = passed && !synth_init( &synth, &config );
+    config.rate = SYNTH_RATE_MAX;
+    passed = passed && synth_init( &synth, &config );
+    test_result( "Synth rates limited to 8kHz to 384kHz", passed );
+
+    // Sine at -6dBFS peak is -9dBFS RMS, through a separate mapping.
+    snprintf( name, sizeof( name ), "/meterPi-test-%d", (int) getpid() );
+    vis = synth_vis_create( name );
+    meter = meter_open( name );
+    if ( !vis || !meter ) return;
+
+    config.rate = 48000;
+    synth_init( &synth, &config );
+    synth_fill( &synth, samples, VIS_BUF_SIZE );
+    synth_vis_write( vis, samples, VIS_BUF_SIZE, config.rate );
+    meter_check( meter );
+    meter_get_dBfs( meter, &peak_meter );
+    passed = meter_get_rate( meter ) == 48000 &&
+             fabsf( peak_meter.dBfs[0] + 9 ) <= 1 &&
+             abs( (int32_t) peak_meter.peak[1] / 256 - 16423 ) < 40;
+    test_result( "Synth sine read through shared memory", passed );
+
+    // Writes wrap the ring at buf_size.
+    passed = vis->buf_index == VIS_BUF_SIZE * 2 % vis->buf_size;
+    synth_vis_write( vis, samples, VIS_BUF_SIZE / 4 + 3, config.rate );
+    passed = passed &&
+             vis->buf_index == ( VIS_BUF_SIZE / 4 + 3 ) * 2 % vis->buf_size;
+    test_result( "Synth writes wrap the ring", passed );
+
+    // Clipped square has runs of full scale samples.
+    config.signal = SYNTH_SQUARE;
+    config.drive = 40;
+    synth_init( &synth, &config );
+    synth_fill( &synth, samples, VIS_BUF_SIZE / VIS_CHANNELS );
+    synth_vis_write( vis, samples, VIS_BUF_SIZE / VIS_CHANNELS,
+                     config.rate );
+    for ( i = 0; i < 10; i++ )
+    {
+        meter_get_dBfs( meter, &peak_meter );
+        meter_get_dB_indices( meter, &peak_meter );
+    }
+    test_result( "Synth clipped square overloads",
+                 peak_meter.overload[0] && peak_meter.overload[1] );
+
+    // Bursts of 10ms every 40ms, at a frequency with few zero samples.
+    config.signal = SYNTH_BURST;
+    config.frequency = 997;
+    synth_init( &synth, &config );
+    synth_fill( &synth, samples, 1920 * 8 );
+    for ( i = 0, on = 0; i < 1920 * 8; i++ ) if ( samples[i * 2] ) on++;
+    passed = abs( (int32_t) on - 480 * 8 ) <= 8;
+
+    // Pink noise RMS at level and channels uncorrelated.
+    config.signal = SYNTH_PINK;
+    config.level = -20;
+    synth_init( &synth, &config );
+    synth_fill( &synth, samples, VIS_BUF_SIZE );
+    for ( i = 0, sum = 0; i < VIS_BUF_SIZE * 2; i++ )
+        sum += (double) samples[i] * samples[i];
+    sum = 10 * log10( sum / ( VIS_BUF_SIZE * 2 ) / ( 32767.0 * 32767.0 ));
+    passed = passed && fabs( sum + 20 ) < 1 && samples[0] != samples[1];
+    test_result( "Synth burst and pink noise levels", passed );
+
+    synth_vis_running( vis, false );
+    meter_check( meter );
+    passed = !meter->status.running;
+    test_result( "Synth stop seen by meter", passed );
+
+    meter_close( meter );
+    synth_vis_destroy( vis, name );
+}
+
+//  ---------------------------------------------------------------------------
+//  Stage that counts and checks the frames it is fed.
+//  ---------------------------------------------------------------------------
+struct test_count_t
+{
+    uint32_t rate;   // Rate at last reset.
+    uint8_t  channels; // Channels at last reset.
+    uint32_t resets; // Number of resets.
+    uint64_t frames; // Frames since reset.
+    int16_t  next;   // Expected left sample of next frame.
+    bool     ordered; // Frames have followed a ramp.
+};
+
+static void test_count_reset( void *state, uint32_t rate, uint8_t channels )
+{
+    struct test_count_t *count = state;
+
+    count->rate = rate;
+    count->channels = channels;
+    count->resets++;
+    count->frames = 0;
+    count->ordered = true;
+}
+
+static void test_count_process( void *state, const int16_t *samples,
+                                uint32_t frames )
+{
+    struct test_count_t *count = state;
+    uint32_t i;
+
+    for ( i = 0; i < frames; i++ )
+    {
+        if ( count->frames > 0 &&
+             samples[i * count->channels] != count->next )
+            count->ordered = false;
+        count->next = samples[i * count->channels] + 1;
+        count->frames++;
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests the WAV file and pipe sources.
+//  ---------------------------------------------------------------------------
+/*
+    Both are fed a ramp, so the counting stage can check that every frame
+    arrives once and in order through ring wraps and split frames.
+*/
+static void test_sources( void )
+{
+    struct test_count_t   count = { 0 };
+    struct meter_stage_t  stage = { "count", &count, test_count_reset,
+                                    test_count_process, NULL };
+    struct meter_source_t source;
+    struct meter_t *meter;
+    static int16_t ramp[20000 * 2];
+    uint8_t  header[44] = "RIFF....WAVEfmt \x10\0\0\0\x01\0\x02\0"
+                          "\x80\xbb\0\0\0\xee\x02\0\x04\0\x10\0data";
+    uint32_t size = sizeof( ramp );
+    char     path[64];
+    FILE     *file;
+    int      fds[2];
+    uint32_t i;
+    bool     passed;
+
+    for ( i = 0; i < 20000; i++ ) ramp[i * 2] = ramp[i * 2 + 1] = i;
+
+    // 48kHz WAV read in blocks of 1000 frames, without looping.
+    snprintf( path, sizeof( path ), "/tmp/meterPi-test-%d.wav",
+              (int) getpid() );
+    memcpy( header + 40, &size, 4 );
+    size += 36;
+    memcpy( header + 4, &size, 4 );
+    file = fopen( path, "wb" );
+    if ( !file ) return;
+    fwrite( header, 1, sizeof( header ), file );
+    fwrite( ramp, 1, sizeof( ramp ), file );
+    fclose( file );
+
+    passed = !source_wav( &source, "/nonexistent.wav", 0, false ) &&
+             source_wav( &source, path, 1000, false );
+    unlink( path );
+    if ( !passed || !( meter = meter_open_source( &source ))) return;
+    meter_add_stage( meter, &stage );
+
+    for ( i = 0; i < 25; i++ ) meter_read( meter );
+    passed = count.rate == 48000 && count.resets == 2 &&
+             count.frames == 20000 && count.ordered &&
+             !meter->status.running;
+    test_result( "WAV source blocks in order to end of file", passed );
+    meter_close( meter );
+
+    // Pipe with a frame split across writes and a ring wrap.
+    if ( pipe( fds ) != 0 ) return;
+    source_pipe( &source, fds[0], 44100, METER_S16, VIS_CHANNELS );
+    meter = meter_open_source( &source );
+    if ( !meter ) return;
+    count.resets = 0;
+    meter_add_stage( meter, &stage );
+
+    meter_read( meter );
+    passed = !meter->status.running;
+    for ( i = 0; i < 20000; i += 1000 )
+    {
+        if ( write( fds[1], ramp + i * 2, 3 ) != 3 ||
+             write( fds[1], (uint8_t *)( ramp + i * 2 ) + 3,
+                    1000 * 4 - 3 ) != 1000 * 4 - 3 )
+            passed = false;
+        meter_read( meter );
+    }
+    // The first read only returns a window, of one frame for meter_read.
+    passed = passed && meter->status.running && count.rate == 44100 &&
+             count.resets == 2 && count.frames == 19001 && count.ordered;
+
+    close( fds[1] );
+    meter_read( meter );
+    passed = passed && !meter->status.running;
+    test_result( "Pipe source frames in order, stops at end", passed );
+
+    meter_close( meter );
+    close( fds[0] );
+}
+
+//  ---------------------------------------------------------------------------
+//  Writes a WAV file.
+//  ---------------------------------------------------------------------------
+static bool test_wav_write( const char *path, uint16_t tag, uint16_t bits,
+                            uint16_t channels, uint32_t rate,
+                            const void *data, uint32_t size )
+{
+    uint8_t  header[44];
+    uint16_t value16;
+    uint32_t value32;
+    FILE     *file;
+
+    memcpy( header, "RIFF", 4 );
+    value32 = size + 36;
+    memcpy( header + 4, &value32, 4 );
+    memcpy( header + 8, "WAVEfmt ", 8 );
+    value32 = 16;
+    memcpy( header + 16, &value32, 4 );
+    memcpy( header + 20, &tag, 2 );
+    memcpy( header + 22, &channels, 2 );
+    memcpy( header + 24, &rate, 4 );
+    value16 = channels * bits / 8;
+    value32 = rate * value16;
+    memcpy( header + 28, &value32, 4 );
+    memcpy( header + 32, &value16, 2 );
+    memcpy( header + 34, &bits, 2 );
+    memcpy( header + 36, "data", 4 );
+    memcpy( header + 40, &size, 4 );
+
+    file = fopen( path, "wb" );
+    if ( !file ) return false;
+    fwrite( header, 1, sizeof( header ), file );
+    fwrite( data, 1, size, file );
+    fclose( file );
+
+    return true;
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests that every sample format is metered at the same scale.
+//  ---------------------------------------------------------------------------
+/*
+    16-bit audio stored in each format must give identical sums and convert
+    back to the same 16-bit frames for stages. A 1kHz sine at -120dBFS,
+    i.e. -123dBFS RMS, is below the 16-bit floor but must be metered from
+    24-bit, 32-bit and float WAV files, all with the same result.
+*/
+static void test_formats( void )
+{
+    struct peak_meter_t peak_meter =
+    {
+        .samples = 4800, .hold_incs = 7, .fall_incs = 2, .over_peaks = 3,
+        .over_incs = 10, .num_levels = 16, .floor = -144,
+        .reference = METER_FULL_SCALE,
+        .scale = { -144, -132, -120, -108, -96, -84, -72, -60,
+                    -48,  -36,  -24,  -18, -12,  -6,  -3,   0 }
+    };
+    static const uint16_t tags[METER_FORMATS] = { 1, 1, 1, 3 };
+    static int32_t  buffer[9600 * VIS_CHANNELS];
+    static int16_t  s16[TEST_FRAMES * VIS_CHANNELS];
+    static int16_t  back[TEST_FRAMES * VIS_CHANNELS];
+    struct meter_acc_t    ref, acc;
+    struct meter_source_t source;
+    struct meter_t *meter;
+    float    dBfs[METER_FORMATS];
+    uint32_t peak[METER_FORMATS];
+    uint8_t  format;
+    char     path[64];
+    uint32_t i;
+    bool     passed = true;
+
+    srand( 3 );
+    test_fill( s16, TEST_FRAMES * VIS_CHANNELS );
+    meter_acc_clear( &ref );
+    meter_kernel_scalar( s16, TEST_FRAMES, VIS_CHANNELS, &ref );
+
+    for ( format = METER_S24; format < METER_FORMATS; format++ )
+    {
+        // Float samples are stored at 1.25 times so scale them back.
+        for ( i = 0; i < TEST_FRAMES * VIS_CHANNELS; i++ )
+            if ( format == METER_FLOAT )
+                ((float *) buffer)[i] = s16[i] / 32768.0f;
+            else test_store( buffer, format, i, s16[i] * 65536 );
+
+        meter_acc_clear( &acc );
+        meter_kernel_select( format )( buffer, TEST_FRAMES, VIS_CHANNELS,
+                                       &acc );
+        meter_convert_select( format )( buffer, TEST_FRAMES, VIS_CHANNELS,
+                                        back );
+        passed = passed && memcmp( &ref, &acc, sizeof( ref )) == 0 &&
+                 memcmp( s16, back, sizeof( s16 )) == 0;
+    }
+    test_result( "Formats normalised to the same scale", passed );
+
+    snprintf( path, sizeof( path ), "/tmp/meterPi-test-%d.wav",
+              (int) getpid() );
+    for ( format = 0; format < METER_FORMATS; format++ )
+    {
+        for ( i = 0; i < 9600 * VIS_CHANNELS; i++ )
+        {
+            // 24-bit samples, lost in the last bit when shifted to 16-bit.
+            int32_t sample = lrint( 8388608 * pow( 10, -120 / 20.0 ) *
+                                    sin( 2 * M_PI * 1000 * ( i / 2 ) /
+                                         48000 ));
+            if ( format == METER_FLOAT )
+                ((float *) buffer)[i] = sample / 8388608.0f;
+            else test_store( buffer, format, i, sample * 256 );
+        }
+
+        dBfs[format] = 0;
+        peak[format] = 0;
+        if ( !test_wav_write( path, tags[format],
+                              meter_format_width( format ) * 8,
+                              VIS_CHANNELS, 48000,
+                              buffer, 9600 * VIS_CHANNELS *
+                                      meter_format_width( format )) ||
+             !source_wav( &source, path, 4800, false ) ||
+             !( meter = meter_open_source( &source )))
+            continue;
+
+        meter_get_dBfs( meter, &peak_meter );
+        meter_get_dBfs( meter, &peak_meter );
+        meter_get_dB_indices( meter, &peak_meter );
+        dBfs[format] = peak_meter.dBfs[0];
+        peak[format] = peak_meter.peak[0];
+        meter_close( meter );
+    }
+    unlink( path );
+
+    passed = dBfs[METER_S16] > -96 && peak[METER_S16] == 256 &&
+             fabsf( dBfs[METER_S24] + 123 ) < 0.3f && peak[METER_S24] == 8 &&
+             peak_meter.bar_index[0] == 2;
+    for ( format = METER_S32; format < METER_FORMATS; format++ )
+        passed = passed && dBfs[format] == dBfs[METER_S24] &&
+                 peak[format] == peak[METER_S24];
+    test_result( "24-bit WAV metered below the 16-bit floor", passed );
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests that every channel of a multichannel file is metered.
+//  ---------------------------------------------------------------------------
+/*
+    A 6 channel WAV file carries a 1kHz sine 6dB lower on each channel, so
+    the levels must step down by 6dB from -3dBFS RMS on the first channel.
+*/
+static void test_channels( void )
+{
+    struct peak_meter_t peak_meter =
+    {
+        .samples = 4800, .hold_incs = 7, .fall_incs = 2, .over_peaks = 3,
+        .over_incs = 10, .num_levels = 16, .floor = -96,
+        .reference = METER_FULL_SCALE,
+        .scale = { -96, -84, -72, -60, -48, -36, -30, -24,
+                   -18, -15, -12,  -9,  -6,  -3,  -1,   0 }
+    };
+    static int16_t buffer[9600 * 6];
+    struct meter_source_t source;
+    struct meter_t *meter = NULL;
+    char     path[64];
+    uint32_t i;
+    uint8_t  channel;
+    bool     passed;
+
+    for ( i = 0; i < 9600 * 6; i++ )
+        buffer[i] = lrint( 32767 * pow( 10, -6.0 * ( i % 6 ) / 20 ) *
+                           sin( 2 * M_PI * 1000 * ( i / 6 ) / 48000 ));
+
+    snprintf( path, sizeof( path ), "/tmp/meterPi-test-%d.wav",
+              (int) getpid() );
+    passed = test_wav_write( path, 1, 16, 6, 48000, buffer,
+                             sizeof( buffer )) &&
+             source_wav( &source, path, 4800, false ) &&
+             ( meter = meter_open_source( &source ));
+    unlink( path );
+
+    if ( passed )
+    {
+        meter_get_dBfs( meter, &peak_meter );
+        meter_get_dBfs( meter, &peak_meter );
+        meter_get_dB_indices( meter, &peak_meter );
+        passed = peak_meter.channels == 6 && meter_get_channels( meter ) == 6;
+        for ( channel = 0; channel < 6; channel++ )
+            passed = passed && fabsf( peak_meter.dBfs[channel] + 3 +
+                                      6 * channel ) < 0.2f;
+        meter_close( meter );
+    }
+    test_result( "6 channel WAV metered per channel", passed );
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests that a full scale mono window is metered at 0dBFS.
+//  ---------------------------------------------------------------------------
+/*
+    A mono window is the longest, VIS_BUF_SIZE frames, so its sum of
+    squares at full scale is 2^60 and must not overflow when the fraction
+    bits are added.
+*/
+static void test_mono( void )
+{
+    struct peak_meter_t peak_meter =
+    {
+        .samples = VIS_BUF_SIZE, .hold_incs = 7, .fall_incs = 2,
+        .over_peaks = 3, .over_incs = 10, .num_levels = 16, .floor = -144,
+        .reference = METER_FULL_SCALE,
+        .scale = { -144, -132, -120, -108, -96, -84, -72, -60,
+                    -48,  -36,  -24,  -18, -12,  -6,  -3,   0 }
+    };
+    static int16_t buffer[VIS_BUF_SIZE * 2];
+    struct meter_source_t source;
+    struct meter_t *meter = NULL;
+    char     path[64];
+    uint32_t i;
+    bool     passed;
+
+    for ( i = 0; i < VIS_BUF_SIZE * 2; i++ ) buffer[i] = INT16_MIN;
+
+    snprintf( path, sizeof( path ), "/tmp/meterPi-test-%d.wav",
+              (int) getpid() );
+    passed = test_wav_write( path, 1, 16, 1, 48000, buffer,
+                             sizeof( buffer )) &&
+             source_wav( &source, path, VIS_BUF_SIZE, false ) &&
+             ( meter = meter_open_source( &source ));
+    unlink( path );
+
+    if ( passed )
+    {
+        meter_get_dBfs( meter, &peak_meter );
+        meter_get_dBfs( meter, &peak_meter );
+        passed = peak_meter.channels == 1 && peak_meter.dBfs[0] == 0 &&
+                 peak_meter.peak[0] == METER_FULL_SCALE;
+        meter_close( meter );
+    }
+    test_result( "Full scale mono window at 0dBFS", passed );
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests correlation and goniometer points of in and out of phase sines.
+//  ---------------------------------------------------------------------------
+/*
+    Pairs of 1kHz sines in phase, inverted, in quadrature and with one
+    channel silent give correlations of +1, -1, 0 and 0. The inverted pair
+    is also read from a WAV file through a meter with meter_get_dBfs, so
+    the stage is fed by the same read as the peak meter.
+*/
+static void test_phase( void )
+{
+    static const struct
+    {
+        const char *name;  // Test name.
+        double      shift; // Phase of right channel (degrees).
+        double      gain;  // Gain of right channel.
+        float       r;     // Expected correlation.
+    }
+    cases[] =
+    {
+        { "in phase is +1",  0,   1,  1 },
+        { "inverted is -1",  180, 1, -1 },
+        { "quadrature is 0", 90,  1,  0 },
+        { "one-sided is 0",  0,   0,  0 }
+    };
+    struct phase_config_t config =
+        { .integration = 200, .points = 256, .decimate = 16 };
+    struct peak_meter_t peak_meter =
+    {
+        .samples = 4800, .hold_incs = 7, .fall_incs = 2, .over_peaks = 3,
+        .over_incs = 10, .num_levels = 16, .floor = -96,
+        .reference = METER_FULL_SCALE,
+        .scale = { -96, -84, -72, -60, -48, -36, -30, -24,
+                   -18, -15, -12,  -9,  -6,  -3,  -1,   0 }
+    };
+    struct phase_t *phase = phase_create( &config );
+    static int16_t buffer[9600 * VIS_CHANNELS];
+    static int16_t mid[256], side[256];
+    static uint8_t pages[192 * 64 / 8];
+    struct meter_stage_t  stage;
+    struct meter_source_t source;
+    struct meter_t *meter = NULL;
+    char     label[64], path[64];
+    uint16_t count, i;
+    uint8_t  c;
+    bool     passed;
+
+    if ( !phase ) return;
+
+    for ( c = 0; c < sizeof( cases ) / sizeof( cases[0] ); c++ )
+    {
+        for ( i = 0; i < 9600; i++ )
+        {
+            buffer[i * 2]     = lrint( 16384 * sin( 2 * M_PI * i / 48 ));
+            buffer[i * 2 + 1] = lrint( 16384 * cases[c].gain *
+                                       sin( 2 * M_PI * i / 48 +
+                                            cases[c].shift * M_PI / 180 ));
+        }
+        phase_reset( phase, 48000, VIS_CHANNELS );
+        phase_process( phase, buffer, 9600 );
+
+        snprintf( label, sizeof( label ), "Phase correlation %s",
+                  cases[c].name );
+        test_result( label, fabsf( phase_get_correlation( phase ) -
+                                   cases[c].r ) < 0.01f );
+    }
+
+    // A mono sine is a vertical line through the centre of the scope.
+    for ( i = 0; i < 9600; i++ )
+        buffer[i * 2] = buffer[i * 2 + 1] =
+            lrint( 32767 * sin( 2 * M_PI * i / 48 ));
+    phase_reset( phase, 48000, VIS_CHANNELS );
+    phase_process( phase, buffer, 4000 );
+    count  = phase_get_points( phase, mid, side, 256 );
+    passed = count == 250;
+    for ( i = 0; i < count; i++ )
+        passed = passed && side[i] == 0 &&
+                 mid[i] == buffer[( i + 1 ) * config.decimate * 2 - 2];
+    phase_draw_pages( phase, pages, 192, 64 );
+    for ( i = 0; i < sizeof( pages ); i++ )
+        passed = passed && ( pages[i] == 0 || i % 192 == 96 );
+    passed = passed && pages[96] | pages[7 * 192 + 96];
+    test_result( "Goniometer points decimated, mono is vertical", passed );
+
+    // Inverted right channel through a meter.
+    for ( i = 0; i < 9600; i++ )
+        buffer[i * 2 + 1] = -buffer[i * 2];
+    snprintf( path, sizeof( path ), "/tmp/meterPi-test-%d.wav",
+              (int) getpid() );
+    stage  = phase_stage( phase );
+    passed = test_wav_write( path, 1, 16, VIS_CHANNELS, 48000, buffer,
+                             sizeof( buffer )) &&
+             source_wav( &source, path, 4800, false ) &&
+             ( meter = meter_open_source( &source )) &&
+             meter_add_stage( meter, &stage );
+    unlink( path );
+    if ( passed )
+    {
+        meter_get_dBfs( meter, &peak_meter );
+        meter_get_dBfs( meter, &peak_meter );
+        passed = fabsf( phase_get_correlation( phase ) + 1 ) < 0.01f &&
+                 fabsf( peak_meter.dBfs[1] + 3 ) < 0.2f;
+    }
+    if ( meter ) meter_close( meter );
+    test_result( "Phase stage fed by the peak meter read", passed );
+
+    phase_destroy( phase );
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns a repeatable pseudo-random sample of a frame and channel.
+//  ---------------------------------------------------------------------------
+static int16_t test_waveform_sample( uint32_t frame, uint8_t channel )
+{
+    uint32_t hash = ( frame * 2654435761u ) ^ ( channel * 40503u + 1 );
+
+    hash ^= hash >> 15;
+    hash *= 2246822519u;
+    hash ^= hash >> 13;
+
+    return (int16_t)( hash >> 8 );
+}
+
+//  ---------------------------------------------------------------------------
+//  Checks a bucket against the frames it covers, worked out directly.
+//  ---------------------------------------------------------------------------
+/*
+    Mean squares above level 0 are means of rounded down means, so may be
+    up to one less per level than the exact mean.
+*/
+static bool test_waveform_bucket( const struct waveform_bucket_t *bucket,
+                                  uint32_t first, uint32_t frames,
+                                  uint8_t channel, uint8_t levels )
+{
+    int16_t  lo = INT16_MAX, hi = INT16_MIN, sample;
+    uint64_t sum = 0;
+    double   mean;
+    uint32_t i;
+
+    for ( i = first; i < first + frames; i++ )
+    {
+        sample = test_waveform_sample( i, channel );
+        if ( sample < lo ) lo = sample;
+        if ( sample > hi ) hi = sample;
+        sum += (int32_t) sample * sample;
+    }
+    mean = (double) sum / frames;
+
+    return bucket->min == lo && bucket->max == hi &&
+           bucket->mean_square <= mean &&
+           bucket->mean_square + levels >= mean;
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests the waveform pyramid against min, max and RMS worked out directly.
+//  ---------------------------------------------------------------------------
+/*
+    Frames are fed in odd sized blocks so buckets end part way through
+    blocks, and for long enough that every ring wraps.
+*/
+static void test_waveform( void )
+{
+    struct waveform_config_t config =
+        { .base = 64, .factor = 4, .levels = 3, .buckets = 256 };
+    struct waveform_t *waveform = waveform_create( &config );
+    static struct waveform_bucket_t buckets[256];
+    static int16_t  buffer[37 * VIS_CHANNELS];
+    static uint8_t  fb[256 * 64];
+    const  uint32_t total = 300013;
+    uint32_t frame = 0, count, frames, first, run, i;
+    uint16_t got, x;
+    uint8_t  l, c;
+    bool     passed;
+
+    if ( !waveform )
+    {
+        test_result( "Waveform pyramid created", false );
+        return;
+    }
+
+    // Part way through the first level 1 bucket, only level 0 has any.
+    waveform_reset( waveform, 48000, VIS_CHANNELS );
+    while ( frame < 200 )
+    {
+        for ( i = 0; i < 37; i++ )
+            for ( c = 0; c < VIS_CHANNELS; c++ )
+                buffer[i * VIS_CHANNELS + c] =
+                    test_waveform_sample( frame + i, c );
+        waveform_process( waveform, buffer, 37 );
+        frame += 37;
+    }
+    frames = waveform_get_columns( waveform, 1, 128, buckets, 256 );
+    passed = frames == 128 &&
+             waveform_get_buckets( waveform, 1, 0, buckets, 256 ) == 0;
+    waveform_get_columns( waveform, 1, 128, buckets, 256 );
+    for ( x = 0; x < 255; x++ )
+        passed = passed && buckets[x].min == 0 && buckets[x].max == 0;
+    passed = passed && test_waveform_bucket( &buckets[255], 0, 128, 1, 1 );
+    test_result( "Waveform columns before enough frames are empty", passed );
+
+    while ( frame < total )
+    {
+        run = total - frame < 37 ? total - frame : 37;
+        for ( i = 0; i < run; i++ )
+            for ( c = 0; c < VIS_CHANNELS; c++ )
+                buffer[i * VIS_CHANNELS + c] =
+                    test_waveform_sample( frame + i, c );
+        waveform_process( waveform, buffer, run );
+        frame += run;
+    }
+
+    // Every level is full and holds its newest buckets.
+    passed = true;
+    for ( l = 0; l < config.levels; l++ )
+    {
+        frames = waveform_bucket_frames( waveform, l );
+        count  = total / frames;
+        for ( c = 0; c < VIS_CHANNELS; c++ )
+        {
+            got    = waveform_get_buckets( waveform, l, c, buckets, 256 );
+            passed = passed && got == 256 &&
+                     waveform->level[l].filled == 256;
+            for ( i = 0; passed && i < got; i++ )
+                passed = test_waveform_bucket( &buckets[i],
+                                               ( count - got + i ) * frames,
+                                               frames, c, l + 1 );
+        }
+    }
+    test_result( "Waveform levels match frames after rings wrap", passed );
+
+    /*
+        700 frames a column is 2 buckets of 256 from the start of the run,
+        so the ring of 256 only has enough for the right half, less one if
+        the oldest bucket is half a column.
+    */
+    passed = true;
+    for ( c = 0; c < VIS_CHANNELS; c++ )
+    {
+        frames = waveform_get_columns( waveform, c, 700, buckets, 256 );
+        count  = total / 256;
+        first  = ( count - count % 2 ) * 256;
+        got    = 256 - ( count % 2 ? 127 : 128 );
+        passed = passed && frames == 512;
+        for ( x = 0; x < got; x++ )
+            passed = passed && buckets[x].min == 0 && buckets[x].max == 0;
+        for ( x = 256; passed && x-- > got; )
+        {
+            first -= 512;
+            passed = test_waveform_bucket( &buckets[x], first, 512, c, 2 );
+        }
+    }
+    test_result( "Waveform columns between levels match frames", passed );
+
+    // Full scale square fills both bands, silence is a dim centre line.
+    for ( i = 0; i < 37 * VIS_CHANNELS; i++ )
+        buffer[i] = i / VIS_CHANNELS % 2 ? -INT16_MAX : INT16_MAX;
+    waveform_reset( waveform, 48000, VIS_CHANNELS );
+    for ( i = 0; i < 256 * 64 / 32; i++ )
+        waveform_process( waveform, buffer, 32 );
+    waveform_draw( waveform, fb, 256, 64, 64 );
+    passed = true;
+    for ( i = 0; i < sizeof( fb ); i++ )
+        passed = passed && fb[i] == 15;
+
+    memset( buffer, 0, sizeof( buffer ));
+    for ( i = 0; i < 256 * 64 / 32; i++ )
+        waveform_process( waveform, buffer, 32 );
+    waveform_draw( waveform, fb, 256, 64, 64 );
+    for ( i = 0; i < sizeof( fb ); i++ )
+        passed = passed &&
+                 fb[i] == ( i / 256 == 15 || i / 256 == 47 ? 5 : 0 );
+    test_result( "Waveform drawn full scale and silent", passed );
+
+    waveform_destroy( waveform );
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests dynamics statistics against values worked out directly.
+//  ---------------------------------------------------------------------------
+/*
+    A sine with a clipped copy checks peak, RMS, crest and clips. Blocks of
+    different levels, each with a spike, check DR against the sorted
+    blocks. A WAV file played through a meter checks that the track is
+    written as CSV when the stream stops.
+*/
+static void test_dynamics( void )
+{
+    struct dynamics_t *dynamics = dynamics_create();
+    struct dynamics_result_t result;
+    struct meter_stage_t  stage;
+    struct meter_source_t source;
+    struct meter_t *meter = NULL;
+    static int16_t buffer[24000 * 2];
+    double   block[11], peaks[11], top, swap, squares;
+    uint32_t clips = 0, i, j, k;
+    char     path[64], line[128];
+    FILE     *csv;
+    bool     passed;
+
+    if ( !dynamics )
+    {
+        test_result( "Dynamics stage created", false );
+        return;
+    }
+
+    // -6dBFS sine on the left and a clipped +1.7dB sine on the right.
+    dynamics_reset( dynamics, 8000, 2 );
+    for ( i = 0; i < 24000; i++ )
+    {
+        buffer[i * 2] = lrint( 16384 * sin( 2 * M_PI * i / 8 ));
+        j = lrint( 40000 * sin( 2 * M_PI * i / 8 ));
+        buffer[i * 2 + 1] = (int32_t) j > 32767 ? 32767 :
+                            (int32_t) j < -32767 ? -32767 : (int32_t) j;
+        if ( abs( buffer[i * 2 + 1] ) == 32767 ) clips++;
+    }
+    for ( k = 0; k < 3; k++ )
+        for ( i = 0; i < 24000; i += 1000 )
+            dynamics_process( dynamics, &buffer[i * 2], 1000 );
+    passed = dynamics_get_channel( dynamics, 0, &result ) &&
+             fabsf( result.peak + 6.02f ) < 0.01f &&
+             fabsf( result.rms + 9.03f ) < 0.01f &&
+             fabsf( result.crest - 3.01f ) < 0.01f &&
+             fabsf( result.dr ) < 0.05f && result.clips == 0;
+    passed = passed && dynamics_get_channel( dynamics, 1, &result ) &&
+             result.clips == clips * 3 && fabsf( result.peak ) < 0.01f &&
+             !dynamics_get_channel( dynamics, 2, &result );
+    test_result( "Dynamics peak, RMS, crest and clips of sines", passed );
+
+    // 11 blocks, so the loudest 3 count.
+    dynamics_stop( dynamics );
+    dynamics_reset( dynamics, 8000, 1 );
+    for ( k = 0; k < 11; k++ )
+    {
+        squares = 0;
+        for ( i = 0; i < 24000; i++ )
+        {
+            buffer[i] = lrint( 300 * (( k * 7 ) % 11 + 1 ) *
+                               sin( 2 * M_PI * i / 37 ));
+            if ( i == 5000 + k ) buffer[i] = 6000 + 2000 * (( k * 3 ) % 11 );
+            squares += (double) buffer[i] * buffer[i];
+        }
+        block[k] = sqrt( 2 * squares / 24000 );
+        peaks[k] = 6000 + 2000 * (( k * 3 ) % 11 );
+        for ( i = 0; i < 24000; i += 997 )
+            dynamics_process( dynamics, &buffer[i],
+                              24000 - i < 997 ? 24000 - i : 997 );
+    }
+    for ( i = 0; i < 11; i++ )
+        for ( j = i + 1; j < 11; j++ )
+        {
+            if ( block[j] > block[i] )
+                swap = block[i], block[i] = block[j], block[j] = swap;
+            if ( peaks[j] > peaks[i] )
+                swap = peaks[i], peaks[i] = peaks[j], peaks[j] = swap;
+        }
+    top = sqrt(( block[0] * block[0] + block[1] * block[1] +
+                 block[2] * block[2] ) / 3 );
+    passed = dynamics_get_channel( dynamics, 0, &result ) &&
+             fabs( result.dr - 20 * log10( peaks[1] / top )) < 1.0 / 32;
+    test_result( "Dynamics DR of loudest blocks and second peak", passed );
+
+    // A gap carries on the track, a new rate starts another.
+    j = dynamics->track;
+    dynamics_reset( dynamics, 8000, 1 );
+    passed = dynamics->track == j && dynamics->frames == 11 * 24000;
+    dynamics_reset( dynamics, 16000, 1 );
+    passed = passed && dynamics->track == j + 1 && dynamics->frames == 0;
+
+    // 4s WAV played out through a meter is one track.
+    for ( i = 0; i < 24000 * 2; i++ )
+        buffer[i] = lrint( 8192 * sin( 2 * M_PI * ( i / 2 ) / 48 ));
+    snprintf( path, sizeof( path ), "/tmp/meterPi-test-%d.wav",
+              (int) getpid() );
+    csv    = tmpfile();
+    stage  = dynamics_stage( dynamics );
+    passed = passed && csv &&
+             test_wav_write( path, 1, 16, 2, 6000, buffer,
+                             sizeof( buffer )) &&
+             source_wav( &source, path, 3000, false ) &&
+             ( meter = meter_open_source( &source )) &&
+             meter_add_stage( meter, &stage );
+    unlink( path );
+    if ( passed )
+    {
+        dynamics_set_csv( dynamics, csv );
+        for ( i = 0; i < 12; i++ ) meter_read( meter );
+        rewind( csv );
+        for ( i = 0; fgets( line, sizeof( line ), csv ); i++ )
+            if ( i == 3 )
+                passed = sscanf( line, "%u,all,6000,4.000,1,", &j ) == 1 &&
+                         j == dynamics->track;
+        passed = passed && i == 4 && dynamics->stopped;
+    }
+    if ( meter ) meter_close( meter );
+    if ( csv ) fclose( csv );
+    test_result( "Dynamics tracks end on stop and rate change", passed );
+
+    dynamics_destroy( dynamics );
+}
+
+//  ---------------------------------------------------------------------------
+//  Waits up to 2s for a player to be added or removed.
+//  ---------------------------------------------------------------------------
+static bool test_players_wait( struct meter_players_t *players,
+                               const char *name, bool present )
+{
+    struct timespec delay = { 0, 10000000 };
+    struct peak_meter_t peak_meter;
+    char    found[VIS_NAME_LEN];
+    uint8_t i, tries;
+
+    for ( tries = 0; tries < 200; tries++ )
+    {
+        for ( i = 0; meter_players_get( players, i, found, sizeof( found ),
+                                        &peak_meter ); i++ )
+            if ( strcmp( found, name ) == 0 ) break;
+        if ( meter_players_get( players, i, NULL, 0, NULL ) == present )
+            return true;
+        nanosleep( &delay, NULL );
+    }
+
+    return false;
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests that every Squeezelite object is found and metered.
+//  ---------------------------------------------------------------------------
+/*
+    Two players exist before the worker starts and a third starts later.
+    Each plays a sine at its own level. A meter opened before its object
+    exists must map it as soon as it is created rather than 5s later.
+*/
+static void test_players( void )
+{
+    struct peak_meter_t peak_meter =
+    {
+        .samples = 4800, .hold_incs = 7, .fall_incs = 2, .over_peaks = 3,
+        .over_incs = 10, .num_levels = 16, .floor = -80,
+        .reference = METER_FULL_SCALE,
+        .scale = { -48, -42, -36, -30, -24, -20, -18, -16,
+                   -14, -12, -10,  -8,  -6,  -4,  -2,   0 }
+    };
+    struct synth_config_t config =
+        { .signal = SYNTH_SINE, .rate = 48000, .frequency = 1000 };
+    struct timespec delay = { 0, 100000000 };
+    static int16_t samples[VIS_BUF_SIZE];
+    struct meter_players_t *players;
+    struct synth_t  synth;
+    struct vis_t   *vis[3];
+    struct meter_t *meter;
+    char     names[3][VIS_NAME_LEN];
+    char     found[METER_PLAYERS_MAX][VIS_NAME_LEN];
+    char     name[VIS_NAME_LEN];
+    uint32_t changes;
+    uint8_t  count, i, j;
+    bool     passed = true;
+
+    for ( i = 0; i < 3; i++ )
+        snprintf( names[i], VIS_NAME_LEN, "/%stest-%d-%c",
+                  METER_PLAYERS_PREFIX, (int) getpid(), 'a' + i );
+
+    // A meter waiting for its object.
+    meter = meter_open( names[2] );
+    if ( !meter ) return;
+    meter_check( meter );
+
+    for ( i = 0; i < 2; i++ )
+    {
+        vis[i] = synth_vis_create( names[i] );
+        if ( !vis[i] ) return;
+        config.level = -6 - 6 * i;
+        synth_init( &synth, &config );
+        synth_fill( &synth, samples, VIS_BUF_SIZE / VIS_CHANNELS );
+        synth_vis_write( vis[i], samples, VIS_BUF_SIZE / VIS_CHANNELS,
+                         config.rate );
+    }
+
+    count = meter_players_scan( VIS_SHM_DIR, found, METER_PLAYERS_MAX );
+    for ( i = 0, j = 0; i < count; i++ )
+        if ( strcmp( found[i], names[0] ) == 0 ||
+             strcmp( found[i], names[1] ) == 0 )
+            j++;
+    test_result( "Players found in shared memory directory", j == 2 );
+
+    players = meter_players_start( 30, &peak_meter );
+    if ( !players ) return;
+    changes = meter_players_changes( players );
+
+    vis[2] = synth_vis_create( names[2] );
+    if ( !vis[2] ) return;
+    config.level = -18;
+    synth_init( &synth, &config );
+    synth_fill( &synth, samples, VIS_BUF_SIZE / VIS_CHANNELS );
+    synth_vis_write( vis[2], samples, VIS_BUF_SIZE / VIS_CHANNELS,
+                     config.rate );
+
+    meter_check( meter );
+    test_result( "Meter maps object as soon as it is created",
+                 meter->status.running && meter_get_rate( meter ) == 48000 );
+    meter_close( meter );
+
+    passed = test_players_wait( players, names[2], true ) &&
+             meter_players_changes( players ) != changes;
+    nanosleep( &delay, NULL );
+    for ( i = 0; passed && meter_players_get( players, i, name,
+                                               sizeof( name ),
+                                               &peak_meter ); i++ )
+    {
+        // Sine peaks at -6, -12 and -18dBFS are 3dB higher than RMS.
+        for ( j = 0; j < 3; j++ )
+            if ( strcmp( name, names[j] ) == 0 )
+                passed = fabsf( peak_meter.dBfs[0] + 9 + 6 * j ) <= 1 &&
+                         fabsf( peak_meter.dBfs[1] + 9 + 6 * j ) <= 1;
+    }
+    test_result( "Three players metered by one worker", passed );
+
+    synth_vis_destroy( vis[1], names[1] );
+    passed = test_players_wait( players, names[1], false ) &&
+             test_players_wait( players, names[0], true );
+    test_result( "Player removed when its object goes", passed );
+
+    meter_players_stop( players );
+    synth_vis_destroy( vis[0], names[0] );
+    synth_vis_destroy( vis[2], names[2] );
+}
+
+//  ---------------------------------------------------------------------------
+//  Publishes results with every value set to the count until done.
+//  ---------------------------------------------------------------------------
+static void *test_publish_writer( void *data )
+{
+    struct meter_publisher_t *publisher = data;
+    struct meter_results_t results;
+    uint32_t count;
+    uint8_t  i;
+
+    memset( &results, 0, sizeof( results ));
+    for ( count = 1; count <= TEST_PUBLISHES; count++ )
+    {
+        results.update_ns = count;
+        results.rate      = count;
+        for ( i = 0; i < METER_CHANNELS_MAX; i++ )
+        {
+            results.dBfs[i] = count;
+            results.peak[i] = count;
+        }
+        for ( i = 0; i < METER_RESULTS_BANDS; i++ )
+            results.spectrum[i] = count;
+        results.max_momentary = count;
+        meter_publish( publisher, &results );
+    }
+
+    return NULL;
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests publishing results to subscribers through shared memory.
+//  ---------------------------------------------------------------------------
+/*
+    A reader racing a writer must only ever see results written by one
+    publish, i.e. with every value equal to the count, and must never see
+    the count go backwards.
+*/
+static void test_publish( void )
+{
+    struct peak_meter_t peak_meter =
+    {
+        .channels = 2, .num_levels = 16,
+        .dBfs = { -6, -12 }, .bar_index = { 13, 10 }, .dot_index = { 14, 11 },
+        .overload = { true, false }
+    };
+    struct timespec delay = { 0, 10000000 };
+    struct meter_publisher_t  *publisher;
+    struct meter_subscriber_t *early, *subscriber;
+    struct meter_results_t     results, read;
+    pthread_t writer;
+    char     name[VIS_NAME_LEN];
+    uint32_t last = 0, reads = 0;
+    uint16_t tries;
+    uint8_t  i;
+    bool     passed;
+
+    snprintf( name, sizeof( name ), "/meterPi-test-%d", (int) getpid() );
+
+    early = meter_subscriber_open( name );
+    if ( !early ) return;
+    passed = !meter_subscriber_read( early, &read );
+
+    publisher = meter_publisher_create( name );
+    if ( !publisher ) return;
+    subscriber = meter_subscriber_open( name );
+    if ( !subscriber ) return;
+    passed = passed && !meter_subscriber_read( subscriber, &read );
+
+    memset( &results, 0, sizeof( results ));
+    meter_results_set_peak( &results, &peak_meter );
+    results.update_ns = 1;
+    results.rate      = 48000;
+    results.running   = true;
+    meter_publish( publisher, &results );
+    passed = passed && meter_subscriber_read( subscriber, &read ) &&
+             read.count == 1 && read.rate == 48000 && read.running &&
+             read.channels == 2 && read.dBfs[1] == -12 &&
+             read.bar_index[0] == 13 && read.dot_index[1] == 11 &&
+             read.overload[0] && !read.overload[1] &&
+             read.publish_ns >= read.update_ns;
+    passed = passed && !meter_subscriber_read( subscriber, &read );
+    meter_publish( publisher, &results );
+    passed = passed && meter_subscriber_read( subscriber, &read ) &&
+             read.count == 2;
+    test_result( "Results read once per publish", passed );
+
+    // Replaced object is found by the subscriber opened before it existed.
+    meter_publisher_destroy( publisher );
+    publisher = meter_publisher_create( name );
+    if ( !publisher ) return;
+    meter_publish( publisher, &results );
+    for ( tries = 0, passed = false; !passed && tries < 200; tries++ )
+    {
+        passed = meter_subscriber_read( early, &read ) && read.count == 1;
+        nanosleep( &delay, NULL );
+    }
+    test_result( "Subscriber finds publisher started later", passed );
+
+    meter_publisher_destroy( publisher );
+    meter_subscriber_close( subscriber );
+    publisher = meter_publisher_create( name );
+    subscriber = meter_subscriber_open( name );
+    if ( !publisher || !subscriber ) return;
+
+    passed = pthread_create( &writer, NULL, test_publish_writer,
+                             publisher ) == 0;
+    while ( passed && last < TEST_PUBLISHES )
+    {
+        if ( !meter_subscriber_read( subscriber, &read )) continue;
+        reads++;
+        passed = read.count > last && read.update_ns == read.count &&
+                 read.rate == read.count &&
+                 read.max_momentary == (float) read.count;
+        for ( i = 0; passed && i < METER_CHANNELS_MAX; i++ )
+            passed = read.dBfs[i] == (float) read.count &&
+                     read.peak[i] == read.count;
+        for ( i = 0; passed && i < METER_RESULTS_BANDS; i++ )
+            passed = read.spectrum[i] == (float) read.count;
+        last = read.count;
+    }
+    pthread_join( writer, NULL );
+    test_result( "Reads racing publishes never torn", passed && reads > 0 );
+
+    meter_subscriber_close( early );
+    meter_subscriber_close( subscriber );
+    meter_publisher_destroy( publisher );
+}
+
+//  ---------------------------------------------------------------------------
+//  Replays a capture, returning the sum of the levels at every refresh.
+//  ---------------------------------------------------------------------------
+static double test_replay( const char *path, struct test_count_t *count,
+                           struct meter_profile_t *profile, uint32_t *records )
+{
+    struct peak_meter_t peak_meter =
+    {
+        .samples = 480, .hold_incs = 7, .fall_incs = 2, .over_peaks = 3,
+        .over_incs = 10, .num_levels = 16, .floor = -80,
+        .reference = METER_FULL_SCALE,
+        .scale = { -48, -42, -36, -30, -24, -20, -18, -16,
+                   -14, -12, -10,  -8,  -6,  -4,  -2,   0 }
+    };
+    struct meter_stage_t     stage = { "count", count, test_count_reset,
+                                       test_count_process, NULL };
+    struct meter_source_t    source;
+    struct capture_replay_t *replay;
+    struct meter_t *meter;
+    double sum = 0;
+
+    memset( count, 0, sizeof( *count ));
+    if ( !source_capture( &source, path, false )) return NAN;
+    replay = source.state;
+    meter  = meter_open_source( &source );
+    if ( !meter ) return NAN;
+    meter_add_stage( meter, &stage );
+    meter_profile( meter, true );
+
+    while ( capture_replay_next( replay ))
+    {
+        meter_get_dBfs( meter, &peak_meter );
+        sum += peak_meter.dBfs[0] + peak_meter.dBfs[1];
+    }
+    sum += meter->status.running;
+
+    meter_get_profile( meter, profile );
+    *records = replay->records;
+    meter_close( meter );
+
+    return sum;
+}
+
+//  ---------------------------------------------------------------------------
+//  Tests recording a Squeezelite buffer and replaying it.
+//  ---------------------------------------------------------------------------
+/*
+    A ramp is written in blocks at 48kHz and then 44.1kHz and the stream
+    stopped. Replay must give the counting stage every frame of each rate
+    in order, and two replays must meter identically.
+*/
+static void test_capture( void )
+{
+    static int16_t ramp[15000 * 2];
+    struct test_count_t    count;
+    struct meter_profile_t profile;
+    struct capture_t *capture;
+    struct vis_t     *vis;
+    struct meter_t   *meter;
+    char     name[VIS_NAME_LEN], path[64];
+    uint32_t records, i;
+    double   sum;
+    bool     passed = true;
+
+    for ( i = 0; i < 15000; i++ ) ramp[i * 2] = ramp[i * 2 + 1] = i;
+
+    snprintf( name, sizeof( name ), "/meterPi-capture-%d", (int) getpid() );
+    snprintf( path, sizeof( path ), "/tmp/meterPi-test-%d.mpc",
+              (int) getpid() );
+    vis = synth_vis_create( name );
+    if ( !vis ) return;
+    meter = meter_open( name );
+    capture = capture_create( path );
+    if ( !meter || !capture ) return;
+
+    for ( i = 0; i < 15; i++ )
+    {
+        synth_vis_write( vis, ramp + i * 1000 * 2, 1000,
+                         i < 10 ? 48000 : 44100 );
+        passed = passed && capture_record( capture, meter, 1000 );
+    }
+    // Nothing new is not recorded, stopping is.
+    passed = passed && capture_record( capture, meter, 1000 ) &&
+             capture->records == 15;
+    synth_vis_running( vis, false );
+    passed = passed && capture_record( capture, meter, 1000 ) &&
+             capture->records == 16 && capture->frames == 15000;
+    passed = capture_close( capture ) && passed;
+    meter_close( meter );
+    synth_vis_destroy( vis, name );
+
+    sum = test_replay( path, &count, &profile, &records );
+    passed = passed && records == 16 && count.resets == 3 &&
+             count.rate == 44100 && count.frames == 5000 && count.ordered &&
+             profile.frames == 15000 && profile.stage_ns[0] > 0;
+    test_result( "Capture replays every frame and rate change", passed );
+
+    passed = test_replay( path, &count, &profile, &records ) == sum;
+    test_result( "Replays of a capture meter identically", passed );
+
+    // A recorder killed mid-write leaves a partial last record.
+    passed = truncate( path, 8 + 16 * 24 + 15000 * 4 - 100 ) == 0 &&
+             !isnan( test_replay( path, &count, &profile, &records )) &&
+             records == 14 && count.frames == 4000 && count.ordered;
+    test_result( "Truncated capture replays to last record", passed );
+
+    unlink( path );
+}
+
+//  ---------------------------------------------------------------------------
+//  Main.
+//  ---------------------------------------------------------------------------
+int main( void )
+{
+    printf( "\nmeterPi DSP tests (selected kernel: %s).\n\n",
+            meter_kernel_name( meter_kernel_select( METER_S16 )));
+
+    test_kernel( "scalar", METER_S16, meter_kernel_scalar );
+    test_kernel( "scalar", METER_S24, meter_kernel_s24_scalar );
+    test_kernel( "scalar", METER_S32, meter_kernel_s32_scalar );
+    test_kernel( "scalar", METER_FLOAT, meter_kernel_float_scalar );
+#if defined( __i386__ ) || defined( __x86_64__ )
+    test_kernel( "sse2", METER_S16, meter_kernel_sse2 );
+    test_kernel( "sse2", METER_S32, meter_kernel_s32_sse2 );
+    test_kernel( "sse2", METER_FLOAT, meter_kernel_float_sse2 );
+#endif
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+    test_kernel( "neon", METER_S16, meter_kernel_neon );
+    test_kernel( "neon", METER_S32, meter_kernel_s32_neon );
+    test_kernel( "neon", METER_FLOAT, meter_kernel_float_neon );
+#endif
+    test_ring_spans();
+    test_formats();
+    test_channels();
+    test_mono();
+    test_phase();
+    test_dynamics();
+    test_waveform();
+    test_dB_table();
+    test_meter_contexts();
+    test_truepeak_kernel( "scalar", truepeak_kernel_scalar );
+#if defined( __i386__ ) || defined( __x86_64__ )
+    test_truepeak_kernel( "sse2", truepeak_kernel_sse2 );
+#endif
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+    test_truepeak_kernel( "neon", truepeak_kernel_neon );
+#endif
+    test_truepeak_level();
+    test_loudness();
+    test_spectrum_fft( "scalar", spectrum_fft_scalar );
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+    test_spectrum_fft( "neon", spectrum_fft_neon );
+#endif
+    test_spectrum_tone();
+    test_waterfall();
+    test_pace();
+    test_synth();
+    test_sources();
+    test_players();
+    test_publish();
+    test_capture();
+
+    printf( "\n%u failure(s).\n", failures );
+
+    return failures ? 1 : 0;
+}
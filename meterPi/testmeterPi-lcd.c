@@ -23,7 +23,7 @@
 /*
     Compile with:
 
-        gcc -c -Wall meterPi.c testmeterPi-lcd.c -o testmeterPi-lcd
+        gcc -c -Wall meterPi.c meterPi-kernel.c meterPi-truepeak.c meterPi-loudness.c meterPi-spectrum.c meterPi-pace.c testmeterPi-lcd.c -o testmeterPi-lcd
                -lm -lpthread -lrt -lncurses
 
     For Raspberry Pi v1 optimisation use the following flags:
@@ -59,6 +59,7 @@
 //  Local libraries -------------------------------------------------------
 
 #include "meterPi.h"
+#include "meterPi-pace.h"
 #include "hd44780i2c.h"
 #include "mcp23017.h"
 
@@ -112,13 +113,15 @@
 //  Functions. ----------------------------------------------------------------
 
 #define METER_LEVELS 16 // 16x2 LCD.
-#define METER_DELAY 1
+#define METER_REFRESH 30 // Display refresh rate (Hz).
+#define METER_IDLE 2     // Poll rate while stopped (Hz).
+#define METER_STATS 10   // Seconds between pacing stats.
 
 pthread_mutex_t displayBusy;
 
 // Meter labels.
-//char lcd_meter[METER_CHANNELS][METER_LEVELS + 1] = {{ 0x00 }, { 0x01 }};
-char lcd_meter[METER_CHANNELS][METER_LEVELS + 1] =
+//char lcd_meter[VIS_CHANNELS][METER_LEVELS + 1] = {{ 0x00 }, { 0x01 }};
+char lcd_meter[VIS_CHANNELS][METER_LEVELS + 1] =
     {{ 0, 2, 4, 2, 4, 2, 4, 2, 4, 2, 4, 2, 4, 2, 4, 2, '\0' },
      { 1, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, 5, 3, '\0' }};
 
@@ -130,7 +133,7 @@ struct peak_meter_t peak_meter =
     .hold_count     = 3,
     .num_levels     = 16,
     .floor          = -80,
-    .reference      = 32768,
+    .reference      = METER_FULL_SCALE,
     .dBfs           = { 0, 0 },
     .bar_index      = { 0, 0 },
     .dot_index      = { 0, 0 },
@@ -146,13 +149,13 @@ struct peak_meter_t peak_meter =
     This is intended for a small LCD (16x2 or similar).
 */
 void get_peak_strings( struct peak_meter_t peak_meter,
-                       char dB_string[METER_CHANNELS]
+                       char dB_string[VIS_CHANNELS]
                                      [METER_LEVELS + 1] )
 {
     uint8_t channel;
     uint8_t i;
 
-    for ( channel = 0; channel < METER_CHANNELS; channel++ )
+    for ( channel = 0; channel < VIS_CHANNELS; channel++ )
     {
         for ( i = 1; i < peak_meter.num_levels; i++ )
         {
@@ -198,20 +201,44 @@ void get_peak_strings( struct peak_meter_t peak_meter,
 //  ---------------------------------------------------------------------------
 void *update_meter()
 {
+    struct meter_t           *meter = vis_get_meter();
+    struct meter_pace_t       pace;
+    struct meter_pace_stats_t stats;
+    uint32_t                  wakes = 0;
+
+    meter_pace_init( &pace, METER_REFRESH, METER_IDLE );
+
     while ( 1 )
     {
-        get_dBfs( &peak_meter );
-        get_dB_indices( &peak_meter );
-        get_peak_strings( peak_meter, lcd_meter );
-
-        pthread_mutex_lock( &displayBusy );
-        hd44780Goto( mcp23017[0], hd44780[0], 0, 0 );
-        hd44780WriteString( mcp23017[0], hd44780[0], lcd_meter[0], 16 );
-        hd44780Goto( mcp23017[0], hd44780[0], 1, 0 );
-        hd44780WriteString( mcp23017[0], hd44780[0], lcd_meter[1], 16 );
-        pthread_mutex_unlock( &displayBusy );
+        if ( meter_pace_wait( &pace, meter ))
+        {
+            get_dBfs( &peak_meter );
+            get_dB_indices( &peak_meter );
+            meter_pace_settle( &pace, &peak_meter );
+            get_peak_strings( peak_meter, lcd_meter );
+
+            pthread_mutex_lock( &displayBusy );
+            hd44780Goto( mcp23017[0], hd44780[0], 0, 0 );
+            hd44780WriteString( mcp23017[0], hd44780[0], lcd_meter[0], 16 );
+            hd44780Goto( mcp23017[0], hd44780[0], 1, 0 );
+            hd44780WriteString( mcp23017[0], hd44780[0], lcd_meter[1], 16 );
+            pthread_mutex_unlock( &displayBusy );
+        }
 
-        usleep( METER_DELAY );
+        // Every METER_STATS seconds while running, longer while idle.
+        if ( ++wakes >= METER_REFRESH * METER_STATS )
+        {
+            meter_pace_stats( &pace, &stats );
+            printf( "Updates %llu, skipped %llu, idle %llu, missed %llu, "
+                    "late %lluus, CPU %.2f%%.\n",
+                    (unsigned long long) stats.updates,
+                    (unsigned long long) stats.skipped,
+                    (unsigned long long) stats.idle,
+                    (unsigned long long) stats.missed,
+                    (unsigned long long) stats.late_max / 1000,
+                    stats.cpu );
+            wakes = 0;
+        }
     }
 }
 
@@ -348,8 +375,6 @@ int main( void )
         hd44780WriteString( mcp23017[0], hd44780[0], lcd_meter[0], 16 );
         hd44780Goto( mcp23017[0], hd44780[0], 1, 0 );
         hd44780WriteString( mcp23017[0], hd44780[0], lcd_meter[1], 16 );
-        usleep( METER_DELAY );
-
     }
     gettimeofday( &end, NULL );
 
@@ -360,9 +385,7 @@ int main( void )
         peak_meter.hold_count = peak_meter.hold_time / elapsed;
     pthread_create( &threads[0], NULL, update_meter, NULL );
 
-    while ( 1 )
-    {
-    };
+    pthread_join( threads[0], NULL );
 
     pthread_mutex_destroy( &displayBusy );
     pthread_exit( NULL );
@@ -23,7 +23,7 @@
 /*
     Compile with:
 
-        gcc -c -Wall meterPi.c testmeterPi-ncurses.c -o testmeterPi-ncurses
+        gcc -c -Wall meterPi.c meterPi-kernel.c meterPi-truepeak.c meterPi-loudness.c meterPi-spectrum.c meterPi-pace.c testmeterPi-ncurses.c -o testmeterPi-ncurses
                -lm -lpthread -lrt -lncurses
 
     For Raspberry Pi v1 optimisation use the following flags:
@@ -60,12 +60,15 @@
 //  Local libraries -------------------------------------------------------
 
 #include "meterPi.h"
+#include "meterPi-pace.h"
 
 
 //  Functions. ----------------------------------------------------------------
 
 #define METER_LEVELS 41
-#define METER_DELAY  5000  // Need a proper timer to match sample rate.
+#define METER_DELAY  5000  // Calibration loop delay.
+#define METER_REFRESH 50   // Display refresh rate (Hz).
+#define METER_IDLE    5    // Poll rate while stopped (Hz).
 /*
     44100 Hz = 22.7 us.
     48000 Hz = 20.8 us.
@@ -83,12 +86,12 @@
     This is intended for a small LCD (16x2 or similar) or terminal output.
 */
 void get_peak_strings( struct peak_meter_t peak_meter,
-                       char dB_string[METER_CHANNELS][METER_LEVELS + 1] )
+                       char dB_string[VIS_CHANNELS][METER_LEVELS + 1] )
 {
     uint8_t channel;
     uint8_t i;
 
-    for ( channel = 0; channel < METER_CHANNELS; channel++ )
+    for ( channel = 0; channel < VIS_CHANNELS; channel++ )
     {
         for ( i = 0; i < peak_meter.num_levels; i++ )
         {
@@ -159,7 +162,7 @@ int main( void )
         .over_incs  = 150,
         .num_levels = 41,
         .floor      = -96,
-        .reference  = 32768,
+        .reference  = METER_FULL_SCALE,
         .overload   = { false, false },
         .dBfs       = { 0, 0 },
         .bar_index  = { 0, 0 },
@@ -173,15 +176,15 @@ int main( void )
     };
 
     // String representations for LCD display.
-    char window_peak_meter[METER_CHANNELS][METER_LEVELS + 1];
+    char window_peak_meter[VIS_CHANNELS][METER_LEVELS + 1];
 
     vis_check();
 
     // Calculate number of samples for integration time.
 	peak_meter.samples = vis_get_rate() * peak_meter.int_time / 1000;
     if ( peak_meter.samples < 1 ) peak_meter.samples = 1;
-    if ( peak_meter.samples > VIS_BUF_SIZE / METER_CHANNELS )
-         peak_meter.samples = VIS_BUF_SIZE / METER_CHANNELS;
+    if ( peak_meter.samples > VIS_BUF_SIZE / VIS_CHANNELS )
+         peak_meter.samples = VIS_BUF_SIZE / VIS_CHANNELS;
 //    peak_meter.samples = 2; // Minimum samples for fastest response but may miss peaks.
     printf( "Samples for %dms = %d.\n", peak_meter.int_time, peak_meter.samples );
 
@@ -284,12 +287,25 @@ int main( void )
 
     mvwprintw( meter_win, 3, 2, "-40  -35  -30  -25  -20  -15  -10  -5    0 dBFS" );
 
+    struct meter_t      *meter = vis_get_meter();
+    struct meter_pace_t  pace;
+
+    meter_pace_init( &pace, METER_REFRESH, METER_IDLE );
+
     int ch = ERR;
     while ( ch == ERR )
     {
+        // Only draw when there are new frames, or until the meters have
+        // fallen once the stream stops.
+        if ( !meter_pace_wait( &pace, meter ))
+        {
+            ch = wgetch( meter_win );
+            continue;
+        }
 
         get_dBfs( &peak_meter );
         get_dB_indices( &peak_meter );
+        meter_pace_settle( &pace, &peak_meter );
         get_peak_strings( peak_meter, window_peak_meter );
 
         // Print ncurses data.
@@ -315,7 +331,6 @@ int main( void )
         // Refresh ncurses window to display.
         wrefresh( meter_win );
         ch = wgetch( meter_win );
-        usleep( METER_DELAY );
     }
 
     // Close ncurses.
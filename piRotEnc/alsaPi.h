@@ -30,6 +30,7 @@
 //  Changelog:
 //
 //  v0.1 Original version.
+//  v0.2 Added stepVol for accelerated controls.
 //
 
 //  To Do:
@@ -124,6 +125,15 @@ void incVol( void );
 // ----------------------------------------------------------------------------
 void decVol( void );
 
+// ----------------------------------------------------------------------------
+//  Changes volume by a number of increments, +ve or -ve.
+// ----------------------------------------------------------------------------
+/*
+    Clamped to the volume range. For accelerated controls where a detent
+    can be more than one increment.
+*/
+void stepVol( int steps );
+
 // ----------------------------------------------------------------------------
 //  Detaches and closes ALSA.
 // ----------------------------------------------------------------------------
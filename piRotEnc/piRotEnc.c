@@ -27,12 +27,12 @@
 */
 // ****************************************************************************
 
-#define piRotEncVersion "Version 0.2"
+#define piRotEncVersion "Version 0.6"
 
 //  Compilation:
 //
-//  Compile with gcc piRotEnc.c alsaPi.c rotencPi.c -o piRotEnc
-//          -lwiringPi -lasound -lm -lpthread
+//  Compile with gcc piRotEnc.c alsaPi.c rotencPi.c rotencPi-chardev.c
+//          rotencPi-accel.c -o piRotEnc -lwiringPi -lasound -lm -lpthread
 //  Also use the following flags for Raspberry Pi optimisation:
 //          -march=armv6 -mtune=arm1176jzf-s -mfloat-abi=hard -mfpu=vfp
 //          -ffast-math -pipe -O3
@@ -45,6 +45,10 @@
 //
 //  v0.1 Original version.
 //  v0.2 Rewrite main functions into libraries.
+//  v0.3 Wait for encoder events rather than polling.
+//  v0.4 Added GPIO character device option.
+//  v0.5 Added encoder acceleration.
+//  v0.6 Added software debounce options.
 //
 
 //  To Do:
@@ -70,6 +74,8 @@
 
 #include "alsaPi.h"
 #include "rotencPi.h"
+#include "rotencPi-chardev.h"
+#include "rotencPi-accel.h"
 
 #define NUM_BOUNDS 2
 
@@ -79,6 +85,11 @@ struct commandStruct            // Command line options.
 {
     char        *card;          // ALSA card name.
     char        *mixer;         // Alsa mixer name.
+    char        *chip;          // GPIO chip, or NULL for wiringPi.
+    uint32_t    debounce;       // GPIO chip debounce period (uS).
+    uint32_t    width;          // Narrowest pulse accepted (uS).
+    uint32_t    lockout;        // Lockout after accepted edge (uS).
+    uint8_t     samples;        // Samples for majority vote.
     uint8_t     gpioA;          // GPIO pin for vol rotary encoder.
     uint8_t     gpioB;          // GPIO pin for vol rotary encoder.
     uint8_t     gpioC;          // GPIO pin for function button.
@@ -90,6 +101,7 @@ struct commandStruct            // Command line options.
     int8_t      balance;        // Volume L/R balance.
     uint16_t    delay;          // Delay between encoder tics.
     uint8_t     decode;         // Decoding method.
+    char        *accel;         // Acceleration curve, or NULL for none.
     bool        printOutput;    // Flag to print output.
     bool        printOptions;   // Flag to print options.
     bool        printRanges;    // Flag to print ranges.
@@ -98,6 +110,11 @@ struct commandStruct            // Command line options.
 {
     .card           = "hw:0",   // 1st ALSA card.
     .mixer          = "PCM",    // Default ALSA control.
+    .chip           = NULL,     // Use wiringPi.
+    .debounce       = 0,        // No debounce.
+    .width          = 0,        // No glitch filter.
+    .lockout        = 0,        // No lockout.
+    .samples        = 1,        // No majority vote.
     .gpioA          = 23,       // GPIO 1 for volume encoder.
     .gpioB          = 24,       // GPIO 2 for volume encoder.
     .gpioC          = 0xFF,     // GPIO for function button - disabled.
@@ -109,6 +126,7 @@ struct commandStruct            // Command line options.
     .balance        = 0,        // L = R.
     .delay          = 100,      // 100ms between state checks.
     .decode         = 4,        // Full decoding mode.
+    .accel          = NULL,     // No acceleration.
     .printOutput    = false,    // No output printing.
     .printOptions   = false,    // No command line options printing.
     .printRanges    = false     // No range printing.
@@ -149,6 +167,12 @@ static void printOptions( void )
     printf( "\t| Encoder         | GPIO%-2i", command.gpioA );
     printf( " & GPIO%-2i |\n", command.gpioB );
     printf( "\t| Function button | GPIO%-11i |\n", command.gpioC );
+    printf( "\t| GPIO chip       | %-15s |\n",
+            command.chip ? command.chip : "wiringPi" );
+    printf( "\t| Debounce        | %5iuS %8s |\n", command.debounce, "" );
+    printf( "\t| Pulse width     | %5iuS %8s |\n", command.width, "" );
+    printf( "\t| Lockout         | %5iuS %8s |\n", command.lockout, "" );
+    printf( "\t| Samples         | %3i %11s |\n", command.samples, "" );
     printf( "\t| Volume          | %3i%% %10s |\n", command.volume, "" );
     printf( "\t| Increments      | %3i %11s |\n", command.increments, "" );
     printf( "\t| Balance         | %3i%% %10s |\n", command.balance, "" );
@@ -157,6 +181,8 @@ static void printOptions( void )
     printf( "\t| Factor          | %7.3f %7s |\n", command.factor, "" );
     printf( "\t| Interrupt delay | %3i %11s |\n", command.delay, "" );
     printf( "\t| Decode method   | %3i %11s |\n", command.decode, "" );
+    printf( "\t| Acceleration    | %-15s |\n",
+            command.accel ? command.accel : "none" );
     printf( "\t+-----------------+-----------------+\n\n" );
 };
 
@@ -206,6 +232,11 @@ static struct argp_option options[] =
     { 0, 0, 0, 0, "GPIO:" },
     { "gpiorot",   'A', "<int>,<int>", 0, "GPIOs for rotary encoder." },
     { "gpiobut",   'B', "<int>",       0, "GPIO for function button." },
+    { "chip",      'g', "<string>",    0, "GPIO chip, e.g. /dev/gpiochip0." },
+    { "debounce",  'e', "<int>",       0, "GPIO chip debounce (uS)." },
+    { "width",     'w', "<int>",       0, "Narrowest pulse accepted (uS)." },
+    { "lockout",   'l', "<int>",       0, "Lockout after an edge (uS)." },
+    { "samples",   's', "<int>",       0, "Samples for majority vote." },
     { 0, 0, 0, 0, "Volume:" },
     { "vol",       'v', "<int>",       0, "Initial volume (%)." },
     { "bal",       'b', "<int>",       0, "Initial L/R balance (%)." },
@@ -216,6 +247,8 @@ static struct argp_option options[] =
     { 0, 0, 0, 0, "Responsiveness:" },
     { "decode",    'd', "<int>",       0, "Decoding method." },
     { "delay",     'r', "<int>",       0, "Interrupt delay (mS)." },
+    { "accel",     'a', "<rate:mult,...>", OPTION_ARG_OPTIONAL,
+      "Acceleration curve (default " ACCEL_CURVE ")." },
     { 0, 0, 0, 0, "Debugging:" },
     { "proutput",  'P',       0,       0, "Print output while running." },
     { "proptions", 'O',       0,       0, "Print all command options." },
@@ -249,6 +282,21 @@ static int parse_opt( int param, char *arg, struct argp_state *state )
         case 'B' :
             command.gpioC = atoi( arg );
             break;
+        case 'g' :
+            command.chip = arg;
+            break;
+        case 'e' :
+            command.debounce = atoi( arg );
+            break;
+        case 'w' :
+            command.width = atoi( arg );
+            break;
+        case 'l' :
+            command.lockout = atoi( arg );
+            break;
+        case 's' :
+            command.samples = atoi( arg );
+            break;
         case 'v' :
             command.volume = atoi( arg );
             break;
@@ -273,6 +321,9 @@ static int parse_opt( int param, char *arg, struct argp_state *state )
         case 'd' :
             command.decode = atoi( arg );
             break;
+        case 'a' :
+            command.accel = ( arg ? arg : ACCEL_CURVE );
+            break;
         case 'P' :
             command.printOutput = true;
             break;
@@ -371,9 +422,25 @@ int main( int argc, char *argv[] )
     sound.min       =   command.minimum;
     sound.max       =   command.maximum;
 
+    //  Set up acceleration.
+    struct accelStruct accel;
+    if ( command.accel && !accelInit( &accel, command.accel ))
+    {
+        printf( "\nThere is something wrong with the acceleration curve.\n" );
+        return -1;
+    }
+
     //  Initialise encoder and function button.
     encoder.mode = command.decode;
-    encoderInit( command.gpioA, command.gpioB, command.gpioC );
+    encoderDebounce( &encoder, command.width, command.lockout,
+                     command.samples );
+    if ( command.chip )
+    {
+        if ( encoderInitChardev( command.chip, command.gpioA, command.gpioB,
+                                 command.gpioC, command.debounce ) < 0 )
+            return -1;
+    }
+    else encoderInit( command.gpioA, command.gpioB, command.gpioC );
 
     //  Initialise ALSA.
     soundOpen();
@@ -381,29 +448,34 @@ int main( int argc, char *argv[] )
     //  Set initial volume.
     setVol();
 
-    //  Check for attributes changed by interrupts.
-    while ( 1 )
+    //  Wait for events from interrupts, applying every detent. Debounced
+    //  levels that settle with no edge after are passed on when due.
+    struct encoderEventStruct event;
+    int ready;
+    while (( ready = encoderWait( &encoder,
+                                  encoderTimeout( &encoder ))) >= 0 )
     {
-        //  Volume.
-        if (( encoderDirection != 0 ) && ( !sound.mute ))
+        if ( ready == 0 ) encoderFlush( &encoder, encoderDue( &encoder ));
+        while ( encoderRead( &encoder, &event ))
         {
-            // Volume +
-            if ( encoderDirection > 0 ) incVol();
-            // Volume -
-            else decVol();
-            encoderDirection = 0;
-            setVol();
+            //  Volume.
+            if (( event.type == EVENT_DETENT ) && ( !sound.mute ))
+            {
+                // Scaled by rate.
+                if ( command.accel )
+                    stepVol( accelDetent( &accel, event.time, event.value ));
+                // Volume +
+                else if ( event.value > 0 ) incVol();
+                // Volume -
+                else decVol();
+            }
+            //  Button.
+//            if ( event.type == EVENT_BUTTON )
+//            {
+//                sound.mute = event.value;
+//                setVol();  // May be better to use playback switch.
+//            }
         }
-        //  Button.
-//        if ( button.state )
-//        {
-//            volume.mute = true;
-//            button.state = false;
-//            setVolumeMixer( volume );  // May be better to use playback switch.
-//        }
-
-        // Sensitivity delay.
-        delay( command.delay );
     }
 
     return 0;
@@ -0,0 +1,159 @@
+/*
+//  ===========================================================================
+
+    rotencPi-accel:
+
+    Velocity sensitive acceleration for rotary encoder detents.
+
+    Copyright 2015 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+//  ===========================================================================
+
+    Compile with:
+
+        gcc -c -fpic -Wall rotencPi-accel.c -lm
+
+//  ---------------------------------------------------------------------------
+
+    Authors:        D.Faulke    12/12/2015
+
+    Contributors:
+
+    Changelog:
+
+        v0.1    Original version.
+
+//  ---------------------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "rotencPi-accel.h"
+
+
+//  Functions -----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Sets a curve from a string of rate:multiplier points. Returns false if bad.
+//  ---------------------------------------------------------------------------
+bool accelInit( struct accelStruct *accel, const char *curve )
+{
+    struct accelPointStruct points[ACCEL_POINTS_MAX];
+    const char *next = curve;
+    char *end;
+    uint8_t count = 0;
+    uint8_t i;
+
+    while ( *next && count < ACCEL_POINTS_MAX )
+    {
+        points[count].rate = strtof( next, &end );
+        if ( end == next || *end != ':' ) return false;
+        next = end + 1;
+        points[count].multiplier = strtof( next, &end );
+        if ( end == next || points[count].multiplier <= 0 ) return false;
+        if ( count > 0 && points[count].rate <= points[count - 1].rate )
+            return false;
+        count++;
+        if ( *end == ',' ) end++;
+        else if ( *end ) return false;
+        next = end;
+    }
+    if ( count == 0 || *next ) return false;
+
+    for ( i = 0; i < count; i++ ) accel->curve[i] = points[i];
+    accel->points = count;
+    accel->tau    = ACCEL_TAU;
+    accel->idle   = ACCEL_IDLE;
+    accelReset( accel );
+
+    return true;
+}
+
+//  ---------------------------------------------------------------------------
+//  Starts again from rest.
+//  ---------------------------------------------------------------------------
+void accelReset( struct accelStruct *accel )
+{
+    accel->rate       = 0;
+    accel->multiplier = 1;
+    accel->fraction   = 0;
+    accel->last       = 0;
+    accel->direction  = 0;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the step multiplier at a detent rate.
+//  ---------------------------------------------------------------------------
+float accelMultiplier( const struct accelStruct *accel, float rate )
+{
+    const struct accelPointStruct *low, *high;
+    uint8_t i;
+
+    if ( rate <= accel->curve[0].rate ) return accel->curve[0].multiplier;
+
+    for ( i = 1; i < accel->points; i++ )
+    {
+        if ( rate < accel->curve[i].rate )
+        {
+            low  = &accel->curve[i - 1];
+            high = &accel->curve[i];
+            return low->multiplier + ( rate - low->rate ) *
+                   ( high->multiplier - low->multiplier ) /
+                   ( high->rate - low->rate );
+        }
+    }
+
+    return accel->curve[accel->points - 1].multiplier;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the signed number of steps for a detent.
+//  ---------------------------------------------------------------------------
+int accelDetent( struct accelStruct *accel, uint64_t time, int8_t direction )
+{
+    float interval, steps;
+    int whole;
+
+    interval = ( time - accel->last ) / 1e9;
+
+    // From rest after a gap, a change of direction or the first detent.
+    if ( accel->direction != direction || time <= accel->last ||
+         interval >= accel->idle )
+    {
+        accel->rate     = 0;
+        accel->fraction = 0;
+    }
+    else
+        accel->rate += ( 1 - expf( -interval / accel->tau )) *
+                       ( 1 / interval - accel->rate );
+
+    accel->last       = time;
+    accel->direction  = direction;
+    accel->multiplier = accelMultiplier( accel, accel->rate );
+
+    // At least one step, carrying any fraction.
+    steps = accel->multiplier + accel->fraction;
+    whole = (int) steps;
+    if ( whole < 1 ) whole = 1;
+    accel->fraction = steps - whole;
+    if ( accel->fraction < 0 ) accel->fraction = 0;
+
+    return whole * direction;
+}
@@ -0,0 +1,174 @@
+/*
+//  ===========================================================================
+
+    rotencPi-chardev:
+
+    GPIO character device backend for the rotary encoder driver.
+
+    Copyright 2015 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+//  ===========================================================================
+
+    Authors:        D.Faulke    12/12/2015
+
+    Contributors:
+
+    Changelog:
+
+        v0.1    Original version.
+        v0.2    Several encoders serviced by one thread.
+        v0.3    Edges passed to the encoder's software debounce.
+
+//  Description. --------------------------------------------------------------
+
+    wiringPi's interrupts run a thread per pin, each woken through sysfs
+    and reading the pins after the fact. Edges on A and B are taken in
+    whatever order the threads happen to run, and a reading may already be
+    stale.
+
+    This backend uses the GPIO character device, /dev/gpiochipN, instead.
+    The encoder and button lines of up to CHARDEV_ENCODERS encoders are
+    requested together with both edges and pull-ups, so the kernel queues
+    every edge of every line in one buffer, in order, stamped with
+    CLOCK_MONOTONIC in its interrupt handler. One thread reads as many events as are waiting in a single
+    read() and passes each edge with its time to the encoder's debounce
+    and decoder, so the state tables run on the edges as they happened
+    rather than on later readings.
+
+    Each edge is passed with the time of the next edge of the same line
+    in the batch, if there is one, so a glitch narrower than the
+    debounce width is dropped as soon as both its edges have been read.
+    A level left by a rejected edge is passed on when it is due, so the
+    thread's poll times out then if nothing else arrives first. Majority
+    sampling reads the line's value from the request.
+
+    The kernel can also debounce the lines, delaying each edge by the
+    debounce period, and drops edges if its buffer overflows. Sequence
+    numbers show any gap, which is counted.
+
+    Encoders are added before the lines are requested:
+
+        volume  = encoderCreate( 23, 24, 25, FULL );
+        balance = encoderCreate( 17, 27, 0xFF, FULL );
+        chardevAdd( volume );
+        chardevAdd( balance );
+        chardevOpen( "/dev/gpiochip0", 0 );
+        chardevStart();
+
+    and each has its own queue to read events from.
+
+    A line request fd can also be attached directly, so a mock chip that
+    writes gpio_v2_line_event records to a pipe can stand in for a real
+    one. See testrotencPi-chardev.c.
+
+    Raspberry Pi GPIOs up to the Pi 4 are the offsets of /dev/gpiochip0.
+
+*/
+
+#ifndef ROTENCPI_CHARDEV_H
+#define ROTENCPI_CHARDEV_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+//  Macros --------------------------------------------------------------------
+
+#define CHARDEV_ENCODERS 8                      // Encoders per request.
+#define CHARDEV_LINES    ( CHARDEV_ENCODERS * 3 ) // A, B and button each.
+#define CHARDEV_EVENTS   64                     // Events per read.
+#define CHARDEV_BUFFER   1024                   // Kernel buffer, edges.
+
+
+//  Data structures -----------------------------------------------------------
+
+struct chardevLineStruct
+{
+    uint32_t              offset;   // Line offset on chip.
+    enum encoderLine_t    role;     // Encoder pin A, B or button.
+    struct encoderStruct *encoder;  // Encoder of line.
+};
+
+struct chardevStruct
+{
+    int       fd;                     // Line request, or mock.
+    int       stop;                   // eventfd to stop thread.
+    uint8_t   encoders;               // Encoders added.
+    struct    encoderStruct *encoder[CHARDEV_ENCODERS]; // Encoders.
+    uint8_t   lines;                  // Lines of all encoders.
+    struct    chardevLineStruct line[CHARDEV_LINES];    // Lines.
+    uint32_t  seqno;                  // Sequence number of last edge.
+    uint64_t  edges;                  // Edges read.
+    uint32_t  lost;                   // Edges lost by the kernel.
+    bool      running;                // Thread is running.
+    pthread_t thread;                 // Thread reading events.
+};
+
+extern struct chardevStruct chardev;
+
+
+//  Functions -----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Adds an encoder's lines to the request. Returns 0 or -1 if full.
+//  ---------------------------------------------------------------------------
+/*
+    Add all encoders before chardevOpen or chardevAttach.
+*/
+int chardevAdd( struct encoderStruct *enc );
+
+//  ---------------------------------------------------------------------------
+//  Requests the lines of all encoders. Returns 0 or -1 on failure.
+//  ---------------------------------------------------------------------------
+/*
+    chip is e.g. /dev/gpiochip0. debounce is in uS, 0 for none.
+*/
+int chardevOpen( const char *chip, uint32_t debounce );
+
+//  ---------------------------------------------------------------------------
+//  Uses an already requested line fd, or a mock, with all lines high.
+//  ---------------------------------------------------------------------------
+void chardevAttach( int fd );
+
+//  ---------------------------------------------------------------------------
+//  Reads waiting events and decodes them. Returns events read or -1.
+//  ---------------------------------------------------------------------------
+/*
+    Blocks if there are none, unless the fd is non-blocking.
+*/
+int chardevRead( void );
+
+//  ---------------------------------------------------------------------------
+//  Starts a thread reading events. Returns 0 or -1 on failure.
+//  ---------------------------------------------------------------------------
+int chardevStart( void );
+
+//  ---------------------------------------------------------------------------
+//  Stops the thread, releases the lines and removes the encoders.
+//  ---------------------------------------------------------------------------
+void chardevClose( void );
+
+//  ---------------------------------------------------------------------------
+//  Initialises encoder and button on a GPIO chip instead of wiringPi.
+//  ---------------------------------------------------------------------------
+/*
+    As encoderInit, using the encoder global, but with the chip and
+    debounce period (uS). Returns 0 or -1 on failure.
+*/
+int encoderInitChardev( const char *chip, uint8_t gpioA, uint8_t gpioB,
+                        uint8_t gpioC, uint32_t debounce );
+
+#endif
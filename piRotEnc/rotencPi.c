@@ -47,6 +47,10 @@
         v0.1    Original version.
         v0.2    Converted to libraries.
         v0.3    Combined different methods.
+        v0.4    Added timestamped event queue, eventfd and callbacks.
+                Separated decoding from GPIO reads.
+        v0.5    Encoder instances, each with its own state and queue.
+        v0.6    Added software debounce of timestamped edges.
 
     To Do:
 
@@ -58,23 +62,30 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <wiringPi.h>
 #include <stdbool.h>
 #include <pthread.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 #include "rotencPi.h"
 
 
-// Mutex locks ----------------------------------------------------------------
-
-pthread_mutex_t encoderBusy; // Mutex lock for encoder interrupt function.
-pthread_mutex_t buttonBusy;  // Mutex lock for button inerrupt function.
-
-
 //  Data types ----------------------------------------------------------------
 
+// Encoder for wiringPi interrupts.
+struct encoderStruct encoder =
+{
+    .gpioC = 0xFF,
+    .busy  = PTHREAD_MUTEX_INITIALIZER,
+    .queue = { .fd = -1 }
+};
+
 // Simple state table.
-static const uint8_t simpleTable[SIMPLE_TABLE_COLS] = SIMPLE_TABLE;
+static const int8_t simpleTable[SIMPLE_TABLE_COLS] = SIMPLE_TABLE;
 
 // State transition table - half mode.
 static const uint8_t halfTable[HALF_TABLE_ROWS][HALF_TABLE_COLS] = HALF_TABLE;
@@ -82,172 +93,558 @@ static const uint8_t halfTable[HALF_TABLE_ROWS][HALF_TABLE_COLS] = HALF_TABLE;
 // State transition table - full mode.
 static const uint8_t fullTable[FULL_TABLE_ROWS][FULL_TABLE_COLS] = FULL_TABLE;
 
+
+//  Instance functions. -------------------------------------------------------
+
 //  ---------------------------------------------------------------------------
-//  Sets direction in encoderDirection according to state of pin B.
+//  Creates an encoder instance. Returns NULL on failure.
 //  ---------------------------------------------------------------------------
-void setDirectionSimple( void )
+struct encoderStruct *encoderCreate( uint8_t gpioA, uint8_t gpioB,
+                                     uint8_t gpioC, enum decode_t mode )
 {
-    // Lock thread.
-    pthread_mutex_lock( &encoderBusy );
+    struct encoderStruct *enc;
 
-    // Function is triggered by A so we only need to read B.
-    bool b = digitalRead( encoder.gpioB );
+    enc = calloc( 1, sizeof( struct encoderStruct ));
+    if ( !enc ) return NULL;
 
-    if ( b ) encoderDirection = -1;
-    else encoderDirection = 1;
+    enc->gpioA    = gpioA;
+    enc->gpioB    = gpioB;
+    enc->gpioC    = gpioC;
+    enc->mode     = mode;
+    enc->queue.fd = -1;
+    pthread_mutex_init( &enc->busy, NULL );
 
-    /*
-        It may be a good idea to allow a function to be registered here
-        rather than rely on polling the encoderDirection variable, which
-        causes high cpu usage. It will then be completely interrupt driven.
-        Since wiringPi does not allow parameter passing via it's interrupt
-        routine, this may not be feasible without rewriting the wiringPi
-        library.
-    */
+    // Pulled up.
+    encoderSetLevel( enc, LINE_A, true );
+    encoderSetLevel( enc, LINE_B, true );
+    encoderSetLevel( enc, LINE_BUTTON, true );
 
-    // Unlock thread.
-    pthread_mutex_unlock( &encoderBusy );
+    if ( encoderOpen( enc ) < 0 )
+    {
+        encoderDestroy( enc );
+        return NULL;
+    }
 
-    return;
-};
+    return enc;
+}
+
+//  ---------------------------------------------------------------------------
+//  Frees an encoder instance. Stop anything feeding it first.
+//  ---------------------------------------------------------------------------
+void encoderDestroy( struct encoderStruct *enc )
+{
+    if ( !enc ) return;
+
+    if ( enc->queue.fd >= 0 ) close( enc->queue.fd );
+    pthread_mutex_destroy( &enc->busy );
+    free( enc );
+}
 
 
+//  Event functions. ----------------------------------------------------------
 
 //  ---------------------------------------------------------------------------
-//  Sets direction in encoderDirection using SIMPLE_TABLE.
+//  Returns the time now (nS, CLOCK_MONOTONIC).
 //  ---------------------------------------------------------------------------
-void setDirectionTable( void )
+static uint64_t eventTime( void )
 {
-    static uint8_t code = 0; // Keep readings between calls.
+    struct timespec now;
 
-    // Lock thread.
-    pthread_mutex_lock( &encoderBusy );
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
 
-    // Shift old AB into higher bits and read current AB into lower bits.
-    code <<= 2;
-    bool a = digitalRead( encoder.gpioA );
-    bool b = digitalRead( encoder.gpioB );
-    code += a * 0x2 + b;
-    code &= 0xf;
+//  ---------------------------------------------------------------------------
+//  Adds the latency of an event to the encoder's measurements.
+//  ---------------------------------------------------------------------------
+static void addLatency( struct encoderStruct *enc,
+                        const struct encoderEventStruct *event )
+{
+    uint64_t now = eventTime();
+    uint64_t latency = ( now > event->time ? now - event->time : 0 );
 
-    // Get direction from state table.
-    encoderDirection = simpleTable[ code ];
+    enc->latency.count++;
+    enc->latency.total += latency;
+    if ( latency > enc->latency.max ) enc->latency.max = latency;
+}
 
-    /*
-        It may be a good idea to allow a function to be registered here
-        rather than rely on polling the encoderDirection variable, which
-        causes high cpu usage. It will then be completely interrupt driven.
-        Since wiringPi does not allow parameter passing via it's interrupt
-        routine, this may not be feasible without rewriting the wiringPi
-        library.
-    */
+//  ---------------------------------------------------------------------------
+//  Queues an event, or calls the callback. Call with encoder locked.
+//  ---------------------------------------------------------------------------
+static void pushEvent( struct encoderStruct *enc, enum eventType_t type,
+                       int8_t value, uint64_t time )
+{
+    struct encoderQueueStruct *queue = &enc->queue;
+    struct encoderEventStruct event = { time, type, value };
+    uint64_t signal = 1;
+    uint32_t head, tail;
 
-    // Unlock thread.
-    pthread_mutex_unlock( &encoderBusy );
+    if ( queue->callback )
+    {
+        addLatency( enc, &event );
+        queue->callback( &event, queue->data );
+        return;
+    }
 
-    return;
-};
+    head = queue->head;
+    tail = __atomic_load_n( &queue->tail, __ATOMIC_ACQUIRE );
+    if ( head - tail >= ENCODER_QUEUE_SIZE )
+    {
+        __atomic_fetch_add( &queue->dropped, 1, __ATOMIC_RELAXED );
+        return;
+    }
+
+    // Publish the event before the head that covers it.
+    queue->event[ head & ( ENCODER_QUEUE_SIZE - 1 )] = event;
+    __atomic_store_n( &queue->head, head + 1, __ATOMIC_RELEASE );
+
+    if ( queue->fd >= 0 )
+        if ( write( queue->fd, &signal, sizeof( signal )) < 0 ) return;
+}
 
 //  ---------------------------------------------------------------------------
-//  Sets direction in encoderDirection using HALF_TABLE.
+//  Opens the event queue. Returns the eventfd or -1 on failure.
 //  ---------------------------------------------------------------------------
-void setDirectionHalf( void )
+int encoderOpen( struct encoderStruct *enc )
 {
-    // Lock thread.
-    pthread_mutex_lock( &encoderBusy );
+    if ( enc->queue.fd < 0 )
+        enc->queue.fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
 
-    // Get AB.
-    static uint8_t state = 0;
-    static uint8_t code = 0;
+    return enc->queue.fd;
+}
 
-    code = ( digitalRead( encoder.gpioB ) << 1 ) |
-             digitalRead( encoder.gpioA );
+//  ---------------------------------------------------------------------------
+//  Waits for events. Returns 1 if there are events, 0 on timeout or -1.
+//  ---------------------------------------------------------------------------
+/*
+    The eventfd is cleared before the events are read, so an event queued
+    while reading signals the next wait rather than being missed.
+*/
+int encoderWait( struct encoderStruct *enc, int timeout )
+{
+    struct pollfd poller = { .fd = enc->queue.fd, .events = POLLIN };
+    uint64_t signals;
+    int ready;
 
-    // Look up state in transition table.
-    state = halfTable[ state & 0xf ][ code ];
+    if ( enc->queue.fd < 0 ) return -1;
 
-    // Determine direction and set encoderDirection.
-    uint8_t direction = state & 0x30;
-    if ( direction ) encoderDirection = ( direction == 0x10 ? -1 : 1 );
-    else encoderDirection = 0;
+    ready = poll( &poller, 1, timeout );
+    if ( ready > 0 )
+        if ( read( enc->queue.fd, &signals, sizeof( signals )) < 0 ) return 1;
 
-    /*
-        It may be a good idea to allow a function to be registered here
-        rather than rely on polling the encoderDirection variable, which
-        causes high cpu usage. It will then be completely interrupt driven.
-        Since wiringPi does not allow parameter passing via it's interrupt
-        routine, this may not be feasible without rewriting the wiringPi
-        library.
-    */
+    return ready;
+}
 
-    // Unlock thread.
-    pthread_mutex_unlock( &encoderBusy );
+//  ---------------------------------------------------------------------------
+//  Reads the oldest event. Returns false if there are none.
+//  ---------------------------------------------------------------------------
+bool encoderRead( struct encoderStruct *enc, struct encoderEventStruct *event )
+{
+    struct encoderQueueStruct *queue = &enc->queue;
+    uint32_t tail = queue->tail;
+    uint32_t head = __atomic_load_n( &queue->head, __ATOMIC_ACQUIRE );
 
-    return;
+    if ( tail == head ) return false;
 
-};
+    // Copy the event out before giving its slot back.
+    *event = queue->event[ tail & ( ENCODER_QUEUE_SIZE - 1 )];
+    __atomic_store_n( &queue->tail, tail + 1, __ATOMIC_RELEASE );
+
+    addLatency( enc, event );
+
+    return true;
+}
 
 //  ---------------------------------------------------------------------------
-//  Sets direction in encoderDirection using FULL_TABLE.
+//  Returns the number of events dropped because the queue was full.
 //  ---------------------------------------------------------------------------
-void setDirectionFull( void )
+uint32_t encoderDropped( struct encoderStruct *enc )
 {
-    // Lock thread.
-    pthread_mutex_lock( &encoderBusy );
+    return __atomic_load_n( &enc->queue.dropped, __ATOMIC_RELAXED );
+}
+
+//  ---------------------------------------------------------------------------
+//  Registers a function to call for each event instead of queueing.
+//  ---------------------------------------------------------------------------
+void encoderCallback( struct encoderStruct *enc,
+                      void (*callback)( const struct encoderEventStruct *event,
+                                        void *data ), void *data )
+{
+    pthread_mutex_lock( &enc->busy );
+    enc->queue.callback = callback;
+    enc->queue.data     = data;
+    pthread_mutex_unlock( &enc->busy );
+}
 
-    // Get AB
-    static uint8_t state = 0;
-    static uint8_t code = 0;
-    code = ( digitalRead( encoder.gpioB ) << 1 ) |
-             digitalRead( encoder.gpioA );
+//  ---------------------------------------------------------------------------
+//  Gets latency of events so far, from edge to being read or called back.
+//  ---------------------------------------------------------------------------
+void encoderLatency( struct encoderStruct *enc,
+                     struct encoderLatencyStruct *latency )
+{
+    *latency = enc->latency;
+}
 
-    // Look up state in transition table.
-    state = fullTable[ state & 0xf ][ code ];
 
-    // Determine direction and set encoderDirection.
-    uint8_t direction = state & 0x30;
-    if ( direction ) encoderDirection = ( direction == 0x10 ? -1 : 1 );
-    else encoderDirection = 0;
+//  Decoding functions. -------------------------------------------------------
 
-    /*
-        It may be a good idea to allow a function to be registered here
-        rather than rely on polling the encoderDirection variable, which
-        causes high cpu usage. It will then be completely interrupt driven.
-        Since wiringPi does not allow parameter passing via it's interrupt
-        routine, this may not be feasible without rewriting the wiringPi
-        library.
-    */
+//  ---------------------------------------------------------------------------
+//  Decodes an edge and queues any detent. Call with encoder locked.
+//  ---------------------------------------------------------------------------
+/*
+    SIMPLE_1 is triggered by the rising edge of A so only needs B.
+    SIMPLE_2 and SIMPLE_4 shift old AB into the higher bits of abAB and
+    look up the direction in the state table. HALF and FULL look up the
+    next state in their transition tables, which has the direction in
+    bits 4 and 5.
+*/
+static void decodeEdge( struct encoderStruct *enc, bool a, bool b,
+                        uint64_t time )
+{
+    int8_t direction = 0;
+
+    switch ( enc->mode )
+    {
+        case SIMPLE_1:
+            direction = ( b ? -1 : 1 );
+            break;
+        case SIMPLE_2:
+        case SIMPLE_4:
+            enc->code = (( enc->code << 2 ) + a * 0x2 + b ) & 0xf;
+            direction = simpleTable[ enc->code ];
+            break;
+        case HALF:
+            enc->state = halfTable[ enc->state & 0xf ][ b << 1 | a ];
+            if ( enc->state & 0x30 )
+                direction = (( enc->state & 0x30 ) == 0x10 ? -1 : 1 );
+            break;
+        default:
+            enc->state = fullTable[ enc->state & 0xf ][ b << 1 | a ];
+            if ( enc->state & 0x30 )
+                direction = (( enc->state & 0x30 ) == 0x10 ? -1 : 1 );
+            break;
+    }
+
+    if ( direction )
+    {
+        enc->direction = direction;
+        pushEvent( enc, EVENT_DETENT, direction, time );
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Toggles the button state and queues it. Call with encoder locked.
+//  ---------------------------------------------------------------------------
+static void pressButton( struct encoderStruct *enc, uint64_t time )
+{
+    enc->buttonState = !enc->buttonState;
+    pushEvent( enc, EVENT_BUTTON, enc->buttonState, time );
+}
+
+//  ---------------------------------------------------------------------------
+//  Decodes an edge on the encoder and queues any detent.
+//  ---------------------------------------------------------------------------
+void encoderEdge( struct encoderStruct *enc, bool a, bool b, uint64_t time )
+{
+    // Lock thread.
+    pthread_mutex_lock( &enc->busy );
+
+    decodeEdge( enc, a, b, time );
 
     // Unlock thread.
-    pthread_mutex_unlock( &encoderBusy );
+    pthread_mutex_unlock( &enc->busy );
 
     return;
+};
+
+//  ---------------------------------------------------------------------------
+//  Toggles the button state on a low level and queues it.
+//  ---------------------------------------------------------------------------
+/*
+    Buttons are pulled up, so a falling edge is a press.
+*/
+void buttonEdge( struct encoderStruct *enc, bool level, uint64_t time )
+{
+    // Shares the encoder lock as there is only one event producer.
+    pthread_mutex_lock( &enc->busy );
 
+    if ( !level ) pressButton( enc, time );
+
+    pthread_mutex_unlock( &enc->busy );
+
+    return;
 };
 
+
+//  Debounce functions. -------------------------------------------------------
+
 //  ---------------------------------------------------------------------------
-//  Returns button state in button struct. Call by interrupt on GPIO.
+//  Passes an accepted level of a line to the decoder or button.
 //  ---------------------------------------------------------------------------
-void setButtonState( void )
+static void acceptEdge( struct encoderStruct *enc, enum encoderLine_t line,
+                        uint64_t time )
 {
-    // Lock thread.
-    pthread_mutex_lock( &buttonBusy );
+    bool level = enc->line[line].level;
+
+    switch ( line )
+    {
+        case LINE_BUTTON:
+            if ( !level ) pressButton( enc, time );
+            return;
+        case LINE_A:
+            if ( enc->mode == SIMPLE_1 && !level ) return;
+            break;
+        default:
+            if ( enc->mode == SIMPLE_1 || enc->mode == SIMPLE_2 ) return;
+            break;
+    }
 
-    // Read GPIO state.
-    int buttonRead = digitalRead( button.gpio );
-    if ( buttonRead ) buttonState = !buttonState;
+    decodeEdge( enc, enc->line[LINE_A].level, enc->line[LINE_B].level, time );
+}
 
-    /*
-        It may be a good idea to allow a function to be registered here
-        rather than rely on polling the buttonState variable, which
-        causes high cpu usage. It will then be completely interrupt driven.
-        Since wiringPi does not allow parameter passing via it's interrupt
-        routine, this may not be feasible without rewriting the wiringPi
-        library.
-    */
+//  ---------------------------------------------------------------------------
+//  Returns when a line's level left by a rejected edge is due, or 0.
+//  ---------------------------------------------------------------------------
+static uint64_t lineDue( struct encoderStruct *enc, enum encoderLine_t line )
+{
+    struct encoderLineStruct *state = &enc->line[line];
+    uint64_t due = state->edge;
 
-    // Unlock thread.
-    pthread_mutex_unlock( &buttonBusy );
+    if ( state->raw == state->level ) return 0;
+
+    if ( state->edge + enc->debounce.width * 1000ULL > due )
+        due = state->edge + enc->debounce.width * 1000ULL;
+    if ( state->accepted + enc->debounce.lockout * 1000ULL > due )
+        due = state->accepted + enc->debounce.lockout * 1000ULL;
+
+    return due;
+}
+
+//  ---------------------------------------------------------------------------
+//  Passes on levels due by time. Call with encoder locked.
+//  ---------------------------------------------------------------------------
+static void flushLines( struct encoderStruct *enc, uint64_t time )
+{
+    struct encoderLineStruct *state;
+    uint64_t due;
+    uint8_t line;
+
+    for ( line = 0; line < ENCODER_LINES; line++ )
+    {
+        due = lineDue( enc, line );
+        if ( due == 0 || due > time ) continue;
+
+        state = &enc->line[line];
+        state->level    = state->raw;
+        state->accepted = due;
+        acceptEdge( enc, line, due );
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns true if most samples of a line agree with level.
+//  ---------------------------------------------------------------------------
+/*
+    The line is taken to be at the level most samples show, so that the
+    other edge of a glitch too short to sample matches it.
+*/
+static bool sampleLine( struct encoderStruct *enc, enum encoderLine_t line,
+                        bool level )
+{
+    uint8_t samples = enc->debounce.samples;
+    uint8_t agree = 0, i;
+    int sample;
+
+    for ( i = 0; i < samples; i++ )
+    {
+        sample = enc->sample( enc, line );
+        if ( sample < 0 ) return true;
+        agree += ( sample == level );
+    }
+    if ( agree * 2 > samples ) return true;
+
+    enc->line[line].raw = !level;
+    return false;
+}
+
+//  ---------------------------------------------------------------------------
+//  Debounces an edge on a line, then decodes it or presses the button.
+//  ---------------------------------------------------------------------------
+void encoderLineEdge( struct encoderStruct *enc, enum encoderLine_t line,
+                      bool level, uint64_t time, uint64_t next )
+{
+    struct encoderLineStruct *state = &enc->line[line];
+    uint64_t width   = enc->debounce.width * 1000ULL;
+    uint64_t lockout = enc->debounce.lockout * 1000ULL;
+    uint64_t last;
+    bool accept = true;
+
+    pthread_mutex_lock( &enc->busy );
+
+    // Levels left by earlier rejected edges come first.
+    flushLines( enc, time );
+
+    // Not an edge of this line, e.g. both lines read on one interrupt.
+    if ( level == state->raw )
+    {
+        pthread_mutex_unlock( &enc->busy );
+        return;
+    }
+
+    last = state->edge;
+    state->raw  = level;
+    state->edge = time;
+
+    // Nothing to do if back at the accepted level, e.g. after a glitch.
+    if ( level != state->level )
+    {
+        if ( width && ( time - last < width ||
+                      ( next && next - time < width )))
+            accept = false;
+        else if ( lockout && time - state->accepted < lockout )
+            accept = false;
+        // A later edge is already known, so the line may have moved on.
+        else if ( enc->debounce.samples > 1 && enc->sample && !next &&
+                  !sampleLine( enc, line, level ))
+            accept = false;
+
+        if ( accept )
+        {
+            state->level    = level;
+            state->accepted = time;
+            acceptEdge( enc, line, time );
+        }
+        else state->rejected++;
+    }
+
+    pthread_mutex_unlock( &enc->busy );
+}
+
+//  ---------------------------------------------------------------------------
+//  Sets a line's level without an edge, e.g. when starting.
+//  ---------------------------------------------------------------------------
+void encoderSetLevel( struct encoderStruct *enc, enum encoderLine_t line,
+                      bool level )
+{
+    pthread_mutex_lock( &enc->busy );
+    enc->line[line].raw      = level;
+    enc->line[line].level    = level;
+    enc->line[line].edge     = 0;
+    enc->line[line].accepted = 0;
+    pthread_mutex_unlock( &enc->busy );
+}
+
+//  ---------------------------------------------------------------------------
+//  Sets debounce methods. Times in uS, 0 for none.
+//  ---------------------------------------------------------------------------
+void encoderDebounce( struct encoderStruct *enc, uint32_t width,
+                      uint32_t lockout, uint8_t samples )
+{
+    pthread_mutex_lock( &enc->busy );
+    enc->debounce.width   = width;
+    enc->debounce.lockout = lockout;
+    enc->debounce.samples = samples;
+    pthread_mutex_unlock( &enc->busy );
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns when the next level left by a rejected edge is due (nS), or 0.
+//  ---------------------------------------------------------------------------
+uint64_t encoderDue( struct encoderStruct *enc )
+{
+    uint64_t due, earliest = 0;
+    uint8_t line;
+
+    pthread_mutex_lock( &enc->busy );
+    for ( line = 0; line < ENCODER_LINES; line++ )
+    {
+        due = lineDue( enc, line );
+        if ( due && ( earliest == 0 || due < earliest )) earliest = due;
+    }
+    pthread_mutex_unlock( &enc->busy );
+
+    return earliest;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns mS until the next level left by a rejected edge is due, or -1.
+//  ---------------------------------------------------------------------------
+int encoderTimeout( struct encoderStruct *enc )
+{
+    uint64_t due = encoderDue( enc );
+    uint64_t time;
+
+    if ( due == 0 ) return -1;
+
+    time = eventTime();
+    if ( due <= time ) return 0;
+
+    // Round up so as not to wake early.
+    return ( due - time + 999999 ) / 1000000;
+}
+
+//  ---------------------------------------------------------------------------
+//  Passes on levels left by rejected edges that are due by time (nS).
+//  ---------------------------------------------------------------------------
+void encoderFlush( struct encoderStruct *enc, uint64_t time )
+{
+    pthread_mutex_lock( &enc->busy );
+    flushLines( enc, time );
+    pthread_mutex_unlock( &enc->busy );
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the number of edges rejected on a line.
+//  ---------------------------------------------------------------------------
+uint32_t encoderRejected( struct encoderStruct *enc, enum encoderLine_t line )
+{
+    return __atomic_load_n( &enc->line[line].rejected, __ATOMIC_RELAXED );
+}
+
+
+//  wiringPi functions. -------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Reads a line of the encoder global for majority sampling.
+//  ---------------------------------------------------------------------------
+static int sampleWiringPi( struct encoderStruct *enc, enum encoderLine_t line )
+{
+    uint8_t gpio[ENCODER_LINES] = { enc->gpioA, enc->gpioB, enc->gpioC };
+
+    return digitalRead( gpio[line] );
+}
+
+//  ---------------------------------------------------------------------------
+//  Reads encoder pins and decodes. Call by interrupt on encoder GPIOs.
+//  ---------------------------------------------------------------------------
+/*
+    wiringPi doesn't pass the edge time or pin to interrupt routines, so
+    the time is taken as soon as the routine runs and both pins are read.
+    The one that hasn't changed is ignored. B goes first, as SIMPLE_1 and
+    SIMPLE_2 only interrupt on A and decode it with B read at the same
+    time.
+*/
+void encoderInterrupt( void )
+{
+    uint64_t time = eventTime();
+    bool a = digitalRead( encoder.gpioA );
+    bool b = digitalRead( encoder.gpioB );
+
+    encoderLineEdge( &encoder, LINE_B, b, time, 0 );
+    encoderLineEdge( &encoder, LINE_A, a, time, 0 );
+
+    return;
+};
+
+//  ---------------------------------------------------------------------------
+//  Reads button pin and toggles state. Call by interrupt on button GPIO.
+//  ---------------------------------------------------------------------------
+void buttonInterrupt( void )
+{
+    uint64_t time = eventTime();
+
+    encoderLineEdge( &encoder, LINE_BUTTON, digitalRead( encoder.gpioC ),
+                     time, 0 );
 
     return;
 };
@@ -263,8 +660,12 @@ void encoderInit( uint8_t gpioA, uint8_t gpioB, uint8_t gpioC )
 
     wiringPiSetupGpio();
 
+    // Open event queue before any interrupts.
+    encoderOpen( &encoder );
+
     encoder.gpioA = gpioA;
     encoder.gpioB = gpioB;
+    encoder.gpioC = gpioC;
 
     // Set encoder GPIO modes.
     pinMode( encoder.gpioA, INPUT );
@@ -272,32 +673,26 @@ void encoderInit( uint8_t gpioA, uint8_t gpioB, uint8_t gpioC )
     pullUpDnControl( encoder.gpioA, PUD_UP );
     pullUpDnControl( encoder.gpioB, PUD_UP );
 
+    // Set states.
+    encoder.direction = 0;
+    encoder.sample = sampleWiringPi;
+    encoderSetLevel( &encoder, LINE_A, digitalRead( encoder.gpioA ));
+    encoderSetLevel( &encoder, LINE_B, digitalRead( encoder.gpioB ));
+
     //  Register interrupt functions.
     switch ( encoder.mode )
     {
+        // SIMPLE_1 decodes rising edges of A but debounce needs both.
         case SIMPLE_1:
-            wiringPiISR( encoder.gpioA, INT_EDGE_RISING, &setDirectionSimple );
-            break;
         case SIMPLE_2:
-            wiringPiISR( encoder.gpioA, INT_EDGE_BOTH, &setDirectionTable );
-            break;
-        case SIMPLE_4:
-            wiringPiISR( encoder.gpioA, INT_EDGE_BOTH, &setDirectionTable );
-            wiringPiISR( encoder.gpioB, INT_EDGE_BOTH, &setDirectionTable );
-            break;
-        case HALF:
-            wiringPiISR( encoder.gpioA, INT_EDGE_BOTH, &setDirectionHalf );
-            wiringPiISR( encoder.gpioB, INT_EDGE_BOTH, &setDirectionHalf );
+            wiringPiISR( encoder.gpioA, INT_EDGE_BOTH, &encoderInterrupt );
             break;
         default:
-            wiringPiISR( encoder.gpioA, INT_EDGE_BOTH, &setDirectionFull );
-            wiringPiISR( encoder.gpioB, INT_EDGE_BOTH, &setDirectionFull );
+            wiringPiISR( encoder.gpioA, INT_EDGE_BOTH, &encoderInterrupt );
+            wiringPiISR( encoder.gpioB, INT_EDGE_BOTH, &encoderInterrupt );
             break;
     }
 
-    // Set states.
-    encoderDirection = 0;
-
     // Only set up a button if there is one.
     if ( gpioC != 0xFF )
     {
@@ -305,17 +700,16 @@ void encoderInit( uint8_t gpioA, uint8_t gpioB, uint8_t gpioC )
             Need to check validity of GPIO number!
         */
 
-        button.gpio = gpioC;
-
         // Set button gpio mode.
-        pinMode( button.gpio, INPUT );
-        pullUpDnControl( button.gpio, PUD_UP );
-
-        // Register interrupt function.
-        wiringPiISR( button.gpio, INT_EDGE_FALLING, &setButtonState );
+        pinMode( encoder.gpioC, INPUT );
+        pullUpDnControl( encoder.gpioC, PUD_UP );
 
         // Set state.
-        buttonState = 0;
+        encoder.buttonState = 0;
+        encoderSetLevel( &encoder, LINE_BUTTON, digitalRead( encoder.gpioC ));
+
+        // Both edges, so that a bounce can be told from a press.
+        wiringPiISR( encoder.gpioC, INT_EDGE_BOTH, &buttonInterrupt );
     }
 
     return;
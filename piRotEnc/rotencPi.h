@@ -35,6 +35,10 @@
 
         v0.1    Original version.
         v0.2    Converted to libraries.
+        v0.3    Combined different methods.
+        v0.4    Added timestamped event queue, eventfd and callbacks.
+        v0.5    Encoder instances, each with its own state and queue.
+        v0.6    Added software debounce of timestamped edges.
 
     To Do:
 
@@ -138,6 +142,82 @@
                 | -ve next    | 06 | 05 | 04 | 00 |
                 +---------------------------------+
 
+//  Events. -------------------------------------------------------------------
+
+    Each detent and button press is queued as an event with the time of the
+    edge that caused it, so fast spins don't lose detents between polls.
+
+    The queue is a lock-free ring with a single producer and a single
+    consumer. The interrupt threads are the producer, one at a time as they
+    already share a lock for the decoder state. The consumer is the app,
+    which can block on an eventfd with poll or epoll rather than polling
+    on a delay:
+
+        while ( encoderWait( &encoder, -1 ) >= 0 )
+            while ( encoderRead( &encoder, &event )) ...
+
+    If the queue fills, new events are dropped and counted rather than
+    overwriting events the consumer may be reading.
+
+    Alternatively a callback can be registered, which is called directly
+    from the interrupt threads instead of queueing. It must be quick.
+
+    Decoding is separate from reading the GPIOs, so edges can be injected
+    for testing with encoderEdge and buttonEdge.
+
+//  Instances. ----------------------------------------------------------------
+
+    Each encoder is an instance with its own GPIOs, decoding method, state,
+    queue and lock, so a process can have several. The GPIO character
+    device backend, rotencPi-chardev, services the lines of all of them
+    from one thread.
+
+    wiringPi can't pass an instance to its interrupt routines, so with
+    encoderInit there is just the one, the encoder global.
+
+    Each instance measures the latency of its events, from the edge to
+    being read or passed to the callback, with encoderLatency.
+
+//  Debounce. -----------------------------------------------------------------
+
+    Backends pass each edge of each line, with its time, to encoderLineEdge.
+    A debounce stage there decides whether an edge changes the line's level
+    before the decoder sees it. An edge is passed on as soon as it arrives
+    unless it is rejected, so clean edges are never delayed and nothing
+    sleeps. Each method is off when 0 and they can be combined:
+
+        Width       Minimum pulse width. An edge is rejected if the line's
+                    last edge was less than width before it, which collapses
+                    chatter, or if the line's next edge is already known to
+                    be less than width after it, which drops narrow pulses.
+                    The chardev backend knows the next edge when both are
+                    read in the same batch.
+
+        Lock-out    Edges are rejected for lock-out after an accepted edge.
+
+        Majority    The line is sampled N times on each edge, and the edge is
+                    rejected if most samples don't agree with it. Needs a
+                    backend that can read lines, which takes microseconds
+                    rather than a sleep. Edges whose next edge is already
+                    known aren't sampled, as the line may have moved on
+                    since; the width covers them.
+
+    Rejecting an edge can leave a line at the wrong level if the line really
+    did change. Once the line has been still for the width and lock-out, the
+    change is passed on, stamped with that time. encoderFlush does this, and
+    each edge flushes its encoder first. Threads reading edges should also
+    flush when the earliest time from encoderDue passes. wiringPi has no
+    such thread, so the app waits no longer than encoderTimeout:
+
+        while (( ready = encoderWait( &encoder,
+                                      encoderTimeout( &encoder ))) >= 0 )
+        {
+            if ( ready == 0 ) encoderFlush( &encoder, encoderDue( &encoder ));
+            while ( encoderRead( &encoder, &event )) ...
+        }
+
+    Rejected edges are counted for each line.
+
 */
 
 //  Macros --------------------------------------------------------------------
@@ -145,6 +225,13 @@
 #ifndef ROTENCPI_H
 #define ROTENCPI_H
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// Event queue size. Must be a power of 2.
+#define ENCODER_QUEUE_SIZE 256
+
 // Simple state table.
 #define SIMPLE_TABLE_COLS 16
 #define SIMPLE_TABLE     { 0,-1, 1, 0, 1, 0, 0,-1,-1, 0, 0, 1, 0, 1,-1, 0 }
@@ -173,62 +260,230 @@
 
 //  Data structures -----------------------------------------------------------
 
-volatile int8_t encoderDirection;   // Encoder direction.
-//volatile int8_t encoderState;       // Encoder state, abAB.
-volatile int8_t buttonState;        // Button state, on or off.
-
 // Decoder methods. See description of encoder functions below.
 enum decode_t { SIMPLE_1, SIMPLE_2, SIMPLE_4, HALF, FULL };
 
-struct encoderStruct
+// Event types.
+enum eventType_t { EVENT_DETENT, EVENT_BUTTON };
+
+// Lines of an encoder.
+#define ENCODER_LINES 3
+enum encoderLine_t { LINE_A, LINE_B, LINE_BUTTON };
+
+struct encoderEventStruct
+{
+    uint64_t         time;  // Time of edge (nS, CLOCK_MONOTONIC).
+    enum eventType_t type;  // Detent or button.
+    int8_t           value; // Direction +1/-1 or button state.
+};
+
+// Event queue. head is only written by the producer, tail by the consumer.
+struct encoderQueueStruct
+{
+    struct encoderEventStruct event[ENCODER_QUEUE_SIZE];
+    uint32_t head;      // Events written.
+    uint32_t tail;      // Events read.
+    uint32_t dropped;   // Events dropped as the queue was full.
+    int      fd;        // eventfd, signalled for each event.
+    void   (*callback)( const struct encoderEventStruct *event, void *data );
+    void    *data;      // Passed to callback.
+};
+
+// Latency from edge to event being read or passed to callback.
+struct encoderLatencyStruct
+{
+    uint64_t count;     // Events measured.
+    uint64_t total;     // Sum of latencies (nS).
+    uint64_t max;       // Longest latency (nS).
+};
+
+// Debounce methods, 0 for none.
+struct debounceStruct
+{
+    uint32_t width;     // Minimum pulse width (uS).
+    uint32_t lockout;   // Lock-out after an accepted edge (uS).
+    uint8_t  samples;   // Majority of samples.
+};
+
+struct encoderLineStruct
 {
-    uint8_t       gpioA; // GPIO for encoder pin A.
-    uint8_t       gpioB; // GPIO for encoder pin B.
-    uint16_t      delay; // Sensitivity delay (uS).
-    enum decode_t mode;  // Simple, half or full quadrature.
-}   encoder;
+    bool     raw;       // Level after last edge.
+    bool     level;     // Level after last accepted edge.
+    uint64_t edge;      // Time of last edge (nS).
+    uint64_t accepted;  // Time of last accepted edge (nS).
+    uint32_t rejected;  // Edges rejected.
+};
 
-struct buttonStruct
+struct encoderStruct
 {
-    uint8_t gpio;   // GPIO for button pin.
-}   button;
+    uint8_t         gpioA;       // GPIO for encoder pin A.
+    uint8_t         gpioB;       // GPIO for encoder pin B.
+    uint8_t         gpioC;       // GPIO for button pin, 0xFF for none.
+    uint16_t        delay;       // Sensitivity delay (uS).
+    enum decode_t   mode;        // Simple, half or full quadrature.
+    uint8_t         code;        // Last readings, abAB.
+    uint8_t         state;       // Transition table state.
+    volatile int8_t direction;   // Last direction, for polling.
+    volatile int8_t buttonState; // Button state, on or off.
+    pthread_mutex_t busy;        // Lock for decoder and event producer.
+    struct encoderQueueStruct   queue;   // Events.
+    struct encoderLatencyStruct latency; // Latency of events.
+    struct debounceStruct    debounce;            // Debounce methods.
+    struct encoderLineStruct line[ENCODER_LINES]; // Line levels.
+    int  (*sample)( struct encoderStruct *enc, enum encoderLine_t line );
+                                 // Reads a line, or -1, for majority.
+};
+
+// Encoder for wiringPi interrupts.
+extern struct encoderStruct encoder;
 
+//  ---------------------------------------------------------------------------
+//  Creates an encoder instance. Returns NULL on failure.
+//  ---------------------------------------------------------------------------
 /*
-    Functions to set direction in encoderDirection variable:
-    encoderDirection = +1: +ve direction.
-                     =  0: no change determined.
-                     = -1: -ve direction.
+    Send 0xFF for button if no GPIO present. Opens its event queue.
 */
+struct encoderStruct *encoderCreate( uint8_t gpioA, uint8_t gpioB,
+                                     uint8_t gpioC, enum decode_t mode );
+
+//  ---------------------------------------------------------------------------
+//  Frees an encoder instance. Stop anything feeding it first.
+//  ---------------------------------------------------------------------------
+void encoderDestroy( struct encoderStruct *enc );
+
 //  ---------------------------------------------------------------------------
-//  Sets direction in encoderDirection according to state of pin B.
+//  Debounces an edge on a line, then decodes it or presses the button.
 //  ---------------------------------------------------------------------------
-void setDirectionSimple( void );
+/*
+    level is the line's level after the edge, at time (nS). next is the
+    time of the line's next edge if already known, else 0. A level the
+    line is already at isn't an edge of it and is ignored. Edges the
+    decoding method doesn't use only set the level: SIMPLE_1 uses rising
+    edges of A, SIMPLE_2 both edges of A and the others both edges of A
+    and B. Buttons are pulled up, so a falling edge is a press.
+*/
+void encoderLineEdge( struct encoderStruct *enc, enum encoderLine_t line,
+                      bool level, uint64_t time, uint64_t next );
 
 //  ---------------------------------------------------------------------------
-//  Sets direction in encoderDirection using SIMPLE_TABLE.
+//  Sets a line's level without an edge, e.g. when starting.
 //  ---------------------------------------------------------------------------
-void setDirectionTable( void );
+void encoderSetLevel( struct encoderStruct *enc, enum encoderLine_t line,
+                      bool level );
 
 //  ---------------------------------------------------------------------------
-//  Sets direction in encoderDirection using HALF_TABLE.
+//  Sets debounce methods. Times in uS, 0 for none.
 //  ---------------------------------------------------------------------------
-void setDirectionHalf( void );
+void encoderDebounce( struct encoderStruct *enc, uint32_t width,
+                      uint32_t lockout, uint8_t samples );
 
 //  ---------------------------------------------------------------------------
-//  Sets direction in encoderDirection using FULL_TABLE.
+//  Returns when the next level left by a rejected edge is due (nS), or 0.
 //  ---------------------------------------------------------------------------
-void setDirectionFull( void );
+uint64_t encoderDue( struct encoderStruct *enc );
+
+//  ---------------------------------------------------------------------------
+//  Returns mS until the next level left by a rejected edge is due, or -1.
+//  ---------------------------------------------------------------------------
+/*
+    For use as the timeout of encoderWait.
+*/
+int encoderTimeout( struct encoderStruct *enc );
 
 //  ---------------------------------------------------------------------------
-//  Returns button state in buttonState. Call by interrupt on GPIO.
+//  Passes on levels left by rejected edges that are due by time (nS).
 //  ---------------------------------------------------------------------------
-void setButtonState( void );
+void encoderFlush( struct encoderStruct *enc, uint64_t time );
+
+//  ---------------------------------------------------------------------------
+//  Returns the number of edges rejected on a line.
+//  ---------------------------------------------------------------------------
+uint32_t encoderRejected( struct encoderStruct *enc, enum encoderLine_t line );
+
+//  ---------------------------------------------------------------------------
+//  Decodes an edge on the encoder and queues any detent.
+//  ---------------------------------------------------------------------------
+/*
+    a and b are the levels of pins A & B after the edge. SIMPLE_1 only
+    uses b. Also sets direction, +1 or -1, for apps that still poll.
+    Doesn't debounce or change line levels, so is for injecting edges.
+*/
+void encoderEdge( struct encoderStruct *enc, bool a, bool b, uint64_t time );
+
+//  ---------------------------------------------------------------------------
+//  Toggles the button state on a low level and queues it.
+//  ---------------------------------------------------------------------------
+/*
+    level is the button's level after the edge. Buttons are pulled up, so
+    a falling edge is a press, as for encoderLineEdge. Doesn't debounce,
+    so is for injecting presses.
+*/
+void buttonEdge( struct encoderStruct *enc, bool level, uint64_t time );
+
+//  ---------------------------------------------------------------------------
+//  Reads encoder pins and decodes. Call by interrupt on encoder GPIOs.
+//  ---------------------------------------------------------------------------
+void encoderInterrupt( void );
+
+//  ---------------------------------------------------------------------------
+//  Reads button pin and toggles state. Call by interrupt on button GPIO.
+//  ---------------------------------------------------------------------------
+void buttonInterrupt( void );
+
+//  ---------------------------------------------------------------------------
+//  Opens the event queue. Returns the eventfd or -1 on failure.
+//  ---------------------------------------------------------------------------
+/*
+    Called by encoderCreate and encoderInit. The eventfd is readable while
+    there are events to read. Call encoderWait( enc, 0 ) when it is,
+    before reading events.
+*/
+int encoderOpen( struct encoderStruct *enc );
+
+//  ---------------------------------------------------------------------------
+//  Waits for events. Returns 1 if there are events, 0 on timeout or -1.
+//  ---------------------------------------------------------------------------
+/*
+    timeout is in mS, -1 to wait indefinitely. Read all events after each
+    wait as the eventfd is cleared.
+*/
+int encoderWait( struct encoderStruct *enc, int timeout );
+
+//  ---------------------------------------------------------------------------
+//  Reads the oldest event. Returns false if there are none.
+//  ---------------------------------------------------------------------------
+bool encoderRead( struct encoderStruct *enc, struct encoderEventStruct *event );
+
+//  ---------------------------------------------------------------------------
+//  Returns the number of events dropped because the queue was full.
+//  ---------------------------------------------------------------------------
+uint32_t encoderDropped( struct encoderStruct *enc );
+
+//  ---------------------------------------------------------------------------
+//  Registers a function to call for each event instead of queueing.
+//  ---------------------------------------------------------------------------
+/*
+    Called from the interrupt threads. NULL returns to queueing.
+*/
+void encoderCallback( struct encoderStruct *enc,
+                      void (*callback)( const struct encoderEventStruct *event,
+                                        void *data ), void *data );
+
+//  ---------------------------------------------------------------------------
+//  Gets latency of events so far, from edge to being read or called back.
+//  ---------------------------------------------------------------------------
+/*
+    Call from the thread reading events, or with callbacks stopped.
+*/
+void encoderLatency( struct encoderStruct *enc,
+                     struct encoderLatencyStruct *latency );
 
 //  ---------------------------------------------------------------------------
 //  Initialises encoder and button GPIOs.
 //  ---------------------------------------------------------------------------
 /*
-    Send 0xFF for button if no GPIO present.
+    Uses the encoder global with wiringPi interrupts. Set encoder.mode
+    first. Send 0xFF for button if no GPIO present.
 */
 void encoderInit( uint8_t encoderA, uint8_t encoderB, uint8_t button );
 
@@ -0,0 +1,208 @@
+/*
+//  ===========================================================================
+
+    replayrotencPi:
+
+    Replays recorded detent timings through an acceleration curve.
+
+    Copyright 2015 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+//  ===========================================================================
+
+    Compilation:
+
+        gcc replayrotencPi.c rotencPi-accel.c -Wall -o replayrotencPi -lm
+
+    Doesn't need an encoder. Recordings are lines of a detent's time (S)
+    and direction (+1 or -1), as printed by testrotencPi. Lines starting
+    with # are ignored. E.g.
+
+        testrotencPi > spin.txt
+        replayrotencPi -c 5:1,15:2,30:5,50:10 -i 20 spin.txt
+
+    prints the rate, multiplier and steps of each detent and where a
+    control of 20 increments, starting at 0, would be after it.
+
+//  ---------------------------------------------------------------------------
+
+    Authors:        D.Faulke    12/12/2015
+
+//  ---------------------------------------------------------------------------
+*/
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <argp.h>
+
+#include "rotencPi-accel.h"
+
+#define replayVersion "Version 0.1"
+
+
+//  Data structures -----------------------------------------------------------
+
+struct replayStruct             // Command line options.
+{
+    char     *file;             // Recording, or NULL for stdin.
+    char     *curve;            // Acceleration curve.
+    float    tau;               // EWMA time constant (S).
+    float    idle;              // Idle gap (S).
+    int      increments;        // Increments of control.
+    int      start;             // Starting increment.
+    bool     quiet;             // Only print summary.
+    bool     error;             // Invalid argument.
+}
+    replay =                    // Default values.
+{
+    .file       = NULL,
+    .curve      = ACCEL_CURVE,
+    .tau        = ACCEL_TAU,
+    .idle       = ACCEL_IDLE,
+    .increments = 20,
+    .start      = 0,
+    .quiet      = false,
+    .error      = false
+};
+
+
+//  Command line option functions. --------------------------------------------
+
+const char *argp_program_version = replayVersion;
+const char *argp_program_bug_address = "darren@alidaf.co.uk";
+static const char doc[] = "Replays detent timings through an acceleration "
+                          "curve.";
+static const char args_doc[] = "[<file>]";
+
+static struct argp_option options[] =
+{
+    { "curve",     'c', "<rate:mult,...>", 0, "Acceleration curve." },
+    { "tau",       't', "<S>",   0, "Rate time constant (default 0.1)." },
+    { "idle",      'g', "<S>",   0, "Gap to start from rest (default 0.5)." },
+    { "inc",       'i', "<int>", 0, "Control increments (default 20)." },
+    { "start",     's', "<int>", 0, "Starting increment (default 0)." },
+    { "quiet",     'q', 0,       0, "Only print summary." },
+    { 0 }
+};
+
+// ----------------------------------------------------------------------------
+//  Command line argument parser.
+// ----------------------------------------------------------------------------
+static int parse_opt( int param, char *arg, struct argp_state *state )
+{
+    switch ( param )
+    {
+        case 'c' :
+            replay.curve = arg;
+            break;
+        case 't' :
+            replay.tau = atof( arg );
+            if ( replay.tau <= 0 ) replay.error = true;
+            break;
+        case 'g' :
+            replay.idle = atof( arg );
+            if ( replay.idle <= 0 ) replay.error = true;
+            break;
+        case 'i' :
+            replay.increments = atoi( arg );
+            if ( replay.increments <= 0 ) replay.error = true;
+            break;
+        case 's' :
+            replay.start = atoi( arg );
+            break;
+        case 'q' :
+            replay.quiet = true;
+            break;
+        case ARGP_KEY_ARG :
+            if ( state->arg_num > 0 ) argp_usage( state );
+            replay.file = arg;
+            break;
+    }
+    return 0;
+};
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+
+//  Main section. -------------------------------------------------------------
+
+int main( int argc, char *argv[] )
+{
+    struct accelStruct accel;
+    char line[128];
+    double seconds;
+    int direction, steps, index;
+    uint32_t detents = 0, lines = 0;
+    int32_t total = 0;
+    uint64_t time;
+    FILE *file = stdin;
+
+    argp_parse( &argp, argc, argv, 0, 0, 0 );
+    if ( replay.error || !accelInit( &accel, replay.curve ))
+    {
+        printf( "There is something wrong with the set parameters.\n" );
+        return -1;
+    }
+    accel.tau  = replay.tau;
+    accel.idle = replay.idle;
+    index = replay.start;
+
+    if ( replay.file && !( file = fopen( replay.file, "r" )))
+    {
+        printf( "Couldn't open %s.\n", replay.file );
+        return -1;
+    }
+
+    if ( !replay.quiet )
+        printf( "%12s %10s %8s %6s %6s %6s\n",
+                "Time (S)", "Gap (mS)", "Rate", "Mult", "Steps", "Index" );
+
+    while ( fgets( line, sizeof( line ), file ))
+    {
+        lines++;
+        if ( line[0] == '#' || line[0] == '\n' ) continue;
+        if ( sscanf( line, "%lf %d", &seconds, &direction ) != 2 ||
+             ( direction != 1 && direction != -1 ) || seconds < 0 )
+        {
+            printf( "Bad detent on line %u.\n", lines );
+            continue;
+        }
+
+        time  = seconds * 1e9;
+        if ( !replay.quiet )
+            printf( "%12.6f %10.1f ", seconds,
+                    accel.last ? ( time - accel.last ) / 1e6 : 0 );
+
+        steps = accelDetent( &accel, time, direction );
+        total += steps;
+        index += steps;
+        if ( index > replay.increments ) index = replay.increments;
+        if ( index < 0 ) index = 0;
+        detents++;
+
+        if ( !replay.quiet )
+            printf( "%8.1f %6.2f %+6d %6d\n",
+                    accel.rate, accel.multiplier, steps, index );
+    }
+    if ( file != stdin ) fclose( file );
+
+    printf( "%u detents, %d steps, finishing at %d of %d.\n",
+            detents, total, index, replay.increments );
+
+    return 0;
+}
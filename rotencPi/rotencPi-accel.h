@@ -0,0 +1,129 @@
+/*
+//  ===========================================================================
+
+    rotencPi-accel:
+
+    Velocity sensitive acceleration for rotary encoder detents.
+
+    Copyright 2015 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+//  ===========================================================================
+
+    Authors:        D.Faulke    12/12/2015
+
+    Contributors:
+
+    Changelog:
+
+        v0.1    Original version.
+
+//  Description. --------------------------------------------------------------
+
+    A control with a large range needs many detents to cross at a fine
+    step, and a coarse step makes fine adjustment hard. Acceleration gives
+    both by scaling steps by how fast the encoder is turned.
+
+    The rate of detents is the reciprocal of the time between their
+    events, smoothed by an exponentially weighted moving average with a
+    time constant rather than a fixed weight, so it means the same however
+    fast the detents come:
+
+        weight = 1 - exp( -interval / tau )
+        rate  += weight * ( 1 / interval - rate )
+
+    The smoothed rate is mapped to a step multiplier by a curve of up to
+    ACCEL_POINTS_MAX points, rate:multiplier, joined by straight lines and
+    flat beyond the ends. E.g. the default curve, "5:1,15:2,30:5,50:10",
+    keeps single steps below 5 detents/s and reaches 10x at 50 detents/s.
+
+    Fractions of steps are carried to the next detent so a multiplier of
+    1.5 gives 3 steps every 2 detents. The rate, and any fraction, start
+    again from rest after an idle gap or when the direction changes, so
+    the first detent of a turn, and a turn back to correct an overshoot,
+    get the lowest multiplier. There is always at least one step per
+    detent.
+
+    Detent timings can be recorded with testrotencPi and replayed through
+    a curve with replayrotencPi to tune it offline.
+
+*/
+
+#ifndef ROTENCPI_ACCEL_H
+#define ROTENCPI_ACCEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//  Macros --------------------------------------------------------------------
+
+#define ACCEL_POINTS_MAX 8                      // Points on a curve.
+#define ACCEL_CURVE      "5:1,15:2,30:5,50:10"  // Default curve.
+#define ACCEL_TAU        0.1                    // Default time constant (S).
+#define ACCEL_IDLE       0.5                    // Default idle gap (S).
+
+
+//  Data structures -----------------------------------------------------------
+
+struct accelPointStruct
+{
+    float rate;         // Detents per second.
+    float multiplier;   // Step multiplier at rate.
+};
+
+struct accelStruct
+{
+    float    tau;       // EWMA time constant (S).
+    float    idle;      // Gap that restarts from rest (S).
+    uint8_t  points;    // Points on curve.
+    struct accelPointStruct curve[ACCEL_POINTS_MAX]; // Rising rates.
+    float    rate;      // Smoothed detent rate (detents/S).
+    float    multiplier;// Multiplier of last detent.
+    float    fraction;  // Fraction of a step carried.
+    uint64_t last;      // Time of last detent (nS).
+    int8_t   direction; // Direction of last detent.
+};
+
+
+//  Functions -----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Sets a curve from a string of rate:multiplier points. Returns false if bad.
+//  ---------------------------------------------------------------------------
+/*
+    Also sets default tau and idle gap, and starts from rest. Rates must
+    rise and multipliers be positive. The curve is unchanged if bad.
+*/
+bool accelInit( struct accelStruct *accel, const char *curve );
+
+//  ---------------------------------------------------------------------------
+//  Starts again from rest.
+//  ---------------------------------------------------------------------------
+void accelReset( struct accelStruct *accel );
+
+//  ---------------------------------------------------------------------------
+//  Returns the step multiplier at a detent rate.
+//  ---------------------------------------------------------------------------
+float accelMultiplier( const struct accelStruct *accel, float rate );
+
+//  ---------------------------------------------------------------------------
+//  Returns the signed number of steps for a detent.
+//  ---------------------------------------------------------------------------
+/*
+    time is of the detent's event (nS) and direction is +1 or -1.
+*/
+int accelDetent( struct accelStruct *accel, uint64_t time, int8_t direction );
+
+#endif
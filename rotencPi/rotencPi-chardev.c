@@ -0,0 +1,383 @@
+/*
+//  ===========================================================================
+
+    rotencPi-chardev:
+
+    GPIO character device backend for the rotary encoder driver.
+
+    Copyright 2015 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+//  ===========================================================================
+
+    Compile with rotencPi.c:
+
+        gcc -c -fpic -Wall rotencPi-chardev.c rotencPi.c -lwiringPi -lpthread
+
+    Needs kernel headers from Linux 5.10 or later for the uAPI v2 ioctls.
+
+//  ---------------------------------------------------------------------------
+
+    Authors:        D.Faulke    12/12/2015
+
+    Contributors:
+
+    Changelog:
+
+        v0.1    Original version.
+        v0.2    Several encoders serviced by one thread.
+        v0.3    Edges passed to the encoder's software debounce.
+
+//  ---------------------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <linux/gpio.h>
+
+#include "rotencPi.h"
+#include "rotencPi-chardev.h"
+
+
+//  Data types ----------------------------------------------------------------
+
+struct chardevStruct chardev = { .fd = -1, .stop = -1 };
+
+
+//  Functions -----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Adds a line to the request.
+//  ---------------------------------------------------------------------------
+static void chardevAddLine( struct encoderStruct *enc, uint8_t gpio,
+                            enum encoderLine_t role )
+{
+    struct chardevLineStruct *line = &chardev.line[chardev.lines++];
+
+    line->offset  = gpio;
+    line->role    = role;
+    line->encoder = enc;
+}
+
+//  ---------------------------------------------------------------------------
+//  Reads the current level of an encoder's line. Returns -1 on failure.
+//  ---------------------------------------------------------------------------
+static int chardevSample( struct encoderStruct *enc, enum encoderLine_t role )
+{
+    struct gpio_v2_line_values values = { 0 };
+    uint8_t i;
+
+    for ( i = 0; i < chardev.lines; i++ )
+        if ( chardev.line[i].encoder == enc && chardev.line[i].role == role )
+            break;
+    if ( i == chardev.lines ) return -1;
+
+    values.mask = 1ULL << i;
+    if ( ioctl( chardev.fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values ) < 0 )
+        return -1;
+
+    return ( values.bits >> i ) & 1;
+}
+
+//  ---------------------------------------------------------------------------
+//  Adds an encoder's lines to the request. Returns 0 or -1 if full.
+//  ---------------------------------------------------------------------------
+int chardevAdd( struct encoderStruct *enc )
+{
+    if ( chardev.encoders == CHARDEV_ENCODERS || chardev.fd >= 0 ) return -1;
+
+    chardev.encoder[chardev.encoders++] = enc;
+    chardevAddLine( enc, enc->gpioA, LINE_A );
+    chardevAddLine( enc, enc->gpioB, LINE_B );
+    if ( enc->gpioC != 0xFF ) chardevAddLine( enc, enc->gpioC, LINE_BUTTON );
+    enc->sample = chardevSample;
+
+    return 0;
+}
+
+//  ---------------------------------------------------------------------------
+//  Requests the lines of all encoders. Returns 0 or -1 on failure.
+//  ---------------------------------------------------------------------------
+/*
+    All lines share one request so their edges share one ordered buffer.
+    Debounce, if any, is added as an attribute for all lines.
+*/
+int chardevOpen( const char *chip, uint32_t debounce )
+{
+    struct gpio_v2_line_request request;
+    struct gpio_v2_line_values values;
+    uint64_t all = ( 1ULL << chardev.lines ) - 1;
+    uint8_t i;
+    int fd, err;
+
+    if ( chardev.lines == 0 ) return -1;
+
+    fd = open( chip, O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 )
+    {
+        printf( "Couldn't open %s.\n", chip );
+        return -1;
+    }
+
+    memset( &request, 0, sizeof( request ));
+    for ( i = 0; i < chardev.lines; i++ )
+        request.offsets[i] = chardev.line[i].offset;
+    request.num_lines = chardev.lines;
+    strncpy( request.consumer, "rotencPi", sizeof( request.consumer ) - 1 );
+    request.event_buffer_size = CHARDEV_BUFFER;
+    request.config.flags = GPIO_V2_LINE_FLAG_INPUT |
+                           GPIO_V2_LINE_FLAG_EDGE_RISING |
+                           GPIO_V2_LINE_FLAG_EDGE_FALLING |
+                           GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+    if ( debounce )
+    {
+        request.config.num_attrs = 1;
+        request.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_DEBOUNCE;
+        request.config.attrs[0].attr.debounce_period_us = debounce;
+        request.config.attrs[0].mask = all;
+    }
+
+    err = ioctl( fd, GPIO_V2_GET_LINE_IOCTL, &request );
+    close( fd );
+    if ( err < 0 )
+    {
+        printf( "Couldn't request GPIO lines on %s.\n", chip );
+        return -1;
+    }
+
+    chardevAttach( request.fd );
+
+    // Get starting levels.
+    values.mask = all;
+    values.bits = all;
+    if ( ioctl( request.fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values ) < 0 )
+        printf( "Couldn't read GPIO lines, assuming high.\n" );
+    for ( i = 0; i < chardev.lines; i++ )
+        encoderSetLevel( chardev.line[i].encoder, chardev.line[i].role,
+                         ( values.bits >> i ) & 1 );
+
+    return 0;
+}
+
+//  ---------------------------------------------------------------------------
+//  Uses an already requested line fd, or a mock, with all lines high.
+//  ---------------------------------------------------------------------------
+void chardevAttach( int fd )
+{
+    uint8_t i;
+
+    chardev.fd    = fd;
+    chardev.seqno = 0;
+    chardev.edges = 0;
+    chardev.lost  = 0;
+
+    for ( i = 0; i < chardev.lines; i++ )
+        encoderSetLevel( chardev.line[i].encoder, chardev.line[i].role, true );
+}
+
+//  ---------------------------------------------------------------------------
+//  Passes an edge to its encoder's debounce.
+//  ---------------------------------------------------------------------------
+/*
+    next is the time of the line's next edge, or 0 if not read yet. The
+    encoder decides which edges its decoding method uses.
+*/
+static void chardevEdge( const struct gpio_v2_line_event *event,
+                         uint64_t next )
+{
+    bool rising = ( event->id == GPIO_V2_LINE_EVENT_RISING_EDGE );
+    struct chardevLineStruct *line;
+    uint8_t i;
+
+    // Count edges the kernel dropped from a full buffer.
+    if ( event->seqno > chardev.seqno + 1 )
+        chardev.lost += event->seqno - chardev.seqno - 1;
+    chardev.seqno = event->seqno;
+    chardev.edges++;
+
+    for ( i = 0; i < chardev.lines; i++ )
+        if ( event->offset == chardev.line[i].offset ) break;
+    if ( i == chardev.lines ) return;
+
+    line = &chardev.line[i];
+    encoderLineEdge( line->encoder, line->role, rising,
+                     event->timestamp_ns, next );
+}
+
+//  ---------------------------------------------------------------------------
+//  Reads waiting events and decodes them. Returns events read or -1.
+//  ---------------------------------------------------------------------------
+int chardevRead( void )
+{
+    struct gpio_v2_line_event events[CHARDEV_EVENTS];
+    uint64_t next;
+    ssize_t bytes;
+    int count, i, j;
+
+    bytes = read( chardev.fd, events, sizeof( events ));
+    if ( bytes < 0 ) return -1;
+
+    count = bytes / sizeof( struct gpio_v2_line_event );
+    for ( i = 0; i < count; i++ )
+    {
+        // Look ahead for the line's next edge.
+        next = 0;
+        for ( j = i + 1; j < count; j++ )
+            if ( events[j].offset == events[i].offset )
+            {
+                next = events[j].timestamp_ns;
+                break;
+            }
+        chardevEdge( &events[i], next );
+    }
+
+    return count;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns mS until the next level left by a rejected edge is due, or -1.
+//  ---------------------------------------------------------------------------
+static int chardevTimeout( void )
+{
+    struct timespec now;
+    uint64_t due, earliest = 0, time;
+    uint8_t i;
+
+    for ( i = 0; i < chardev.encoders; i++ )
+    {
+        due = encoderDue( chardev.encoder[i] );
+        if ( due && ( earliest == 0 || due < earliest )) earliest = due;
+    }
+    if ( earliest == 0 ) return -1;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    time = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+    if ( earliest <= time ) return 0;
+
+    // Round up so as not to wake early.
+    return ( earliest - time + 999999 ) / 1000000;
+}
+
+//  ---------------------------------------------------------------------------
+//  Passes on levels that are due for all encoders.
+//  ---------------------------------------------------------------------------
+static void chardevFlush( void )
+{
+    struct timespec now;
+    uint64_t time;
+    uint8_t i;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    time = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+    for ( i = 0; i < chardev.encoders; i++ )
+        encoderFlush( chardev.encoder[i], time );
+}
+
+//  ---------------------------------------------------------------------------
+//  Reads events until stopped.
+//  ---------------------------------------------------------------------------
+static void *chardevThread( void *data )
+{
+    struct pollfd pollers[2] =
+    {
+        { .fd = chardev.fd,   .events = POLLIN },
+        { .fd = chardev.stop, .events = POLLIN }
+    };
+    int ready;
+
+    (void) data;
+
+    while (( ready = poll( pollers, 2, chardevTimeout() )) >= 0 )
+    {
+        if ( ready == 0 ) chardevFlush();
+        if ( pollers[1].revents ) break;
+        if ( pollers[0].revents & ( POLLERR | POLLHUP | POLLNVAL )) break;
+        if ( pollers[0].revents & POLLIN ) chardevRead();
+    }
+
+    return NULL;
+}
+
+//  ---------------------------------------------------------------------------
+//  Starts a thread reading events. Returns 0 or -1 on failure.
+//  ---------------------------------------------------------------------------
+int chardevStart( void )
+{
+    if ( chardev.fd < 0 || chardev.running ) return -1;
+
+    chardev.stop = eventfd( 0, EFD_CLOEXEC );
+    if ( chardev.stop < 0 ) return -1;
+
+    if ( pthread_create( &chardev.thread, NULL, chardevThread, NULL ) != 0 )
+    {
+        close( chardev.stop );
+        chardev.stop = -1;
+        return -1;
+    }
+    chardev.running = true;
+
+    return 0;
+}
+
+//  ---------------------------------------------------------------------------
+//  Stops the thread, releases the lines and removes the encoders.
+//  ---------------------------------------------------------------------------
+void chardevClose( void )
+{
+    uint64_t signal = 1;
+
+    if ( chardev.running )
+    {
+        if ( write( chardev.stop, &signal, sizeof( signal )) > 0 )
+            pthread_join( chardev.thread, NULL );
+        chardev.running = false;
+    }
+    if ( chardev.stop >= 0 ) close( chardev.stop );
+    if ( chardev.fd >= 0 ) close( chardev.fd );
+    chardev.stop     = -1;
+    chardev.fd       = -1;
+    chardev.encoders = 0;
+    chardev.lines    = 0;
+}
+
+//  ---------------------------------------------------------------------------
+//  Initialises encoder and button on a GPIO chip instead of wiringPi.
+//  ---------------------------------------------------------------------------
+int encoderInitChardev( const char *chip, uint8_t gpioA, uint8_t gpioB,
+                        uint8_t gpioC, uint32_t debounce )
+{
+    // Open event queue before any edges.
+    if ( encoderOpen( &encoder ) < 0 ) return -1;
+
+    encoder.gpioA       = gpioA;
+    encoder.gpioB       = gpioB;
+    encoder.gpioC       = gpioC;
+    encoder.direction   = 0;
+    encoder.buttonState = 0;
+
+    if ( chardevAdd( &encoder ) < 0 ) return -1;
+    if ( chardevOpen( chip, debounce ) < 0 ) return -1;
+
+    return chardevStart();
+}
@@ -0,0 +1,407 @@
+/*
+//  ===========================================================================
+
+    stressrotencPi:
+
+    Stress test for the rotary encoder event queue.
+
+    Copyright 2015 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+//  ===========================================================================
+
+    Compilation:
+
+        gcc stressrotencPi.c rotencPi.c rotencPi-chardev.c -Wall
+            -o stressrotencPi -lwiringPi -lpthread
+
+    Doesn't need an encoder. Edges are injected with encoderEdge from a
+    thread at 10k edges/s, in FULL mode, as a fast spin back and forth with
+    button presses. Every detent and press must be read in order, first
+    from the queue by blocking on the eventfd and then by callback.
+
+    Then ENCODERS encoders are spun together through a mock GPIO chip, a
+    pipe of gpio_v2_line_event records, at 10k edges/s in all, serviced
+    by the one chardev thread. Events are read from each encoder's queue
+    as its eventfd signals, and the latency from writing each edge to
+    reading its detent is given for each encoder.
+
+    Returns 0 if nothing was lost.
+
+//  ---------------------------------------------------------------------------
+
+    Authors:        D.Faulke    11/12/2015
+
+//  ---------------------------------------------------------------------------
+*/
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <linux/gpio.h>
+
+#include "rotencPi.h"
+#include "rotencPi-chardev.h"
+
+#define EDGE_RATE   10000   // Edges per second.
+#define SECONDS     2       // Length of each run.
+#define SPIN        25      // Detents each way.
+#define PRESS_EVERY 100     // Detents between button presses.
+#define ENCODERS    8       // Encoders spun together.
+
+
+//  Data structures -----------------------------------------------------------
+
+// AB codes ( B << 1 | A ) for one detent each way in FULL mode, from rest.
+static const uint8_t detentPlus[4]  = { 2, 0, 1, 3 };
+static const uint8_t detentMinus[4] = { 1, 0, 2, 3 };
+
+struct runStruct
+{
+    uint32_t detents;   // Detents injected.
+    uint32_t presses;   // Button presses injected.
+    bool     done;      // Injection finished.
+    uint32_t received;  // Events received.
+    uint32_t wrong;     // Events out of order or of wrong value.
+    uint64_t latency;   // Longest time from edge to read (nS).
+    uint64_t last;      // Time of last event received.
+} run;
+
+// Encoders spun together, on a mock chip.
+struct multiStruct
+{
+    struct encoderStruct *encoder[ENCODERS];
+    int      mock[2];               // Pipe, read end is the line request.
+    uint32_t detents[ENCODERS];     // Detents injected.
+    uint32_t received[ENCODERS];    // Detents received.
+    uint32_t wrong[ENCODERS];       // Detents of wrong direction.
+    bool     done;                  // Injection finished.
+} multi;
+
+
+//  Functions -----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Returns the time now (nS, CLOCK_MONOTONIC).
+//  ---------------------------------------------------------------------------
+static uint64_t timeNow( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the event expected as event n, or false for the end of the run.
+//  ---------------------------------------------------------------------------
+/*
+    The injector presses the button after every PRESS_EVERY detents, so
+    the nth event is found by counting back out the presses.
+*/
+static void expected( uint32_t n, enum eventType_t *type, int8_t *value )
+{
+    uint32_t detent = n - n / ( PRESS_EVERY + 1 );
+
+    if (( n + 1 ) % ( PRESS_EVERY + 1 ) == 0 )
+    {
+        *type  = EVENT_BUTTON;
+        *value = ( n / ( PRESS_EVERY + 1 )) % 2 == 0;
+    }
+    else
+    {
+        *type  = EVENT_DETENT;
+        *value = ( detent / SPIN ) % 2 == 0 ? 1 : -1;
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Checks an event against the expected sequence.
+//  ---------------------------------------------------------------------------
+static void check( const struct encoderEventStruct *event )
+{
+    enum eventType_t type;
+    int8_t value;
+    uint64_t latency = timeNow() - event->time;
+
+    expected( run.received, &type, &value );
+    if ( event->type != type || event->value != value ||
+         event->time < run.last )
+        run.wrong++;
+
+    if ( latency > run.latency ) run.latency = latency;
+    run.last = event->time;
+    run.received++;
+}
+
+//  ---------------------------------------------------------------------------
+//  Callback for events.
+//  ---------------------------------------------------------------------------
+static void callback( const struct encoderEventStruct *event, void *data )
+{
+    (void) data;
+    check( event );
+}
+
+//  ---------------------------------------------------------------------------
+//  Injects edges at EDGE_RATE for SECONDS.
+//  ---------------------------------------------------------------------------
+static void *inject( void *data )
+{
+    struct timespec next;
+    const uint8_t *codes;
+    uint32_t edge;
+
+    (void) data;
+    clock_gettime( CLOCK_MONOTONIC, &next );
+
+    for ( edge = 0; edge < EDGE_RATE * SECONDS; edge++ )
+    {
+        codes = ( run.detents / SPIN ) % 2 == 0 ? detentPlus : detentMinus;
+        encoderEdge( &encoder, codes[ edge % 4 ] & 1, codes[ edge % 4 ] >> 1,
+                     timeNow() );
+
+        if ( edge % 4 == 3 )
+        {
+            run.detents++;
+            if ( run.detents % PRESS_EVERY == 0 )
+            {
+                buttonEdge( &encoder, false, timeNow() );
+                run.presses++;
+            }
+        }
+
+        next.tv_nsec += 1000000000 / EDGE_RATE;
+        if ( next.tv_nsec >= 1000000000 )
+        {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL );
+    }
+
+    __atomic_store_n( &run.done, true, __ATOMIC_RELEASE );
+
+    return NULL;
+}
+
+//  ---------------------------------------------------------------------------
+//  Prints the results of a run. Returns true if nothing was lost.
+//  ---------------------------------------------------------------------------
+static bool report( const char *name, uint32_t dropped )
+{
+    bool passed = run.received == run.detents + run.presses &&
+                  run.wrong == 0 && dropped == 0;
+
+    printf( "%-8s %6u detents %4u presses %6u received %4u wrong "
+            "%4u dropped %6.1fuS max latency: %s\n",
+            name, run.detents, run.presses, run.received, run.wrong,
+            dropped, run.latency / 1000.0, passed ? "passed" : "FAILED" );
+
+    return passed;
+}
+
+//  ---------------------------------------------------------------------------
+//  Starts a run, resetting decoder and button.
+//  ---------------------------------------------------------------------------
+static void start( pthread_t *thread )
+{
+    memset( &run, 0, sizeof( run ));
+    encoder.buttonState = 0;
+    pthread_create( thread, NULL, inject, NULL );
+}
+
+
+//  ---------------------------------------------------------------------------
+//  Spins all encoders on the mock chip, an edge of each in turn.
+//  ---------------------------------------------------------------------------
+/*
+    Each edge is written as it happens, stamped with the time it is
+    written, as the kernel would pass it on.
+*/
+static void *injectMulti( void *data )
+{
+    struct gpio_v2_line_event event;
+    struct timespec next;
+    const uint8_t *codes;
+    uint8_t  previous[ENCODERS], changed, code, e;
+    uint32_t edge, step;
+
+    (void) data;
+    memset( previous, 3, sizeof( previous ));
+    clock_gettime( CLOCK_MONOTONIC, &next );
+
+    for ( edge = 0; edge < EDGE_RATE * SECONDS; edge++ )
+    {
+        e     = edge % ENCODERS;
+        step  = edge / ENCODERS;
+        codes = ( multi.detents[e] / SPIN ) % 2 == 0 ? detentPlus
+                                                     : detentMinus;
+        code    = codes[ step % 4 ];
+        changed = code ^ previous[e];
+        previous[e] = code;
+
+        memset( &event, 0, sizeof( event ));
+        event.timestamp_ns = timeNow();
+        event.offset = ( changed & 1 ) ? multi.encoder[e]->gpioA
+                                       : multi.encoder[e]->gpioB;
+        event.id     = ( code & changed ) ? GPIO_V2_LINE_EVENT_RISING_EDGE
+                                          : GPIO_V2_LINE_EVENT_FALLING_EDGE;
+        event.seqno  = edge + 1;
+        if ( write( multi.mock[1], &event, sizeof( event )) < 0 ) break;
+
+        if ( step % 4 == 3 ) multi.detents[e]++;
+
+        next.tv_nsec += 1000000000 / EDGE_RATE;
+        if ( next.tv_nsec >= 1000000000 )
+        {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL );
+    }
+
+    __atomic_store_n( &multi.done, true, __ATOMIC_RELEASE );
+
+    return NULL;
+}
+
+//  ---------------------------------------------------------------------------
+//  Reads and checks the events of an encoder.
+//  ---------------------------------------------------------------------------
+static void readMulti( uint8_t e )
+{
+    struct encoderEventStruct event;
+    int8_t direction;
+
+    while ( encoderRead( multi.encoder[e], &event ))
+    {
+        direction = ( multi.received[e] / SPIN ) % 2 == 0 ? 1 : -1;
+        if ( event.type != EVENT_DETENT || event.value != direction )
+            multi.wrong[e]++;
+        multi.received[e]++;
+    }
+}
+
+//  ---------------------------------------------------------------------------
+//  Spins ENCODERS encoders together. Returns true if nothing was lost.
+//  ---------------------------------------------------------------------------
+static bool spinMulti( void )
+{
+    struct encoderLatencyStruct latency;
+    struct pollfd pollers[ENCODERS];
+    pthread_t thread;
+    bool passed, ok;
+    uint8_t e;
+
+    memset( &multi, 0, sizeof( multi ));
+    if ( pipe( multi.mock ) < 0 ) return false;
+
+    // Encoder e on GPIOs 2e + 2 and 2e + 3.
+    for ( e = 0; e < ENCODERS; e++ )
+    {
+        multi.encoder[e] = encoderCreate( 2 * e + 2, 2 * e + 3, 0xFF, FULL );
+        if ( !multi.encoder[e] ) return false;
+        chardevAdd( multi.encoder[e] );
+        pollers[e].fd     = multi.encoder[e]->queue.fd;
+        pollers[e].events = POLLIN;
+    }
+    chardevAttach( multi.mock[0] );
+    if ( chardevStart() < 0 ) return false;
+
+    pthread_create( &thread, NULL, injectMulti, NULL );
+    while ( !__atomic_load_n( &multi.done, __ATOMIC_ACQUIRE ))
+    {
+        if ( poll( pollers, ENCODERS, 100 ) < 0 ) break;
+        for ( e = 0; e < ENCODERS; e++ )
+        {
+            if ( !pollers[e].revents ) continue;
+            encoderWait( multi.encoder[e], 0 );
+            readMulti( e );
+        }
+    }
+    pthread_join( thread, NULL );
+
+    // Let the chardev thread finish the pipe.
+    close( multi.mock[1] );
+    usleep( 100000 );
+    chardevClose();
+
+    printf( "%-8s %7s %8s %6s %7s %10s %10s\n", "encoder",
+            "detents", "received", "wrong", "dropped", "mean (uS)", "max (uS)" );
+    passed = ( chardev.lost == 0 );
+    for ( e = 0; e < ENCODERS; e++ )
+    {
+        readMulti( e );
+        encoderLatency( multi.encoder[e], &latency );
+        ok = multi.received[e] == multi.detents[e] && multi.wrong[e] == 0 &&
+             encoderDropped( multi.encoder[e] ) == 0;
+        printf( "%-8u %7u %8u %6u %7u %10.1f %10.1f: %s\n", e,
+                multi.detents[e], multi.received[e], multi.wrong[e],
+                encoderDropped( multi.encoder[e] ),
+                latency.count ? latency.total / 1000.0 / latency.count : 0,
+                latency.max / 1000.0, ok ? "passed" : "FAILED" );
+        passed = passed && ok;
+        encoderDestroy( multi.encoder[e] );
+    }
+
+    return passed;
+}
+
+
+//  Main section. -------------------------------------------------------------
+
+int main( void )
+{
+    struct encoderEventStruct event;
+    pthread_t thread;
+    bool passed;
+
+    encoder.mode = FULL;
+    if ( encoderOpen( &encoder ) < 0 )
+    {
+        printf( "Couldn't open event queue.\n" );
+        return -1;
+    }
+
+    // Queue, blocking on the eventfd.
+    start( &thread );
+    while ( !__atomic_load_n( &run.done, __ATOMIC_ACQUIRE ))
+    {
+        if ( encoderWait( &encoder, 100 ) < 0 ) break;
+        while ( encoderRead( &encoder, &event )) check( &event );
+    }
+    pthread_join( thread, NULL );
+    while ( encoderRead( &encoder, &event )) check( &event );
+    passed = report( "queue", encoderDropped( &encoder ) );
+
+    // Callback.
+    encoderCallback( &encoder, callback, NULL );
+    start( &thread );
+    pthread_join( thread, NULL );
+    encoderCallback( &encoder, NULL, NULL );
+    passed = report( "callback", 0 ) && passed;
+
+    // Encoders together on a mock chip.
+    passed = spinMulti() && passed;
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+/*
+//  ===========================================================================
+
+    testrotencPi-accel:
+
+    Tests encoder acceleration.
+
+    Copyright 2015 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+//  ===========================================================================
+
+    Compilation:
+
+        gcc testrotencPi-accel.c rotencPi-accel.c -Wall
+            -o testrotencPi-accel -lm
+
+    Returns 0 if all tests pass.
+
+//  ---------------------------------------------------------------------------
+
+    Authors:        D.Faulke    12/12/2015
+
+//  ---------------------------------------------------------------------------
+*/
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "rotencPi-accel.h"
+
+static int failures = 0;
+
+
+//  Functions -----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Prints the result of a test.
+//  ---------------------------------------------------------------------------
+static void testResult( const char *name, bool passed )
+{
+    printf( "%-40s %s\n", name, passed ? "passed" : "FAILED" );
+    if ( !passed ) failures++;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns total steps of detents at a fixed gap (mS), from time (S).
+//  ---------------------------------------------------------------------------
+static int spin( struct accelStruct *accel, double time, uint32_t detents,
+                 double gap, int8_t direction )
+{
+    int steps = 0;
+    uint32_t i;
+
+    for ( i = 0; i < detents; i++ )
+        steps += accelDetent( accel, ( time + i * gap / 1000 ) * 1e9,
+                              direction );
+
+    return steps;
+}
+
+
+//  Tests ---------------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Curves are parsed, checked and interpolated.
+//  ---------------------------------------------------------------------------
+static void testCurve( void )
+{
+    struct accelStruct accel;
+    bool passed;
+
+    passed = accelInit( &accel, ACCEL_CURVE ) && accel.points == 4;
+    passed = passed && accelMultiplier( &accel, 0 ) == 1 &&
+             accelMultiplier( &accel, 10 ) == 1.5 &&
+             accelMultiplier( &accel, 40 ) == 7.5 &&
+             accelMultiplier( &accel, 100 ) == 10;
+    passed = passed && !accelInit( &accel, "10:1,5:2" ) &&
+             !accelInit( &accel, "10:0" ) && !accelInit( &accel, "10" ) &&
+             !accelInit( &accel, "" ) && !accelInit( &accel, "10:1,x" ) &&
+             accel.points == 4;
+    testResult( "Curves", passed );
+}
+
+//  ---------------------------------------------------------------------------
+//  Slow turns are single steps, fast spins are multiplied.
+//  ---------------------------------------------------------------------------
+static void testRate( void )
+{
+    struct accelStruct accel;
+    bool passed;
+
+    accelInit( &accel, ACCEL_CURVE );
+
+    // 4 detents/s.
+    passed = spin( &accel, 1, 10, 250, 1 ) == 10;
+    testResult( "Slow turn", passed );
+
+    // 100 detents/s settles near the rate and the top of the curve.
+    passed = spin( &accel, 10, 100, 10, 1 ) > 800 &&
+             fabsf( accel.rate - 100 ) < 1 && accel.multiplier == 10;
+    testResult( "Fast spin", passed );
+}
+
+//  ---------------------------------------------------------------------------
+//  Rate starts from rest after a gap or a change of direction.
+//  ---------------------------------------------------------------------------
+static void testRest( void )
+{
+    struct accelStruct accel;
+    bool passed;
+
+    accelInit( &accel, ACCEL_CURVE );
+
+    spin( &accel, 1, 50, 10, 1 );
+    passed = accelDetent( &accel, 1.5e9, -1 ) == -1 && accel.rate == 0;
+    spin( &accel, 2, 50, 10, 1 );
+    passed = passed && accelDetent( &accel, 3.5e9, 1 ) == 1 &&
+             accel.rate == 0;
+    testResult( "Rest after gap or reversal", passed );
+}
+
+//  ---------------------------------------------------------------------------
+//  Fractions of steps are carried.
+//  ---------------------------------------------------------------------------
+static void testFraction( void )
+{
+    struct accelStruct accel;
+
+    // Flat curve of 1.5x.
+    accelInit( &accel, "0:1.5" );
+    testResult( "Fractions carried", spin( &accel, 1, 10, 100, 1 ) == 15 );
+}
+
+
+//  Main section. -------------------------------------------------------------
+
+int main( void )
+{
+    testCurve();
+    testRate();
+    testRest();
+    testFraction();
+
+    return failures ? 1 : 0;
+}
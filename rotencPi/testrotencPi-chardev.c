@@ -0,0 +1,380 @@
+/*
+//  ===========================================================================
+
+    testrotencPi-chardev:
+
+    Tests the GPIO character device backend against a mock chip.
+
+    Copyright 2015 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+//  ===========================================================================
+
+    Compilation:
+
+        gcc testrotencPi-chardev.c rotencPi-chardev.c rotencPi.c -Wall
+            -o testrotencPi-chardev -lwiringPi -lpthread
+
+    Doesn't need an encoder or a GPIO chip. The mock chip is a pipe that
+    gpio_v2_line_event records are written to, numbered and stamped as
+    the kernel would, and the backend is attached to its other end.
+
+    Returns 0 if all tests pass.
+
+//  ---------------------------------------------------------------------------
+
+    Authors:        D.Faulke    12/12/2015
+
+//  ---------------------------------------------------------------------------
+*/
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <linux/gpio.h>
+
+#include "rotencPi.h"
+#include "rotencPi-chardev.h"
+
+#define GPIO_A      23  // Encoder offsets on mock chip.
+#define GPIO_B      24
+#define GPIO_C      25  // Button offset on mock chip.
+#define GPIO_A2     5   // Second encoder offsets on mock chip.
+#define GPIO_B2     6
+#define DETENTS     1000
+
+
+//  Data structures -----------------------------------------------------------
+
+// Mock chip.
+struct mockStruct
+{
+    int      fd[2];     // Pipe, read end is the line request.
+    uint32_t seqno;     // Last sequence number.
+    uint64_t time;      // Last timestamp (nS).
+} mock;
+
+static int failures = 0;
+
+
+//  Functions -----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Prints the result of a test.
+//  ---------------------------------------------------------------------------
+static void testResult( const char *name, bool passed )
+{
+    printf( "%-40s %s\n", name, passed ? "passed" : "FAILED" );
+    if ( !passed ) failures++;
+}
+
+//  ---------------------------------------------------------------------------
+//  Opens the mock chip and attaches the backend, all lines high.
+//  ---------------------------------------------------------------------------
+/*
+    Adds the encoder global and a second encoder, if not NULL.
+*/
+static void mockOpen( enum decode_t mode, struct encoderStruct *second )
+{
+    struct encoderEventStruct event;
+
+    if ( pipe( mock.fd ) < 0 ) return;
+    mock.seqno = 0;
+    mock.time  = 1000000;
+
+    encoder.mode  = mode;
+    encoder.gpioA = GPIO_A;
+    encoder.gpioB = GPIO_B;
+    encoder.gpioC = GPIO_C;
+    encoder.buttonState = 0;
+    chardevAdd( &encoder );
+    if ( second ) chardevAdd( second );
+    chardevAttach( mock.fd[0] );
+    while ( encoderRead( &encoder, &event ));
+}
+
+//  ---------------------------------------------------------------------------
+//  Closes the mock chip.
+//  ---------------------------------------------------------------------------
+static void mockClose( void )
+{
+    close( mock.fd[1] );
+    chardevClose();
+}
+
+//  ---------------------------------------------------------------------------
+//  Sets an edge record, 100uS after the last. skip drops edges before it.
+//  ---------------------------------------------------------------------------
+static void mockEdge( struct gpio_v2_line_event *event, uint32_t offset,
+                      bool rising, uint32_t skip )
+{
+    memset( event, 0, sizeof( *event ));
+    mock.seqno += 1 + skip;
+    mock.time  += 100000;
+    event->timestamp_ns = mock.time;
+    event->id     = rising ? GPIO_V2_LINE_EVENT_RISING_EDGE
+                           : GPIO_V2_LINE_EVENT_FALLING_EDGE;
+    event->offset = offset;
+    event->seqno  = mock.seqno;
+}
+
+//  ---------------------------------------------------------------------------
+//  Sets the four edge records of a detent, from rest with A & B high.
+//  ---------------------------------------------------------------------------
+/*
+    +ve in FULL mode is A falling, B falling, A rising then B rising.
+*/
+static void mockDetentOn( struct gpio_v2_line_event *events, uint32_t a,
+                          uint32_t b, int8_t direction )
+{
+    uint32_t first  = direction > 0 ? a : b;
+    uint32_t second = direction > 0 ? b : a;
+
+    mockEdge( &events[0], first,  false, 0 );
+    mockEdge( &events[1], second, false, 0 );
+    mockEdge( &events[2], first,  true,  0 );
+    mockEdge( &events[3], second, true,  0 );
+}
+
+//  ---------------------------------------------------------------------------
+//  Sets the four edge records of a detent of the encoder global.
+//  ---------------------------------------------------------------------------
+static void mockDetent( struct gpio_v2_line_event *events, int8_t direction )
+{
+    mockDetentOn( events, GPIO_A, GPIO_B, direction );
+}
+
+//  ---------------------------------------------------------------------------
+//  Writes records to the mock chip in one write.
+//  ---------------------------------------------------------------------------
+static bool mockWrite( const struct gpio_v2_line_event *events, int count )
+{
+    ssize_t bytes = count * sizeof( struct gpio_v2_line_event );
+
+    return write( mock.fd[1], events, bytes ) == bytes;
+}
+
+//  ---------------------------------------------------------------------------
+//  Writes DETENTS detents, alternating direction every 10.
+//  ---------------------------------------------------------------------------
+/*
+    Paced at 40k edges/s, faster than any encoder, as an unpaced writer
+    would only test the size of the event queue.
+*/
+static void *mockSpin( void *data )
+{
+    struct gpio_v2_line_event events[4];
+    uint32_t detent;
+
+    (void) data;
+    for ( detent = 0; detent < DETENTS; detent++ )
+    {
+        mockDetent( events, ( detent / 10 ) % 2 ? -1 : 1 );
+        if ( !mockWrite( events, 4 )) break;
+        if ( detent % 10 == 9 ) usleep( 1000 );
+    }
+
+    return NULL;
+}
+
+//  ---------------------------------------------------------------------------
+//  Checks the directions and timestamps of spun detents.
+//  ---------------------------------------------------------------------------
+static bool checkSpin( struct encoderEventStruct *event, uint32_t detent )
+{
+    int8_t direction = ( detent / 10 ) % 2 ? -1 : 1;
+
+    // Stamped with the time of the detent's last edge.
+    return event->type == EVENT_DETENT && event->value == direction &&
+           event->time == 1000000 + ( detent + 1 ) * 4 * 100000ULL;
+}
+
+
+//  Tests ---------------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  A detent in one batch, decoded from edges rather than readings.
+//  ---------------------------------------------------------------------------
+static void testBatch( void )
+{
+    struct gpio_v2_line_event events[8];
+    struct encoderEventStruct event;
+    bool passed;
+
+    mockOpen( FULL, NULL );
+    mockDetent( events, 1 );
+    mockDetent( events + 4, -1 );
+    mockWrite( events, 8 );
+
+    passed = ( chardevRead() == 8 );
+    passed = passed && encoderRead( &encoder, &event ) && event.value == 1 &&
+             event.time == events[3].timestamp_ns;
+    passed = passed && encoderRead( &encoder, &event ) && event.value == -1 &&
+             event.time == events[7].timestamp_ns;
+    passed = passed && !encoderRead( &encoder, &event ) &&
+             chardev.edges == 8 && encoder.line[LINE_A].level &&
+             encoder.line[LINE_B].level;
+    testResult( "Batch of two detents", passed );
+
+    mockClose();
+}
+
+//  ---------------------------------------------------------------------------
+//  SIMPLE_1 decodes rising edges of A with B's level from the stream.
+//  ---------------------------------------------------------------------------
+static void testSimple( void )
+{
+    struct gpio_v2_line_event events[8];
+    struct encoderEventStruct event;
+    bool passed;
+
+    mockOpen( SIMPLE_1, NULL );
+    mockDetent( events, 1 );
+    mockDetent( events + 4, -1 );
+    mockWrite( events, 8 );
+    chardevRead();
+
+    passed = encoderRead( &encoder, &event ) && event.value == 1 &&
+             event.time == events[2].timestamp_ns;
+    passed = passed && encoderRead( &encoder, &event ) && event.value == -1 &&
+             event.time == events[7].timestamp_ns;
+    passed = passed && !encoderRead( &encoder, &event );
+    testResult( "SIMPLE_1 on rising edges of A", passed );
+
+    mockClose();
+}
+
+//  ---------------------------------------------------------------------------
+//  Button presses on falling edges, and edges lost by the kernel.
+//  ---------------------------------------------------------------------------
+static void testButton( void )
+{
+    struct gpio_v2_line_event events[4];
+    struct encoderEventStruct event;
+    bool passed;
+
+    mockOpen( FULL, NULL );
+    mockEdge( &events[0], GPIO_C, false, 0 );
+    mockEdge( &events[1], GPIO_C, true,  0 );
+    mockEdge( &events[2], GPIO_C, false, 3 );
+    mockEdge( &events[3], GPIO_C, true,  0 );
+    mockWrite( events, 4 );
+    chardevRead();
+
+    passed = encoderRead( &encoder, &event ) && event.type == EVENT_BUTTON &&
+             event.value == 1 && event.time == events[0].timestamp_ns;
+    passed = passed && encoderRead( &encoder, &event ) && event.value == 0;
+    passed = passed && !encoderRead( &encoder, &event ) && chardev.lost == 3;
+    testResult( "Button presses and lost edges", passed );
+
+    mockClose();
+}
+
+//  ---------------------------------------------------------------------------
+//  A fast spin through the backend's thread, waiting on the queue.
+//  ---------------------------------------------------------------------------
+static void testThread( void )
+{
+    struct encoderEventStruct event;
+    pthread_t thread;
+    uint32_t detent = 0;
+    bool passed = true;
+
+    mockOpen( FULL, NULL );
+    chardevStart();
+    pthread_create( &thread, NULL, mockSpin, NULL );
+
+    while ( detent < DETENTS && encoderWait( &encoder, 1000 ) > 0 )
+        while ( encoderRead( &encoder, &event ))
+            passed = checkSpin( &event, detent++ ) && passed;
+
+    pthread_join( thread, NULL );
+    passed = passed && detent == DETENTS && chardev.lost == 0 &&
+             encoderDropped( &encoder ) == 0;
+    testResult( "Spin read by thread", passed );
+
+    mockClose();
+}
+
+
+//  ---------------------------------------------------------------------------
+//  Two encoders' edges interleaved in one stream, each to its own queue.
+//  ---------------------------------------------------------------------------
+static void testTwo( void )
+{
+    struct gpio_v2_line_event one[4], two[4], events[8];
+    struct encoderEventStruct event;
+    struct encoderStruct *second;
+    bool passed;
+    int i;
+
+    second = encoderCreate( GPIO_A2, GPIO_B2, 0xFF, HALF );
+    if ( !second )
+    {
+        testResult( "Two encoders", false );
+        return;
+    }
+
+    mockOpen( FULL, second );
+    mockDetentOn( one, GPIO_A, GPIO_B, 1 );
+    mockDetentOn( two, GPIO_A2, GPIO_B2, -1 );
+
+    // Number edges in the order they are interleaved.
+    mock.seqno = 0;
+    for ( i = 0; i < 4; i++ )
+    {
+        events[2 * i]     = one[i];
+        events[2 * i + 1] = two[i];
+        events[2 * i].seqno     = ++mock.seqno;
+        events[2 * i + 1].seqno = ++mock.seqno;
+    }
+    mockWrite( events, 8 );
+    chardevRead();
+
+    // HALF gives a detent at both the half and the full step.
+    passed = encoderRead( &encoder, &event ) && event.value == 1 &&
+             !encoderRead( &encoder, &event );
+    passed = passed && encoderRead( second, &event ) && event.value == -1 &&
+             encoderRead( second, &event ) && event.value == -1 &&
+             !encoderRead( second, &event ) && chardev.lost == 0;
+    testResult( "Two encoders", passed );
+
+    mockClose();
+    encoderDestroy( second );
+}
+
+
+//  Main section. -------------------------------------------------------------
+
+int main( void )
+{
+    if ( encoderOpen( &encoder ) < 0 )
+    {
+        printf( "Couldn't open event queue.\n" );
+        return -1;
+    }
+
+    testBatch();
+    testSimple();
+    testButton();
+    testThread();
+    testTwo();
+
+    return failures ? 1 : 0;
+}
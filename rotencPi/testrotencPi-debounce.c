@@ -0,0 +1,489 @@
+/*
+//  ===========================================================================
+
+    testrotencPi-debounce:
+
+    Tests software debounce of timestamped edges.
+
+    Copyright 2015 Darren Faulke <darren@alidaf.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+//  ===========================================================================
+
+    Compilation:
+
+        gcc testrotencPi-debounce.c rotencPi.c -Wall
+            -o testrotencPi-debounce -lpthread
+
+    wiringPi is stubbed here, so pins can be set and interrupts run
+    without a Pi. Returns 0 if all tests pass.
+
+//  ---------------------------------------------------------------------------
+
+    Authors:        D.Faulke    12/12/2015
+
+//  ---------------------------------------------------------------------------
+*/
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <wiringPi.h>
+
+#include "rotencPi.h"
+
+// Edges start 1S in, so a lockout from time 0 has passed.
+#define START 1000000000ULL
+
+static int failures = 0;
+
+// Samples returned by the fake sampler, in turn.
+static struct
+{
+    int     level[8];
+    uint8_t next;
+} samples;
+
+// Stub wiringPi pins.
+#define PINS 32
+static struct
+{
+    bool level[PINS];
+    int  edge[PINS];
+    void ( *isr[PINS] )( void );
+} pins;
+
+
+//  Functions -----------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Prints the result of a test.
+//  ---------------------------------------------------------------------------
+static void testResult( const char *name, bool passed )
+{
+    printf( "%-40s %s\n", name, passed ? "passed" : "FAILED" );
+    if ( !passed ) failures++;
+}
+
+//  ---------------------------------------------------------------------------
+//  Passes an edge at time (uS), with the line's next edge or 0.
+//  ---------------------------------------------------------------------------
+static void edge( struct encoderStruct *enc, enum encoderLine_t line,
+                  bool level, uint32_t time, uint32_t next )
+{
+    encoderLineEdge( enc, line, level, START + time * 1000ULL,
+                     next ? START + next * 1000ULL : 0 );
+}
+
+//  ---------------------------------------------------------------------------
+//  Passes an edge at time (uS) followed by a bounce back and forth.
+//  ---------------------------------------------------------------------------
+static void bounce( struct encoderStruct *enc, enum encoderLine_t line,
+                    bool level, uint32_t time )
+{
+    edge( enc, line, level,  time,       0 );
+    edge( enc, line, !level, time + 50,  0 );
+    edge( enc, line, level,  time + 100, 0 );
+}
+
+//  ---------------------------------------------------------------------------
+//  Reads all queued events. Returns detents, adding up their directions.
+//  ---------------------------------------------------------------------------
+static int drain( struct encoderStruct *enc, int *total, int *presses,
+                  uint64_t *last )
+{
+    struct encoderEventStruct event;
+    int detents = 0;
+
+    *total = 0;
+    *presses = 0;
+    while ( encoderRead( enc, &event ))
+    {
+        if ( event.type == EVENT_BUTTON )
+            ( *presses )++;
+        else
+        {
+            detents++;
+            *total += event.value;
+        }
+        *last = event.time;
+    }
+
+    return detents;
+}
+
+//  ---------------------------------------------------------------------------
+//  Returns the next fake sample.
+//  ---------------------------------------------------------------------------
+static int sampleFake( struct encoderStruct *enc, enum encoderLine_t line )
+{
+    (void) enc;
+    (void) line;
+
+    return samples.level[ samples.next++ & 7 ];
+}
+
+
+//  wiringPi stubs ------------------------------------------------------------
+
+int wiringPiSetupGpio( void ) { return 0; }
+void pinMode( int pin, int mode ) { (void) pin; (void) mode; }
+void pullUpDnControl( int pin, int pud ) { pins.level[pin] = ( pud == PUD_UP ); }
+int digitalRead( int pin ) { return pins.level[pin]; }
+
+int wiringPiISR( int pin, int edge, void ( *isr )( void ))
+{
+    pins.edge[pin] = edge;
+    pins.isr[pin]  = isr;
+    return 0;
+}
+
+//  ---------------------------------------------------------------------------
+//  Sets a pin and runs its interrupt routine if it is registered for the edge.
+//  ---------------------------------------------------------------------------
+static void pinSet( int pin, bool level )
+{
+    if ( pins.level[pin] == level ) return;
+    pins.level[pin] = level;
+
+    if ( !pins.isr[pin] ) return;
+    if ( pins.edge[pin] == INT_EDGE_BOTH ||
+       ( pins.edge[pin] == INT_EDGE_RISING && level ) ||
+       ( pins.edge[pin] == INT_EDGE_FALLING && !level ))
+        pins.isr[pin]();
+}
+
+//  ---------------------------------------------------------------------------
+//  Initialises the encoder global on stub pins. Returns detents of cycles.
+//  ---------------------------------------------------------------------------
+/*
+    +ve is A falling, B falling, A rising then B rising. Edges are at
+    least gap uS apart.
+*/
+static int pinSpin( enum decode_t mode, int cycles, uint32_t gap, int *total )
+{
+    uint64_t last = 0;
+    int presses, i, j;
+
+    pins = ( typeof( pins )){ { 0 }, { 0 }, { NULL } };
+    encoder.mode = mode;
+    encoderInit( 5, 6, 0xFF );
+
+    for ( i = 0; i < cycles; i++ )
+        for ( j = 0; j < 4; j++ )
+        {
+            if ( gap ) usleep( gap );
+            pinSet( j & 1 ? 6 : 5, j > 1 );
+        }
+
+    return drain( &encoder, total, &presses, &last );
+}
+
+
+//  Tests ---------------------------------------------------------------------
+
+//  ---------------------------------------------------------------------------
+//  Clean edges pass straight through at their own times.
+//  ---------------------------------------------------------------------------
+static void testClean( void )
+{
+    struct encoderStruct *enc = encoderCreate( 0, 1, 0xFF, FULL );
+    uint64_t last = 0;
+    int total, presses;
+    bool passed;
+
+    encoderDebounce( enc, 500, 0, 1 );
+    edge( enc, LINE_A, false, 1000, 0 );
+    edge( enc, LINE_B, false, 2000, 0 );
+    edge( enc, LINE_A, true,  3000, 0 );
+    edge( enc, LINE_B, true,  4000, 0 );
+
+    passed = ( drain( enc, &total, &presses, &last ) == 1 ) && total == 1 &&
+             last == START + 4000000 && encoderRejected( enc, LINE_A ) == 0 &&
+             encoderRejected( enc, LINE_B ) == 0 && encoderDue( enc ) == 0;
+    testResult( "Clean edges at their own time", passed );
+
+    encoderDestroy( enc );
+}
+
+//  ---------------------------------------------------------------------------
+//  Bounces within the width are rejected and the detent still decodes.
+//  ---------------------------------------------------------------------------
+static void testChatter( void )
+{
+    struct encoderStruct *enc = encoderCreate( 0, 1, 0xFF, FULL );
+    uint64_t last = 0;
+    int total, presses;
+    bool passed;
+
+    encoderDebounce( enc, 500, 0, 1 );
+    bounce( enc, LINE_B, false, 1000 );
+    bounce( enc, LINE_A, false, 2000 );
+    bounce( enc, LINE_B, true,  3000 );
+    bounce( enc, LINE_A, true,  4000 );
+
+    passed = ( drain( enc, &total, &presses, &last ) == 1 ) && total == -1 &&
+             last == START + 4000000 && encoderRejected( enc, LINE_A ) == 2 &&
+             encoderRejected( enc, LINE_B ) == 2 && encoderDue( enc ) == 0;
+    testResult( "Chatter within width", passed );
+
+    encoderDestroy( enc );
+}
+
+//  ---------------------------------------------------------------------------
+//  A pulse narrower than the width is dropped when its end is known.
+//  ---------------------------------------------------------------------------
+static void testGlitch( void )
+{
+    struct encoderStruct *enc = encoderCreate( 0, 1, 0xFF, SIMPLE_1 );
+    uint64_t last = 0;
+    int total, presses;
+    bool passed;
+
+    // Without debounce, a rising edge of A is a detent.
+    encoderSetLevel( enc, LINE_A, false );
+    edge( enc, LINE_A, true,  1000, 1200 );
+    edge( enc, LINE_A, false, 1200, 0 );
+    passed = ( drain( enc, &total, &presses, &last ) == 1 );
+
+    encoderDebounce( enc, 500, 0, 1 );
+    edge( enc, LINE_A, true,  2000, 2200 );
+    edge( enc, LINE_A, false, 2200, 0 );
+    passed = passed && ( drain( enc, &total, &presses, &last ) == 0 ) &&
+             encoderRejected( enc, LINE_A ) == 1 && encoderDue( enc ) == 0;
+    testResult( "Glitch dropped by next edge", passed );
+
+    encoderDestroy( enc );
+}
+
+//  ---------------------------------------------------------------------------
+//  A level left by a rejected edge is passed on when due.
+//  ---------------------------------------------------------------------------
+static void testFlush( void )
+{
+    struct encoderStruct *enc = encoderCreate( 0, 1, 0xFF, SIMPLE_1 );
+    uint64_t last = 0;
+    int total, presses;
+    bool passed;
+
+    encoderDebounce( enc, 500, 0, 1 );
+    edge( enc, LINE_A, false, 1000, 0 );
+    edge( enc, LINE_A, true,  1200, 0 );
+
+    passed = ( encoderDue( enc ) == START + 1700000 );
+    encoderFlush( enc, START + 1600000 );
+    passed = passed && ( drain( enc, &total, &presses, &last ) == 0 );
+    encoderFlush( enc, START + 1700000 );
+    passed = passed && ( drain( enc, &total, &presses, &last ) == 1 ) &&
+             last == START + 1700000 && encoderDue( enc ) == 0;
+
+    // A later edge passes it on first.
+    edge( enc, LINE_A, false, 3000, 0 );
+    edge( enc, LINE_A, true,  3200, 0 );
+    edge( enc, LINE_A, false, 5000, 0 );
+    passed = passed && ( drain( enc, &total, &presses, &last ) == 1 ) &&
+             last == START + 3700000;
+    testResult( "Rejected level passed on when due", passed );
+
+    encoderDestroy( enc );
+}
+
+//  ---------------------------------------------------------------------------
+//  A wait with encoderTimeout wakes when a rejected level is due.
+//  ---------------------------------------------------------------------------
+static void testTimeout( void )
+{
+    struct encoderStruct *enc = encoderCreate( 0, 1, 0xFF, SIMPLE_1 );
+    struct timespec now;
+    uint64_t time, last = 0;
+    int total, presses, timeout, ready;
+    bool passed;
+
+    passed = ( encoderTimeout( enc ) == -1 );
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    time = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+    encoderDebounce( enc, 20000, 0, 1 );
+    encoderLineEdge( enc, LINE_A, false, time, 0 );
+    encoderLineEdge( enc, LINE_A, true,  time + 100000, 0 );
+
+    timeout = encoderTimeout( enc );
+    passed  = passed && timeout > 0 && timeout <= 21;
+    ready   = encoderWait( enc, timeout );
+    if ( ready == 0 ) encoderFlush( enc, encoderDue( enc ));
+    passed  = passed && ready == 0 &&
+              ( drain( enc, &total, &presses, &last ) == 1 ) &&
+              last == time + 20100000 && encoderTimeout( enc ) == -1;
+    testResult( "Wait times out when level is due", passed );
+
+    encoderDestroy( enc );
+}
+
+//  ---------------------------------------------------------------------------
+//  Edges within the lockout of an accepted edge are rejected.
+//  ---------------------------------------------------------------------------
+static void testLockout( void )
+{
+    struct encoderStruct *enc = encoderCreate( 0, 1, 2, FULL );
+    uint64_t last = 0;
+    int total, presses;
+    bool passed;
+
+    encoderDebounce( enc, 0, 20000, 1 );
+    edge( enc, LINE_BUTTON, false, 1000,   0 );
+    edge( enc, LINE_BUTTON, true,  6000,   0 );
+    edge( enc, LINE_BUTTON, false, 12000,  0 );
+    edge( enc, LINE_BUTTON, true,  50000,  0 );
+    edge( enc, LINE_BUTTON, false, 100000, 0 );
+
+    passed = ( drain( enc, &total, &presses, &last ) == 0 ) && presses == 2 &&
+             last == START + 100000000 &&
+             encoderRejected( enc, LINE_BUTTON ) == 1;
+    testResult( "Lockout after accepted edge", passed );
+
+    encoderDestroy( enc );
+}
+
+//  ---------------------------------------------------------------------------
+//  A bouncing button press and release toggles once.
+//  ---------------------------------------------------------------------------
+static void testButton( void )
+{
+    struct encoderStruct *enc = encoderCreate( 0, 1, 2, FULL );
+    uint64_t last = 0;
+    int total, presses;
+    bool passed;
+
+    encoderDebounce( enc, 1000, 0, 1 );
+    bounce( enc, LINE_BUTTON, false, 1000 );
+    bounce( enc, LINE_BUTTON, true,  80000 );
+    encoderFlush( enc, START + 200000000 );
+
+    passed = ( drain( enc, &total, &presses, &last ) == 0 ) && presses == 1 &&
+             last == START + 1000000 && enc->buttonState == 1;
+    testResult( "Bouncing button toggles once", passed );
+
+    encoderDestroy( enc );
+}
+
+//  ---------------------------------------------------------------------------
+//  An edge most samples disagree with is rejected.
+//  ---------------------------------------------------------------------------
+static void testMajority( void )
+{
+    struct encoderStruct *enc = encoderCreate( 0, 1, 0xFF, SIMPLE_1 );
+    uint64_t last = 0;
+    int total, presses;
+    bool passed;
+
+    enc->sample = sampleFake;
+    encoderDebounce( enc, 0, 0, 3 );
+    encoderSetLevel( enc, LINE_A, false );
+
+    samples = ( typeof( samples )){ { 0, 1, 0, 1, 1, 0, -1, -1 }, 0 };
+    edge( enc, LINE_A, true, 1000, 0 );
+    passed = ( drain( enc, &total, &presses, &last ) == 0 ) &&
+             encoderRejected( enc, LINE_A ) == 1 && encoderDue( enc ) == 0;
+
+    edge( enc, LINE_A, true, 2000, 0 );
+    passed = passed && ( drain( enc, &total, &presses, &last ) == 1 );
+
+    // Sampling fails, so the edge is taken as it is.
+    samples.next = 6;
+    edge( enc, LINE_A, false, 3000, 0 );
+    edge( enc, LINE_A, true,  4000, 0 );
+    passed = passed && ( drain( enc, &total, &presses, &last ) == 1 ) &&
+             encoderRejected( enc, LINE_A ) == 1;
+    testResult( "Majority of samples", passed );
+
+    encoderDestroy( enc );
+}
+//  ---------------------------------------------------------------------------
+//  Edges read in a batch are only sampled if they are the line's last.
+//  ---------------------------------------------------------------------------
+/*
+    By the time a batch is read the lines are back at rest, so sampling
+    any earlier edge would reject it.
+*/
+static void testBatch( void )
+{
+    struct encoderStruct *enc = encoderCreate( 0, 1, 0xFF, FULL );
+    uint64_t last = 0;
+    int total, presses;
+    bool passed;
+
+    enc->sample = sampleFake;
+    encoderDebounce( enc, 0, 0, 3 );
+    samples = ( typeof( samples )){ { 1, 1, 1, 1, 1, 1, 1, 1 }, 0 };
+
+    edge( enc, LINE_A, false, 1000, 3000 );
+    edge( enc, LINE_B, false, 2000, 4000 );
+    edge( enc, LINE_A, true,  3000, 5000 );
+    edge( enc, LINE_B, true,  4000, 6000 );
+    edge( enc, LINE_A, false, 5000, 7000 );
+    edge( enc, LINE_B, false, 6000, 8000 );
+    edge( enc, LINE_A, true,  7000, 0 );
+    edge( enc, LINE_B, true,  8000, 0 );
+
+    passed = ( drain( enc, &total, &presses, &last ) == 2 ) && total == 2 &&
+             encoderRejected( enc, LINE_A ) == 0 &&
+             encoderRejected( enc, LINE_B ) == 0 && samples.next == 6;
+    testResult( "Batched edges with sampling", passed );
+
+    encoderDestroy( enc );
+}
+
+//  ---------------------------------------------------------------------------
+//  wiringPi interrupts pass their edges through debounce to the decoder.
+//  ---------------------------------------------------------------------------
+static void testInterrupt( void )
+{
+    int total;
+    bool passed;
+
+    passed = ( pinSpin( SIMPLE_1, 8, 0, &total ) == 8 ) && total == 8;
+    passed = passed && ( pinSpin( FULL, 8, 0, &total ) == 8 ) && total == 8;
+    testResult( "wiringPi interrupts decode", passed );
+
+    // Edges of A are twice the gap apart, so outside the width.
+    encoderDebounce( &encoder, 500, 0, 1 );
+    passed = ( pinSpin( FULL, 4, 300, &total ) == 4 ) && total == 4 &&
+             encoderRejected( &encoder, LINE_A ) == 0 &&
+             encoderRejected( &encoder, LINE_B ) == 0;
+    encoderDebounce( &encoder, 0, 0, 1 );
+    testResult( "wiringPi interrupts with width", passed );
+}
+
+
+//  Main section. -------------------------------------------------------------
+
+int main( void )
+{
+    testClean();
+    testChatter();
+    testGlitch();
+    testFlush();
+    testTimeout();
+    testLockout();
+    testButton();
+    testMajority();
+    testBatch();
+    testInterrupt();
+
+    return failures ? 1 : 0;
+}
@@ -27,6 +27,11 @@
         gcc testrotencPi.c rotencPi.c -Wall -o testrotencPi
                                       -lwiringPi -lpthread
 
+    Prints each detent as its time (S) and direction, which can be saved
+    and replayed through an acceleration curve with replayrotencPi:
+
+        testrotencPi > spin.txt
+
     Also use the following flags for Raspberry Pi optimisation:
 
         -march=armv6 -mtune=arm1176jzf-s -mfloat-abi=hard -mfpu=vfp
@@ -52,33 +57,27 @@
 
 int main( void )
 {
+    struct encoderEventStruct event;
+
     // Initialise encoder and function button.
     encoder.mode = SIMPLE_1;
     encoderInit( 23, 24, 0xFF );
-    encoder.delay = 100;
 
-    // Check for attributes changed by interrupts.
-    while ( 1 )
+    // Wait for events from interrupts.
+    while ( encoderWait( &encoder, -1 ) >= 0 )
     {
-        // Volume.
-        if ( encoderDirection != 0 )
+        while ( encoderRead( &encoder, &event ))
         {
-            // Volume +
-            if ( encoderDirection > 0 ) printf( "++++.\n" );
-            // Volume -
-            else printf( "----\n" );
-            encoderDirection = 0;
+            // Volume.
+            if ( event.type == EVENT_DETENT )
+                printf( "%llu.%09llu %+d\n",
+                        (unsigned long long) event.time / 1000000000,
+                        (unsigned long long) event.time % 1000000000,
+                        event.value );
+            // Button.
+            else printf( "# Button %s.\n", event.value ? "on" : "off" );
+            fflush( stdout );
         }
-        // Button.
-//        if ( button.state )
-//        {
-//            volume.mute = true;
-//            button.state = false;
-//            setVolumeMixer( volume );  // May be better to use playback switch.
-//        }
-
-        // Sensitivity delay.
-        delay( encoder.delay );
     }
 
     return 0;